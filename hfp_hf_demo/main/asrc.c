@@ -0,0 +1,82 @@
+/*
+ * asrc.c - asynchronous sample rate converter for small clock offsets between producer and consumer
+ */
+
+#include <string.h>
+
+#include "asrc.h"
+
+#define ASRC_ONE                    (1ULL << 32)
+
+// controller: error is smoothed over ~64 updates, proportional gain in ppm per sample,
+// integral gain in ppm per sample and update (Q16)
+#define ASRC_ERROR_FILTER_SHIFT     6
+#define ASRC_KP_PPM                 2
+#define ASRC_KI_Q16                 (1 << 9)
+
+static int32_t asrc_clamp_ppm(int32_t ppm){
+    if (ppm >  ASRC_MAX_PPM) return  ASRC_MAX_PPM;
+    if (ppm < -ASRC_MAX_PPM) return -ASRC_MAX_PPM;
+    return ppm;
+}
+
+void asrc_init(asrc_t * asrc){
+    memset(asrc, 0, sizeof(asrc_t));
+    asrc->step  = ASRC_ONE;
+    // fill complete history before first output
+    asrc->phase = 3 * ASRC_ONE;
+}
+
+void asrc_set_ppm(asrc_t * asrc, int32_t ppm){
+    asrc->ppm  = asrc_clamp_ppm(ppm);
+    asrc->step = (uint64_t) ((int64_t) ASRC_ONE + (((int64_t) ASRC_ONE * asrc->ppm) / 1000000));
+}
+
+void asrc_update(asrc_t * asrc, int32_t error_samples){
+    asrc->filtered_error_q8 += ((error_samples << 8) - asrc->filtered_error_q8) >> ASRC_ERROR_FILTER_SHIFT;
+
+    // integrate with anti-windup
+    int32_t integral_q16 = asrc->integral_q16 + ((asrc->filtered_error_q8 * ASRC_KI_Q16) >> 8);
+    if (integral_q16 >  (ASRC_MAX_PPM << 16)) integral_q16 =  (ASRC_MAX_PPM << 16);
+    if (integral_q16 < -(ASRC_MAX_PPM << 16)) integral_q16 = -(ASRC_MAX_PPM << 16);
+    asrc->integral_q16 = integral_q16;
+
+    int32_t ppm = ((asrc->filtered_error_q8 * ASRC_KP_PPM) >> 8) + (integral_q16 >> 16);
+    asrc_set_ppm(asrc, ppm);
+}
+
+// cubic Hermite between y1 and y2, t in Q16
+static int16_t asrc_interpolate(const int16_t * y, int32_t t){
+    int32_t c0 = y[1];
+    int32_t c1 = (y[2] - y[0]) >> 1;
+    int32_t c2 = y[0] - ((5 * y[1]) >> 1) + 2 * y[2] - (y[3] >> 1);
+    int32_t c3 = ((y[3] - y[0]) >> 1) + ((3 * (y[1] - y[2])) >> 1);
+    int64_t value = ((((((int64_t) c3 * t) >> 16) + c2) * t >> 16) + c1) * t;
+    int32_t sample = c0 + (int32_t) (value >> 16);
+    if (sample >  32767) return  32767;
+    if (sample < -32768) return -32768;
+    return (int16_t) sample;
+}
+
+uint16_t asrc_process(asrc_t * asrc, const int16_t * input, uint16_t num_input, uint16_t * num_input_used,
+                      int16_t * output, uint16_t num_output){
+    uint16_t input_pos  = 0;
+    uint16_t output_pos = 0;
+    while (output_pos < num_output){
+        while (asrc->phase >= ASRC_ONE){
+            if (input_pos == num_input){
+                *num_input_used = input_pos;
+                return output_pos;
+            }
+            asrc->history[0] = asrc->history[1];
+            asrc->history[1] = asrc->history[2];
+            asrc->history[2] = asrc->history[3];
+            asrc->history[3] = input[input_pos++];
+            asrc->phase -= ASRC_ONE;
+        }
+        output[output_pos++] = asrc_interpolate(asrc->history, (int32_t) (asrc->phase >> 16));
+        asrc->phase += asrc->step;
+    }
+    *num_input_used = input_pos;
+    return output_pos;
+}
@@ -0,0 +1,72 @@
+/*
+ * asrc.h - asynchronous sample rate converter for small clock offsets between producer and consumer
+ *
+ * Samples are interpolated with a 4-point cubic Hermite at a fractional step close to 1.0. The step is
+ * steered by a PI controller from the fill level error of the buffer between the two clock domains:
+ * a buffer filling up makes the converter consume more input samples per output sample and vice versa.
+ */
+
+#ifndef ASRC_H
+#define ASRC_H
+
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// largest correction, well above the +/- 200 ppm of typical crystals
+#define ASRC_MAX_PPM    1000
+
+typedef struct {
+    // input samples per output sample, Q32
+    uint64_t step;
+    // position of next output after history[1], Q32, >= 1.0 if more input is needed
+    uint64_t phase;
+    int16_t  history[4];
+
+    // fill level controller
+    int32_t  ppm;
+    int32_t  filtered_error_q8;
+    int32_t  integral_q16;
+} asrc_t;
+
+/**
+ * @brief Init converter with ratio 1.0 and empty history
+ * @param asrc
+ */
+void asrc_init(asrc_t * asrc);
+
+/**
+ * @brief Set ratio directly
+ * @param asrc
+ * @param ppm > 0 consumes more input samples than output samples are produced
+ */
+void asrc_set_ppm(asrc_t * asrc, int32_t ppm);
+
+/**
+ * @brief Update ratio from fill level error of buffer between clock domains, call once per processed block
+ * @param asrc
+ * @param error_samples buffer fill level minus target, > 0 if converter should consume faster (pull)
+ *        or produce slower (push)
+ */
+void asrc_update(asrc_t * asrc, int32_t error_samples);
+
+/**
+ * @brief Convert until output is full or input is used up
+ * @param asrc
+ * @param input
+ * @param num_input
+ * @param num_input_used set to number of consumed input samples
+ * @param output
+ * @param num_output max output samples
+ * @return number of output samples produced
+ */
+uint16_t asrc_process(asrc_t * asrc, const int16_t * input, uint16_t num_input, uint16_t * num_input_used,
+                      int16_t * output, uint16_t num_output);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * cycle_stats.c - CPU cycle counter and cost statistics for audio / HID hot paths
+ */
+
+#include <string.h>
+
+#include "cycle_stats.h"
+
+#define SUB_BUCKETS (1 << CYCLE_STATS_SUB_BUCKET_BITS)
+
+static int cycle_stats_msb(uint32_t value){
+    int msb = 0;
+    while (value >>= 1){
+        msb++;
+    }
+    return msb;
+}
+
+static uint16_t cycle_stats_bucket_for_value(uint32_t value){
+    if (value < SUB_BUCKETS) return (uint16_t) value;
+    int msb = cycle_stats_msb(value);
+    int shift = msb - CYCLE_STATS_SUB_BUCKET_BITS;
+    uint32_t sub = (value >> shift) & (SUB_BUCKETS - 1);
+    return (uint16_t) (((shift + 1) << CYCLE_STATS_SUB_BUCKET_BITS) + sub);
+}
+
+static uint32_t cycle_stats_bucket_upper_bound(uint16_t bucket){
+    if (bucket < SUB_BUCKETS) return bucket;
+    int shift = (bucket >> CYCLE_STATS_SUB_BUCKET_BITS) - 1;
+    uint64_t lower = ((uint64_t) (SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1)))) << shift;
+    uint64_t upper = lower + (1ULL << shift) - 1;
+    return upper > UINT32_MAX ? UINT32_MAX : (uint32_t) upper;
+}
+
+void cycle_stats_reset(cycle_stats_t * stats){
+    memset(stats, 0, sizeof(cycle_stats_t));
+    stats->min = UINT32_MAX;
+}
+
+void cycle_stats_add(cycle_stats_t * stats, uint32_t cycles){
+    stats->count++;
+    stats->total += cycles;
+    if (cycles < stats->min){
+        stats->min = cycles;
+    }
+    if (cycles > stats->max){
+        stats->max = cycles;
+    }
+    stats->histogram[cycle_stats_bucket_for_value(cycles)]++;
+}
+
+uint32_t cycle_stats_get_average(const cycle_stats_t * stats){
+    if (stats->count == 0) return 0;
+    return (uint32_t) (stats->total / stats->count);
+}
+
+uint32_t cycle_stats_get_percentile(const cycle_stats_t * stats, uint8_t percent){
+    if (stats->count == 0) return 0;
+    if (percent > 100){
+        percent = 100;
+    }
+    // rank of requested sample, rounded up
+    uint32_t rank = (uint32_t) (((uint64_t) stats->count * percent + 99) / 100);
+    if (rank == 0){
+        rank = 1;
+    }
+    uint32_t seen = 0;
+    uint16_t bucket;
+    for (bucket = 0; bucket < CYCLE_STATS_NUM_BUCKETS; bucket++){
+        seen += stats->histogram[bucket];
+        if (seen >= rank) break;
+    }
+    uint32_t upper = cycle_stats_bucket_upper_bound(bucket);
+    return upper < stats->max ? upper : stats->max;
+}
@@ -0,0 +1,78 @@
+/*
+ * cycle_stats.h - CPU cycle counter and cost statistics for audio / HID hot paths
+ */
+
+#ifndef CYCLE_STATS_H
+#define CYCLE_STATS_H
+
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#if defined(ESP_PLATFORM)
+#include "esp_cpu.h"
+static inline uint32_t cycle_stats_get_cycles(void){
+    return (uint32_t) esp_cpu_get_cycle_count();
+}
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint32_t cycle_stats_get_cycles(void){
+    return (uint32_t) __rdtsc();
+}
+#else
+#include <time.h>
+// fallback for hosts without a cycle counter: nanoseconds
+static inline uint32_t cycle_stats_get_cycles(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+#endif
+
+// log-linear histogram: 4 sub-buckets per power of two, covers full uint32_t range
+#define CYCLE_STATS_SUB_BUCKET_BITS 2
+#define CYCLE_STATS_NUM_BUCKETS     (32 << CYCLE_STATS_SUB_BUCKET_BITS)
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t histogram[CYCLE_STATS_NUM_BUCKETS];
+} cycle_stats_t;
+
+/**
+ * @brief Reset all samples
+ * @param stats
+ */
+void cycle_stats_reset(cycle_stats_t * stats);
+
+/**
+ * @brief Add single measurement
+ * @param stats
+ * @param cycles
+ */
+void cycle_stats_add(cycle_stats_t * stats, uint32_t cycles);
+
+/**
+ * @brief Get average of all measurements
+ * @param stats
+ * @return average or 0 if empty
+ */
+uint32_t cycle_stats_get_average(const cycle_stats_t * stats);
+
+/**
+ * @brief Get percentile from histogram, result is upper bound of the matching bucket (max. 25% error)
+ * @param stats
+ * @param percent 1..100
+ * @return cycles or 0 if empty
+ */
+uint32_t cycle_stats_get_percentile(const cycle_stats_t * stats, uint8_t percent);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,223 @@
+/*
+ * deferred_log.c - binary log for hot paths, formatted later by a background task
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "deferred_log.h"
+#include "cycle_stats.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+#define DEFERRED_LOG_MASK (DEFERRED_LOG_NUM_ENTRIES - 1)
+
+_Static_assert((DEFERRED_LOG_NUM_ENTRIES & DEFERRED_LOG_MASK) == 0, "DEFERRED_LOG_NUM_ENTRIES must be power of two");
+
+typedef struct {
+    // write index + 1 once entry is complete
+    atomic_uint  sequence;
+    const char * format;
+    uint32_t     timestamp_us;
+    uint8_t      level;
+    uint8_t      num_args;
+    // cost of deferred_log_write up to publishing the entry
+    uint32_t     write_cycles;
+    uintptr_t    args[DEFERRED_LOG_MAX_ARGS];
+} deferred_log_entry_t;
+
+// multi producer / single consumer, free running indices
+static deferred_log_entry_t deferred_log_entries[DEFERRED_LOG_NUM_ENTRIES];
+static atomic_uint          deferred_log_write_index;
+static atomic_uint          deferred_log_read_index;
+static atomic_uint          deferred_log_logged;
+static atomic_uint          deferred_log_dropped;
+static atomic_uint          deferred_log_printed;
+static uint32_t             deferred_log_dropped_reported;
+// owned by the thread that drains, i.e. writer task or deferred_log_flush
+static atomic_flag          deferred_log_draining = ATOMIC_FLAG_INIT;
+static cycle_stats_t        deferred_log_write_cycles;
+static atomic_uint          deferred_log_write_cycles_avg;
+static atomic_uint          deferred_log_write_cycles_p99;
+static atomic_uint          deferred_log_write_cycles_max;
+static bool                 deferred_log_created;
+
+static const char deferred_log_level_tags[] = { 'D', 'I', 'E' };
+
+static uint32_t deferred_log_get_time_us(void){
+#ifdef ESP_PLATFORM
+    return (uint32_t) esp_timer_get_time();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+#endif
+}
+
+// writer
+
+static void deferred_log_print(const deferred_log_entry_t * entry){
+    const uintptr_t * a = entry->args;
+    printf("[%u.%06u] %c: ", (unsigned int) (entry->timestamp_us / 1000000), (unsigned int) (entry->timestamp_us % 1000000),
+           deferred_log_level_tags[entry->level]);
+    // all arguments are passed, printf ignores the ones not used by the format
+    printf(entry->format, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+}
+
+static bool deferred_log_drain_one(void){
+    unsigned int read_index = atomic_load_explicit(&deferred_log_read_index, memory_order_relaxed);
+    deferred_log_entry_t * slot = &deferred_log_entries[read_index & DEFERRED_LOG_MASK];
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != (read_index + 1)) return false;
+    deferred_log_entry_t entry;
+    entry.format       = slot->format;
+    entry.timestamp_us = slot->timestamp_us;
+    entry.level        = slot->level;
+    entry.num_args     = slot->num_args;
+    entry.write_cycles = slot->write_cycles;
+    memcpy(entry.args, slot->args, sizeof(entry.args));
+    // release slot before slow formatting
+    atomic_store_explicit(&deferred_log_read_index, read_index + 1, memory_order_release);
+    deferred_log_print(&entry);
+    atomic_fetch_add_explicit(&deferred_log_printed, 1, memory_order_relaxed);
+    cycle_stats_add(&deferred_log_write_cycles, entry.write_cycles);
+    return true;
+}
+
+// caller owns deferred_log_draining
+static void deferred_log_drain(void){
+    bool drained = false;
+    while (deferred_log_drain_one()){
+        drained = true;
+    }
+    if (drained){
+        // publish write cost for deferred_log_get_statistics
+        atomic_store_explicit(&deferred_log_write_cycles_avg, cycle_stats_get_average(&deferred_log_write_cycles), memory_order_relaxed);
+        atomic_store_explicit(&deferred_log_write_cycles_p99, cycle_stats_get_percentile(&deferred_log_write_cycles, 99), memory_order_relaxed);
+        atomic_store_explicit(&deferred_log_write_cycles_max, deferred_log_write_cycles.max, memory_order_relaxed);
+    }
+    uint32_t dropped = atomic_load_explicit(&deferred_log_dropped, memory_order_relaxed);
+    if (dropped != deferred_log_dropped_reported){
+        printf("Deferred log: %u entries dropped\n", (unsigned int) (dropped - deferred_log_dropped_reported));
+        deferred_log_dropped_reported = dropped;
+    }
+}
+
+// platform
+
+#ifdef ESP_PLATFORM
+
+#define DEFERRED_LOG_TASK_STACK_SIZE 4096
+#define DEFERRED_LOG_TASK_PRIORITY   (tskIDLE_PRIORITY + 1)
+
+static void deferred_log_thread(void * arg){
+    UNUSED(arg);
+    while (true){
+        vTaskDelay(pdMS_TO_TICKS(DEFERRED_LOG_DRAIN_PERIOD_MS));
+        // skip period while deferred_log_flush drains
+        if (atomic_flag_test_and_set_explicit(&deferred_log_draining, memory_order_acquire)) continue;
+        deferred_log_drain();
+        atomic_flag_clear_explicit(&deferred_log_draining, memory_order_release);
+    }
+}
+
+static void deferred_log_yield(void){
+    vTaskDelay(1);
+}
+
+static void deferred_log_create(void){
+    xTaskCreate(&deferred_log_thread, "deferred_log", DEFERRED_LOG_TASK_STACK_SIZE, NULL,
+                DEFERRED_LOG_TASK_PRIORITY, NULL);
+}
+
+#else
+
+static pthread_t deferred_log_pthread;
+
+static void * deferred_log_thread(void * arg){
+    UNUSED(arg);
+    const struct timespec period = { 0, DEFERRED_LOG_DRAIN_PERIOD_MS * 1000000L };
+    while (true){
+        nanosleep(&period, NULL);
+        // skip period while deferred_log_flush drains
+        if (atomic_flag_test_and_set_explicit(&deferred_log_draining, memory_order_acquire)) continue;
+        deferred_log_drain();
+        atomic_flag_clear_explicit(&deferred_log_draining, memory_order_release);
+    }
+    return NULL;
+}
+
+static void deferred_log_yield(void){
+    sched_yield();
+}
+
+static void deferred_log_create(void){
+    pthread_create(&deferred_log_pthread, NULL, &deferred_log_thread, NULL);
+}
+
+#endif
+
+// API
+
+void deferred_log_init(void){
+    if (deferred_log_created) return;
+    deferred_log_created = true;
+    deferred_log_create();
+}
+
+void deferred_log_write(uint8_t level, const char * format, const uintptr_t * args, uint8_t num_args){
+    btstack_assert(level < DEFERRED_LOG_LEVEL_NONE);
+    btstack_assert(num_args <= DEFERRED_LOG_MAX_ARGS);
+    uint32_t cycles_start = cycle_stats_get_cycles();
+
+    // reserve slot or drop if full
+    unsigned int write_index = atomic_load_explicit(&deferred_log_write_index, memory_order_relaxed);
+    do {
+        unsigned int read_index = atomic_load_explicit(&deferred_log_read_index, memory_order_acquire);
+        if ((write_index - read_index) >= DEFERRED_LOG_NUM_ENTRIES){
+            atomic_fetch_add_explicit(&deferred_log_dropped, 1, memory_order_relaxed);
+            return;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&deferred_log_write_index, &write_index, write_index + 1,
+                                                    memory_order_relaxed, memory_order_relaxed));
+
+    deferred_log_entry_t * slot = &deferred_log_entries[write_index & DEFERRED_LOG_MASK];
+    slot->format       = format;
+    slot->timestamp_us = deferred_log_get_time_us();
+    slot->level        = level;
+    slot->num_args     = num_args;
+    memcpy(slot->args, args, sizeof(slot->args));
+    slot->write_cycles = cycle_stats_get_cycles() - cycles_start;
+    // publish entry after it has been stored
+    atomic_store_explicit(&slot->sequence, write_index + 1, memory_order_release);
+    atomic_fetch_add_explicit(&deferred_log_logged, 1, memory_order_relaxed);
+}
+
+void deferred_log_flush(void){
+    // wait until writer task has printed the entries it took, keeps output in order
+    while (atomic_flag_test_and_set_explicit(&deferred_log_draining, memory_order_acquire)){
+        deferred_log_yield();
+    }
+    deferred_log_drain();
+    atomic_flag_clear_explicit(&deferred_log_draining, memory_order_release);
+}
+
+void deferred_log_get_statistics(deferred_log_statistics_t * statistics){
+    statistics->entries_logged  = atomic_load_explicit(&deferred_log_logged,  memory_order_relaxed);
+    statistics->entries_dropped = atomic_load_explicit(&deferred_log_dropped, memory_order_relaxed);
+    statistics->entries_printed = atomic_load_explicit(&deferred_log_printed, memory_order_relaxed);
+    statistics->write_cycles_avg = atomic_load_explicit(&deferred_log_write_cycles_avg, memory_order_relaxed);
+    statistics->write_cycles_p99 = atomic_load_explicit(&deferred_log_write_cycles_p99, memory_order_relaxed);
+    statistics->write_cycles_max = atomic_load_explicit(&deferred_log_write_cycles_max, memory_order_relaxed);
+}
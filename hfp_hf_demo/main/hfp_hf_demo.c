@@ -30,6 +30,7 @@ static void show_usage(void);
 #endif
 static hci_con_handle_t acl_handle = HCI_CON_HANDLE_INVALID;
 static hci_con_handle_t sco_handle = HCI_CON_HANDLE_INVALID;
+static sco_audio_ctx_t * sco_audio_ctx;
 
 static uint8_t codecs[] = {
         HFP_CODEC_CVSD,
@@ -412,7 +413,7 @@ static void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *
         case HCI_SCO_DATA_PACKET:
             // 處理接收到的 SCO 音頻資料包，並轉發給 SCO 組件
             if (READ_SCO_CONNECTION_HANDLE(event) != sco_handle) break;
-            sco_demo_receive(event, event_size);
+            sco_demo_receive(sco_audio_ctx, event, event_size);
             break;
 
         case HCI_EVENT_PACKET:
@@ -432,7 +433,7 @@ static void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *
 
                 case HCI_EVENT_SCO_CAN_SEND_NOW:
                     // 當可以發送 SCO 音頻時，發送數據
-                    sco_demo_send(sco_handle);
+                    sco_demo_send(sco_audio_ctx, sco_handle);
                     break;
 
                 default:
@@ -455,7 +456,7 @@ static void hfp_hf_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t
         case HCI_SCO_DATA_PACKET:
             // 處理接收到的 SCO 音頻資料包
             if (READ_SCO_CONNECTION_HANDLE(event) != sco_handle) break;
-            sco_demo_receive(event, event_size);
+            sco_demo_receive(sco_audio_ctx, event, event_size);
             break;
 
         case HCI_EVENT_PACKET:
@@ -475,7 +476,7 @@ static void hfp_hf_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t
 
                 case HCI_EVENT_SCO_CAN_SEND_NOW:
                     // 當可以發送 SCO 音頻時，發送數據
-                    sco_demo_send(sco_handle);
+                    sco_demo_send(sco_audio_ctx, sco_handle);
                     break;
                     
                 case HCI_EVENT_HFP_META:
@@ -520,7 +521,7 @@ static void hfp_hf_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t
                                     printf("Using unknown codec 0x%02x.\n", negotiated_codec);
                                     break;
                             }
-                            sco_demo_set_codec(negotiated_codec);
+                            sco_demo_set_codec(sco_audio_ctx, negotiated_codec);
                             hci_request_sco_can_send_now_event();
                             break;
 
@@ -538,7 +539,7 @@ static void hfp_hf_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t
                             // 音頻連接已釋放
                             sco_handle = HCI_CON_HANDLE_INVALID;
                             printf("Audio connection released\n");
-                            sco_demo_close();
+                            sco_demo_close(sco_audio_ctx);
                             break;
 
                         case HFP_SUBEVENT_COMPLETE:
@@ -613,6 +614,8 @@ static void hfp_hf_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t
                             // 麥克風音量
                             printf("Microphone volume: gain %u\n",
                             hfp_subevent_microphone_volume_get_gain(event));
+                            // 增益 0 視為靜音
+                            sco_demo_set_microphone_mute(sco_audio_ctx, hfp_subevent_microphone_volume_get_gain(event) == 0);
                             break;
 
                         case HFP_SUBEVENT_CALLING_LINE_IDENTIFICATION_NOTIFICATION:
@@ -746,8 +749,11 @@ int btstack_main(int argc, const char * argv[]){
         (1<<HFP_HFSF_VOICE_RECOGNITION_FUNCTION)  |  // 語音識別功能支持
         (1<<HFP_HFSF_ENHANCED_VOICE_RECOGNITION_STATUS) |  // 增強的語音識別狀態支持
         (1<<HFP_HFSF_VOICE_RECOGNITION_TEXT) |  // 語音識別文本支持
-        (1<<HFP_HFSF_EC_NR_FUNCTION) |  // 回聲消除和噪音抑制功能
         (1<<HFP_HFSF_REMOTE_VOLUME_CONTROL);  // 遠程音量控制支持
+    // 回聲消除功能由 sco_demo_util 提供
+    if (sco_demo_echo_cancel_supported()){
+        hf_supported_features |= (1<<HFP_HFSF_EC_NR_FUNCTION);
+    }
 
     // 初始化 HFP HF 服務
     hfp_hf_init(rfcomm_channel_nr);
@@ -789,6 +795,7 @@ int btstack_main(int argc, const char * argv[]){
 
     // 初始化 SCO / HFP 音頻處理
     sco_demo_init();
+    sco_audio_ctx = sco_demo_create_context();
 
 #ifdef HAVE_BTSTACK_STDIN
     // 解析人類可讀的藍牙地址
@@ -0,0 +1,128 @@
+/*
+ * jitter_buffer.h - adaptive playout buffer for received audio on top of a sample ring buffer
+ *
+ * The receiver writes decoded samples into the ring buffer and reports each packet arrival. The spread of
+ * arrival times over the last two measurement windows, plus one packet and one playback block, sets the
+ * target depth within [min_ms, max_ms]. Playback starts once the target depth is reached. If the buffer
+ * runs empty, the missing samples are concealed by repeating the last played period with decreasing gain.
+ *
+ * Playback runs on the audio clock, samples arrive on the Bluetooth clock. An ASRC stage between ring
+ * buffer and playback keeps the depth at target, compensating the drift between the two clocks. If the
+ * depth is far above target, e.g. after the target was lowered, single samples are dropped instead.
+ *
+ * Receiver and playback can run on different threads. Values shared between them are relaxed atomics written
+ * by one side only, the samples themselves are published by the ring buffer.
+ */
+
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sample_ring_buffer.h"
+#include "asrc.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// concealment repeats the last 5 ms (max 32 kHz), fading out over 20 ms
+#define JITTER_BUFFER_CONCEAL_PERIOD_MS     5
+#define JITTER_BUFFER_CONCEAL_FADE_MS       20
+#define JITTER_BUFFER_CONCEAL_HISTORY_MAX   (JITTER_BUFFER_CONCEAL_PERIOD_MS * 32)
+
+typedef struct {
+    uint16_t depth_ms;
+    uint16_t target_ms;
+    uint16_t jitter_ms;
+    // average depth during playback = latency added by buffering
+    uint16_t added_latency_ms;
+    uint32_t underruns;
+    uint32_t concealed_samples;
+    uint32_t dropped_samples;
+    // current clock drift correction
+    int32_t  drift_ppm;
+} jitter_buffer_metrics_t;
+
+typedef struct {
+    sample_ring_buffer_t * ring;
+    uint32_t sample_rate;
+    uint32_t min_samples;
+    uint32_t max_samples;
+    uint32_t window_us;
+
+    // arrival tracking, offsets are arrival time minus nominal time of received samples
+    bool     arrival_started;
+    uint32_t last_write_pos;
+    uint32_t window_start_us;
+    int32_t  nominal_us;
+    int32_t  window_min_us;
+    int32_t  window_max_us;
+    int32_t  previous_min_us;
+    int32_t  previous_max_us;
+    // written by receiver
+    atomic_uint packet_samples;
+    atomic_uint jitter_us;
+    atomic_uint target_samples;
+
+    // playback
+    asrc_t   asrc;
+    bool     playing;
+    // written by playback
+    atomic_uint read_samples;
+    uint32_t drop_countdown;
+    uint16_t conceal_period;
+    uint16_t conceal_pos;
+    uint32_t conceal_gain;
+    uint32_t conceal_gain_step;
+    int16_t  history[JITTER_BUFFER_CONCEAL_HISTORY_MAX];
+
+    // metrics
+    uint32_t underruns;
+    uint32_t concealed_samples;
+    uint32_t dropped_samples;
+    uint64_t depth_sum;
+    uint32_t depth_count;
+} jitter_buffer_t;
+
+/**
+ * @brief Init jitter buffer for ring buffer. Ring buffer must be able to hold max_ms plus one packet
+ * @param jitter_buffer
+ * @param ring with received samples
+ * @param sample_rate up to 32000
+ * @param min_ms target depth lower limit
+ * @param max_ms target depth upper limit
+ */
+void jitter_buffer_init(jitter_buffer_t * jitter_buffer, sample_ring_buffer_t * ring, uint32_t sample_rate, uint16_t min_ms, uint16_t max_ms);
+
+/**
+ * @brief Report packet arrival after received samples have been written into the ring buffer
+ * @note called by the receiving thread
+ * @param jitter_buffer
+ * @param now_us arrival time
+ */
+void jitter_buffer_packet_received(jitter_buffer_t * jitter_buffer, uint32_t now_us);
+
+/**
+ * @brief Get samples for playback, missing samples are concealed
+ * @note called by the playback thread
+ * @param jitter_buffer
+ * @param samples
+ * @param num_samples
+ */
+void jitter_buffer_read(jitter_buffer_t * jitter_buffer, int16_t * samples, uint16_t num_samples);
+
+/**
+ * @brief Get current state and statistics since init
+ * @param jitter_buffer
+ * @param metrics
+ */
+void jitter_buffer_get_metrics(const jitter_buffer_t * jitter_buffer, jitter_buffer_metrics_t * metrics);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * polyphase_resampler.c - fixed-point polyphase resampler between codec and audio device rate
+ */
+
+#include <string.h>
+
+#include "polyphase_resampler.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+#define POLYPHASE_RESAMPLER_DEVICE_RATE 48000
+
+// low-pass prototypes at upsampled rate: Kaiser windowed sinc (beta 6), cutoff at 0.9 of lower Nyquist frequency,
+// POLYPHASE_RESAMPLER_TAPS_PER_PHASE taps per phase, Q15 with DC gain of factor
+
+// factor 6: 8 kHz <-> 48 kHz
+static const int16_t polyphase_resampler_prototype_6[6 * POLYPHASE_RESAMPLER_TAPS_PER_PHASE] = {
+         8,      6,      1,     -6,    -15,    -22,    -25,    -22,    -12,      3,
+        21,     39,     51,     52,     40,     16,    -17,    -53,    -82,    -97,
+       -90,    -60,    -10,     51,    110,    151,    163,    137,     74,    -16,
+      -115,   -201,   -251,   -248,   -186,    -71,     76,    224,    338,    387,
+       351,    228,     36,   -187,   -393,   -530,   -560,   -462,   -246,     53,
+       373,    641,    789,    771,    570,    216,   -227,   -665,   -995,  -1130,
+     -1017,   -656,   -104,    532,   1113,   1499,   1580,   1302,    691,   -150,
+     -1052,  -1814,  -2244,  -2204,  -1643,   -627,    668,   1981,   3012,   3483,
+      3202,   2117,    344,  -1828,  -3977,  -5607,  -6235,  -5479,  -3140,    746,
+      5892,  11787,  17762,  23087,  27081,  29221,  29221,  27081,  23087,  17762,
+     11787,   5892,    746,  -3140,  -5479,  -6235,  -5607,  -3977,  -1828,    344,
+      2117,   3202,   3483,   3012,   1981,    668,   -627,  -1643,  -2204,  -2244,
+     -1814,  -1052,   -150,    691,   1302,   1580,   1499,   1113,    532,   -104,
+      -656,  -1017,  -1130,   -995,   -665,   -227,    216,    570,    771,    789,
+       641,    373,     53,   -246,   -462,   -560,   -530,   -393,   -187,     36,
+       228,    351,    387,    338,    224,     76,    -71,   -186,   -248,   -251,
+      -201,   -115,    -16,     74,    137,    163,    151,    110,     51,    -10,
+       -60,    -90,    -97,    -82,    -53,    -17,     16,     40,     52,     51,
+        39,     21,      3,    -12,    -22,    -25,    -22,    -15,     -6,      1,
+         6,      8,
+};
+
+// factor 3: 16 kHz <-> 48 kHz at 48 kHz, 32 kHz <-> 48 kHz at 96 kHz
+static const int16_t polyphase_resampler_prototype_3[3 * POLYPHASE_RESAMPLER_TAPS_PER_PHASE] = {
+         7,     -2,    -17,    -23,     -5,     29,     51,     28,    -34,    -89,
+       -76,     20,    131,    151,     31,   -159,   -253,   -132,    150,    368,
+       296,    -73,   -468,   -523,   -102,    514,    797,    407,   -451,  -1086,
+      -862,    211,   1334,   1482,    289,  -1460,  -2284,  -1182,   1339,   3329,
+      2755,   -715,  -4887,  -6046,  -1378,   8785,  20550,  28407,  28407,  20550,
+      8785,  -1378,  -6046,  -4887,   -715,   2755,   3329,   1339,  -1182,  -2284,
+     -1460,    289,   1482,   1334,    211,   -862,  -1086,   -451,    407,    797,
+       514,   -102,   -523,   -468,    -73,    296,    368,    150,   -132,   -253,
+      -159,     31,    151,    131,     20,    -76,    -89,    -34,     28,     51,
+        29,     -5,    -23,    -17,     -2,      7,
+};
+
+static uint32_t polyphase_resampler_gcd(uint32_t a, uint32_t b){
+    while (b != 0){
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+bool polyphase_resampler_init(polyphase_resampler_t * resampler, uint32_t input_rate, uint32_t output_rate){
+    memset(resampler, 0, sizeof(polyphase_resampler_t));
+    if ((input_rate == 0) || (output_rate == 0)) return false;
+
+    uint32_t gcd = polyphase_resampler_gcd(input_rate, output_rate);
+    resampler->interpolation = (uint8_t) (output_rate / gcd);
+    resampler->decimation    = (uint8_t) (input_rate / gcd);
+    resampler->phase         = resampler->interpolation;
+
+    // same rate: copy
+    if (input_rate == output_rate) return true;
+
+    uint32_t low_rate  = btstack_min(input_rate, output_rate);
+    uint32_t high_rate = btstack_max(input_rate, output_rate);
+    if (high_rate != POLYPHASE_RESAMPLER_DEVICE_RATE) return false;
+
+    const int16_t * prototype;
+    uint16_t factor;
+    switch (low_rate){
+        case 8000:
+            prototype = polyphase_resampler_prototype_6;
+            factor    = 6;
+            break;
+        case 16000:
+        case 32000:
+            prototype = polyphase_resampler_prototype_3;
+            factor    = 3;
+            break;
+        default:
+            return false;
+    }
+
+    // split into phases, scale to interpolation gain in Q14 and correct rounding error for exact DC gain per phase
+    uint16_t num_coefficients = factor * POLYPHASE_RESAMPLER_TAPS_PER_PHASE;
+    uint16_t interpolation    = resampler->interpolation;
+    resampler->num_taps = num_coefficients / interpolation;
+    btstack_assert(resampler->num_taps <= POLYPHASE_RESAMPLER_MAX_TAPS);
+    uint16_t phase;
+    for (phase = 0; phase < interpolation; phase++){
+        int16_t * coefficients = &resampler->coefficients[phase * resampler->num_taps];
+        int32_t sum = 0;
+        uint32_t sum_abs = 0;
+        uint16_t center = 0;
+        uint16_t tap;
+        for (tap = 0; tap < resampler->num_taps; tap++){
+            int32_t scaled = (int32_t) prototype[phase + tap * interpolation] * interpolation;
+            int32_t value  = (scaled >= 0) ? ((scaled + factor) / (2 * factor)) : -((factor - scaled) / (2 * factor));
+            coefficients[tap] = (int16_t) value;
+            sum += value;
+            if (value > coefficients[center]){
+                center = tap;
+            }
+        }
+        coefficients[center] += (int16_t) ((1 << 14) - sum);
+        for (tap = 0; tap < resampler->num_taps; tap++){
+            sum_abs += (uint32_t) ((coefficients[tap] < 0) ? -coefficients[tap] : coefficients[tap]);
+        }
+        // accumulator can't overflow for full scale input
+        btstack_assert(sum_abs < (1u << 16));
+        UNUSED(sum_abs);
+    }
+    return true;
+}
+
+uint16_t polyphase_resampler_get_input_needed(const polyphase_resampler_t * resampler, uint16_t num_output){
+    if (num_output == 0) return 0;
+    return (uint16_t) ((resampler->phase + (uint32_t) (num_output - 1) * resampler->decimation) / resampler->interpolation);
+}
+
+static inline int16_t polyphase_resampler_filter(const int16_t * coefficients, const int16_t * history, uint16_t num_taps){
+    int32_t sum = 1 << 13;
+    uint16_t i;
+    for (i = 0; i < num_taps; i++){
+        sum += (int32_t) coefficients[i] * history[i];
+    }
+    sum >>= 14;
+    if (sum >  32767) return  32767;
+    if (sum < -32768) return -32768;
+    return (int16_t) sum;
+}
+
+uint16_t polyphase_resampler_process(polyphase_resampler_t * resampler, const int16_t * input, uint16_t num_input,
+                                     uint16_t * num_input_used, int16_t * output, uint16_t num_output){
+    if (resampler->num_taps == 0){
+        uint16_t num_samples = btstack_min(num_input, num_output);
+        memcpy(output, input, num_samples * sizeof(int16_t));
+        *num_input_used = num_samples;
+        return num_samples;
+    }
+
+    uint16_t num_taps      = resampler->num_taps;
+    uint16_t interpolation = resampler->interpolation;
+    uint16_t input_pos  = 0;
+    uint16_t output_pos = 0;
+    while (output_pos < num_output){
+        while (resampler->phase >= interpolation){
+            if (input_pos == num_input){
+                *num_input_used = input_pos;
+                return output_pos;
+            }
+            // newest sample first, stored twice so the window is always contiguous
+            resampler->history_pos = (resampler->history_pos == 0) ? (num_taps - 1) : (resampler->history_pos - 1);
+            resampler->history[resampler->history_pos]            = input[input_pos];
+            resampler->history[resampler->history_pos + num_taps] = input[input_pos];
+            input_pos++;
+            resampler->phase -= interpolation;
+        }
+        output[output_pos++] = polyphase_resampler_filter(&resampler->coefficients[resampler->phase * num_taps],
+                                                          &resampler->history[resampler->history_pos], num_taps);
+        resampler->phase += resampler->decimation;
+    }
+    *num_input_used = input_pos;
+    return output_pos;
+}
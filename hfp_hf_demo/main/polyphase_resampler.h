@@ -0,0 +1,73 @@
+/*
+ * polyphase_resampler.h - fixed-point polyphase resampler between codec and audio device rate
+ *
+ * Converts between 8, 16 or 32 kHz and 48 kHz by the rational factor L/M: each output sample is the dot
+ * product of one phase of a low-pass prototype with the newest input samples, so no zeros are inserted and
+ * no discarded samples are computed. Coefficients are Q14 and split into contiguous phases at init, the delay
+ * line is stored twice to keep the filter window contiguous. Equal rates are passed through.
+ */
+
+#ifndef POLYPHASE_RESAMPLER_H
+#define POLYPHASE_RESAMPLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// filter length per output sample when interpolating, decimation uses up to 6 times as many
+#define POLYPHASE_RESAMPLER_TAPS_PER_PHASE  32
+#define POLYPHASE_RESAMPLER_MAX_TAPS        (6 * POLYPHASE_RESAMPLER_TAPS_PER_PHASE)
+
+typedef struct {
+    // output_rate / input_rate = interpolation / decimation
+    uint8_t  interpolation;
+    uint8_t  decimation;
+    // taps per phase, 0 for pass-through
+    uint16_t num_taps;
+    // position of next output in interpolated grid after newest input, >= interpolation if more input is needed
+    uint16_t phase;
+    uint16_t history_pos;
+    // [phase][tap], Q14
+    int16_t  coefficients[POLYPHASE_RESAMPLER_MAX_TAPS];
+    // newest sample first
+    int16_t  history[2 * POLYPHASE_RESAMPLER_MAX_TAPS];
+} polyphase_resampler_t;
+
+/**
+ * @brief Init resampler with empty history
+ * @param resampler
+ * @param input_rate 8000, 16000, 32000 or 48000
+ * @param output_rate 8000, 16000, 32000 or 48000, one of the rates needs to be 48000 unless both are equal
+ * @return false if rates are not supported
+ */
+bool polyphase_resampler_init(polyphase_resampler_t * resampler, uint32_t input_rate, uint32_t output_rate);
+
+/**
+ * @brief Get number of input samples needed to produce the given number of output samples
+ * @param resampler
+ * @param num_output
+ * @return num_input
+ */
+uint16_t polyphase_resampler_get_input_needed(const polyphase_resampler_t * resampler, uint16_t num_output);
+
+/**
+ * @brief Resample until output is full or input is used up
+ * @param resampler
+ * @param input
+ * @param num_input
+ * @param num_input_used set to number of consumed input samples
+ * @param output
+ * @param num_output max output samples
+ * @return number of output samples produced
+ */
+uint16_t polyphase_resampler_process(polyphase_resampler_t * resampler, const int16_t * input, uint16_t num_input,
+                                     uint16_t * num_input_used, int16_t * output, uint16_t num_output);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * sample_ring_buffer.h - ring buffer for 16-bit audio samples with direct access to contiguous regions
+ *
+ * Producers can render into the buffer via get_write_region/commit_write, consumers can process
+ * samples in place via get_read_region/commit_read, avoiding intermediate copies.
+ *
+ * One producer and one consumer may run in different threads or cores without further locking:
+ * positions are atomic and each one is only written by its owner. Storage becomes visible to the
+ * other side with the commit. Init and reset must not run concurrently with any other call.
+ */
+
+#ifndef SAMPLE_RING_BUFFER_H
+#define SAMPLE_RING_BUFFER_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// keep read and write position in separate cache lines to avoid false sharing between producer and consumer
+#ifndef SAMPLE_RING_BUFFER_CACHE_LINE_SIZE
+#ifdef ESP_PLATFORM
+#define SAMPLE_RING_BUFFER_CACHE_LINE_SIZE 32
+#else
+#define SAMPLE_RING_BUFFER_CACHE_LINE_SIZE 64
+#endif
+#endif
+
+typedef struct {
+    int16_t * storage;
+    uint32_t  size;
+    // one slot stays empty to distinguish full from empty
+    // written by consumer only
+    _Alignas(SAMPLE_RING_BUFFER_CACHE_LINE_SIZE) atomic_uint read_pos;
+    // written by producer only
+    _Alignas(SAMPLE_RING_BUFFER_CACHE_LINE_SIZE) atomic_uint write_pos;
+} sample_ring_buffer_t;
+
+/**
+ * @brief Init ring buffer, it can hold num_samples - 1 samples
+ * @param ring
+ * @param storage needs to stay valid
+ * @param num_samples size of storage
+ */
+void sample_ring_buffer_init(sample_ring_buffer_t * ring, int16_t * storage, uint32_t num_samples);
+
+/**
+ * @brief Drop all samples
+ * @param ring
+ */
+void sample_ring_buffer_reset(sample_ring_buffer_t * ring);
+
+/**
+ * @brief Get number of samples available for reading. Exact for consumer, lower bound for producer
+ * @param ring
+ * @return num samples
+ */
+uint32_t sample_ring_buffer_samples_available(const sample_ring_buffer_t * ring);
+
+/**
+ * @brief Get number of samples that can be written. Exact for producer, lower bound for consumer
+ * @param ring
+ * @return num samples
+ */
+uint32_t sample_ring_buffer_samples_free(const sample_ring_buffer_t * ring);
+
+/**
+ * @brief Get write position, producer only
+ * @param ring
+ * @return index into storage of next sample to write
+ */
+static inline uint32_t sample_ring_buffer_get_write_pos(const sample_ring_buffer_t * ring){
+    return atomic_load_explicit(&ring->write_pos, memory_order_relaxed);
+}
+
+/**
+ * @brief Get largest contiguous region that can be written without wrapping, producer only
+ * @param ring
+ * @param samples set to start of region
+ * @return num samples in region, less than samples_free if free space wraps around
+ */
+uint32_t sample_ring_buffer_get_write_region(sample_ring_buffer_t * ring, int16_t ** samples);
+
+/**
+ * @brief Mark samples in write region as written and publish them to consumer
+ * @param ring
+ * @param num_samples <= size of write region
+ */
+void sample_ring_buffer_commit_write(sample_ring_buffer_t * ring, uint32_t num_samples);
+
+/**
+ * @brief Get largest contiguous region that can be read without wrapping, consumer only
+ * @param ring
+ * @param samples set to start of region
+ * @return num samples in region, less than samples_available if data wraps around
+ */
+uint32_t sample_ring_buffer_get_read_region(const sample_ring_buffer_t * ring, const int16_t ** samples);
+
+/**
+ * @brief Mark samples in read region as consumed and return space to producer
+ * @param ring
+ * @param num_samples <= size of read region
+ */
+void sample_ring_buffer_commit_read(sample_ring_buffer_t * ring, uint32_t num_samples);
+
+/**
+ * @brief Copy samples into ring buffer, producer only
+ * @param ring
+ * @param samples
+ * @param num_samples
+ * @return num samples written, less than num_samples if buffer is full
+ */
+uint32_t sample_ring_buffer_write(sample_ring_buffer_t * ring, const int16_t * samples, uint32_t num_samples);
+
+/**
+ * @brief Copy samples from ring buffer, consumer only
+ * @param ring
+ * @param samples
+ * @param num_samples
+ * @return num samples read, less than num_samples if buffer runs empty
+ */
+uint32_t sample_ring_buffer_read(sample_ring_buffer_t * ring, int16_t * samples, uint32_t num_samples);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
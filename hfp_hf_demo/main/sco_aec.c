@@ -0,0 +1,370 @@
+/*
+ * sco_aec.c - fixed-point acoustic echo canceller for the microphone path
+ */
+
+#include <string.h>
+
+#include "sco_aec.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+// samples are scaled up by 4 bits for precision, FFT growth of 7 bits still fits into int32_t
+#define SCO_AEC_SIGNAL_SHIFT            4
+
+// filter coefficients Q16, filter output and coefficients are limited so the inverse FFTs cannot overflow
+#define SCO_AEC_FILTER_SHIFT            16
+#define SCO_AEC_FILTER_LIMIT            (1 << 22)
+#define SCO_AEC_OUTPUT_LIMIT            (1 << 22)
+
+// max step size mu in Q15, used until converged
+#define SCO_AEC_STEP_SIZE_Q15           16384
+
+// step size control: leakage regression over 1/32 per block, converged above 10 dB ERLE
+#define SCO_AEC_LEAK_SHIFT              5
+#define SCO_AEC_CONVERGED_ERLE_DB       10
+
+// reference power smoothing, 1/4 per block
+#define SCO_AEC_POWER_SHIFT             2
+
+// regularization of normalization, power of white reference at about -60 dBFS
+#define SCO_AEC_REGULARIZATION          (1ULL << 25)
+
+// far-end peak over tail below about -54 dBFS: nothing to adapt to
+#define SCO_AEC_FAR_END_MIN_PEAK        64
+
+// double talk if microphone peak exceeds far-end peak by this ratio in Q8: the echo path may amplify
+// by up to 6 dB, e.g. with loudspeaker close to microphone
+#define SCO_AEC_DOUBLE_TALK_RATIO_Q8    512
+#define SCO_AEC_DOUBLE_TALK_HANGOVER    8
+
+// filter comparison: block energies are scaled down so products fit into 64 bits, background is restored
+// on 4 times the evidence needed for update
+#define SCO_AEC_COMPARE_ENERGY_SHIFT    10
+#define SCO_AEC_RESTORE_RATIO           4
+
+// output bypass: energy smoothing 1/4 per block
+#define SCO_AEC_OUTPUT_SHIFT            2
+
+// ERLE smoothing, 1/16 per block
+#define SCO_AEC_ERLE_SHIFT              4
+
+static inline int32_t sco_aec_clamp(int64_t value, int32_t limit){
+    if (value >  limit) return  limit;
+    if (value < -limit) return -limit;
+    return (int32_t) value;
+}
+
+static inline int16_t sco_aec_saturate(int32_t value){
+    if (value >  32767) return  32767;
+    if (value < -32768) return -32768;
+    return (int16_t) value;
+}
+
+static inline uint8_t sco_aec_partition_before(const sco_aec_t * aec, uint8_t index){
+    return (index == 0) ? (aec->num_partitions - 1) : (index - 1);
+}
+
+static inline int64_t sco_aec_signed_square(int64_t value){
+    return value * ((value < 0) ? -value : value);
+}
+
+// decide if background filter cancels significantly better (> 0) or worse (< 0) than foreground filter: the
+// energy reduction and its short and long term averages are compared against their variance, estimated from
+// foreground error energy times energy of the difference between the filter outputs. With near-end speech in
+// the error only a large reduction counts
+static int8_t sco_aec_compare_filters(sco_aec_t * aec, uint64_t foreground_energy, uint64_t background_energy,
+                                      uint64_t difference_energy){
+    int64_t foreground = (int64_t) (foreground_energy >> SCO_AEC_COMPARE_ENERGY_SHIFT);
+    int64_t background = (int64_t) (background_energy >> SCO_AEC_COMPARE_ENERGY_SHIFT);
+    int64_t difference = (int64_t) (difference_energy >> SCO_AEC_COMPARE_ENERGY_SHIFT);
+    int64_t reduction  = foreground - background;
+    int64_t variance   = foreground * difference;
+
+    // short and long term average in Q8: 0.6 / 0.4 and 0.85 / 0.15, variance with squared weights
+    aec->reduction_average[0]  = (154 * aec->reduction_average[0] + 102 * reduction) >> 8;
+    aec->reduction_average[1]  = (218 * aec->reduction_average[1] +  38 * reduction) >> 8;
+    aec->reduction_variance[0] = (92  * aec->reduction_variance[0] + 41 * variance)  >> 8;
+    aec->reduction_variance[1] = (185 * aec->reduction_variance[1] +  6 * variance)  >> 8;
+
+    int8_t result = 0;
+    if ((sco_aec_signed_square(reduction) > variance)
+     || (sco_aec_signed_square(aec->reduction_average[0]) > (aec->reduction_variance[0] / 2))
+     || (sco_aec_signed_square(aec->reduction_average[1]) > (aec->reduction_variance[1] / 4))){
+        result = 1;
+    } else if ((-sco_aec_signed_square(reduction) > (SCO_AEC_RESTORE_RATIO * variance))
+     || (-sco_aec_signed_square(aec->reduction_average[0]) > (SCO_AEC_RESTORE_RATIO * aec->reduction_variance[0]))
+     || (-sco_aec_signed_square(aec->reduction_average[1]) > (SCO_AEC_RESTORE_RATIO * aec->reduction_variance[1]))){
+        result = -1;
+    }
+    if (result != 0){
+        memset(aec->reduction_average,  0, sizeof(aec->reduction_average));
+        memset(aec->reduction_variance, 0, sizeof(aec->reduction_variance));
+    }
+    return result;
+}
+
+// complete spectrum of real signal from bins 0..N/2
+static void sco_aec_mirror_spectrum(fixed_fft_complex_t * work){
+    uint16_t k;
+    for (k = 1; k < (SCO_AEC_FFT_SIZE / 2); k++){
+        work[SCO_AEC_FFT_SIZE - k].re =  work[k].re;
+        work[SCO_AEC_FFT_SIZE - k].im = -work[k].im;
+    }
+}
+
+// transform previous and current reference block, store spectrum as newest and update power
+static void sco_aec_reference_update(sco_aec_t * aec, const int16_t * reference){
+    fixed_fft_complex_t * work = aec->work;
+    int16_t peak = 0;
+    uint16_t i;
+    for (i = 0; i < SCO_AEC_BLOCK_SAMPLES; i++){
+        work[i].re = aec->reference_previous[i] * (1 << SCO_AEC_SIGNAL_SHIFT);
+        work[i].im = 0;
+        work[SCO_AEC_BLOCK_SAMPLES + i].re = reference[i] * (1 << SCO_AEC_SIGNAL_SHIFT);
+        work[SCO_AEC_BLOCK_SAMPLES + i].im = 0;
+        int16_t magnitude = (reference[i] < 0) ? (int16_t) btstack_min(-reference[i], 32767) : reference[i];
+        if (magnitude > peak){
+            peak = magnitude;
+        }
+    }
+    memcpy(aec->reference_previous, reference, sizeof(aec->reference_previous));
+    fixed_fft_forward(work, SCO_AEC_FFT_LOG2_SIZE);
+
+    aec->reference_newest = (aec->reference_newest + 1) % aec->num_partitions;
+    aec->reference_peak[aec->reference_newest] = peak;
+    fixed_fft_complex_t * spectrum = aec->reference_spectra[aec->reference_newest];
+    for (i = 0; i < SCO_AEC_NUM_BINS; i++){
+        spectrum[i] = work[i];
+        uint64_t power = (uint64_t) ((int64_t) work[i].re * work[i].re + (int64_t) work[i].im * work[i].im);
+        aec->reference_power[i] += (power >> SCO_AEC_POWER_SHIFT) - (aec->reference_power[i] >> SCO_AEC_POWER_SHIFT);
+    }
+}
+
+// error = microphone - echo estimate of filter, returns error energy
+static uint64_t sco_aec_filter(sco_aec_t * aec, fixed_fft_complex_t (*filter)[SCO_AEC_NUM_BINS],
+                               const int16_t * microphone, int16_t * error){
+    fixed_fft_complex_t * work = aec->work;
+    uint16_t k;
+    for (k = 0; k < SCO_AEC_NUM_BINS; k++){
+        int64_t sum_re = 0;
+        int64_t sum_im = 0;
+        uint8_t x_index = aec->reference_newest;
+        uint8_t p;
+        for (p = 0; p < aec->num_partitions; p++){
+            const fixed_fft_complex_t * w = &filter[p][k];
+            const fixed_fft_complex_t * x = &aec->reference_spectra[x_index][k];
+            sum_re += (int64_t) w->re * x->re - (int64_t) w->im * x->im;
+            sum_im += (int64_t) w->re * x->im + (int64_t) w->im * x->re;
+            x_index = sco_aec_partition_before(aec, x_index);
+        }
+        // remove Q16 and 1/N of inverse transform
+        work[k].re = sco_aec_clamp(sum_re >> (SCO_AEC_FILTER_SHIFT + SCO_AEC_FFT_LOG2_SIZE), SCO_AEC_OUTPUT_LIMIT);
+        work[k].im = sco_aec_clamp(sum_im >> (SCO_AEC_FILTER_SHIFT + SCO_AEC_FFT_LOG2_SIZE), SCO_AEC_OUTPUT_LIMIT);
+    }
+    sco_aec_mirror_spectrum(work);
+    fixed_fft_inverse(work, SCO_AEC_FFT_LOG2_SIZE);
+    // overlap-save: second half is the linear convolution
+    uint64_t energy = 0;
+    uint16_t i;
+    for (i = 0; i < SCO_AEC_BLOCK_SAMPLES; i++){
+        int32_t echo = (work[SCO_AEC_BLOCK_SAMPLES + i].re + (1 << (SCO_AEC_SIGNAL_SHIFT - 1))) >> SCO_AEC_SIGNAL_SHIFT;
+        int16_t sample = sco_aec_saturate(microphone[i] - echo);
+        error[i] = sample;
+        energy  += (uint64_t) ((int32_t) sample * sample);
+    }
+    return energy;
+}
+
+// step size from ratio of residual echo to error (RER), as in Speex MDF: residual echo is estimated from
+// the leakage of echo power into error power. Near-end speech raises the error but not the residual echo
+// and slows down adaptation, after an echo path change error power follows echo power and the step grows
+static int32_t sco_aec_step_size(sco_aec_t * aec, uint64_t error_energy, uint64_t echo_energy){
+    int64_t error = (int64_t) (error_energy >> SCO_AEC_COMPARE_ENERGY_SHIFT);
+    int64_t echo  = (int64_t) (echo_energy  >> SCO_AEC_COMPARE_ENERGY_SHIFT);
+    aec->error_mean += (error - aec->error_mean) >> SCO_AEC_LEAK_SHIFT;
+    aec->echo_mean  += (echo  - aec->echo_mean)  >> SCO_AEC_LEAK_SHIFT;
+    int64_t error_deviation = error - aec->error_mean;
+    int64_t echo_deviation  = echo  - aec->echo_mean;
+    aec->leak_covariance += ((error_deviation * echo_deviation) - aec->leak_covariance) >> SCO_AEC_LEAK_SHIFT;
+    aec->leak_variance   += ((echo_deviation  * echo_deviation) - aec->leak_variance)   >> SCO_AEC_LEAK_SHIFT;
+
+    if (aec->converged == false) return SCO_AEC_STEP_SIZE_Q15;
+
+    // leak in Q16, 0..1
+    int64_t leak_q16 = 0;
+    int64_t variance = aec->leak_variance >> 8;
+    if ((aec->leak_covariance > 0) && (variance > 0)){
+        leak_q16 = (aec->leak_covariance << 8) / variance;
+        if (leak_q16 > 65536){
+            leak_q16 = 65536;
+        }
+    }
+    int64_t residual = (3 * leak_q16 * echo) >> 16;
+    int64_t rer_q15  = (residual << 15) / (error + 1);
+    return (rer_q15 < SCO_AEC_STEP_SIZE_Q15) ? (int32_t) rer_q15 : SCO_AEC_STEP_SIZE_Q15;
+}
+
+// NLMS update of all background partitions with its error spectrum
+static void sco_aec_adapt(sco_aec_t * aec, int32_t step_size_q15){
+    fixed_fft_complex_t * work = aec->work;
+    uint16_t i;
+    for (i = 0; i < SCO_AEC_BLOCK_SAMPLES; i++){
+        work[i].re = 0;
+        work[i].im = 0;
+        work[SCO_AEC_BLOCK_SAMPLES + i].re = aec->error_background[i] * (1 << SCO_AEC_SIGNAL_SHIFT);
+        work[SCO_AEC_BLOCK_SAMPLES + i].im = 0;
+    }
+    fixed_fft_forward(work, SCO_AEC_FFT_LOG2_SIZE);
+
+    uint16_t k;
+    for (k = 0; k < SCO_AEC_NUM_BINS; k++){
+        // g = mu * E / (num_partitions * power + regularization) in Q31, with one 64 / 32 bit division:
+        // normalize denominator to 32 bits, 2^62 / denominator is in (2^30, 2^31]
+        uint64_t denominator = aec->num_partitions * aec->reference_power[k] + SCO_AEC_REGULARIZATION;
+        int32_t shift = (63 - __builtin_clzll(denominator)) - 31;
+        uint32_t denominator_normalized = (uint32_t) ((shift >= 0) ? (denominator >> shift) : (denominator << -shift));
+        int64_t inverse = (int64_t) ((1ULL << 62) / denominator_normalized);
+        // shift >= -6 because of regularization
+        int32_t g_re = sco_aec_clamp((((work[k].re * inverse) >> (16 + shift)) * step_size_q15) >> 15, INT32_MAX);
+        int32_t g_im = sco_aec_clamp((((work[k].im * inverse) >> (16 + shift)) * step_size_q15) >> 15, INT32_MAX);
+
+        // W_p += g * conj(X_p)
+        uint8_t x_index = aec->reference_newest;
+        uint8_t p;
+        for (p = 0; p < aec->num_partitions; p++){
+            fixed_fft_complex_t * w = &aec->filter_background[p][k];
+            const fixed_fft_complex_t * x = &aec->reference_spectra[x_index][k];
+            int64_t delta_re = ((int64_t) g_re * x->re + (int64_t) g_im * x->im) >> 30;
+            int64_t delta_im = ((int64_t) g_im * x->re - (int64_t) g_re * x->im) >> 30;
+            w->re = sco_aec_clamp(w->re + delta_re, SCO_AEC_FILTER_LIMIT);
+            w->im = sco_aec_clamp(w->im + delta_im, SCO_AEC_FILTER_LIMIT);
+            x_index = sco_aec_partition_before(aec, x_index);
+        }
+    }
+}
+
+// gradient constraint: limit impulse response of one background partition to one block
+static void sco_aec_constrain(sco_aec_t * aec){
+    fixed_fft_complex_t * work = aec->work;
+    fixed_fft_complex_t * filter = aec->filter_background[aec->constrain_next];
+    uint16_t i;
+    for (i = 0; i < SCO_AEC_NUM_BINS; i++){
+        work[i] = filter[i];
+    }
+    sco_aec_mirror_spectrum(work);
+    fixed_fft_inverse(work, SCO_AEC_FFT_LOG2_SIZE);
+    for (i = 0; i < SCO_AEC_BLOCK_SAMPLES; i++){
+        work[i].re = (work[i].re + (1 << (SCO_AEC_FFT_LOG2_SIZE - 1))) >> SCO_AEC_FFT_LOG2_SIZE;
+        work[i].im = 0;
+        work[SCO_AEC_BLOCK_SAMPLES + i].re = 0;
+        work[SCO_AEC_BLOCK_SAMPLES + i].im = 0;
+    }
+    fixed_fft_forward(work, SCO_AEC_FFT_LOG2_SIZE);
+    for (i = 0; i < SCO_AEC_NUM_BINS; i++){
+        filter[i].re = sco_aec_clamp(work[i].re, SCO_AEC_FILTER_LIMIT);
+        filter[i].im = sco_aec_clamp(work[i].im, SCO_AEC_FILTER_LIMIT);
+    }
+    aec->constrain_next = (aec->constrain_next + 1) % aec->num_partitions;
+}
+
+void sco_aec_init(sco_aec_t * aec, uint16_t sample_rate, uint16_t tail_ms){
+    btstack_assert(sample_rate > 0);
+    memset(aec, 0, sizeof(sco_aec_t));
+    uint32_t num_partitions = ((uint32_t) tail_ms * sample_rate / 1000 + SCO_AEC_BLOCK_SAMPLES - 1) / SCO_AEC_BLOCK_SAMPLES;
+    num_partitions = btstack_max(1, btstack_min(num_partitions, SCO_AEC_MAX_PARTITIONS));
+    aec->num_partitions = (uint8_t) num_partitions;
+    aec->metrics.tail_ms = (uint16_t) (num_partitions * SCO_AEC_BLOCK_SAMPLES * 1000 / sample_rate);
+}
+
+void sco_aec_process(sco_aec_t * aec, const int16_t * reference, int16_t * microphone){
+    sco_aec_reference_update(aec, reference);
+    uint64_t foreground_energy = sco_aec_filter(aec, aec->filter_foreground, microphone, aec->error_foreground);
+    uint64_t background_energy = sco_aec_filter(aec, aec->filter_background, microphone, aec->error_background);
+
+    uint64_t microphone_energy = 0;
+    uint64_t difference_energy = 0;
+    uint64_t echo_energy = 0;
+    int16_t  microphone_peak = 0;
+    uint16_t i;
+    for (i = 0; i < SCO_AEC_BLOCK_SAMPLES; i++){
+        int32_t sample = microphone[i];
+        microphone_energy += (uint64_t) (sample * sample);
+        int32_t difference = aec->error_foreground[i] - aec->error_background[i];
+        difference_energy += (uint64_t) ((int64_t) difference * difference);
+        // background echo estimate
+        int32_t echo = sample - aec->error_background[i];
+        echo_energy += (uint64_t) ((int64_t) echo * echo);
+        int16_t magnitude = (int16_t) btstack_min((sample < 0) ? -sample : sample, 32767);
+        if (magnitude > microphone_peak){
+            microphone_peak = magnitude;
+        }
+    }
+
+    // Geigel double talk detector against far-end peak over tail
+    int16_t far_end_peak = 0;
+    uint8_t p;
+    for (p = 0; p < aec->num_partitions; p++){
+        if (aec->reference_peak[p] > far_end_peak){
+            far_end_peak = aec->reference_peak[p];
+        }
+    }
+    bool far_end_active = far_end_peak >= SCO_AEC_FAR_END_MIN_PEAK;
+    if (far_end_active && (((int32_t) microphone_peak << 8) > ((int32_t) far_end_peak * SCO_AEC_DOUBLE_TALK_RATIO_Q8))){
+        aec->double_talk_hangover = SCO_AEC_DOUBLE_TALK_HANGOVER;
+    } else if (aec->double_talk_hangover > 0){
+        aec->double_talk_hangover--;
+    }
+    bool double_talk = aec->double_talk_hangover > 0;
+
+    if (far_end_active){
+        int8_t comparison = sco_aec_compare_filters(aec, foreground_energy, background_energy, difference_energy);
+        if (comparison > 0){
+            // background cancels better, e.g. initial convergence or echo path change
+            memcpy(aec->filter_foreground, aec->filter_background, aec->num_partitions * sizeof(aec->filter_foreground[0]));
+            memcpy(aec->error_foreground, aec->error_background, sizeof(aec->error_foreground));
+            foreground_energy = background_energy;
+            aec->metrics.filter_updates++;
+        } else if (comparison < 0){
+            // background diverged, e.g. by double talk
+            memcpy(aec->filter_background, aec->filter_foreground, aec->num_partitions * sizeof(aec->filter_background[0]));
+            memcpy(aec->error_background, aec->error_foreground, sizeof(aec->error_background));
+            aec->metrics.filter_restores++;
+        }
+    }
+    aec->microphone_energy += (microphone_energy >> SCO_AEC_OUTPUT_SHIFT) - (aec->microphone_energy >> SCO_AEC_OUTPUT_SHIFT);
+    aec->foreground_energy += (foreground_energy >> SCO_AEC_OUTPUT_SHIFT) - (aec->foreground_energy >> SCO_AEC_OUTPUT_SHIFT);
+
+    aec->metrics.blocks++;
+    if (far_end_active == false){
+        aec->metrics.blocks_far_end_idle++;
+    } else if (double_talk){
+        aec->metrics.blocks_double_talk++;
+    } else {
+        // smoothed ERLE
+        aec->erle_microphone_energy += (microphone_energy >> SCO_AEC_ERLE_SHIFT) - (aec->erle_microphone_energy >> SCO_AEC_ERLE_SHIFT);
+        aec->erle_error_energy      += (foreground_energy >> SCO_AEC_ERLE_SHIFT) - (aec->erle_error_energy      >> SCO_AEC_ERLE_SHIFT);
+        // 10 * log10(2) = 3.01
+        int32_t log2_ratio_q8 = fixed_fft_log2_q8(aec->erle_microphone_energy) - fixed_fft_log2_q8(aec->erle_error_energy);
+        aec->metrics.erle_db = (int16_t) ((log2_ratio_q8 * 301) / (100 * 256));
+        if (aec->metrics.erle_db >= SCO_AEC_CONVERGED_ERLE_DB){
+            aec->converged = true;
+        }
+    }
+
+    // output, pass microphone if filter adds echo, e.g. after echo path change
+    if (aec->foreground_energy > aec->microphone_energy){
+        aec->metrics.blocks_bypassed++;
+    } else {
+        memcpy(microphone, aec->error_foreground, sizeof(aec->error_foreground));
+    }
+
+    if (far_end_active && (double_talk == false)){
+        sco_aec_adapt(aec, sco_aec_step_size(aec, background_energy, echo_energy));
+        sco_aec_constrain(aec);
+    }
+}
+
+void sco_aec_get_metrics(const sco_aec_t * aec, sco_aec_metrics_t * metrics){
+    *metrics = aec->metrics;
+}
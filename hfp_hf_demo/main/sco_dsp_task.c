@@ -0,0 +1,278 @@
+/*
+ * sco_dsp_task.c - run SCO decode/encode in a separate task, exchanging packets with the run loop via lock-free queues
+ */
+
+#include <string.h>
+
+#include "sco_dsp_task.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#else
+#include <pthread.h>
+#endif
+
+#define SCO_DSP_TASK_QUEUE_MASK (SCO_DSP_TASK_QUEUE_SIZE - 1)
+
+_Static_assert((SCO_DSP_TASK_QUEUE_SIZE & SCO_DSP_TASK_QUEUE_MASK) == 0, "SCO_DSP_TASK_QUEUE_SIZE must be power of two");
+_Static_assert(SCO_DSP_TASK_PAYLOADS_AHEAD <= SCO_DSP_TASK_QUEUE_SIZE, "SCO_DSP_TASK_PAYLOADS_AHEAD larger than queue");
+
+typedef struct {
+    uint32_t arrival_us;
+    uint16_t size;
+    uint8_t  data[SCO_DSP_TASK_MAX_PACKET_SIZE];
+} sco_dsp_task_packet_t;
+
+// single producer / single consumer, free running indices
+typedef struct {
+    atomic_uint write_index;
+    atomic_uint read_index;
+    sco_dsp_task_packet_t packets[SCO_DSP_TASK_QUEUE_SIZE];
+} sco_dsp_task_queue_t;
+
+static sco_dsp_task_queue_t           sco_dsp_task_receive_queue;
+static sco_dsp_task_queue_t           sco_dsp_task_payload_queue;
+static const sco_dsp_task_handler_t * sco_dsp_task_handler;
+static void *                         sco_dsp_task_context;
+static atomic_bool                    sco_dsp_task_active;
+static atomic_bool                    sco_dsp_task_stop_requested;
+static atomic_uint                    sco_dsp_task_payload_size;
+static bool                           sco_dsp_task_created;
+// statistics, relaxed atomics so they can be read from any thread
+static atomic_uint                    sco_dsp_task_packets_dropped;
+static atomic_uint                    sco_dsp_task_payloads_missing;
+
+static inline void sco_dsp_task_statistics_increment(atomic_uint * counter){
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// queue
+
+static void sco_dsp_task_queue_init(sco_dsp_task_queue_t * queue){
+    atomic_init(&queue->write_index, 0);
+    atomic_init(&queue->read_index, 0);
+}
+
+static unsigned int sco_dsp_task_queue_count(sco_dsp_task_queue_t * queue){
+    unsigned int read_index  = atomic_load_explicit(&queue->read_index,  memory_order_acquire);
+    unsigned int write_index = atomic_load_explicit(&queue->write_index, memory_order_acquire);
+    return write_index - read_index;
+}
+
+// producer: get free slot or NULL if full
+static sco_dsp_task_packet_t * sco_dsp_task_queue_get_write_slot(sco_dsp_task_queue_t * queue){
+    unsigned int write_index = atomic_load_explicit(&queue->write_index, memory_order_relaxed);
+    unsigned int read_index  = atomic_load_explicit(&queue->read_index,  memory_order_acquire);
+    if ((write_index - read_index) >= SCO_DSP_TASK_QUEUE_SIZE) return NULL;
+    return &queue->packets[write_index & SCO_DSP_TASK_QUEUE_MASK];
+}
+
+static void sco_dsp_task_queue_commit_write(sco_dsp_task_queue_t * queue){
+    // publish packet after it has been stored
+    atomic_fetch_add_explicit(&queue->write_index, 1, memory_order_release);
+}
+
+// consumer: get oldest packet or NULL if empty
+static sco_dsp_task_packet_t * sco_dsp_task_queue_get_read_slot(sco_dsp_task_queue_t * queue){
+    unsigned int read_index  = atomic_load_explicit(&queue->read_index,  memory_order_relaxed);
+    unsigned int write_index = atomic_load_explicit(&queue->write_index, memory_order_acquire);
+    if (read_index == write_index) return NULL;
+    return &queue->packets[read_index & SCO_DSP_TASK_QUEUE_MASK];
+}
+
+static void sco_dsp_task_queue_commit_read(sco_dsp_task_queue_t * queue){
+    // release slot after packet has been processed
+    atomic_fetch_add_explicit(&queue->read_index, 1, memory_order_release);
+}
+
+// platform
+
+static void sco_dsp_task_process(void);
+
+#ifdef ESP_PLATFORM
+
+#define SCO_DSP_TASK_STACK_SIZE     8192
+#define SCO_DSP_TASK_PRIORITY       (tskIDLE_PRIORITY + 1)
+#if CONFIG_FREERTOS_UNICORE
+#define SCO_DSP_TASK_CORE           0
+#else
+#define SCO_DSP_TASK_CORE           1
+#endif
+
+static TaskHandle_t      sco_dsp_task_handle;
+static SemaphoreHandle_t sco_dsp_task_stopped;
+
+static void sco_dsp_task_signal(void){
+    xTaskNotifyGive(sco_dsp_task_handle);
+}
+
+static void sco_dsp_task_wait_stopped(void){
+    xSemaphoreTake(sco_dsp_task_stopped, portMAX_DELAY);
+}
+
+static void sco_dsp_task_thread(void * arg){
+    UNUSED(arg);
+    while (true){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (atomic_exchange(&sco_dsp_task_stop_requested, false)){
+            xSemaphoreGive(sco_dsp_task_stopped);
+            continue;
+        }
+        sco_dsp_task_process();
+    }
+}
+
+static void sco_dsp_task_create(void){
+    sco_dsp_task_stopped = xSemaphoreCreateBinary();
+    xTaskCreatePinnedToCore(&sco_dsp_task_thread, "sco_dsp", SCO_DSP_TASK_STACK_SIZE, NULL,
+                            SCO_DSP_TASK_PRIORITY, &sco_dsp_task_handle, SCO_DSP_TASK_CORE);
+}
+
+#else
+
+static pthread_t       sco_dsp_task_pthread;
+static pthread_mutex_t sco_dsp_task_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  sco_dsp_task_cond  = PTHREAD_COND_INITIALIZER;
+static bool            sco_dsp_task_signaled;
+static bool            sco_dsp_task_stopped;
+
+static void sco_dsp_task_signal(void){
+    pthread_mutex_lock(&sco_dsp_task_mutex);
+    sco_dsp_task_signaled = true;
+    pthread_cond_broadcast(&sco_dsp_task_cond);
+    pthread_mutex_unlock(&sco_dsp_task_mutex);
+}
+
+static void sco_dsp_task_wait_stopped(void){
+    pthread_mutex_lock(&sco_dsp_task_mutex);
+    while (sco_dsp_task_stopped == false){
+        pthread_cond_wait(&sco_dsp_task_cond, &sco_dsp_task_mutex);
+    }
+    sco_dsp_task_stopped = false;
+    pthread_mutex_unlock(&sco_dsp_task_mutex);
+}
+
+static void * sco_dsp_task_thread(void * arg){
+    UNUSED(arg);
+    while (true){
+        pthread_mutex_lock(&sco_dsp_task_mutex);
+        while (sco_dsp_task_signaled == false){
+            pthread_cond_wait(&sco_dsp_task_cond, &sco_dsp_task_mutex);
+        }
+        sco_dsp_task_signaled = false;
+        if (atomic_exchange(&sco_dsp_task_stop_requested, false)){
+            sco_dsp_task_stopped = true;
+            pthread_cond_broadcast(&sco_dsp_task_cond);
+            pthread_mutex_unlock(&sco_dsp_task_mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&sco_dsp_task_mutex);
+        sco_dsp_task_process();
+    }
+    return NULL;
+}
+
+static void sco_dsp_task_create(void){
+    pthread_create(&sco_dsp_task_pthread, NULL, &sco_dsp_task_thread, NULL);
+}
+
+#endif
+
+// DSP task: decode all received packets, then encode payloads ahead
+static void sco_dsp_task_process(void){
+    sco_dsp_task_packet_t * packet;
+    while (atomic_load(&sco_dsp_task_active)){
+        packet = sco_dsp_task_queue_get_read_slot(&sco_dsp_task_receive_queue);
+        if (packet == NULL) break;
+        (*sco_dsp_task_handler->process_packet)(sco_dsp_task_context, packet->data, packet->size, packet->arrival_us);
+        sco_dsp_task_queue_commit_read(&sco_dsp_task_receive_queue);
+    }
+    if (atomic_load(&sco_dsp_task_active) && (sco_dsp_task_handler->process_input != NULL)){
+        (*sco_dsp_task_handler->process_input)(sco_dsp_task_context);
+    }
+    while (atomic_load(&sco_dsp_task_active)){
+        uint16_t payload_size = (uint16_t) atomic_load(&sco_dsp_task_payload_size);
+        if (payload_size == 0) break;
+        if (sco_dsp_task_queue_count(&sco_dsp_task_payload_queue) >= SCO_DSP_TASK_PAYLOADS_AHEAD) break;
+        packet = sco_dsp_task_queue_get_write_slot(&sco_dsp_task_payload_queue);
+        btstack_assert(packet != NULL);
+        (*sco_dsp_task_handler->produce_payload)(sco_dsp_task_context, packet->data, payload_size);
+        packet->size = payload_size;
+        sco_dsp_task_queue_commit_write(&sco_dsp_task_payload_queue);
+    }
+}
+
+// run loop
+
+void sco_dsp_task_start(const sco_dsp_task_handler_t * handler, void * context){
+    sco_dsp_task_handler = handler;
+    sco_dsp_task_context = context;
+    sco_dsp_task_queue_init(&sco_dsp_task_receive_queue);
+    sco_dsp_task_queue_init(&sco_dsp_task_payload_queue);
+    atomic_store_explicit(&sco_dsp_task_packets_dropped, 0, memory_order_relaxed);
+    atomic_store_explicit(&sco_dsp_task_payloads_missing, 0, memory_order_relaxed);
+    atomic_store(&sco_dsp_task_payload_size, 0);
+    atomic_store(&sco_dsp_task_stop_requested, false);
+    atomic_store(&sco_dsp_task_active, true);
+    if (sco_dsp_task_created == false){
+        sco_dsp_task_created = true;
+        sco_dsp_task_create();
+    }
+}
+
+void sco_dsp_task_stop(void){
+    if (atomic_load(&sco_dsp_task_active) == false) return;
+    atomic_store(&sco_dsp_task_active, false);
+    atomic_store(&sco_dsp_task_stop_requested, true);
+    sco_dsp_task_signal();
+    sco_dsp_task_wait_stopped();
+}
+
+void sco_dsp_task_receive(const uint8_t * packet, uint16_t size, uint32_t arrival_us){
+    if (atomic_load(&sco_dsp_task_active) == false) return;
+    sco_dsp_task_packet_t * slot = sco_dsp_task_queue_get_write_slot(&sco_dsp_task_receive_queue);
+    if (slot == NULL){
+        sco_dsp_task_statistics_increment(&sco_dsp_task_packets_dropped);
+        return;
+    }
+    uint16_t bytes_to_copy = btstack_min(size, SCO_DSP_TASK_MAX_PACKET_SIZE);
+    memcpy(slot->data, packet, bytes_to_copy);
+    slot->size       = bytes_to_copy;
+    slot->arrival_us = arrival_us;
+    sco_dsp_task_queue_commit_write(&sco_dsp_task_receive_queue);
+    sco_dsp_task_signal();
+}
+
+bool sco_dsp_task_get_payload(uint8_t * payload, uint16_t size){
+    if (atomic_load(&sco_dsp_task_active) == false) return false;
+    atomic_store(&sco_dsp_task_payload_size, size);
+    sco_dsp_task_packet_t * slot = sco_dsp_task_queue_get_read_slot(&sco_dsp_task_payload_queue);
+    bool ready = (slot != NULL) && (slot->size == size);
+    if (ready){
+        memcpy(payload, slot->data, size);
+    } else {
+        sco_dsp_task_statistics_increment(&sco_dsp_task_payloads_missing);
+    }
+    if (slot != NULL){
+        sco_dsp_task_queue_commit_read(&sco_dsp_task_payload_queue);
+    }
+    // encode next payload
+    sco_dsp_task_signal();
+    return ready;
+}
+
+void sco_dsp_task_wakeup(void){
+    if (atomic_load(&sco_dsp_task_active) == false) return;
+    sco_dsp_task_signal();
+}
+
+void sco_dsp_task_get_statistics(sco_dsp_task_statistics_t * statistics){
+    statistics->packets_dropped  = atomic_load_explicit(&sco_dsp_task_packets_dropped,  memory_order_relaxed);
+    statistics->payloads_missing = atomic_load_explicit(&sco_dsp_task_payloads_missing, memory_order_relaxed);
+}
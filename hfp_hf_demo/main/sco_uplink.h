@@ -0,0 +1,139 @@
+/*
+ * sco_uplink.h - conditioning of microphone audio before encoding: high-pass, noise suppression and gain control
+ *
+ * Audio is processed in place in frames of 7.5 ms at codec rate, i.e. one CVSD packet group, mSBC or LC3-SWB
+ * frame. Each stage can be enabled separately and reports the cycles it used per frame, so the stages that
+ * fit the CPU budget of a codec rate can be selected:
+ *
+ * - High-pass: first order DC blocker, removes offset and rumble below the corner frequency.
+ * - Noise suppression: spectral gain per frequency bin with overlap-add of frames with 50% sqrt-Hann windows,
+ *   adds one frame of latency. Noise power is tracked by following the minimum of the smoothed power per bin,
+ *   which rises slowly while speech is present. The gain is 1 - 2 * noise / power, limited to the configured
+ *   attenuation, and smoothed over frames against musical noise.
+ * - Gain control: the speech level is estimated over frames clearly above the background level and the gain
+ *   moves towards the configured target level, slowly up and faster down. Gain is interpolated across a frame
+ *   and reduced instantly if the frame would exceed full scale.
+ *
+ * All processing is fixed point without allocation. Levels are dBFS relative to the power of a full scale
+ * square wave.
+ */
+
+#ifndef SCO_UPLINK_H
+#define SCO_UPLINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fixed_fft.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// 7.5 ms at 32 kHz, two frames fit into the largest FFT
+#define SCO_UPLINK_MAX_FRAME_SAMPLES    240
+#define SCO_UPLINK_MAX_NUM_BINS         (FIXED_FFT_MAX_SIZE / 2 + 1)
+
+typedef enum {
+    SCO_UPLINK_HIGH_PASS = 0,
+    SCO_UPLINK_NOISE_SUPPRESSION,
+    SCO_UPLINK_GAIN_CONTROL,
+    SCO_UPLINK_NUM_STAGES
+} sco_uplink_stage_t;
+
+#define SCO_UPLINK_STAGE_MASK(stage)    (1 << (stage))
+#define SCO_UPLINK_ALL_STAGES           ((1 << SCO_UPLINK_NUM_STAGES) - 1)
+
+typedef struct {
+    // SCO_UPLINK_STAGE_MASK of enabled stages
+    uint8_t  stages;
+    // high-pass corner frequency
+    uint16_t high_pass_hz;
+    // max attenuation of noise
+    uint8_t  noise_suppression_db;
+    // speech level after gain control, max gain, e.g. -20 and 12
+    int8_t   gain_target_dbfs;
+    uint8_t  gain_max_db;
+} sco_uplink_config_t;
+
+typedef struct {
+    uint32_t frames;
+    // noise suppression: estimated noise level and reduction of energy in frames without speech, smoothed
+    int16_t  noise_level_dbfs;
+    int16_t  noise_reduction_db;
+    // gain control: speech level before gain and current gain, frames counted as speech or limited to full scale
+    int16_t  speech_level_dbfs;
+    int16_t  gain_db;
+    uint32_t frames_speech;
+    uint32_t frames_limited;
+} sco_uplink_metrics_t;
+
+typedef struct {
+    sco_uplink_config_t config;
+    uint16_t            frame_samples;
+
+    // high-pass: pole in Q15, output state with 8 fractional bits
+    int32_t             high_pass_pole;
+    int32_t             high_pass_state;
+    int16_t             high_pass_previous;
+
+    // noise suppression
+    uint8_t             fft_log2_size;
+    bool                noise_initialized;
+    // sin(pi n / (2 * frame_samples)) in Q15 for n = 0..frame_samples, rising half of the sqrt-Hann window
+    int16_t             window[SCO_UPLINK_MAX_FRAME_SAMPLES + 1];
+    int16_t             input_previous[SCO_UPLINK_MAX_FRAME_SAMPLES];
+    int32_t             overlap[SCO_UPLINK_MAX_FRAME_SAMPLES];
+    uint64_t            power[SCO_UPLINK_MAX_NUM_BINS];
+    uint64_t            noise_power[SCO_UPLINK_MAX_NUM_BINS];
+    // Q15
+    int16_t             gain[SCO_UPLINK_MAX_NUM_BINS];
+    int16_t             gain_floor;
+    fixed_fft_complex_t work[FIXED_FFT_MAX_SIZE];
+    uint64_t            noise_input_energy;
+    uint64_t            noise_output_energy;
+
+    // gain control, levels and gain in Q8 dB, applied gain Q16
+    int32_t             background_level;
+    int32_t             speech_level;
+    int32_t             gain_level;
+    int32_t             gain_applied;
+
+    sco_uplink_metrics_t metrics;
+} sco_uplink_t;
+
+/**
+ * @brief Reset state for codec rate
+ * @param uplink
+ * @param sample_rate 8000, 16000 or 32000
+ * @param config copied
+ */
+void sco_uplink_init(sco_uplink_t * uplink, uint16_t sample_rate, const sco_uplink_config_t * config);
+
+/**
+ * @brief Get frame size for codec rate
+ * @param uplink
+ * @return samples per 7.5 ms
+ */
+uint16_t sco_uplink_get_frame_samples(const sco_uplink_t * uplink);
+
+/**
+ * @brief Process one frame in place through all enabled stages
+ * @param uplink
+ * @param samples frame_samples
+ * @param stage_cycles SCO_UPLINK_NUM_STAGES values, cycles used per stage, 0 if disabled
+ */
+void sco_uplink_process(sco_uplink_t * uplink, int16_t * samples, uint32_t * stage_cycles);
+
+/**
+ * @brief Get metrics, values are updated per frame by the processing thread
+ * @param uplink
+ * @param metrics
+ */
+void sco_uplink_get_metrics(const sco_uplink_t * uplink, sco_uplink_metrics_t * metrics);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
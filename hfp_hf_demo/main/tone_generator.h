@@ -0,0 +1,78 @@
+/*
+ * tone_generator.h - phase accumulator oscillator for test signals: multiple tones and linear sweeps
+ *
+ * Each tone advances a 32-bit phase per sample, so any frequency up to half the sample rate can be
+ * generated with sub-Hz resolution. Samples are produced in blocks, e.g. directly into a ring buffer region.
+ */
+
+#ifndef TONE_GENERATOR_H
+#define TONE_GENERATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#define TONE_GENERATOR_MAX_TONES 4
+
+typedef struct {
+    uint32_t phase;
+    // phase increment per sample, 2^32 = sample rate
+    uint32_t step;
+    // sweep: step changes by step_delta per sample, restarts at step_start after sweep_samples
+    uint32_t step_start;
+    int32_t  step_delta;
+    uint32_t sweep_samples;
+    uint32_t sweep_position;
+    // Q15
+    int16_t  amplitude;
+} tone_generator_tone_t;
+
+typedef struct {
+    uint32_t sample_rate;
+    uint8_t  num_tones;
+    tone_generator_tone_t tones[TONE_GENERATOR_MAX_TONES];
+} tone_generator_t;
+
+/**
+ * @brief Init tone generator without tones, produces silence
+ * @param generator
+ * @param sample_rate
+ */
+void tone_generator_init(tone_generator_t * generator, uint32_t sample_rate);
+
+/**
+ * @brief Add sine tone, output is the sum of all tones
+ * @param generator
+ * @param frequency_hz < sample_rate / 2
+ * @param amplitude Q15, sum of all amplitudes should stay below 32768 to avoid clipping
+ * @return false if TONE_GENERATOR_MAX_TONES already added
+ */
+bool tone_generator_add_tone(tone_generator_t * generator, uint32_t frequency_hz, int16_t amplitude);
+
+/**
+ * @brief Add sine tone with linear frequency sweep, repeated after duration
+ * @param generator
+ * @param start_hz
+ * @param end_hz < sample_rate / 2
+ * @param duration_ms
+ * @param amplitude Q15
+ * @return false if TONE_GENERATOR_MAX_TONES already added
+ */
+bool tone_generator_add_sweep(tone_generator_t * generator, uint32_t start_hz, uint32_t end_hz, uint32_t duration_ms, int16_t amplitude);
+
+/**
+ * @brief Render next samples
+ * @param generator
+ * @param samples
+ * @param num_samples
+ */
+void tone_generator_fill(tone_generator_t * generator, int16_t * samples, uint32_t num_samples);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * button_input_esp32.c - button input HAL for active-low GPIO buttons with edge interrupts
+ *
+ * btstack_run_loop_execute_on_main_thread() is not interrupt-safe, so the GPIO ISR only
+ * records the edge and wakes a small task that forwards it via button_input_edge_detected().
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "button_input_esp32.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define BUTTON_INPUT_TASK_STACK_SIZE 2048
+#define BUTTON_INPUT_TASK_PRIORITY   (configMAX_PRIORITIES - 2)
+
+static const gpio_num_t * button_input_gpios;
+static button_input_hal_t button_input_esp32_hal;
+static TaskHandle_t       button_input_task_handle;
+static atomic_uint        button_input_edges;
+
+static void IRAM_ATTR button_input_esp32_isr(void * arg){
+    uint8_t button = (uint8_t)(uintptr_t) arg;
+    atomic_fetch_or(&button_input_edges, 1u << button);
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(button_input_task_handle, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+static void button_input_esp32_task(void * arg){
+    UNUSED(arg);
+    while (true){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        unsigned int edges = atomic_exchange(&button_input_edges, 0);
+        uint8_t button;
+        for (button = 0; button < button_input_esp32_hal.num_buttons; button++){
+            if (edges & (1u << button)){
+                button_input_edge_detected(button);
+            }
+        }
+    }
+}
+
+static void button_input_esp32_init(void){
+    xTaskCreate(&button_input_esp32_task, "button_input", BUTTON_INPUT_TASK_STACK_SIZE, NULL,
+                BUTTON_INPUT_TASK_PRIORITY, &button_input_task_handle);
+
+    // service may already be installed by other drivers
+    gpio_install_isr_service(0);
+
+    uint8_t button;
+    for (button = 0; button < button_input_esp32_hal.num_buttons; button++){
+        gpio_num_t gpio = button_input_gpios[button];
+        gpio_reset_pin(gpio);
+        gpio_set_direction(gpio, GPIO_MODE_INPUT);
+        gpio_set_pull_mode(gpio, GPIO_PULLUP_ONLY);
+        gpio_set_intr_type(gpio, GPIO_INTR_ANYEDGE);
+        gpio_isr_handler_add(gpio, &button_input_esp32_isr, (void *)(uintptr_t) button);
+        gpio_intr_enable(gpio);
+    }
+}
+
+static bool button_input_esp32_is_pressed(uint8_t button){
+    return gpio_get_level(button_input_gpios[button]) == 0;
+}
+
+const button_input_hal_t * button_input_esp32_get_instance(const gpio_num_t * gpios, uint8_t num_gpios){
+    btstack_assert(num_gpios <= BUTTON_INPUT_MAX_BUTTONS);
+    button_input_gpios = gpios;
+    button_input_esp32_hal.num_buttons = num_gpios;
+    button_input_esp32_hal.init        = &button_input_esp32_init;
+    button_input_esp32_hal.is_pressed  = &button_input_esp32_is_pressed;
+    return &button_input_esp32_hal;
+}
@@ -0,0 +1,130 @@
+/*
+ * deferred_log.h - binary log for hot paths, formatted later by a background task
+ *
+ * A log call stores the format string pointer, a timestamp and the raw arguments in a lock-free RAM ring
+ * and returns; a writer task formats and prints the entries every DEFERRED_LOG_DRAIN_PERIOD_MS. If the
+ * ring is full, entries are dropped and counted. Any thread can log, the ring is multi-producer.
+ *
+ * A log call reads the timestamp and copies all DEFERRED_LOG_MAX_ARGS arguments, its measured cost in cycles
+ * is reported in deferred_log_statistics_t.
+ *
+ * Arguments are stored as uintptr_t, i.e. int-sized on ESP32: %d/%u/%x/%c and %p work directly, %s only
+ * for strings that stay valid, e.g. string literals or const tables. Values from buffers that are reused,
+ * e.g. bd_addr_to_str(), need to be logged by value.
+ *
+ * Levels below DEFERRED_LOG_LEVEL are removed at compile time, arguments are not evaluated.
+ */
+
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#define DEFERRED_LOG_LEVEL_DEBUG    0
+#define DEFERRED_LOG_LEVEL_INFO     1
+#define DEFERRED_LOG_LEVEL_ERROR    2
+#define DEFERRED_LOG_LEVEL_NONE     3
+
+#ifndef DEFERRED_LOG_LEVEL
+#define DEFERRED_LOG_LEVEL          DEFERRED_LOG_LEVEL_INFO
+#endif
+
+// ring size, must be power of two, 52 bytes per entry on ESP32
+#define DEFERRED_LOG_NUM_ENTRIES    128
+#define DEFERRED_LOG_MAX_ARGS       8
+#define DEFERRED_LOG_DRAIN_PERIOD_MS 20
+
+typedef struct {
+    uint32_t entries_logged;
+    uint32_t entries_dropped;
+    uint32_t entries_printed;
+    // cost of deferred_log_write for printed entries, updated by writer task
+    uint32_t write_cycles_avg;
+    uint32_t write_cycles_p99;
+    uint32_t write_cycles_max;
+} deferred_log_statistics_t;
+
+/**
+ * @brief Start writer task, entries logged before are kept
+ */
+void deferred_log_init(void);
+
+/**
+ * @brief Store entry, use the deferred_log_* macros instead
+ * @param level
+ * @param format printf format, needs to stay valid
+ * @param args DEFERRED_LOG_MAX_ARGS values, unused ones zero
+ * @param num_args up to DEFERRED_LOG_MAX_ARGS
+ */
+void deferred_log_write(uint8_t level, const char * format, const uintptr_t * args, uint8_t num_args);
+
+/**
+ * @brief Print all stored entries on the calling thread, e.g. before printf output that should follow them.
+ *        Waits while the writer task is printing
+ */
+void deferred_log_flush(void);
+
+/**
+ * @brief Get counters since boot
+ * @param statistics
+ */
+void deferred_log_get_statistics(deferred_log_statistics_t * statistics);
+
+// not called, lets the compiler check format and arguments
+static inline void deferred_log_format_check(const char * format, ...) __attribute__ ((format (printf, 1, 2)));
+static inline void deferred_log_format_check(const char * format, ...){
+    (void) format;
+}
+
+#define DEFERRED_LOG_NUM_ARGS(...) DEFERRED_LOG_NUM_ARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DEFERRED_LOG_NUM_ARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+
+// cast each argument to uintptr_t
+#define DEFERRED_LOG_CONCAT(a, b)   DEFERRED_LOG_CONCAT_(a, b)
+#define DEFERRED_LOG_CONCAT_(a, b)  a ## b
+#define DEFERRED_LOG_ARGS_0()
+#define DEFERRED_LOG_ARGS_1(a)      (uintptr_t) (a)
+#define DEFERRED_LOG_ARGS_2(a, ...) (uintptr_t) (a), DEFERRED_LOG_ARGS_1(__VA_ARGS__)
+#define DEFERRED_LOG_ARGS_3(a, ...) (uintptr_t) (a), DEFERRED_LOG_ARGS_2(__VA_ARGS__)
+#define DEFERRED_LOG_ARGS_4(a, ...) (uintptr_t) (a), DEFERRED_LOG_ARGS_3(__VA_ARGS__)
+#define DEFERRED_LOG_ARGS_5(a, ...) (uintptr_t) (a), DEFERRED_LOG_ARGS_4(__VA_ARGS__)
+#define DEFERRED_LOG_ARGS_6(a, ...) (uintptr_t) (a), DEFERRED_LOG_ARGS_5(__VA_ARGS__)
+#define DEFERRED_LOG_ARGS_7(a, ...) (uintptr_t) (a), DEFERRED_LOG_ARGS_6(__VA_ARGS__)
+#define DEFERRED_LOG_ARGS_8(a, ...) (uintptr_t) (a), DEFERRED_LOG_ARGS_7(__VA_ARGS__)
+#define DEFERRED_LOG_ARGS(...)      DEFERRED_LOG_CONCAT(DEFERRED_LOG_ARGS_, DEFERRED_LOG_NUM_ARGS(__VA_ARGS__))(__VA_ARGS__)
+
+#define DEFERRED_LOG_WRITE(level, format, ...) do {                                                     \
+    if (0) { deferred_log_format_check(format, ##__VA_ARGS__); }                                       \
+    _Static_assert(DEFERRED_LOG_NUM_ARGS(__VA_ARGS__) <= DEFERRED_LOG_MAX_ARGS, "too many log arguments"); \
+    const uintptr_t deferred_log_args[DEFERRED_LOG_MAX_ARGS] = { DEFERRED_LOG_ARGS(__VA_ARGS__) };      \
+    deferred_log_write(level, format, deferred_log_args, DEFERRED_LOG_NUM_ARGS(__VA_ARGS__));          \
+} while (0)
+
+#if DEFERRED_LOG_LEVEL <= DEFERRED_LOG_LEVEL_DEBUG
+#define deferred_log_debug(format, ...) DEFERRED_LOG_WRITE(DEFERRED_LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#else
+#define deferred_log_debug(...) do { } while (0)
+#endif
+
+#if DEFERRED_LOG_LEVEL <= DEFERRED_LOG_LEVEL_INFO
+#define deferred_log_info(format, ...) DEFERRED_LOG_WRITE(DEFERRED_LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#else
+#define deferred_log_info(...) do { } while (0)
+#endif
+
+#if DEFERRED_LOG_LEVEL <= DEFERRED_LOG_LEVEL_ERROR
+#define deferred_log_error(format, ...) DEFERRED_LOG_WRITE(DEFERRED_LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#else
+#define deferred_log_error(...) do { } while (0)
+#endif
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ * fixed_fft.c - in-place radix-2 complex FFT on 32-bit fixed-point data for audio processing blocks
+ */
+
+#include "fixed_fft.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+// sin(2 pi k / FIXED_FFT_MAX_SIZE) in Q30, quarter period
+static const int32_t fixed_fft_sine[FIXED_FFT_MAX_SIZE / 4 + 1] = {
+             0,   13176464,   26350943,   39521455,   52686014,   65842639,
+      78989349,   92124163,  105245103,  118350194,  131437462,  144504935,
+     157550647,  170572633,  183568930,  196537583,  209476638,  222384147,
+     235258165,  248096755,  260897982,  273659918,  286380643,  299058239,
+     311690799,  324276419,  336813204,  349299266,  361732726,  374111709,
+     386434353,  398698801,  410903207,  423045732,  435124548,  447137835,
+     459083786,  470960600,  482766489,  494499676,  506158392,  517740883,
+     529245404,  540670223,  552013618,  563273883,  574449320,  585538248,
+     596538995,  607449906,  618269338,  628995660,  639627258,  650162530,
+     660599890,  670937767,  681174602,  691308855,  701339000,  711263525,
+     721080937,  730789757,  740388522,  749875788,  759250125,  768510122,
+     777654384,  786681534,  795590213,  804379079,  813046808,  821592095,
+     830013654,  838310216,  846480531,  854523370,  862437520,  870221790,
+     877875009,  885396022,  892783698,  900036924,  907154608,  914135678,
+     920979082,  927683790,  934248793,  940673101,  946955747,  953095785,
+     959092290,  964944360,  970651112,  976211688,  981625251,  986890984,
+     992008094,  996975812, 1001793390, 1006460100, 1010975242, 1015338134,
+    1019548121, 1023604567, 1027506862, 1031254418, 1034846671, 1038283080,
+    1041563127, 1044686319, 1047652185, 1050460278, 1053110176, 1055601479,
+    1057933813, 1060106826, 1062120190, 1063973603, 1065666786, 1067199483,
+    1068571464, 1069782521, 1070832474, 1071721163, 1072448455, 1073014240,
+    1073418433, 1073660973, 1073741824
+};
+
+// e^(-j 2 pi k / FIXED_FFT_MAX_SIZE) for k < FIXED_FFT_MAX_SIZE / 2
+static void fixed_fft_twiddle(uint16_t k, int32_t * cos_q30, int32_t * sin_q30){
+    if (k <= (FIXED_FFT_MAX_SIZE / 4)){
+        *cos_q30 = fixed_fft_sine[(FIXED_FFT_MAX_SIZE / 4) - k];
+        *sin_q30 = fixed_fft_sine[k];
+    } else {
+        *cos_q30 = -fixed_fft_sine[k - (FIXED_FFT_MAX_SIZE / 4)];
+        *sin_q30 = fixed_fft_sine[(FIXED_FFT_MAX_SIZE / 2) - k];
+    }
+}
+
+static inline int32_t fixed_fft_mul_q30(int32_t a, int32_t b){
+    return (int32_t) (((int64_t) a * b + (1 << 29)) >> 30);
+}
+
+static void fixed_fft_bit_reverse(fixed_fft_complex_t * data, uint8_t log2_size){
+    uint16_t size = 1 << log2_size;
+    uint16_t i;
+    uint16_t j = 0;
+    for (i = 0; i < size - 1; i++){
+        if (i < j){
+            fixed_fft_complex_t tmp = data[i];
+            data[i] = data[j];
+            data[j] = tmp;
+        }
+        uint16_t bit = size >> 1;
+        while (j & bit){
+            j ^= bit;
+            bit >>= 1;
+        }
+        j |= bit;
+    }
+}
+
+// decimation in time, sign of sine selects direction
+static void fixed_fft_transform(fixed_fft_complex_t * data, uint8_t log2_size, bool inverse){
+    btstack_assert((log2_size > 0) && (log2_size <= FIXED_FFT_MAX_LOG2_SIZE));
+    fixed_fft_bit_reverse(data, log2_size);
+    uint16_t size = 1 << log2_size;
+    uint16_t half;
+    for (half = 1; half < size; half <<= 1){
+        uint16_t step = FIXED_FFT_MAX_SIZE / (2 * half);
+        uint16_t k;
+        for (k = 0; k < half; k++){
+            int32_t c;
+            int32_t s;
+            fixed_fft_twiddle(k * step, &c, &s);
+            if (inverse == false){
+                s = -s;
+            }
+            uint16_t i;
+            for (i = k; i < size; i += 2 * half){
+                fixed_fft_complex_t * a = &data[i];
+                fixed_fft_complex_t * b = &data[i + half];
+                int32_t t_re;
+                int32_t t_im;
+                if (k == 0){
+                    t_re = b->re;
+                    t_im = b->im;
+                } else {
+                    t_re = fixed_fft_mul_q30(b->re, c) - fixed_fft_mul_q30(b->im, s);
+                    t_im = fixed_fft_mul_q30(b->re, s) + fixed_fft_mul_q30(b->im, c);
+                }
+                b->re = a->re - t_re;
+                b->im = a->im - t_im;
+                a->re += t_re;
+                a->im += t_im;
+            }
+        }
+    }
+}
+
+void fixed_fft_forward(fixed_fft_complex_t * data, uint8_t log2_size){
+    fixed_fft_transform(data, log2_size, false);
+}
+
+void fixed_fft_inverse(fixed_fft_complex_t * data, uint8_t log2_size){
+    fixed_fft_transform(data, log2_size, true);
+}
+
+int32_t fixed_fft_sine_q30(uint32_t phase){
+    // quarter and index into quarter table, 2^32 / FIXED_FFT_MAX_SIZE per entry
+    uint8_t  quarter  = phase >> 30;
+    uint32_t offset   = phase & 0x3fffffff;
+    if (quarter & 1){
+        offset = 0x40000000 - offset;
+    }
+    uint32_t index    = offset >> (32 - FIXED_FFT_MAX_LOG2_SIZE);
+    uint32_t fraction = (offset >> (16 - FIXED_FFT_MAX_LOG2_SIZE)) & 0xffff;
+    int32_t  value    = fixed_fft_sine[index];
+    if (index < (FIXED_FFT_MAX_SIZE / 4)){
+        value += (int32_t) (((int64_t) (fixed_fft_sine[index + 1] - value) * fraction) >> 16);
+    }
+    return (quarter & 2) ? -value : value;
+}
+
+int32_t fixed_fft_log2_q8(uint64_t value){
+    if (value == 0) return 0;
+    int32_t msb = 63 - __builtin_clzll(value);
+    uint32_t fraction = (msb >= 8) ? (uint32_t) (value >> (msb - 8)) : (uint32_t) (value << (8 - msb));
+    return msb * 256 + (int32_t) (fraction & 0xff);
+}
@@ -0,0 +1,59 @@
+/*
+ * fixed_fft.h - in-place radix-2 complex FFT on 32-bit fixed-point data for audio processing blocks
+ *
+ * Transforms are unscaled: a forward transform followed by an inverse transform multiplies by the size.
+ * Callers keep enough headroom, i.e. max input magnitude times size has to fit into int32_t, and divide
+ * by the size where needed. Twiddle factors are Q30, products are calculated with 64 bits.
+ */
+
+#ifndef FIXED_FFT_H
+#define FIXED_FFT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#define FIXED_FFT_MAX_LOG2_SIZE 9
+#define FIXED_FFT_MAX_SIZE      (1 << FIXED_FFT_MAX_LOG2_SIZE)
+
+typedef struct {
+    int32_t re;
+    int32_t im;
+} fixed_fft_complex_t;
+
+/**
+ * @brief Forward transform, X[k] = sum x[n] e^(-j 2 pi n k / N)
+ * @param data N values
+ * @param log2_size log2(N), 1..FIXED_FFT_MAX_LOG2_SIZE
+ */
+void fixed_fft_forward(fixed_fft_complex_t * data, uint8_t log2_size);
+
+/**
+ * @brief Inverse transform without 1/N, x[n] = sum X[k] e^(j 2 pi n k / N)
+ * @param data N values
+ * @param log2_size log2(N), 1..FIXED_FFT_MAX_LOG2_SIZE
+ */
+void fixed_fft_inverse(fixed_fft_complex_t * data, uint8_t log2_size);
+
+/**
+ * @brief Sine from twiddle table with linear interpolation, e.g. for analysis windows
+ * @param phase full period is 2^32
+ * @return sin(2 pi phase / 2^32) in Q30
+ */
+int32_t fixed_fft_sine_q30(uint32_t phase);
+
+/**
+ * @brief Binary logarithm with linear interpolation between powers of two, e.g. for levels of band energies
+ * @param value
+ * @return log2(value) in Q8, 0 for 0
+ */
+int32_t fixed_fft_log2_q8(uint64_t value);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -10,12 +10,46 @@
 #include "sco_demo_util.h"
 #include "btstack_run_loop.h"
 #include "hid_device.h"
+#include "hid_key_tracker.h"
+#include "button_input.h"
+#include "button_input_esp32.h"
+#include "hid_keyboard_report.h"
+#include "key_matrix.h"
+#include "key_matrix_esp32.h"
+#include "hid_keyboard_layout.h"
+#include "hid_text_typer.h"
+#include "deferred_log.h"
 
 // 常量定义
 #define REPORT_ID           0x01
 #define BUTTON_GPIO         1
 #define HID_KEY_Q           0x14
 
+// 按键去抖动窗口；典型连发 (typematic) 延迟/周期，周期为 0 时禁用
+#define BUTTON_DEBOUNCE_MS      20
+#define TYPEMATIC_DELAY_MS      500
+#define TYPEMATIC_PERIOD_MS     0
+
+// 键盘矩阵：定义 ENABLE_KEY_MATRIX 后使用扫描矩阵代替单个按键
+// #define ENABLE_KEY_MATRIX
+#define KEY_MATRIX_SCAN_PERIOD_MS   1
+#define KEY_MATRIX_DEBOUNCE_SCANS   5
+
+// 1: 使用 NKRO 位图报告 (hid_descriptor_keyboard_nkro)，0: 使用 6KRO 报告 (hid_descriptor_keyboard)
+#define HID_KEYBOARD_NKRO       0
+
+// 文本输入缓冲区大小；定义 ENABLE_TYPING_DEMO 后在 HID 连接建立时输入演示文本
+#define TYPING_BUFFER_SIZE      1024
+// #define ENABLE_TYPING_DEMO
+
+// 启动时测量字符查表耗时
+// #define ENABLE_KEYBOARD_LAYOUT_BENCHMARK
+#define KEYBOARD_LAYOUT_BENCHMARK_ROUNDS    100
+
+// 事件处理中使用延迟日志；地址按值记录，bd_addr_to_str() 的缓冲区会被复用
+#define BD_ADDR_LOG_FORMAT      "%02X:%02X:%02X:%02X:%02X:%02X"
+#define BD_ADDR_LOG_ARGS(addr)  (addr)[0], (addr)[1], (addr)[2], (addr)[3], (addr)[4], (addr)[5]
+
 // HID 键盘描述符
 const uint8_t hid_descriptor_keyboard[] = {
     0x05, 0x01,                    // Usage Page (Generic Desktop)
@@ -65,6 +99,56 @@ const uint8_t hid_descriptor_keyboard[] = {
     0xc0                           // End Collection
 };
 
+// HID NKRO 键盘描述符：修饰键字节 + 0x00..0xff 按键位图
+const uint8_t hid_descriptor_keyboard_nkro[] = {
+    0x05, 0x01,                    // Usage Page (Generic Desktop)
+    0x09, 0x06,                    // Usage (Keyboard)
+    0xa1, 0x01,                    // Collection (Application)
+
+    // Report ID
+    0x85, REPORT_ID,               // Report ID
+
+    // Modifier byte (input)
+    0x75, 0x01,                    // Report size (1)
+    0x95, 0x08,                    // Report count (8)
+    0x05, 0x07,                    // Usage page (Keyboard)
+    0x19, 0xe0,                    // Usage minimum (Left Control)
+    0x29, 0xe7,                    // Usage maximum (Right GUI)
+    0x15, 0x00,                    // Logical minimum (0)
+    0x25, 0x01,                    // Logical maximum (1)
+    0x81, 0x02,                    // Input (Data, Variable, Absolute)
+
+    // LED report + padding (output)
+    0x95, 0x05,                    // Report count (5)
+    0x75, 0x01,                    // Report size (1)
+    0x05, 0x08,                    // Usage page (LEDs)
+    0x19, 0x01,                    // Usage minimum (Num Lock)
+    0x29, 0x05,                    // Usage maximum (Kana)
+    0x91, 0x02,                    // Output (Data, Variable, Absolute)
+
+    0x95, 0x01,                    // Report count (1)
+    0x75, 0x03,                    // Report size (3)
+    0x91, 0x03,                    // Output (Constant, Variable, Absolute)
+
+    // Key bitmap (input)
+    0x96, 0x00, 0x01,              // Report count (256)
+    0x75, 0x01,                    // Report size (1)
+    0x15, 0x00,                    // Logical minimum (0)
+    0x25, 0x01,                    // Logical maximum (1)
+    0x05, 0x07,                    // Usage page (Keyboard)
+    0x19, 0x00,                    // Usage minimum (Reserved)
+    0x29, 0xff,                    // Usage maximum (Reserved)
+    0x81, 0x02,                    // Input (Data, Variable, Absolute)
+
+    0xc0                           // End Collection
+};
+
+#if HID_KEYBOARD_NKRO
+#define HID_DESCRIPTOR_KEYBOARD hid_descriptor_keyboard_nkro
+#else
+#define HID_DESCRIPTOR_KEYBOARD hid_descriptor_keyboard
+#endif
+
 // 全局 HID 变量
 static uint8_t hid_service_buffer[300];
 static btstack_packet_callback_registration_t hid_hci_event_callback_registration;
@@ -80,55 +164,304 @@ typedef enum {
 
 static app_state_t app_state = APP_BOOTING;
 
+// 当前按下的按键
+static hid_keyboard_keys_t keyboard_keys;
+
+// 按键状态跟踪：仅在按下/释放时发送报告
+static hid_key_tracker_t key_tracker;
+
+// 文本输入使用的键盘布局
+static const hid_keyboard_layout_t * keyboard_layout = &hid_keyboard_layout_us;
+
+// 文本输入：由 HID_SUBEVENT_CAN_SEND_NOW 驱动，输入期间暂停物理按键报告
+static uint8_t          typing_buffer_storage[TYPING_BUFFER_SIZE];
+static hid_text_typer_t typer;
+static bool             typing_active;
+
+#if HID_KEYBOARD_NKRO
+// 上一次发送的 NKRO 报告：修饰键 + 位图
+static uint8_t nkro_report_sent[1 + HID_KEYBOARD_NKRO_BITMAP_SIZE];
+#endif
+
+#if HID_KEYBOARD_NKRO
+// 发送 HID NKRO 报告
+static void send_report_nkro(const uint8_t * report) {
+    uint8_t message[2 + sizeof(nkro_report_sent)];
+    message[0] = 0xa1;
+    message[1] = REPORT_ID;
+    memcpy(&message[2], report, sizeof(nkro_report_sent));
+    hid_device_send_interrupt_message(hid_cid, message, sizeof(message));
+}
+#else
 // 发送 HID 报告
-static void send_report(int modifier, int keycode) {
-    uint8_t message[] = { 0xa1, REPORT_ID, modifier, 0, keycode, 0, 0, 0, 0, 0 };
+static void send_report(uint8_t modifier, const uint8_t * keycodes) {
+    uint8_t message[] = { 0xa1, REPORT_ID, modifier, 0,
+                          keycodes[0], keycodes[1], keycodes[2], keycodes[3], keycodes[4], keycodes[5] };
     hid_device_send_interrupt_message(hid_cid, message, sizeof(message));
 }
+#endif
+
+#ifdef ENABLE_KEY_MATRIX
+// 键盘矩阵 GPIO 和键位表 (HID usage)，请根据电路板调整
+static const gpio_num_t key_matrix_row_gpios[] = { 12, 13, 14, 15 };
+static const gpio_num_t key_matrix_col_gpios[] = { 19, 21, 22, 27 };
+static const uint8_t key_matrix_keymap[4][4] = {
+    { 0x1e, 0x1f, 0x20, 0x04 },    // 1 2 3 A
+    { 0x21, 0x22, 0x23, 0x05 },    // 4 5 6 B
+    { 0x24, 0x25, 0x26, 0x06 },    // 7 8 9 C
+    { 0x55, 0x27, 0x2c, 0x07 },    // * 0 Space D
+};
+#else
+// 按键 GPIO，由 GPIO 中断触发，去抖动后在 run loop 中处理
+static const gpio_num_t button_gpios[] = { BUTTON_GPIO };
+#endif
 
-// 初始化按钮 GPIO
-void button_init() {
-    gpio_reset_pin(BUTTON_GPIO);
-    gpio_set_direction(BUTTON_GPIO, GPIO_MODE_INPUT);
-    gpio_set_pull_mode(BUTTON_GPIO, GPIO_PULLUP_ONLY);
+// 连发定时器
+static btstack_timer_source_t typematic_timer;
+
+// 发送文本输入报告
+static void send_typing_report(uint8_t modifier, const uint8_t * keycodes) {
+#if HID_KEYBOARD_NKRO
+    hid_keyboard_keys_t keys;
+    hid_keyboard_keys_init(&keys);
+    uint8_t i;
+    for (i = 0; i < HID_TEXT_TYPER_NUM_KEYS; i++) {
+        hid_keyboard_keys_set(&keys, keycodes[i], true);
+    }
+    uint8_t report[sizeof(nkro_report_sent)];
+    report[0] = modifier;
+    hid_keyboard_keys_get_nkro(&keys, &report[1]);
+    send_report_nkro(report);
+#else
+    send_report(modifier, keycodes);
+#endif
 }
 
-// 检查按钮是否被按下
-bool button_is_pressed() {
-    return gpio_get_level(BUTTON_GPIO) == 0;
+static void key_report_update(void);
+
+#if !HID_KEYBOARD_NKRO
+static void typematic_timer_handler(btstack_timer_source_t *ts) {
+    UNUSED(ts);
+    key_report_update();
 }
+#endif
 
-// 全局定时器
-static btstack_timer_source_t button_monitor_timer;
+// 仅在状态变化（或连发到期）时发送报告，并安排下一次连发
+static void key_report_update(void) {
+    btstack_run_loop_remove_timer(&typematic_timer);
+    if (app_state != APP_CONNECTED) return;
+    // 文本输入结束后重新发送当前按键状态
+    if (typing_active) return;
+
+#if HID_KEYBOARD_NKRO
+    // NKRO：报告变化时发送，连发由主机处理
+    uint8_t report[sizeof(nkro_report_sent)];
+    report[0] = hid_keyboard_keys_get_nkro(&keyboard_keys, &report[1]);
+    if (memcmp(report, nkro_report_sent, sizeof(nkro_report_sent)) == 0) {
+        key_tracker.reports_suppressed++;
+        return;
+    }
+    memcpy(nkro_report_sent, report, sizeof(nkro_report_sent));
+    key_tracker.reports_sent++;
+    send_report_nkro(report);
+#else
+    uint8_t keycodes[HID_KEYBOARD_6KRO_NUM_KEYS];
+    uint8_t modifier = hid_keyboard_keys_get_6kro(&keyboard_keys, keycodes);
+    hid_key_tracker_set_keys(&key_tracker, modifier, keycodes, HID_KEYBOARD_6KRO_NUM_KEYS);
+
+    uint32_t now_ms = btstack_run_loop_get_time_ms();
+    if (hid_key_tracker_poll(&key_tracker, now_ms)) {
+        send_report(key_tracker.report_modifier, key_tracker.report_keycodes);
+    }
 
-// 按钮监控任务处理器
-static void button_monitor_handler(btstack_timer_source_t *ts) {
-    if (button_is_pressed()) {
-        send_report(0, HID_KEY_Q);
-    } else {
-        send_report(0, 0);
+    uint32_t due_ms;
+    if (hid_key_tracker_get_next_poll_ms(&key_tracker, &due_ms)) {
+        int32_t delay_ms = (int32_t)(due_ms - now_ms);
+        btstack_run_loop_set_timer_handler(&typematic_timer, &typematic_timer_handler);
+        btstack_run_loop_set_timer(&typematic_timer, (delay_ms > 0) ? (uint32_t) delay_ms : 0);
+        btstack_run_loop_add_timer(&typematic_timer);
     }
+#endif
+}
 
-    // 重置定时器间隔为 10ms 后再次调用
-    btstack_run_loop_set_timer(ts, 10);
-    btstack_run_loop_add_timer(ts);
+// 新 HID 连接：主机认为所有按键均已释放
+static void key_report_reset(void) {
+    hid_key_tracker_reset(&key_tracker);
+#if HID_KEYBOARD_NKRO
+    memset(nkro_report_sent, 0, sizeof(nkro_report_sent));
+#endif
 }
 
-// 启动按钮监控定时器
+// 发送下一个文本输入报告，输入完成后恢复物理按键报告
+static void typing_can_send_now(void) {
+    if (typing_active == false) return;
+
+    uint8_t modifier;
+    uint8_t keycodes[HID_TEXT_TYPER_NUM_KEYS];
+    if (hid_text_typer_get_next_report(&typer, btstack_run_loop_get_time_ms(), &modifier, keycodes)) {
+        send_typing_report(modifier, keycodes);
+    }
+    if (hid_text_typer_has_report(&typer)) {
+        hid_device_request_can_send_now_event(hid_cid);
+        return;
+    }
+
+    deferred_log_info("Typing done: %u chars, %u skipped, %u dropped, %u reports (%u release, %u modifier), %u chars/s\n",
+                      (unsigned int) typer.chars_typed, (unsigned int) typer.chars_skipped, (unsigned int) typer.chars_dropped,
+                      (unsigned int) typer.reports_sent, (unsigned int) typer.reports_release, (unsigned int) typer.reports_modifier,
+                      (unsigned int) hid_text_typer_get_chars_per_second(&typer));
+    typing_active = false;
+    hid_text_typer_reset(&typer);
+    // 最后一个报告已释放所有按键
+    key_report_reset();
+    key_report_update();
+}
+
+#ifdef ENABLE_TYPING_DEMO
+static const char * typing_demo_text = "\n\nHello World!\n\nThis is the BTstack HID Keyboard Demo running on an Embedded Device.\n\n";
+
+// 输入文本，缓冲区满时丢弃剩余字符
+static void keyboard_type_text(const char * text) {
+    if (app_state != APP_CONNECTED) return;
+    hid_text_typer_write(&typer, text, (uint32_t) strlen(text));
+    if (typing_active) return;
+    typing_active = true;
+    btstack_run_loop_remove_timer(&typematic_timer);
+    hid_device_request_can_send_now_event(hid_cid);
+}
+#endif
+
+#ifdef ENABLE_KEY_MATRIX
+// 矩阵按键事件处理器
+static void key_matrix_handler(uint8_t row, uint8_t col, bool pressed) {
+    hid_keyboard_keys_set(&keyboard_keys, key_matrix_keymap[row][col], pressed);
+    key_report_update();
+}
+#else
+// 按键事件处理器
+static void button_handler(uint8_t button, bool pressed) {
+    UNUSED(button);
+    hid_keyboard_keys_set(&keyboard_keys, HID_KEY_Q, pressed);
+    key_report_update();
+}
+#endif
+
+// 启动按键输入
 static void start_button_monitor(void) {
-    btstack_run_loop_set_timer_handler(&button_monitor_timer, button_monitor_handler);
-    btstack_run_loop_set_timer(&button_monitor_timer, 10);  // 初始间隔 10ms
-    btstack_run_loop_add_timer(&button_monitor_timer);
+    hid_keyboard_keys_init(&keyboard_keys);
+    hid_key_tracker_init(&key_tracker);
+    hid_key_tracker_set_typematic(&key_tracker, TYPEMATIC_DELAY_MS, TYPEMATIC_PERIOD_MS);
+    hid_text_typer_init(&typer, keyboard_layout, typing_buffer_storage, sizeof(typing_buffer_storage));
+
+#ifdef ENABLE_KEY_MATRIX
+    const key_matrix_hal_t * hal = key_matrix_esp32_get_instance(
+        key_matrix_row_gpios, sizeof(key_matrix_row_gpios) / sizeof(key_matrix_row_gpios[0]),
+        key_matrix_col_gpios, sizeof(key_matrix_col_gpios) / sizeof(key_matrix_col_gpios[0]));
+    key_matrix_init(hal, KEY_MATRIX_SCAN_PERIOD_MS, KEY_MATRIX_DEBOUNCE_SCANS, &key_matrix_handler);
+#else
+    const button_input_hal_t * hal = button_input_esp32_get_instance(button_gpios, sizeof(button_gpios) / sizeof(button_gpios[0]));
+    button_input_init(hal, BUTTON_DEBOUNCE_MS, &button_handler);
+#endif
+}
+
+#ifdef ENABLE_KEYBOARD_LAYOUT_BENCHMARK
+// 测量批量文本的字符 -> 键码查表耗时
+static void keyboard_layout_benchmark(void) {
+    static const char benchmark_text[] = "The quick brown fox jumps over the lazy dog. 0123456789 !@#$%^&*()_+-=[]{};':\",./<>?\n";
+    cycle_stats_t stats;
+    cycle_stats_reset(&stats);
+    uint32_t found = 0;
+    int round;
+    for (round = 0; round < KEYBOARD_LAYOUT_BENCHMARK_ROUNDS; round++) {
+        uint32_t cycles_start = cycle_stats_get_cycles();
+        const char * text;
+        for (text = benchmark_text; *text != 0; text++) {
+            uint8_t keycode;
+            uint8_t modifier;
+            if (hid_keyboard_layout_lookup(keyboard_layout, (uint8_t) *text, &keycode, &modifier)) {
+                found++;
+            }
+        }
+        cycle_stats_add(&stats, cycle_stats_get_cycles() - cycles_start);
+    }
+    uint32_t num_chars = sizeof(benchmark_text) - 1;
+    uint32_t average = cycle_stats_get_average(&stats);
+    printf("Keyboard layout '%s': %u chars, %u found, %u cycles/text avg, %u min, %u max, %u.%02u cycles/char\n",
+           keyboard_layout->name, (unsigned int) num_chars, (unsigned int) (found / KEYBOARD_LAYOUT_BENCHMARK_ROUNDS),
+           (unsigned int) average, (unsigned int) stats.min, (unsigned int) stats.max,
+           (unsigned int) (average / num_chars), (unsigned int) ((average * 100 / num_chars) % 100));
 }
+#endif
 
 // HFP 相关变量和函数
 uint8_t hfp_service_buffer[300];
 const uint8_t rfcomm_channel_nr = 1;
 const char hfp_hf_service_name[] = "HFP HF Demo";
 
-static bd_addr_t device_addr;
-static hci_con_handle_t acl_handle = HCI_CON_HANDLE_INVALID;
+// 多点连接：同时连接两个 AG (手机)，唯一的 SCO 音频通路切换到有通话的 AG
+#define HFP_AG_MAX_CONNECTIONS  2
+
+// 通话状态，数值越大音频优先级越高
+typedef enum {
+    HFP_AG_CALL_NONE = 0,
+    HFP_AG_CALL_HELD,
+    HFP_AG_CALL_SETUP,
+    HFP_AG_CALL_ACTIVE
+} hfp_ag_call_state_t;
+
+static const char * const hfp_ag_call_state_names[] = { "none", "held", "setup", "active" };
+
+typedef struct {
+    hci_con_handle_t    acl_handle;
+    bd_addr_t           addr;
+    // AG 指示器 "call", "callsetup", "callheld"
+    uint8_t             call;
+    uint8_t             callsetup;
+    uint8_t             callheld;
+    hfp_ag_call_state_t call_state;
+    // 进入当前通话状态的顺序，优先级相同时最近的通话优先
+    uint32_t            call_state_sequence;
+} hfp_ag_t;
+
+static hfp_ag_t         hfp_ags[HFP_AG_MAX_CONNECTIONS];
+static uint32_t         hfp_ag_call_state_sequence;
+
+// 当前使用 SCO 音频通路的 AG
+static hfp_ag_t *       hfp_ag_audio;
 static hci_con_handle_t sco_handle = HCI_CON_HANDLE_INVALID;
+static sco_audio_ctx_t * sco_audio_ctx;
+
+// 音频切换：从通话事件到目标 AG 的第一个 SCO 包的延迟
+static hfp_ag_t *       hfp_ag_switch_target;
+static uint32_t         hfp_ag_switch_start_ms;
+static uint32_t         hfp_ag_switches_aborted;
+
+// 切换延迟统计，单位 ms
+typedef struct {
+    uint32_t count;
+    uint32_t min_ms;
+    uint32_t max_ms;
+    uint32_t total_ms;
+} hfp_ag_latency_stats_t;
+
+static hfp_ag_latency_stats_t hfp_ag_switch_latency;
+
+static void hfp_ag_latency_stats_reset(hfp_ag_latency_stats_t * stats) {
+    memset(stats, 0, sizeof(hfp_ag_latency_stats_t));
+    stats->min_ms = UINT32_MAX;
+}
+
+static void hfp_ag_latency_stats_add(hfp_ag_latency_stats_t * stats, uint32_t latency_ms) {
+    stats->count++;
+    stats->total_ms += latency_ms;
+    if (latency_ms < stats->min_ms) stats->min_ms = latency_ms;
+    if (latency_ms > stats->max_ms) stats->max_ms = latency_ms;
+}
+
+static uint32_t hfp_ag_latency_stats_get_average(const hfp_ag_latency_stats_t * stats) {
+    if (stats->count == 0) return 0;
+    return stats->total_ms / stats->count;
+}
 
 static uint8_t codecs[] = {
     HFP_CODEC_CVSD,
@@ -160,6 +493,100 @@ static void dump_supported_codecs(void) {
     }
 }
 
+static hfp_ag_t * hfp_ag_for_acl_handle(hci_con_handle_t acl_handle) {
+    int i;
+    for (i = 0; i < HFP_AG_MAX_CONNECTIONS; i++) {
+        if (hfp_ags[i].acl_handle == acl_handle) return &hfp_ags[i];
+    }
+    return NULL;
+}
+
+// 选择应使用音频通路的 AG：拨号/响铃或通话中且优先级最高，优先级相同时取最近变化者
+static hfp_ag_t * hfp_ag_select_audio(void) {
+    hfp_ag_t * selected = NULL;
+    int i;
+    for (i = 0; i < HFP_AG_MAX_CONNECTIONS; i++) {
+        hfp_ag_t * ag = &hfp_ags[i];
+        if (ag->acl_handle == HCI_CON_HANDLE_INVALID) continue;
+        if (ag->call_state < HFP_AG_CALL_SETUP) continue;
+        if ((selected == NULL) || (ag->call_state > selected->call_state) ||
+            ((ag->call_state == selected->call_state) && ((int32_t)(ag->call_state_sequence - selected->call_state_sequence) > 0))) {
+            selected = ag;
+        }
+    }
+    return selected;
+}
+
+static void hfp_ag_switch_abort(void) {
+    if (hfp_ag_switch_target == NULL) return;
+    hfp_ag_switch_target = NULL;
+    hfp_ag_switches_aborted++;
+}
+
+// 将 SCO 音频通路移到选中的 AG：先释放其他 AG 的音频，释放完成后再建立
+static void hfp_ag_arbitrate(void) {
+    hfp_ag_t * selected = hfp_ag_select_audio();
+    if (selected == NULL) {
+        // 没有通话：保持当前音频，例如语音识别
+        hfp_ag_switch_abort();
+        return;
+    }
+    if (selected == hfp_ag_audio) {
+        if (hfp_ag_switch_target != selected) {
+            hfp_ag_switch_abort();
+        }
+        return;
+    }
+    if (hfp_ag_switch_target != selected) {
+        hfp_ag_switch_abort();
+        hfp_ag_switch_target   = selected;
+        hfp_ag_switch_start_ms = btstack_run_loop_get_time_ms();
+        deferred_log_info("Audio: switching to AG " BD_ADDR_LOG_FORMAT " (call %s)\n", BD_ADDR_LOG_ARGS(selected->addr),
+                          hfp_ag_call_state_names[selected->call_state]);
+    }
+    if (hfp_ag_audio != NULL) {
+        hfp_hf_release_audio_connection(hfp_ag_audio->acl_handle);
+        return;
+    }
+    // 通话接通后主动请求音频，拨号/响铃时由 AG 建立 (带内铃声)
+    if (selected->call_state == HFP_AG_CALL_ACTIVE) {
+        hfp_hf_establish_audio_connection(selected->acl_handle);
+    }
+}
+
+// 根据 AG 指示器更新通话状态
+static void hfp_ag_update_call_state(hfp_ag_t * ag) {
+    hfp_ag_call_state_t call_state;
+    if ((ag->call != 0) && (ag->callheld != 2)) {
+        call_state = HFP_AG_CALL_ACTIVE;
+    } else if (ag->callsetup != 0) {
+        call_state = HFP_AG_CALL_SETUP;
+    } else if (ag->callheld != 0) {
+        call_state = HFP_AG_CALL_HELD;
+    } else {
+        call_state = HFP_AG_CALL_NONE;
+    }
+    if (call_state == ag->call_state) return;
+    ag->call_state = call_state;
+    ag->call_state_sequence = ++hfp_ag_call_state_sequence;
+    deferred_log_info("AG " BD_ADDR_LOG_FORMAT ": call %s\n", BD_ADDR_LOG_ARGS(ag->addr), hfp_ag_call_state_names[call_state]);
+    hfp_ag_arbitrate();
+}
+
+// 收到当前 SCO 连接的数据包：切换完成
+static void hfp_ag_audio_flowing(void) {
+    if ((hfp_ag_switch_target == NULL) || (hfp_ag_switch_target != hfp_ag_audio)) return;
+    hfp_ag_switch_target = NULL;
+    uint32_t latency_ms = btstack_run_loop_get_time_ms() - hfp_ag_switch_start_ms;
+    hfp_ag_latency_stats_add(&hfp_ag_switch_latency, latency_ms);
+    deferred_log_info("Audio: switched to AG " BD_ADDR_LOG_FORMAT " in %u ms\n", BD_ADDR_LOG_ARGS(hfp_ag_audio->addr),
+                      (unsigned int) latency_ms);
+    deferred_log_info("Audio: switch latency min %u, avg %u, max %u ms over %u switches, %u aborted\n",
+                      (unsigned int) hfp_ag_switch_latency.min_ms, (unsigned int) hfp_ag_latency_stats_get_average(&hfp_ag_switch_latency),
+                      (unsigned int) hfp_ag_switch_latency.max_ms, (unsigned int) hfp_ag_switch_latency.count,
+                      (unsigned int) hfp_ag_switches_aborted);
+}
+
 static void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t * event, uint16_t event_size){
     UNUSED(channel);
     bd_addr_t event_addr;
@@ -169,7 +596,8 @@ static void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *
         case HCI_SCO_DATA_PACKET:
             // 處理接收到的 SCO 音頻資料包，並轉發給 SCO 組件
             if (READ_SCO_CONNECTION_HANDLE(event) != sco_handle) break;
-            sco_demo_receive(event, event_size);
+            hfp_ag_audio_flowing();
+            sco_demo_receive(sco_audio_ctx, event, event_size);
             break;
 
         case HCI_EVENT_PACKET:
@@ -182,14 +610,14 @@ static void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *
 
                 case HCI_EVENT_PIN_CODE_REQUEST:
                     // 當收到 PIN 碼請求時，回應 "0000"
-                    printf("Pin code request - using '0000'\n");
+                    deferred_log_info("Pin code request - using '0000'\n");
                     hci_event_pin_code_request_get_bd_addr(event, event_addr);
                     gap_pin_code_response(event_addr, "0000");
                     break;
 
                 case HCI_EVENT_SCO_CAN_SEND_NOW:
                     // 當可以發送 SCO 音頻時，發送數據
-                    sco_demo_send(sco_handle);
+                    sco_demo_send(sco_audio_ctx, sco_handle);
                     break;
 
                 default:
@@ -206,12 +634,15 @@ static void hfp_hf_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t
     UNUSED(channel);
     uint8_t status;
     bd_addr_t event_addr;
+    hfp_ag_t * ag;
+    const char * indicator_name;
 
     switch (packet_type){
         case HCI_SCO_DATA_PACKET:
             // 處理接收到的 SCO 音頻資料包
             if (READ_SCO_CONNECTION_HANDLE(event) != sco_handle) break;
-            sco_demo_receive(event, event_size);
+            hfp_ag_audio_flowing();
+            sco_demo_receive(sco_audio_ctx, event, event_size);
             break;
 
         case HCI_EVENT_PACKET:
@@ -222,13 +653,13 @@ static void hfp_hf_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t
                     break;
 
                 case HCI_EVENT_PIN_CODE_REQUEST:
-                    printf("Pin code request - using '0000'\n");
+                    deferred_log_info("Pin code request - using '0000'\n");
                     hci_event_pin_code_request_get_bd_addr(event, event_addr);
                     gap_pin_code_response(event_addr, "0000");
                     break;
 
                 case HCI_EVENT_SCO_CAN_SEND_NOW:
-                    sco_demo_send(sco_handle);
+                    sco_demo_send(sco_audio_ctx, sco_handle);
                     break;
 
                 case HCI_EVENT_HFP_META:
@@ -236,42 +667,96 @@ static void hfp_hf_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t
                         case HFP_SUBEVENT_SERVICE_LEVEL_CONNECTION_ESTABLISHED:
                             status = hfp_subevent_service_level_connection_established_get_status(event);
                             if (status != ERROR_CODE_SUCCESS){
-                                printf("HFP Connection failed, status 0x%02x\n", status);
+                                deferred_log_error("HFP Connection failed, status 0x%02x\n", status);
+                                break;
+                            }
+                            hfp_subevent_service_level_connection_established_get_bd_addr(event, event_addr);
+                            ag = hfp_ag_for_acl_handle(HCI_CON_HANDLE_INVALID);
+                            if (ag == NULL){
+                                deferred_log_info("HFP Service level connection with " BD_ADDR_LOG_FORMAT " rejected, %u AGs connected.\n",
+                                                  BD_ADDR_LOG_ARGS(event_addr), HFP_AG_MAX_CONNECTIONS);
+                                hfp_hf_release_service_level_connection(hfp_subevent_service_level_connection_established_get_acl_handle(event));
                                 break;
                             }
-                            // HFP 连接建立成功，保存设备地址
-                            hfp_subevent_service_level_connection_established_get_bd_addr(event, device_addr);
-                            printf("HFP Service level connection established with %s.\n", bd_addr_to_str(device_addr));
+                            // HFP 连接建立成功，保存 AG 地址
+                            memset(ag, 0, sizeof(hfp_ag_t));
+                            ag->acl_handle = hfp_subevent_service_level_connection_established_get_acl_handle(event);
+                            bd_addr_copy(ag->addr, event_addr);
+                            deferred_log_info("HFP Service level connection established with " BD_ADDR_LOG_FORMAT ".\n", BD_ADDR_LOG_ARGS(ag->addr));
                             
                             // 这里检查 HID 是否已经连接，如果未连接则启动 HID 连接
                             if (app_state != APP_CONNECTED) {
-                                printf("HID not connected. Initiating HID connection...\n");
-                                hid_device_connect(device_addr, &hid_cid);
+                                deferred_log_info("HID not connected. Initiating HID connection...\n");
+                                hid_device_connect(ag->addr, &hid_cid);
                             }
                             break;
 
                         case HFP_SUBEVENT_SERVICE_LEVEL_CONNECTION_RELEASED:
-                            acl_handle = HCI_CON_HANDLE_INVALID;
-                            printf("HFP Service level connection released.\n\n");
+                            ag = hfp_ag_for_acl_handle(hfp_subevent_service_level_connection_released_get_acl_handle(event));
+                            if (ag == NULL) break;
+                            deferred_log_info("HFP Service level connection with " BD_ADDR_LOG_FORMAT " released.\n\n", BD_ADDR_LOG_ARGS(ag->addr));
+                            if (ag == hfp_ag_audio){
+                                sco_handle = HCI_CON_HANDLE_INVALID;
+                                hfp_ag_audio = NULL;
+                                sco_demo_close(sco_audio_ctx);
+                            }
+                            if (ag == hfp_ag_switch_target){
+                                hfp_ag_switch_abort();
+                            }
+                            ag->acl_handle = HCI_CON_HANDLE_INVALID;
+                            hfp_ag_arbitrate();
                             break;
 
                         case HFP_SUBEVENT_AUDIO_CONNECTION_ESTABLISHED:
                             status = hfp_subevent_audio_connection_established_get_status(event);
                             if (status != ERROR_CODE_SUCCESS){
-                                printf("HFP Audio connection failed with status 0x%02x\n", status);
+                                deferred_log_error("HFP Audio connection failed with status 0x%02x\n", status);
+                                break;
+                            }
+                            ag = hfp_ag_for_acl_handle(hfp_subevent_audio_connection_established_get_acl_handle(event));
+                            if (ag == NULL) break;
+                            // 只有一个音频通路：拒绝其他 AG 的音频连接
+                            if ((hfp_ag_audio != NULL) || ((hfp_ag_switch_target != NULL) && (hfp_ag_switch_target != ag))){
+                                deferred_log_info("HFP Audio connection from " BD_ADDR_LOG_FORMAT " rejected, audio in use by other AG\n", BD_ADDR_LOG_ARGS(ag->addr));
+                                hfp_hf_release_audio_connection(ag->acl_handle);
                                 break;
                             }
+                            hfp_ag_audio = ag;
                             sco_handle = hfp_subevent_audio_connection_established_get_sco_handle(event);
-                            printf("HFP Audio connection established with SCO handle 0x%04x.\n", sco_handle);
+                            deferred_log_info("HFP Audio connection established with " BD_ADDR_LOG_FORMAT ", SCO handle 0x%04x.\n",
+                                              BD_ADDR_LOG_ARGS(ag->addr), sco_handle);
                             negotiated_codec = hfp_subevent_audio_connection_established_get_negotiated_codec(event);
-                            sco_demo_set_codec(negotiated_codec);
+                            sco_demo_set_codec(sco_audio_ctx, negotiated_codec);
                             hci_request_sco_can_send_now_event();
                             break;
 
                         case HFP_SUBEVENT_AUDIO_CONNECTION_RELEASED:
+                            ag = hfp_ag_for_acl_handle(hfp_subevent_audio_connection_released_get_acl_handle(event));
+                            // 被拒绝的音频连接
+                            if ((ag == NULL) || (ag != hfp_ag_audio)) break;
                             sco_handle = HCI_CON_HANDLE_INVALID;
-                            printf("HFP Audio connection released\n");
-                            sco_demo_close();
+                            hfp_ag_audio = NULL;
+                            deferred_log_info("HFP Audio connection released\n");
+                            sco_demo_close(sco_audio_ctx);
+                            // 切换中：为目标 AG 建立音频
+                            hfp_ag_arbitrate();
+                            break;
+
+                        case HFP_SUBEVENT_AG_INDICATOR_STATUS_CHANGED:
+                            ag = hfp_ag_for_acl_handle(hfp_subevent_ag_indicator_status_changed_get_acl_handle(event));
+                            if (ag == NULL) break;
+                            indicator_name = (const char *) hfp_subevent_ag_indicator_status_changed_get_indicator_name(event);
+                            status = hfp_subevent_ag_indicator_status_changed_get_indicator_status(event);
+                            if (strcmp(indicator_name, "call") == 0){
+                                ag->call = status;
+                            } else if ((strcmp(indicator_name, "callsetup") == 0) || (strcmp(indicator_name, "call_setup") == 0)){
+                                ag->callsetup = status;
+                            } else if (strcmp(indicator_name, "callheld") == 0){
+                                ag->callheld = status;
+                            } else {
+                                break;
+                            }
+                            hfp_ag_update_call_state(ag);
                             break;
 
                         default:
@@ -305,20 +790,42 @@ static void hid_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
                     switch (hci_event_hid_meta_get_subevent_code(packet)){
                         case HID_SUBEVENT_CONNECTION_OPENED:
                             if (hid_subevent_connection_opened_get_status(packet) != ERROR_CODE_SUCCESS) {
-                                printf("HID Connection failed.\n");
+                                deferred_log_error("HID Connection failed.\n");
                                 app_state = APP_NOT_CONNECTED;
                                 hid_cid = 0;
                                 return;
                             }
-                            printf("HID Connection established.\n");
+                            deferred_log_info("HID Connection established.\n");
                             app_state = APP_CONNECTED;
                             hid_cid = hid_subevent_connection_opened_get_hid_cid(packet);
+                            // 新连接的主机认为所有按键均已释放
+                            typing_active = false;
+                            hid_text_typer_reset(&typer);
+                            key_report_reset();
+                            key_report_update();
+#ifdef ENABLE_TYPING_DEMO
+                            keyboard_type_text(typing_demo_text);
+#endif
+                            break;
+
+                        case HID_SUBEVENT_CAN_SEND_NOW:
+                            typing_can_send_now();
                             break;
 
                         case HID_SUBEVENT_CONNECTION_CLOSED:
-                            printf("HID Connection closed.\n");
+                            deferred_log_info("HID Connection closed.\n");
+                            deferred_log_info("HID reports: %u sent, %u suppressed\n",
+                                              (unsigned int) key_tracker.reports_sent, (unsigned int) key_tracker.reports_suppressed);
+#ifdef ENABLE_KEY_MATRIX
+                            deferred_log_info("Key matrix scan: avg %u, max %u cycles\n",
+                                              (unsigned int) cycle_stats_get_average(key_matrix_get_scan_cycles()),
+                                              (unsigned int) key_matrix_get_scan_cycles()->max);
+#endif
                             app_state = APP_NOT_CONNECTED;
                             hid_cid = 0;
+                            typing_active = false;
+                            hid_text_typer_reset(&typer);
+                            key_report_update();
                             break;
 
                         default:
@@ -342,8 +849,8 @@ int btstack_main(int argc, const char * argv[]){
     (void)argc;
     (void)argv;
 
-    // 初始化按鈕並創建監控任務
-    button_init();
+    // 事件日志由后台任务输出
+    deferred_log_init();
 
     // 初始化基本协议栈
     l2cap_init(); 
@@ -363,8 +870,11 @@ int btstack_main(int argc, const char * argv[]){
         (1<<HFP_HFSF_VOICE_RECOGNITION_FUNCTION) |
         (1<<HFP_HFSF_ENHANCED_VOICE_RECOGNITION_STATUS) |
         (1<<HFP_HFSF_VOICE_RECOGNITION_TEXT) |
-        (1<<HFP_HFSF_EC_NR_FUNCTION) |
         (1<<HFP_HFSF_REMOTE_VOLUME_CONTROL);
+    // 回声消除由 sco_demo_util 提供
+    if (sco_demo_echo_cancel_supported()){
+        hf_supported_features |= (1<<HFP_HFSF_EC_NR_FUNCTION);
+    }
 
     // 初始化 HFP HF 服务
     hfp_hf_init(rfcomm_channel_nr);
@@ -389,13 +899,13 @@ int btstack_main(int argc, const char * argv[]){
         1, 1,
         0,
         0, 0, 3200,
-        hid_descriptor_keyboard,
-        sizeof(hid_descriptor_keyboard),
+        HID_DESCRIPTOR_KEYBOARD,
+        sizeof(HID_DESCRIPTOR_KEYBOARD),
         hid_service_name
     };
     hid_create_sdp_record(hid_service_buffer, sdp_create_service_record_handle(), &hid_params);
     sdp_register_service(hid_service_buffer);
-    hid_device_init(0, sizeof(hid_descriptor_keyboard), hid_descriptor_keyboard);
+    hid_device_init(0, sizeof(HID_DESCRIPTOR_KEYBOARD), HID_DESCRIPTOR_KEYBOARD);
 
     // 注册 HID 事件处理程序
     hid_hci_event_callback_registration.callback = &hid_packet_handler;  
@@ -409,10 +919,20 @@ int btstack_main(int argc, const char * argv[]){
 
     // 初始化 SCO / HFP 音频处理
     sco_demo_init();
+    sco_audio_ctx = sco_demo_create_context();
+    int i;
+    for (i = 0; i < HFP_AG_MAX_CONNECTIONS; i++) {
+        hfp_ags[i].acl_handle = HCI_CON_HANDLE_INVALID;
+    }
+    hfp_ag_latency_stats_reset(&hfp_ag_switch_latency);
 
     // 启动按键监控
     start_button_monitor();
 
+#ifdef ENABLE_KEYBOARD_LAYOUT_BENCHMARK
+    keyboard_layout_benchmark();
+#endif
+
     // 配置 GAP 参数
     gap_set_local_name("HFP HF Demo 00:00:00:00:00:00");
     gap_discoverable_control(1);
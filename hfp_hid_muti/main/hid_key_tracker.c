@@ -0,0 +1,89 @@
+/*
+ * hid_key_tracker.c - send HID keyboard reports only on key state changes, with optional typematic repeat
+ */
+
+#include <string.h>
+
+#include "hid_key_tracker.h"
+
+static bool hid_key_tracker_report_pending(const hid_key_tracker_t * tracker){
+    if (tracker->modifier != tracker->report_modifier) return true;
+    return memcmp(tracker->keycodes, tracker->report_keycodes, HID_KEY_TRACKER_NUM_KEYS) != 0;
+}
+
+static bool hid_key_tracker_keys_held(const hid_key_tracker_t * tracker){
+    if (tracker->modifier != 0) return true;
+    int i;
+    for (i = 0; i < HID_KEY_TRACKER_NUM_KEYS; i++){
+        if (tracker->keycodes[i] != 0) return true;
+    }
+    return false;
+}
+
+void hid_key_tracker_init(hid_key_tracker_t * tracker){
+    memset(tracker, 0, sizeof(hid_key_tracker_t));
+}
+
+void hid_key_tracker_set_typematic(hid_key_tracker_t * tracker, uint16_t delay_ms, uint16_t period_ms){
+    tracker->repeat_delay_ms  = delay_ms;
+    tracker->repeat_period_ms = period_ms;
+}
+
+void hid_key_tracker_reset(hid_key_tracker_t * tracker){
+    tracker->report_modifier = 0;
+    memset(tracker->report_keycodes, 0, HID_KEY_TRACKER_NUM_KEYS);
+    tracker->repeat_released = false;
+}
+
+void hid_key_tracker_set_keys(hid_key_tracker_t * tracker, uint8_t modifier, const uint8_t * keycodes, uint8_t num_keycodes){
+    tracker->modifier = modifier;
+    memset(tracker->keycodes, 0, HID_KEY_TRACKER_NUM_KEYS);
+    // keep keys packed at the start of the array, so the same key set always gives the same report
+    uint8_t pos = 0;
+    uint8_t i;
+    for (i = 0; i < num_keycodes && pos < HID_KEY_TRACKER_NUM_KEYS; i++){
+        if (keycodes[i] == 0) continue;
+        tracker->keycodes[pos++] = keycodes[i];
+    }
+}
+
+bool hid_key_tracker_poll(hid_key_tracker_t * tracker, uint32_t now_ms){
+
+    // press / release edge, or key press following a typematic release
+    if (hid_key_tracker_report_pending(tracker)){
+        if (tracker->repeat_released){
+            tracker->repeat_released = false;
+            tracker->repeat_due_ms = now_ms + tracker->repeat_period_ms;
+        } else {
+            tracker->repeat_due_ms = now_ms + tracker->repeat_delay_ms;
+        }
+        tracker->report_modifier = tracker->modifier;
+        memcpy(tracker->report_keycodes, tracker->keycodes, HID_KEY_TRACKER_NUM_KEYS);
+        tracker->reports_sent++;
+        return true;
+    }
+
+    tracker->repeat_released = false;
+
+    // typematic: release held keys, they get pressed again on next poll
+    if ((tracker->repeat_period_ms != 0) && hid_key_tracker_keys_held(tracker) && ((int32_t)(now_ms - tracker->repeat_due_ms) >= 0)){
+        tracker->report_modifier = tracker->modifier;
+        memset(tracker->report_keycodes, 0, HID_KEY_TRACKER_NUM_KEYS);
+        tracker->repeat_released = true;
+        tracker->reports_sent++;
+        return true;
+    }
+
+    tracker->reports_suppressed++;
+    return false;
+}
+
+bool hid_key_tracker_get_next_poll_ms(const hid_key_tracker_t * tracker, uint32_t * due_ms){
+    // after typematic release, repeat_due_ms has already passed and the key gets pressed again right away
+    if (!tracker->repeat_released){
+        if (tracker->repeat_period_ms == 0) return false;
+        if (!hid_key_tracker_keys_held(tracker)) return false;
+    }
+    *due_ms = tracker->repeat_due_ms;
+    return true;
+}
@@ -0,0 +1,86 @@
+/*
+ * hid_key_tracker.h - send HID keyboard reports only on key state changes, with optional typematic repeat
+ */
+
+#ifndef HID_KEY_TRACKER_H
+#define HID_KEY_TRACKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#define HID_KEY_TRACKER_NUM_KEYS 6
+
+typedef struct {
+    // requested key state
+    uint8_t  modifier;
+    uint8_t  keycodes[HID_KEY_TRACKER_NUM_KEYS];
+
+    // key state of last report, valid after hid_key_tracker_poll returned true
+    uint8_t  report_modifier;
+    uint8_t  report_keycodes[HID_KEY_TRACKER_NUM_KEYS];
+
+    // typematic repeat, disabled if repeat_period_ms == 0
+    uint16_t repeat_delay_ms;
+    uint16_t repeat_period_ms;
+    uint32_t repeat_due_ms;
+    bool     repeat_released;
+
+    // statistics
+    uint32_t reports_sent;
+    uint32_t reports_suppressed;
+} hid_key_tracker_t;
+
+/**
+ * @brief Init tracker with all keys released and typematic repeat disabled
+ * @param tracker
+ */
+void hid_key_tracker_init(hid_key_tracker_t * tracker);
+
+/**
+ * @brief Enable typematic repeat: held keys get released and pressed again every period after initial delay
+ * @param tracker
+ * @param delay_ms
+ * @param period_ms or 0 to disable
+ */
+void hid_key_tracker_set_typematic(hid_key_tracker_t * tracker, uint16_t delay_ms, uint16_t period_ms);
+
+/**
+ * @brief Forget last reported state, e.g. after new HID connection. Host assumes all keys released.
+ * @param tracker
+ */
+void hid_key_tracker_reset(hid_key_tracker_t * tracker);
+
+/**
+ * @brief Set current key state
+ * @param tracker
+ * @param modifier
+ * @param keycodes pressed keys, 0 entries are ignored
+ * @param num_keycodes max HID_KEY_TRACKER_NUM_KEYS
+ */
+void hid_key_tracker_set_keys(hid_key_tracker_t * tracker, uint8_t modifier, const uint8_t * keycodes, uint8_t num_keycodes);
+
+/**
+ * @brief Check if report needs to be sent. Counts sent or suppressed report.
+ * @param tracker
+ * @param now_ms
+ * @return true if report_modifier/report_keycodes should be sent now
+ */
+bool hid_key_tracker_poll(hid_key_tracker_t * tracker, uint32_t now_ms);
+
+/**
+ * @brief Get time of next typematic event for event driven callers
+ * @param tracker
+ * @param due_ms
+ * @return true if hid_key_tracker_poll needs to be called at due_ms
+ */
+bool hid_key_tracker_get_next_poll_ms(const hid_key_tracker_t * tracker, uint32_t * due_ms);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * hid_keyboard_layout.c - character to HID keycode + modifier lookup for keyboard layouts
+ *
+ * Maps are built by the compiler with designated initializers, unlisted characters stay 0.
+ * If a character is available on several keys, the lowest keycode without modifier wins,
+ * same as the linear search through keytable_us_none / keytable_us_shift did before.
+ */
+
+#include "hid_keyboard_layout.h"
+
+#define KEY(character, keycode)         [(uint8_t) (character)] = { (keycode), 0 }
+#define SHIFT(character, keycode)       [(uint8_t) (character)] = { (keycode), HID_KEYBOARD_MODIFIER_LEFT_SHIFT }
+
+#define CHAR_RETURN     '\n'
+#define CHAR_ESCAPE      27
+#define CHAR_TAB         '\t'
+#define CHAR_BACKSPACE   0x7f
+
+const hid_keyboard_layout_t hid_keyboard_layout_us = {
+    .name = "us",
+    .keys = {
+        KEY('a', 0x04), KEY('b', 0x05), KEY('c', 0x06), KEY('d', 0x07), KEY('e', 0x08),
+        KEY('f', 0x09), KEY('g', 0x0a), KEY('h', 0x0b), KEY('i', 0x0c), KEY('j', 0x0d),
+        KEY('k', 0x0e), KEY('l', 0x0f), KEY('m', 0x10), KEY('n', 0x11), KEY('o', 0x12),
+        KEY('p', 0x13), KEY('q', 0x14), KEY('r', 0x15), KEY('s', 0x16), KEY('t', 0x17),
+        KEY('u', 0x18), KEY('v', 0x19), KEY('w', 0x1a), KEY('x', 0x1b), KEY('y', 0x1c),
+        KEY('z', 0x1d),
+
+        SHIFT('A', 0x04), SHIFT('B', 0x05), SHIFT('C', 0x06), SHIFT('D', 0x07), SHIFT('E', 0x08),
+        SHIFT('F', 0x09), SHIFT('G', 0x0a), SHIFT('H', 0x0b), SHIFT('I', 0x0c), SHIFT('J', 0x0d),
+        SHIFT('K', 0x0e), SHIFT('L', 0x0f), SHIFT('M', 0x10), SHIFT('N', 0x11), SHIFT('O', 0x12),
+        SHIFT('P', 0x13), SHIFT('Q', 0x14), SHIFT('R', 0x15), SHIFT('S', 0x16), SHIFT('T', 0x17),
+        SHIFT('U', 0x18), SHIFT('V', 0x19), SHIFT('W', 0x1a), SHIFT('X', 0x1b), SHIFT('Y', 0x1c),
+        SHIFT('Z', 0x1d),
+
+        KEY('1', 0x1e), KEY('2', 0x1f), KEY('3', 0x20), KEY('4', 0x21), KEY('5', 0x22),
+        KEY('6', 0x23), KEY('7', 0x24), KEY('8', 0x25), KEY('9', 0x26), KEY('0', 0x27),
+
+        SHIFT('!', 0x1e), SHIFT('@', 0x1f), SHIFT('#', 0x20), SHIFT('$', 0x21), SHIFT('%', 0x22),
+        SHIFT('^', 0x23), SHIFT('&', 0x24),                   SHIFT('(', 0x26), SHIFT(')', 0x27),
+
+        KEY(CHAR_RETURN, 0x28), KEY(CHAR_ESCAPE, 0x29), KEY(CHAR_BACKSPACE, 0x2a), KEY(CHAR_TAB, 0x2b),
+        KEY(' ', 0x2c),
+
+        KEY('-',  0x2d), KEY('=', 0x2e), KEY('[', 0x2f), KEY(']', 0x30), KEY('\\', 0x31),
+        KEY(';',  0x33), KEY('\'', 0x34), KEY('`', 0x35), KEY(',', 0x36), KEY('.', 0x37),
+        KEY('/',  0x38),
+
+        SHIFT('_', 0x2d),                   SHIFT('{', 0x2f), SHIFT('}', 0x30), SHIFT('|', 0x31),
+        SHIFT(':', 0x33), SHIFT('"', 0x34), SHIFT('~', 0x35), SHIFT('<', 0x36), SHIFT('>', 0x37),
+        SHIFT('?', 0x38),
+
+        // keypad, only for characters not found on the main keys
+        KEY('*', 0x55), KEY('+', 0x57),
+
+        // non-US backslash key
+        KEY(0xa7, 0x64), SHIFT(0xb1, 0x64),
+    },
+};
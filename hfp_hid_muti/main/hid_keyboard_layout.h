@@ -0,0 +1,58 @@
+/*
+ * hid_keyboard_layout.h - character to HID keycode + modifier lookup for keyboard layouts
+ *
+ * Each layout provides a reverse map with one entry per 8-bit character, so a lookup is a single
+ * table access instead of a search through the keycode tables.
+ */
+
+#ifndef HID_KEYBOARD_LAYOUT_H
+#define HID_KEYBOARD_LAYOUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#define HID_KEYBOARD_LAYOUT_NUM_CHARACTERS  256
+
+#define HID_KEYBOARD_MODIFIER_LEFT_SHIFT    0x02
+
+typedef struct {
+    // keycode 0 = character not available in this layout
+    uint8_t keycode;
+    uint8_t modifier;
+} hid_keyboard_layout_key_t;
+
+typedef struct {
+    const char * name;
+    hid_keyboard_layout_key_t keys[HID_KEYBOARD_LAYOUT_NUM_CHARACTERS];
+} hid_keyboard_layout_t;
+
+/**
+ * English (US)
+ */
+extern const hid_keyboard_layout_t hid_keyboard_layout_us;
+
+/**
+ * @brief Get keycode and modifier for character
+ * @param layout
+ * @param character
+ * @param keycode
+ * @param modifier
+ * @return true if character can be typed with this layout
+ */
+static inline bool hid_keyboard_layout_lookup(const hid_keyboard_layout_t * layout, uint8_t character, uint8_t * keycode, uint8_t * modifier){
+    const hid_keyboard_layout_key_t * key = &layout->keys[character];
+    if (key->keycode == 0) return false;
+    *keycode  = key->keycode;
+    *modifier = key->modifier;
+    return true;
+}
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
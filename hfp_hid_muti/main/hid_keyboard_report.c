@@ -0,0 +1,64 @@
+/*
+ * hid_keyboard_report.c - set of pressed keys and builders for 6KRO boot-style and NKRO bitmap reports
+ */
+
+#include <string.h>
+
+#include "hid_keyboard_report.h"
+
+void hid_keyboard_keys_init(hid_keyboard_keys_t * keys){
+    memset(keys, 0, sizeof(hid_keyboard_keys_t));
+}
+
+void hid_keyboard_keys_set(hid_keyboard_keys_t * keys, uint8_t usage, bool pressed){
+    if ((usage >= HID_USAGE_LEFT_CONTROL) && (usage <= HID_USAGE_RIGHT_GUI)){
+        uint8_t mask = 1 << (usage - HID_USAGE_LEFT_CONTROL);
+        if (pressed){
+            keys->modifier |= mask;
+        } else {
+            keys->modifier &= ~mask;
+        }
+        return;
+    }
+    // usage 0 means 'no key'
+    if (usage == 0) return;
+
+    uint32_t mask = 1u << (usage & 31);
+    uint32_t * word = &keys->keys[usage >> 5];
+    bool was_pressed = (*word & mask) != 0;
+    if (pressed == was_pressed) return;
+    if (pressed){
+        *word |= mask;
+        keys->num_keys++;
+    } else {
+        *word &= ~mask;
+        keys->num_keys--;
+    }
+}
+
+uint8_t hid_keyboard_keys_get_6kro(const hid_keyboard_keys_t * keys, uint8_t * keycodes){
+    if (keys->num_keys > HID_KEYBOARD_6KRO_NUM_KEYS){
+        memset(keycodes, HID_USAGE_ERROR_ROLL_OVER, HID_KEYBOARD_6KRO_NUM_KEYS);
+        return keys->modifier;
+    }
+    memset(keycodes, 0, HID_KEYBOARD_6KRO_NUM_KEYS);
+    uint8_t pos = 0;
+    uint8_t index;
+    for (index = 0; (index < 8) && (pos < keys->num_keys); index++){
+        uint32_t word = keys->keys[index];
+        while (word != 0){
+            uint8_t bit = (uint8_t) __builtin_ctz(word);
+            keycodes[pos++] = (uint8_t) ((index << 5) | bit);
+            word &= word - 1;
+        }
+    }
+    return keys->modifier;
+}
+
+uint8_t hid_keyboard_keys_get_nkro(const hid_keyboard_keys_t * keys, uint8_t * bitmap){
+    uint8_t i;
+    for (i = 0; i < HID_KEYBOARD_NKRO_BITMAP_SIZE; i++){
+        bitmap[i] = (uint8_t) (keys->keys[i >> 2] >> ((i & 3) * 8));
+    }
+    return keys->modifier;
+}
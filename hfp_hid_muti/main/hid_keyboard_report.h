@@ -0,0 +1,66 @@
+/*
+ * hid_keyboard_report.h - set of pressed keys and builders for 6KRO boot-style and NKRO bitmap reports
+ */
+
+#ifndef HID_KEYBOARD_REPORT_H
+#define HID_KEYBOARD_REPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#define HID_KEYBOARD_6KRO_NUM_KEYS      6
+
+// keyboard usages covered by NKRO bitmap: 0x00..0xff, modifiers 0xe0..0xe7 go into modifier byte and stay 0 in bitmap
+#define HID_KEYBOARD_NKRO_NUM_USAGES    256
+#define HID_KEYBOARD_NKRO_BITMAP_SIZE   (HID_KEYBOARD_NKRO_NUM_USAGES / 8)
+
+#define HID_USAGE_ERROR_ROLL_OVER       0x01
+#define HID_USAGE_LEFT_CONTROL          0xe0
+#define HID_USAGE_RIGHT_GUI             0xe7
+
+typedef struct {
+    uint8_t  modifier;
+    uint8_t  num_keys;
+    // pressed non-modifier keys by usage, 256 bits
+    uint32_t keys[8];
+} hid_keyboard_keys_t;
+
+/**
+ * @brief Init with all keys released
+ * @param keys
+ */
+void hid_keyboard_keys_init(hid_keyboard_keys_t * keys);
+
+/**
+ * @brief Update key by HID usage, modifier usages 0xe0..0xe7 update modifier byte
+ * @param keys
+ * @param usage
+ * @param pressed
+ */
+void hid_keyboard_keys_set(hid_keyboard_keys_t * keys, uint8_t usage, bool pressed);
+
+/**
+ * @brief Build 6KRO key array. If more than 6 keys are pressed, all slots report ErrorRollOver
+ * @param keys
+ * @param keycodes array of HID_KEYBOARD_6KRO_NUM_KEYS
+ * @return modifier byte
+ */
+uint8_t hid_keyboard_keys_get_6kro(const hid_keyboard_keys_t * keys, uint8_t * keycodes);
+
+/**
+ * @brief Build NKRO bitmap for usages 0x00..0xff
+ * @param keys
+ * @param bitmap array of HID_KEYBOARD_NKRO_BITMAP_SIZE
+ * @return modifier byte
+ */
+uint8_t hid_keyboard_keys_get_nkro(const hid_keyboard_keys_t * keys, uint8_t * bitmap);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
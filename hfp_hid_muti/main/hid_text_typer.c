@@ -0,0 +1,145 @@
+/*
+ * hid_text_typer.c - type buffered text as HID keyboard reports, paced by the HID can-send-now events
+ */
+
+#include <string.h>
+
+#include "hid_text_typer.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+static uint8_t hid_text_typer_peek(const hid_text_typer_t * typer, uint32_t offset){
+    uint32_t pos = typer->read_pos + offset;
+    if (pos >= typer->size){
+        pos -= typer->size;
+    }
+    return typer->buffer[pos];
+}
+
+static void hid_text_typer_consume(hid_text_typer_t * typer, uint32_t num_chars){
+    typer->read_pos += num_chars;
+    if (typer->read_pos >= typer->size){
+        typer->read_pos -= typer->size;
+    }
+    typer->fill -= num_chars;
+}
+
+static bool hid_text_typer_contains(const uint8_t * keycodes, uint8_t num_keys, uint8_t keycode){
+    uint8_t i;
+    for (i = 0; i < num_keys; i++){
+        if (keycodes[i] == keycode) return true;
+    }
+    return false;
+}
+
+// skip characters not available in layout, return false if no character left
+static bool hid_text_typer_lookup_next(hid_text_typer_t * typer, uint8_t * keycode, uint8_t * modifier){
+    while (typer->fill > 0){
+        if (hid_keyboard_layout_lookup(typer->layout, hid_text_typer_peek(typer, 0), keycode, modifier)) return true;
+        hid_text_typer_consume(typer, 1);
+        typer->chars_skipped++;
+    }
+    return false;
+}
+
+void hid_text_typer_init(hid_text_typer_t * typer, const hid_keyboard_layout_t * layout, uint8_t * buffer, uint32_t size){
+    memset(typer, 0, sizeof(hid_text_typer_t));
+    typer->layout = layout;
+    typer->buffer = buffer;
+    typer->size   = size;
+    typer->max_keys_per_report = HID_TEXT_TYPER_NUM_KEYS;
+}
+
+void hid_text_typer_set_max_keys_per_report(hid_text_typer_t * typer, uint8_t max_keys_per_report){
+    btstack_assert((max_keys_per_report > 0) && (max_keys_per_report <= HID_TEXT_TYPER_NUM_KEYS));
+    typer->max_keys_per_report = max_keys_per_report;
+}
+
+void hid_text_typer_reset(hid_text_typer_t * typer){
+    typer->read_pos = 0;
+    typer->fill     = 0;
+    typer->report_modifier = 0;
+    typer->report_num_keys = 0;
+    typer->chars_typed      = 0;
+    typer->chars_skipped    = 0;
+    typer->chars_dropped    = 0;
+    typer->reports_sent     = 0;
+    typer->reports_release  = 0;
+    typer->reports_modifier = 0;
+}
+
+uint32_t hid_text_typer_write(hid_text_typer_t * typer, const char * text, uint32_t len){
+    uint32_t num_chars = btstack_min(len, hid_text_typer_get_free(typer));
+    uint32_t write_pos = typer->read_pos + typer->fill;
+    if (write_pos >= typer->size){
+        write_pos -= typer->size;
+    }
+    // copy in up to two chunks
+    uint32_t first_chunk = btstack_min(num_chars, typer->size - write_pos);
+    memcpy(&typer->buffer[write_pos], text, first_chunk);
+    memcpy(typer->buffer, &text[first_chunk], num_chars - first_chunk);
+    typer->fill += num_chars;
+    typer->chars_dropped += len - num_chars;
+    return num_chars;
+}
+
+uint32_t hid_text_typer_get_free(const hid_text_typer_t * typer){
+    return typer->size - typer->fill;
+}
+
+bool hid_text_typer_has_report(const hid_text_typer_t * typer){
+    if (typer->fill > 0) return true;
+    return (typer->report_num_keys > 0) || (typer->report_modifier != 0);
+}
+
+bool hid_text_typer_get_next_report(hid_text_typer_t * typer, uint32_t now_ms, uint8_t * modifier, uint8_t * keycodes){
+    if (hid_text_typer_has_report(typer) == false) return false;
+
+    uint8_t keycode;
+    uint8_t next_modifier = 0;
+    uint8_t num_keys = 0;
+    memset(keycodes, 0, HID_TEXT_TYPER_NUM_KEYS);
+
+    if (hid_text_typer_lookup_next(typer, &keycode, &next_modifier) == false){
+        // text done: release everything
+        typer->reports_release++;
+    } else if (hid_text_typer_contains(typer->report_keycodes, typer->report_num_keys, keycode)){
+        // key still pressed: release all keys, modifier can change at the same time
+        typer->reports_release++;
+    } else if (next_modifier != typer->report_modifier){
+        // change modifier before pressing keys that depend on it
+        typer->reports_modifier++;
+    } else {
+        // press as many new keys as possible
+        do {
+            keycodes[num_keys++] = keycode;
+            hid_text_typer_consume(typer, 1);
+            if (num_keys == typer->max_keys_per_report) break;
+            uint8_t key_modifier;
+            if (hid_text_typer_lookup_next(typer, &keycode, &key_modifier) == false) break;
+            if (key_modifier != next_modifier) break;
+            if (hid_text_typer_contains(keycodes, num_keys, keycode)) break;
+            if (hid_text_typer_contains(typer->report_keycodes, typer->report_num_keys, keycode)) break;
+        } while (true);
+        typer->chars_typed += num_keys;
+    }
+
+    typer->report_modifier = next_modifier;
+    typer->report_num_keys = num_keys;
+    memcpy(typer->report_keycodes, keycodes, HID_TEXT_TYPER_NUM_KEYS);
+    *modifier = next_modifier;
+
+    if (typer->reports_sent == 0){
+        typer->first_report_ms = now_ms;
+    }
+    typer->last_report_ms = now_ms;
+    typer->reports_sent++;
+    return true;
+}
+
+uint32_t hid_text_typer_get_chars_per_second(const hid_text_typer_t * typer){
+    uint32_t duration_ms = typer->last_report_ms - typer->first_report_ms;
+    if (duration_ms == 0) return 0;
+    return (uint32_t) (((uint64_t) typer->chars_typed * 1000) / duration_ms);
+}
@@ -0,0 +1,115 @@
+/*
+ * hid_text_typer.h - type buffered text as HID keyboard reports, paced by the HID can-send-now events
+ *
+ * Consecutive characters with the same modifier and distinct keys are pressed together in one report,
+ * hosts handle newly pressed keys in array order. All keys are released only if the next character
+ * needs a key that is still pressed, and a modifier change gets its own report before the next keys.
+ */
+
+#ifndef HID_TEXT_TYPER_H
+#define HID_TEXT_TYPER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hid_keyboard_layout.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#define HID_TEXT_TYPER_NUM_KEYS 6
+
+typedef struct {
+    const hid_keyboard_layout_t * layout;
+    uint8_t  max_keys_per_report;
+
+    // text ring buffer
+    uint8_t * buffer;
+    uint32_t  size;
+    uint32_t  read_pos;
+    uint32_t  fill;
+
+    // key state of last report
+    uint8_t  report_modifier;
+    uint8_t  report_num_keys;
+    uint8_t  report_keycodes[HID_TEXT_TYPER_NUM_KEYS];
+
+    // statistics
+    uint32_t chars_typed;
+    uint32_t chars_skipped;
+    uint32_t chars_dropped;
+    uint32_t reports_sent;
+    uint32_t reports_release;
+    uint32_t reports_modifier;
+    uint32_t first_report_ms;
+    uint32_t last_report_ms;
+} hid_text_typer_t;
+
+/**
+ * @brief Init typer with empty text buffer and all keys released
+ * @param typer
+ * @param layout used to map characters to keycode and modifier
+ * @param buffer storage for text, needs to stay valid
+ * @param size of buffer
+ */
+void hid_text_typer_init(hid_text_typer_t * typer, const hid_keyboard_layout_t * layout, uint8_t * buffer, uint32_t size);
+
+/**
+ * @brief Limit number of keys pressed per report, e.g. 1 for hosts that don't keep the array order
+ * @param typer
+ * @param max_keys_per_report 1..HID_TEXT_TYPER_NUM_KEYS, default HID_TEXT_TYPER_NUM_KEYS
+ */
+void hid_text_typer_set_max_keys_per_report(hid_text_typer_t * typer, uint8_t max_keys_per_report);
+
+/**
+ * @brief Drop queued text and forget last report, e.g. after new HID connection. Host assumes all keys released.
+ * @param typer
+ */
+void hid_text_typer_reset(hid_text_typer_t * typer);
+
+/**
+ * @brief Queue text, characters not available in the layout are skipped when typed
+ * @param typer
+ * @param text
+ * @param len
+ * @return number of characters queued, less than len if buffer is full
+ */
+uint32_t hid_text_typer_write(hid_text_typer_t * typer, const char * text, uint32_t len);
+
+/**
+ * @brief Get free space in text buffer
+ * @param typer
+ * @return number of characters
+ */
+uint32_t hid_text_typer_get_free(const hid_text_typer_t * typer);
+
+/**
+ * @brief Check if text is queued or keys still need to be released
+ * @param typer
+ * @return true if hid_text_typer_get_next_report will provide a report
+ */
+bool hid_text_typer_has_report(const hid_text_typer_t * typer);
+
+/**
+ * @brief Get next report, to be sent on HID_SUBEVENT_CAN_SEND_NOW
+ * @param typer
+ * @param now_ms for chars/s statistics
+ * @param modifier
+ * @param keycodes array of HID_TEXT_TYPER_NUM_KEYS
+ * @return true if report was provided
+ */
+bool hid_text_typer_get_next_report(hid_text_typer_t * typer, uint32_t now_ms, uint8_t * modifier, uint8_t * keycodes);
+
+/**
+ * @brief Get typing rate between first and last report since init/reset
+ * @param typer
+ * @return characters per second
+ */
+uint32_t hid_text_typer_get_chars_per_second(const hid_text_typer_t * typer);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
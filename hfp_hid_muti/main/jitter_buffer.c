@@ -0,0 +1,194 @@
+/*
+ * jitter_buffer.c - adaptive playout buffer for received audio on top of a sample ring buffer
+ */
+
+#include <string.h>
+
+#include "jitter_buffer.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+// arrival spread is measured over two windows of this length
+#define JITTER_BUFFER_WINDOW_MS             2000
+
+// while above target, drop one sample every interval
+#define JITTER_BUFFER_DROP_INTERVAL         128
+
+#define JITTER_BUFFER_GAIN_ONE              (1u << 16)
+
+static uint32_t jitter_buffer_samples_for_ms(const jitter_buffer_t * jitter_buffer, uint32_t ms){
+    return ms * jitter_buffer->sample_rate / 1000;
+}
+
+void jitter_buffer_init(jitter_buffer_t * jitter_buffer, sample_ring_buffer_t * ring, uint32_t sample_rate, uint16_t min_ms, uint16_t max_ms){
+    btstack_assert(min_ms <= max_ms);
+    memset(jitter_buffer, 0, sizeof(jitter_buffer_t));
+    jitter_buffer->ring           = ring;
+    jitter_buffer->sample_rate    = sample_rate;
+    jitter_buffer->min_samples    = jitter_buffer_samples_for_ms(jitter_buffer, min_ms);
+    jitter_buffer->max_samples    = jitter_buffer_samples_for_ms(jitter_buffer, max_ms);
+    jitter_buffer->window_us      = JITTER_BUFFER_WINDOW_MS * 1000;
+    atomic_store_explicit(&jitter_buffer->target_samples, jitter_buffer->min_samples, memory_order_relaxed);
+    jitter_buffer->last_write_pos = sample_ring_buffer_get_write_pos(ring);
+    jitter_buffer->drop_countdown = JITTER_BUFFER_DROP_INTERVAL;
+    asrc_init(&jitter_buffer->asrc);
+
+    jitter_buffer->conceal_period = (uint16_t) jitter_buffer_samples_for_ms(jitter_buffer, JITTER_BUFFER_CONCEAL_PERIOD_MS);
+    btstack_assert(jitter_buffer->conceal_period <= JITTER_BUFFER_CONCEAL_HISTORY_MAX);
+    jitter_buffer->conceal_gain_step = JITTER_BUFFER_GAIN_ONE / jitter_buffer_samples_for_ms(jitter_buffer, JITTER_BUFFER_CONCEAL_FADE_MS);
+}
+
+void jitter_buffer_packet_received(jitter_buffer_t * jitter_buffer, uint32_t now_us){
+    // samples written since last packet, e.g. 0 for mSBC packets that don't complete a frame
+    sample_ring_buffer_t * ring = jitter_buffer->ring;
+    uint32_t write_pos = sample_ring_buffer_get_write_pos(ring);
+    uint32_t num_samples = (write_pos >= jitter_buffer->last_write_pos) ? (write_pos - jitter_buffer->last_write_pos)
+                                                                        : (ring->size - jitter_buffer->last_write_pos + write_pos);
+    jitter_buffer->last_write_pos = write_pos;
+    if (num_samples == 0) return;
+
+    if (jitter_buffer->arrival_started == false){
+        // first packet defines time base
+        jitter_buffer->arrival_started = true;
+        jitter_buffer->window_start_us = now_us;
+        jitter_buffer->nominal_us      = (int32_t) now_us;
+        jitter_buffer->window_min_us   = 0;
+        jitter_buffer->window_max_us   = 0;
+        jitter_buffer->previous_min_us = 0;
+        jitter_buffer->previous_max_us = 0;
+    }
+
+    // lateness compared to nominal arrival time of these samples
+    int32_t offset_us = (int32_t) (now_us - (uint32_t) jitter_buffer->nominal_us);
+    jitter_buffer->nominal_us += (int32_t) (((uint64_t) num_samples * 1000000) / jitter_buffer->sample_rate);
+    atomic_store_explicit(&jitter_buffer->packet_samples, num_samples, memory_order_relaxed);
+
+    if ((uint32_t) (now_us - jitter_buffer->window_start_us) >= jitter_buffer->window_us){
+        jitter_buffer->previous_min_us = jitter_buffer->window_min_us;
+        jitter_buffer->previous_max_us = jitter_buffer->window_max_us;
+        jitter_buffer->window_min_us   = offset_us;
+        jitter_buffer->window_max_us   = offset_us;
+        jitter_buffer->window_start_us = now_us;
+    } else {
+        if (offset_us < jitter_buffer->window_min_us) jitter_buffer->window_min_us = offset_us;
+        if (offset_us > jitter_buffer->window_max_us) jitter_buffer->window_max_us = offset_us;
+    }
+
+    int32_t min_us = (jitter_buffer->window_min_us < jitter_buffer->previous_min_us) ? jitter_buffer->window_min_us : jitter_buffer->previous_min_us;
+    int32_t max_us = (jitter_buffer->window_max_us > jitter_buffer->previous_max_us) ? jitter_buffer->window_max_us : jitter_buffer->previous_max_us;
+    uint32_t jitter_us = (uint32_t) (max_us - min_us);
+    atomic_store_explicit(&jitter_buffer->jitter_us, jitter_us, memory_order_relaxed);
+
+    // cover arrival spread plus one packet and one playback block
+    uint32_t target_samples = (uint32_t) (((uint64_t) jitter_us * jitter_buffer->sample_rate) / 1000000)
+                            + num_samples + atomic_load_explicit(&jitter_buffer->read_samples, memory_order_relaxed);
+    target_samples = btstack_max(target_samples, jitter_buffer->min_samples);
+    target_samples = btstack_min(target_samples, jitter_buffer->max_samples);
+    atomic_store_explicit(&jitter_buffer->target_samples, target_samples, memory_order_relaxed);
+}
+
+static void jitter_buffer_update_history(jitter_buffer_t * jitter_buffer, const int16_t * samples, uint16_t num_samples){
+    uint16_t period = jitter_buffer->conceal_period;
+    if (num_samples >= period){
+        memcpy(jitter_buffer->history, &samples[num_samples - period], period * sizeof(int16_t));
+    } else {
+        memmove(jitter_buffer->history, &jitter_buffer->history[num_samples], (period - num_samples) * sizeof(int16_t));
+        memcpy(&jitter_buffer->history[period - num_samples], samples, num_samples * sizeof(int16_t));
+    }
+}
+
+static void jitter_buffer_start_concealment(jitter_buffer_t * jitter_buffer){
+    jitter_buffer->conceal_pos  = 0;
+    jitter_buffer->conceal_gain = JITTER_BUFFER_GAIN_ONE;
+}
+
+// repeat last period with decreasing gain, silence afterwards
+static void jitter_buffer_conceal(jitter_buffer_t * jitter_buffer, int16_t * samples, uint16_t num_samples){
+    uint16_t i;
+    for (i = 0; i < num_samples; i++){
+        if (jitter_buffer->conceal_gain == 0){
+            memset(&samples[i], 0, (num_samples - i) * sizeof(int16_t));
+            return;
+        }
+        int32_t sample = jitter_buffer->history[jitter_buffer->conceal_pos];
+        samples[i] = (int16_t) ((sample * (int32_t) jitter_buffer->conceal_gain) >> 16);
+        jitter_buffer->conceal_pos++;
+        if (jitter_buffer->conceal_pos == jitter_buffer->conceal_period){
+            jitter_buffer->conceal_pos = 0;
+        }
+        jitter_buffer->conceal_gain = (jitter_buffer->conceal_gain > jitter_buffer->conceal_gain_step)
+                                    ? (jitter_buffer->conceal_gain - jitter_buffer->conceal_gain_step) : 0;
+        jitter_buffer->concealed_samples++;
+    }
+}
+
+void jitter_buffer_read(jitter_buffer_t * jitter_buffer, int16_t * samples, uint16_t num_samples){
+    sample_ring_buffer_t * ring = jitter_buffer->ring;
+    uint32_t available = sample_ring_buffer_samples_available(ring);
+    uint32_t target_samples = atomic_load_explicit(&jitter_buffer->target_samples, memory_order_relaxed);
+    atomic_store_explicit(&jitter_buffer->read_samples, num_samples, memory_order_relaxed);
+
+    // wait for target depth
+    if (jitter_buffer->playing == false){
+        if (available < target_samples){
+            jitter_buffer_conceal(jitter_buffer, samples, num_samples);
+            return;
+        }
+        jitter_buffer->playing = true;
+    }
+
+    jitter_buffer->depth_sum += available;
+    jitter_buffer->depth_count++;
+
+    // follow Bluetooth clock
+    asrc_update(&jitter_buffer->asrc, (int32_t) available - (int32_t) target_samples);
+
+    // reduce latency quickly if depth stays far above target
+    uint32_t packet_samples = atomic_load_explicit(&jitter_buffer->packet_samples, memory_order_relaxed);
+    if (available > (target_samples + packet_samples + num_samples)){
+        if (jitter_buffer->drop_countdown <= num_samples){
+            int16_t dropped;
+            jitter_buffer->dropped_samples += sample_ring_buffer_read(ring, &dropped, 1);
+            jitter_buffer->drop_countdown = JITTER_BUFFER_DROP_INTERVAL;
+        } else {
+            jitter_buffer->drop_countdown -= num_samples;
+        }
+    } else {
+        jitter_buffer->drop_countdown = JITTER_BUFFER_DROP_INTERVAL;
+    }
+
+    // resample directly from ring buffer
+    uint16_t samples_read = 0;
+    while (samples_read < num_samples){
+        const int16_t * region;
+        uint32_t region_size = sample_ring_buffer_get_read_region(ring, &region);
+        if (region_size == 0) break;
+        uint16_t region_used;
+        samples_read += asrc_process(&jitter_buffer->asrc, region, (uint16_t) btstack_min(region_size, UINT16_MAX), &region_used,
+                                     &samples[samples_read], num_samples - samples_read);
+        sample_ring_buffer_commit_read(ring, region_used);
+    }
+    jitter_buffer_update_history(jitter_buffer, samples, samples_read);
+    if (samples_read == num_samples) return;
+
+    // underrun: conceal and rebuffer up to target depth
+    jitter_buffer->underruns++;
+    jitter_buffer->playing = false;
+    jitter_buffer_start_concealment(jitter_buffer);
+    jitter_buffer_conceal(jitter_buffer, &samples[samples_read], num_samples - samples_read);
+}
+
+void jitter_buffer_get_metrics(const jitter_buffer_t * jitter_buffer, jitter_buffer_metrics_t * metrics){
+    uint32_t sample_rate = jitter_buffer->sample_rate;
+    uint32_t depth = sample_ring_buffer_samples_available(jitter_buffer->ring);
+    uint32_t average_depth = (jitter_buffer->depth_count == 0) ? 0 : (uint32_t) (jitter_buffer->depth_sum / jitter_buffer->depth_count);
+    metrics->depth_ms          = (uint16_t) (depth * 1000 / sample_rate);
+    metrics->target_ms         = (uint16_t) (atomic_load_explicit(&jitter_buffer->target_samples, memory_order_relaxed) * 1000 / sample_rate);
+    metrics->jitter_ms         = (uint16_t) (atomic_load_explicit(&jitter_buffer->jitter_us, memory_order_relaxed) / 1000);
+    metrics->added_latency_ms  = (uint16_t) (average_depth * 1000 / sample_rate);
+    metrics->underruns         = jitter_buffer->underruns;
+    metrics->concealed_samples = jitter_buffer->concealed_samples;
+    metrics->dropped_samples   = jitter_buffer->dropped_samples;
+    metrics->drift_ppm         = jitter_buffer->asrc.ppm;
+}
@@ -0,0 +1,140 @@
+/*
+ * key_matrix.c - scanned key matrix with per-row debouncing, running on the BTstack run loop
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "key_matrix.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+#include "btstack_run_loop.h"
+
+typedef struct {
+    uint32_t stable;
+    uint32_t candidate;
+    uint8_t  candidate_scans;
+} key_matrix_row_t;
+
+static const key_matrix_hal_t * key_matrix_hal;
+static key_matrix_handler_t     key_matrix_handler;
+static uint16_t                 key_matrix_scan_period_ms;
+static uint8_t                  key_matrix_debounce_scans;
+static key_matrix_row_t         key_matrix_rows[KEY_MATRIX_MAX_ROWS];
+static btstack_timer_source_t   key_matrix_scan_timer;
+static bool                     key_matrix_scanning;
+static cycle_stats_t            key_matrix_scan_cycles;
+
+// wakeup from other thread
+static atomic_bool                             key_matrix_wakeup_pending;
+static btstack_context_callback_registration_t key_matrix_wakeup_registration;
+
+static void key_matrix_scan_timer_handler(btstack_timer_source_t * ts);
+
+static void key_matrix_start_scanning(void){
+    if (key_matrix_scanning) return;
+    key_matrix_scanning = true;
+    if (key_matrix_hal->set_idle_wakeup != NULL){
+        (*key_matrix_hal->set_idle_wakeup)(false);
+    }
+    btstack_run_loop_set_timer_handler(&key_matrix_scan_timer, &key_matrix_scan_timer_handler);
+    btstack_run_loop_set_timer(&key_matrix_scan_timer, 0);
+    btstack_run_loop_add_timer(&key_matrix_scan_timer);
+}
+
+static bool key_matrix_idle(void){
+    uint8_t row;
+    for (row = 0; row < key_matrix_hal->num_rows; row++){
+        if (key_matrix_rows[row].stable != 0) return false;
+        if (key_matrix_rows[row].candidate_scans != 0) return false;
+    }
+    return true;
+}
+
+static void key_matrix_scan_timer_handler(btstack_timer_source_t * ts){
+    key_matrix_scan();
+
+    // stop scanning if all keys are released and HAL can wake us up
+    if ((key_matrix_hal->set_idle_wakeup != NULL) && key_matrix_idle()){
+        key_matrix_scanning = false;
+        (*key_matrix_hal->set_idle_wakeup)(true);
+        return;
+    }
+
+    btstack_run_loop_set_timer(ts, key_matrix_scan_period_ms);
+    btstack_run_loop_add_timer(ts);
+}
+
+static void key_matrix_process_wakeup(void * context){
+    UNUSED(context);
+    atomic_store(&key_matrix_wakeup_pending, false);
+    key_matrix_start_scanning();
+}
+
+static void key_matrix_report_changes(uint8_t row, uint32_t changed, uint32_t pressed){
+    while (changed != 0){
+        uint8_t col = (uint8_t) __builtin_ctz(changed);
+        (*key_matrix_handler)(row, col, (pressed & (1u << col)) != 0);
+        changed &= changed - 1;
+    }
+}
+
+void key_matrix_scan(void){
+    uint32_t cycles_start = cycle_stats_get_cycles();
+    uint8_t row;
+    for (row = 0; row < key_matrix_hal->num_rows; row++){
+        key_matrix_row_t * state = &key_matrix_rows[row];
+        uint32_t raw = (*key_matrix_hal->scan_row)(row);
+        if (raw == state->stable){
+            state->candidate_scans = 0;
+            continue;
+        }
+        if ((state->candidate_scans == 0) || (raw != state->candidate)){
+            state->candidate = raw;
+            state->candidate_scans = 1;
+        } else {
+            state->candidate_scans++;
+        }
+        if (state->candidate_scans < key_matrix_debounce_scans) continue;
+
+        uint32_t changed = raw ^ state->stable;
+        state->stable = raw;
+        state->candidate_scans = 0;
+        key_matrix_report_changes(row, changed, raw);
+    }
+    cycle_stats_add(&key_matrix_scan_cycles, cycle_stats_get_cycles() - cycles_start);
+}
+
+void key_matrix_init(const key_matrix_hal_t * hal, uint16_t scan_period_ms, uint8_t debounce_scans, key_matrix_handler_t handler){
+    btstack_assert(hal->num_rows <= KEY_MATRIX_MAX_ROWS);
+    btstack_assert(hal->num_cols <= KEY_MATRIX_MAX_COLS);
+
+    key_matrix_hal            = hal;
+    key_matrix_handler        = handler;
+    key_matrix_scan_period_ms = scan_period_ms;
+    key_matrix_debounce_scans = (debounce_scans == 0) ? 1 : debounce_scans;
+    key_matrix_scanning       = false;
+    memset(key_matrix_rows, 0, sizeof(key_matrix_rows));
+    cycle_stats_reset(&key_matrix_scan_cycles);
+
+    key_matrix_wakeup_registration.callback = &key_matrix_process_wakeup;
+    key_matrix_wakeup_registration.context  = NULL;
+    atomic_store(&key_matrix_wakeup_pending, false);
+
+    (*key_matrix_hal->init)();
+
+    // initial scan picks up keys held during boot
+    key_matrix_start_scanning();
+}
+
+void key_matrix_wakeup(void){
+    if (atomic_exchange(&key_matrix_wakeup_pending, true) == false){
+        btstack_run_loop_execute_on_main_thread(&key_matrix_wakeup_registration);
+    }
+}
+
+const cycle_stats_t * key_matrix_get_scan_cycles(void){
+    return &key_matrix_scan_cycles;
+}
@@ -0,0 +1,86 @@
+/*
+ * key_matrix.h - scanned key matrix with per-row debouncing, running on the BTstack run loop
+ *
+ * While keys are held, the full matrix is scanned every scan period. When all keys are released,
+ * scanning stops and the HAL is asked to report the next key press via key_matrix_wakeup().
+ * A host build can provide a simulated matrix as HAL to benchmark scan cost and report latency.
+ */
+
+#ifndef KEY_MATRIX_H
+#define KEY_MATRIX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cycle_stats.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#define KEY_MATRIX_MAX_ROWS 16
+#define KEY_MATRIX_MAX_COLS 32
+
+typedef struct {
+    uint8_t num_rows;
+    uint8_t num_cols;
+
+    /**
+     * @brief Setup hardware, all rows inactive
+     */
+    void (*init)(void);
+
+    /**
+     * @brief Activate row, read columns and deactivate row again
+     * @param row
+     * @return bitmask of pressed keys in this row, bit n = column n
+     */
+    uint32_t (*scan_row)(uint8_t row);
+
+    /**
+     * @brief Enable/disable idle mode: all rows active, any key press calls key_matrix_wakeup()
+     * @note optional, if NULL the matrix is scanned continuously
+     * @param enabled
+     */
+    void (*set_idle_wakeup)(bool enabled);
+} key_matrix_hal_t;
+
+/**
+ * @brief Called on run loop for every debounced key change
+ * @param row
+ * @param col
+ * @param pressed
+ */
+typedef void (*key_matrix_handler_t)(uint8_t row, uint8_t col, bool pressed);
+
+/**
+ * @brief Init key matrix and start scanning, needs to be called from run loop
+ * @param hal
+ * @param scan_period_ms
+ * @param debounce_scans number of identical scans before a row change is reported
+ * @param handler
+ */
+void key_matrix_init(const key_matrix_hal_t * hal, uint16_t scan_period_ms, uint8_t debounce_scans, key_matrix_handler_t handler);
+
+/**
+ * @brief Resume scanning after key press in idle mode. Thread-safe, but must not be called from interrupt context
+ */
+void key_matrix_wakeup(void);
+
+/**
+ * @brief Scan full matrix once and report debounced changes
+ * @note called from scan timer, exposed for simulation / benchmarks
+ */
+void key_matrix_scan(void);
+
+/**
+ * @brief Get cost of full matrix scans
+ * @return cycle statistics
+ */
+const cycle_stats_t * key_matrix_get_scan_cycles(void);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * key_matrix_esp32.c - key matrix HAL: open-drain row GPIOs, column GPIOs with pull-ups and wakeup interrupts
+ *
+ * In idle mode all rows are driven low and a falling edge on any column wakes a small task,
+ * which forwards it via key_matrix_wakeup() as that is not interrupt-safe.
+ */
+
+#include <stddef.h>
+
+#include "key_matrix_esp32.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+#include "esp_rom_sys.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// time for column lines to settle after row got activated
+#define KEY_MATRIX_SETTLE_US           2
+
+#define KEY_MATRIX_TASK_STACK_SIZE     2048
+#define KEY_MATRIX_TASK_PRIORITY       (configMAX_PRIORITIES - 2)
+
+static const gpio_num_t * key_matrix_row_gpios;
+static const gpio_num_t * key_matrix_col_gpios;
+static key_matrix_hal_t   key_matrix_esp32_hal;
+static TaskHandle_t       key_matrix_task_handle;
+
+static void IRAM_ATTR key_matrix_esp32_isr(void * arg){
+    UNUSED(arg);
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(key_matrix_task_handle, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+static void key_matrix_esp32_task(void * arg){
+    UNUSED(arg);
+    while (true){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        key_matrix_wakeup();
+    }
+}
+
+static void key_matrix_esp32_init(void){
+    xTaskCreate(&key_matrix_esp32_task, "key_matrix", KEY_MATRIX_TASK_STACK_SIZE, NULL,
+                KEY_MATRIX_TASK_PRIORITY, &key_matrix_task_handle);
+
+    // service may already be installed by other drivers
+    gpio_install_isr_service(0);
+
+    uint8_t i;
+    for (i = 0; i < key_matrix_esp32_hal.num_rows; i++){
+        gpio_num_t gpio = key_matrix_row_gpios[i];
+        gpio_reset_pin(gpio);
+        gpio_set_direction(gpio, GPIO_MODE_OUTPUT_OD);
+        gpio_set_level(gpio, 1);
+    }
+    for (i = 0; i < key_matrix_esp32_hal.num_cols; i++){
+        gpio_num_t gpio = key_matrix_col_gpios[i];
+        gpio_reset_pin(gpio);
+        gpio_set_direction(gpio, GPIO_MODE_INPUT);
+        gpio_set_pull_mode(gpio, GPIO_PULLUP_ONLY);
+        gpio_set_intr_type(gpio, GPIO_INTR_NEGEDGE);
+        gpio_isr_handler_add(gpio, &key_matrix_esp32_isr, NULL);
+        gpio_intr_disable(gpio);
+    }
+}
+
+static uint32_t key_matrix_esp32_scan_row(uint8_t row){
+    gpio_num_t row_gpio = key_matrix_row_gpios[row];
+    gpio_set_level(row_gpio, 0);
+    esp_rom_delay_us(KEY_MATRIX_SETTLE_US);
+    uint32_t pressed = 0;
+    uint8_t col;
+    for (col = 0; col < key_matrix_esp32_hal.num_cols; col++){
+        if (gpio_get_level(key_matrix_col_gpios[col]) == 0){
+            pressed |= 1u << col;
+        }
+    }
+    gpio_set_level(row_gpio, 1);
+    return pressed;
+}
+
+static void key_matrix_esp32_set_idle_wakeup(bool enabled){
+    uint8_t i;
+    for (i = 0; i < key_matrix_esp32_hal.num_rows; i++){
+        gpio_set_level(key_matrix_row_gpios[i], enabled ? 0 : 1);
+    }
+    for (i = 0; i < key_matrix_esp32_hal.num_cols; i++){
+        if (enabled){
+            gpio_intr_enable(key_matrix_col_gpios[i]);
+        } else {
+            gpio_intr_disable(key_matrix_col_gpios[i]);
+        }
+    }
+    // key pressed while we were enabling wakeup: no edge will follow
+    if (enabled){
+        for (i = 0; i < key_matrix_esp32_hal.num_cols; i++){
+            if (gpio_get_level(key_matrix_col_gpios[i]) == 0){
+                xTaskNotifyGive(key_matrix_task_handle);
+                break;
+            }
+        }
+    }
+}
+
+const key_matrix_hal_t * key_matrix_esp32_get_instance(const gpio_num_t * row_gpios, uint8_t num_rows,
+                                                       const gpio_num_t * col_gpios, uint8_t num_cols){
+    btstack_assert(num_rows <= KEY_MATRIX_MAX_ROWS);
+    btstack_assert(num_cols <= KEY_MATRIX_MAX_COLS);
+    key_matrix_row_gpios = row_gpios;
+    key_matrix_col_gpios = col_gpios;
+    key_matrix_esp32_hal.num_rows        = num_rows;
+    key_matrix_esp32_hal.num_cols        = num_cols;
+    key_matrix_esp32_hal.init            = &key_matrix_esp32_init;
+    key_matrix_esp32_hal.scan_row        = &key_matrix_esp32_scan_row;
+    key_matrix_esp32_hal.set_idle_wakeup = &key_matrix_esp32_set_idle_wakeup;
+    return &key_matrix_esp32_hal;
+}
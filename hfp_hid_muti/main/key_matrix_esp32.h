@@ -0,0 +1,32 @@
+/*
+ * key_matrix_esp32.h - key matrix HAL: open-drain row GPIOs, column GPIOs with pull-ups and wakeup interrupts
+ */
+
+#ifndef KEY_MATRIX_ESP32_H
+#define KEY_MATRIX_ESP32_H
+
+#include <stdint.h>
+
+#include "key_matrix.h"
+#include "driver/gpio.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Get HAL for matrix with diodes from column to row: a row is active when driven low
+ * @param row_gpios array needs to stay valid
+ * @param num_rows max KEY_MATRIX_MAX_ROWS
+ * @param col_gpios array needs to stay valid
+ * @param num_cols max KEY_MATRIX_MAX_COLS
+ * @return hal
+ */
+const key_matrix_hal_t * key_matrix_esp32_get_instance(const gpio_num_t * row_gpios, uint8_t num_rows,
+                                                       const gpio_num_t * col_gpios, uint8_t num_cols);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
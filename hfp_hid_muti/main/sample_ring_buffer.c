@@ -0,0 +1,112 @@
+/*
+ * sample_ring_buffer.c - ring buffer for 16-bit audio samples with direct access to contiguous regions
+ */
+
+#include <string.h>
+
+#include "sample_ring_buffer.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+void sample_ring_buffer_init(sample_ring_buffer_t * ring, int16_t * storage, uint32_t num_samples){
+    btstack_assert(num_samples > 1);
+    ring->storage = storage;
+    ring->size    = num_samples;
+    sample_ring_buffer_reset(ring);
+}
+
+void sample_ring_buffer_reset(sample_ring_buffer_t * ring){
+    atomic_store_explicit(&ring->read_pos,  0, memory_order_relaxed);
+    atomic_store_explicit(&ring->write_pos, 0, memory_order_relaxed);
+}
+
+static uint32_t sample_ring_buffer_distance(const sample_ring_buffer_t * ring, uint32_t read_pos, uint32_t write_pos){
+    if (write_pos >= read_pos){
+        return write_pos - read_pos;
+    }
+    return ring->size - read_pos + write_pos;
+}
+
+uint32_t sample_ring_buffer_samples_available(const sample_ring_buffer_t * ring){
+    uint32_t read_pos  = atomic_load_explicit(&ring->read_pos,  memory_order_acquire);
+    uint32_t write_pos = atomic_load_explicit(&ring->write_pos, memory_order_acquire);
+    return sample_ring_buffer_distance(ring, read_pos, write_pos);
+}
+
+uint32_t sample_ring_buffer_samples_free(const sample_ring_buffer_t * ring){
+    return ring->size - 1 - sample_ring_buffer_samples_available(ring);
+}
+
+uint32_t sample_ring_buffer_get_write_region(sample_ring_buffer_t * ring, int16_t ** samples){
+    uint32_t write_pos = atomic_load_explicit(&ring->write_pos, memory_order_relaxed);
+    // acquire: consumer is done with samples before read_pos
+    uint32_t read_pos  = atomic_load_explicit(&ring->read_pos,  memory_order_acquire);
+    *samples = &ring->storage[write_pos];
+    if (write_pos < read_pos){
+        return read_pos - write_pos - 1;
+    }
+    // up to end of storage, but keep last slot free if reader is at start
+    uint32_t num_samples = ring->size - write_pos;
+    if (read_pos == 0){
+        num_samples--;
+    }
+    return num_samples;
+}
+
+void sample_ring_buffer_commit_write(sample_ring_buffer_t * ring, uint32_t num_samples){
+    uint32_t write_pos = atomic_load_explicit(&ring->write_pos, memory_order_relaxed) + num_samples;
+    if (write_pos >= ring->size){
+        write_pos -= ring->size;
+    }
+    // release: samples are stored before consumer sees new write_pos
+    atomic_store_explicit(&ring->write_pos, write_pos, memory_order_release);
+}
+
+uint32_t sample_ring_buffer_get_read_region(const sample_ring_buffer_t * ring, const int16_t ** samples){
+    uint32_t read_pos  = atomic_load_explicit(&ring->read_pos,  memory_order_relaxed);
+    // acquire: samples before write_pos are stored
+    uint32_t write_pos = atomic_load_explicit(&ring->write_pos, memory_order_acquire);
+    *samples = &ring->storage[read_pos];
+    if (write_pos >= read_pos){
+        return write_pos - read_pos;
+    }
+    return ring->size - read_pos;
+}
+
+void sample_ring_buffer_commit_read(sample_ring_buffer_t * ring, uint32_t num_samples){
+    uint32_t read_pos = atomic_load_explicit(&ring->read_pos, memory_order_relaxed) + num_samples;
+    if (read_pos >= ring->size){
+        read_pos -= ring->size;
+    }
+    // release: samples are consumed before producer may overwrite them
+    atomic_store_explicit(&ring->read_pos, read_pos, memory_order_release);
+}
+
+uint32_t sample_ring_buffer_write(sample_ring_buffer_t * ring, const int16_t * samples, uint32_t num_samples){
+    uint32_t samples_written = 0;
+    while (samples_written < num_samples){
+        int16_t * region;
+        uint32_t region_size = sample_ring_buffer_get_write_region(ring, &region);
+        if (region_size == 0) break;
+        uint32_t samples_to_copy = btstack_min(region_size, num_samples - samples_written);
+        memcpy(region, &samples[samples_written], samples_to_copy * sizeof(int16_t));
+        sample_ring_buffer_commit_write(ring, samples_to_copy);
+        samples_written += samples_to_copy;
+    }
+    return samples_written;
+}
+
+uint32_t sample_ring_buffer_read(sample_ring_buffer_t * ring, int16_t * samples, uint32_t num_samples){
+    uint32_t samples_read = 0;
+    while (samples_read < num_samples){
+        const int16_t * region;
+        uint32_t region_size = sample_ring_buffer_get_read_region(ring, &region);
+        if (region_size == 0) break;
+        uint32_t samples_to_copy = btstack_min(region_size, num_samples - samples_read);
+        memcpy(&samples[samples_read], region, samples_to_copy * sizeof(int16_t));
+        sample_ring_buffer_commit_read(ring, samples_to_copy);
+        samples_read += samples_to_copy;
+    }
+    return samples_read;
+}
@@ -0,0 +1,122 @@
+/*
+ * sco_aec.h - fixed-point acoustic echo canceller for the microphone path
+ *
+ * The echo path from the far-end reference, i.e. the audio that is played, to the microphone is modelled
+ * by an adaptive FIR filter. The filter is split into partitions of SCO_AEC_BLOCK_SAMPLES, which are applied
+ * and adapted in the frequency domain with overlap-save and FFTs of two blocks (partitioned-block
+ * frequency-domain NLMS, also known as MDF). The step size is normalized per frequency bin by the smoothed
+ * reference power. One partition per block is constrained back to a linear convolution, in turn.
+ *
+ * Two filters are run: a background filter is adapted continuously and copied to the foreground filter,
+ * which produces the output, only while it cancels significantly better. Near-end speech during far-end
+ * speech (double talk) therefore cannot disturb the output, and a background filter diverged by it is
+ * restored from the foreground filter. Once converged, the background step size follows the ratio of
+ * estimated residual echo to error, so near-end speech also slows down adaptation. Adaptation pauses
+ * without far-end signal and when the microphone peak is far above the reference peak over the echo tail
+ * (Geigel). If the output gets louder than the microphone signal, the microphone signal is passed.
+ *
+ * Samples are int16_t at codec rate, spectra int32_t, filter coefficients Q16. The state holds all buffers,
+ * there is no allocation and no floating point. Bulk delay between reference and microphone is left to
+ * the caller, the tail only needs to cover the echo path itself.
+ */
+
+#ifndef SCO_AEC_H
+#define SCO_AEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fixed_fft.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#define SCO_AEC_BLOCK_SAMPLES       64
+#define SCO_AEC_FFT_LOG2_SIZE       7
+#define SCO_AEC_FFT_SIZE            (1 << SCO_AEC_FFT_LOG2_SIZE)
+#define SCO_AEC_NUM_BINS            (SCO_AEC_FFT_SIZE / 2 + 1)
+
+// max echo tail: 128 ms at 8 kHz, 64 ms at 16 kHz, 32 ms at 32 kHz
+#define SCO_AEC_MAX_PARTITIONS      16
+
+typedef struct {
+    uint32_t blocks;
+    // blocks without far-end signal, filter is applied but not adapted
+    uint32_t blocks_far_end_idle;
+    uint32_t blocks_double_talk;
+    // background filter copied to foreground / restored from foreground
+    uint32_t filter_updates;
+    uint32_t filter_restores;
+    // filter output louder than microphone, microphone passed unchanged
+    uint32_t blocks_bypassed;
+    // echo return loss enhancement, smoothed over blocks with far-end signal only
+    int16_t  erle_db;
+    // modelled tail after rounding to partitions
+    uint16_t tail_ms;
+} sco_aec_metrics_t;
+
+typedef struct {
+    uint8_t             num_partitions;
+    // ring index of newest reference spectrum
+    uint8_t             reference_newest;
+    uint8_t             constrain_next;
+    uint8_t             double_talk_hangover;
+    int16_t             reference_previous[SCO_AEC_BLOCK_SAMPLES];
+    // reference block peaks, same ring as spectra
+    int16_t             reference_peak[SCO_AEC_MAX_PARTITIONS];
+    fixed_fft_complex_t reference_spectra[SCO_AEC_MAX_PARTITIONS][SCO_AEC_NUM_BINS];
+    // partition p is applied to reference spectrum of p blocks ago
+    fixed_fft_complex_t filter_background[SCO_AEC_MAX_PARTITIONS][SCO_AEC_NUM_BINS];
+    fixed_fft_complex_t filter_foreground[SCO_AEC_MAX_PARTITIONS][SCO_AEC_NUM_BINS];
+    // smoothed |X|^2 per bin
+    uint64_t            reference_power[SCO_AEC_NUM_BINS];
+    fixed_fft_complex_t work[SCO_AEC_FFT_SIZE];
+    int16_t             error_background[SCO_AEC_BLOCK_SAMPLES];
+    int16_t             error_foreground[SCO_AEC_BLOCK_SAMPLES];
+    // foreground / background comparison, short and long term
+    int64_t             reduction_average[2];
+    int64_t             reduction_variance[2];
+    // step size control, energies scaled down
+    bool                converged;
+    int64_t             error_mean;
+    int64_t             echo_mean;
+    int64_t             leak_covariance;
+    int64_t             leak_variance;
+    // smoothed block energies of microphone and output
+    uint64_t            microphone_energy;
+    uint64_t            foreground_energy;
+    // smoothed block energies for ERLE
+    uint64_t            erle_microphone_energy;
+    uint64_t            erle_error_energy;
+    sco_aec_metrics_t   metrics;
+} sco_aec_t;
+
+/**
+ * @brief Reset filter and metrics
+ * @param aec
+ * @param sample_rate
+ * @param tail_ms length of echo path to model, limited to SCO_AEC_MAX_PARTITIONS blocks
+ */
+void sco_aec_init(sco_aec_t * aec, uint16_t sample_rate, uint16_t tail_ms);
+
+/**
+ * @brief Remove echo of reference block from microphone block
+ * @param aec
+ * @param reference SCO_AEC_BLOCK_SAMPLES samples played, aligned to microphone by caller
+ * @param microphone SCO_AEC_BLOCK_SAMPLES samples, replaced by echo-cancelled signal
+ */
+void sco_aec_process(sco_aec_t * aec, const int16_t * reference, int16_t * microphone);
+
+/**
+ * @brief Get metrics, values are updated per block by the processing thread
+ * @param aec
+ * @param metrics
+ */
+void sco_aec_get_metrics(const sco_aec_t * aec, sco_aec_metrics_t * metrics);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
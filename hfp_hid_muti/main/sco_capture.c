@@ -0,0 +1,303 @@
+/*
+ * sco_capture.c - capture received and sent SCO audio to rolling WAV files from a background writer
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sco_capture.h"
+#include "sample_ring_buffer.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#define SCO_CAPTURE_FLUSH_PERIOD_MS 50
+#define SCO_CAPTURE_WAV_HEADER_SIZE 44
+#define SCO_CAPTURE_FILENAME_MAX    64
+
+typedef struct {
+    // producer, counters are relaxed atomics with single writer
+    sample_ring_buffer_t ring;
+    atomic_uint          samples_captured;
+    atomic_uint          overrun_samples;
+    atomic_uint          overruns;
+    // writer
+    FILE *               file;
+    uint32_t             file_samples;
+    uint16_t             file_index;
+    atomic_uint          samples_written;
+    atomic_uint          write_errors;
+    atomic_uint          files;
+} sco_capture_channel_state_t;
+
+static int16_t                     sco_capture_storage[SCO_CAPTURE_NUM_CHANNELS][SCO_CAPTURE_BUFFER_SAMPLES];
+static sco_capture_channel_state_t sco_capture_channels[SCO_CAPTURE_NUM_CHANNELS];
+static const char * const          sco_capture_channel_names[SCO_CAPTURE_NUM_CHANNELS] = { "rx", "tx" };
+static const char *                sco_capture_prefix;
+static uint32_t                    sco_capture_sample_rate;
+static atomic_bool                 sco_capture_active;
+static atomic_bool                 sco_capture_stop_requested;
+static bool                        sco_capture_created;
+// stop signalled to writer but not confirmed yet, run loop only
+static bool                        sco_capture_stopping;
+
+static inline void sco_capture_counter_add(atomic_uint * counter, uint32_t value){
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+// WAV file
+
+static void sco_capture_wav_header(uint8_t * header, uint32_t sample_rate, uint32_t num_samples){
+    uint32_t data_size = num_samples * 2;
+    memcpy(&header[0], "RIFF", 4);
+    little_endian_store_32(header, 4, 36 + data_size);
+    memcpy(&header[8], "WAVEfmt ", 8);
+    little_endian_store_32(header, 16, 16);
+    little_endian_store_16(header, 20, 1);              // PCM
+    little_endian_store_16(header, 22, 1);              // mono
+    little_endian_store_32(header, 24, sample_rate);
+    little_endian_store_32(header, 28, sample_rate * 2);
+    little_endian_store_16(header, 32, 2);              // block align
+    little_endian_store_16(header, 34, 16);             // bits per sample
+    memcpy(&header[36], "data", 4);
+    little_endian_store_32(header, 40, data_size);
+}
+
+static void sco_capture_file_open(sco_capture_channel_t channel){
+    sco_capture_channel_state_t * state = &sco_capture_channels[channel];
+    char filename[SCO_CAPTURE_FILENAME_MAX];
+    snprintf(filename, sizeof(filename), "%s_%s_%u.wav", sco_capture_prefix, sco_capture_channel_names[channel],
+             (unsigned int) state->file_index);
+    state->file_index = (state->file_index + 1) % SCO_CAPTURE_MAX_FILES;
+    state->file_samples = 0;
+    state->file = fopen(filename, "wb");
+    if (state->file == NULL){
+        atomic_fetch_add(&state->write_errors, 1);
+        return;
+    }
+    uint8_t header[SCO_CAPTURE_WAV_HEADER_SIZE];
+    sco_capture_wav_header(header, sco_capture_sample_rate, 0);
+    fwrite(header, 1, sizeof(header), state->file);
+    atomic_fetch_add(&state->files, 1);
+}
+
+static void sco_capture_file_close(sco_capture_channel_t channel){
+    sco_capture_channel_state_t * state = &sco_capture_channels[channel];
+    if (state->file == NULL) return;
+    // update sizes
+    uint8_t header[SCO_CAPTURE_WAV_HEADER_SIZE];
+    sco_capture_wav_header(header, sco_capture_sample_rate, state->file_samples);
+    fseek(state->file, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), state->file);
+    fclose(state->file);
+    state->file = NULL;
+}
+
+static void sco_capture_file_write(sco_capture_channel_t channel, const int16_t * samples, uint32_t num_samples){
+    sco_capture_channel_state_t * state = &sco_capture_channels[channel];
+    if (state->file == NULL) return;
+    size_t items_written;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    items_written = fwrite(samples, 2, num_samples, state->file);
+#else
+    uint8_t buffer[SCO_CAPTURE_BLOCK_SAMPLES * 2];
+    uint32_t i;
+    for (i = 0; i < num_samples; i++){
+        little_endian_store_16(buffer, i * 2, (uint16_t) samples[i]);
+    }
+    items_written = fwrite(buffer, 2, num_samples, state->file);
+#endif
+    if (items_written != num_samples){
+        atomic_fetch_add(&state->write_errors, 1);
+    }
+    state->file_samples += num_samples;
+    atomic_fetch_add(&state->samples_written, num_samples);
+}
+
+// writer: flush full blocks, or everything when stopping. Samples are dropped while no file is open
+static void sco_capture_flush(sco_capture_channel_t channel, bool flush_all){
+    sco_capture_channel_state_t * state = &sco_capture_channels[channel];
+    uint32_t file_max_samples = sco_capture_sample_rate * SCO_CAPTURE_FILE_DURATION_SECONDS;
+    while (true){
+        uint32_t available = sample_ring_buffer_samples_available(&state->ring);
+        if (available == 0) break;
+        if ((flush_all == false) && (available < SCO_CAPTURE_BLOCK_SAMPLES)) break;
+        const int16_t * samples;
+        uint32_t num_samples = sample_ring_buffer_get_read_region(&state->ring, &samples);
+        num_samples = btstack_min(num_samples, SCO_CAPTURE_BLOCK_SAMPLES);
+        num_samples = btstack_min(num_samples, file_max_samples - state->file_samples);
+        sco_capture_file_write(channel, samples, num_samples);
+        sample_ring_buffer_commit_read(&state->ring, num_samples);
+        if (state->file_samples >= file_max_samples){
+            sco_capture_file_close(channel);
+            sco_capture_file_open(channel);
+        }
+    }
+}
+
+static void sco_capture_process(void){
+    uint8_t channel;
+    for (channel = 0; channel < SCO_CAPTURE_NUM_CHANNELS; channel++){
+        if (sco_capture_channels[channel].file == NULL){
+            sco_capture_file_open((sco_capture_channel_t) channel);
+        }
+        sco_capture_flush((sco_capture_channel_t) channel, false);
+    }
+}
+
+static void sco_capture_finish(void){
+    uint8_t channel;
+    for (channel = 0; channel < SCO_CAPTURE_NUM_CHANNELS; channel++){
+        sco_capture_flush((sco_capture_channel_t) channel, true);
+        sco_capture_file_close((sco_capture_channel_t) channel);
+    }
+}
+
+// platform
+
+#ifdef ESP_PLATFORM
+
+#define SCO_CAPTURE_TASK_STACK_SIZE 4096
+#define SCO_CAPTURE_TASK_PRIORITY   (tskIDLE_PRIORITY + 1)
+
+static SemaphoreHandle_t sco_capture_stopped;
+
+static void sco_capture_wait_stopped(void){
+    xSemaphoreTake(sco_capture_stopped, portMAX_DELAY);
+}
+
+static void sco_capture_thread(void * arg){
+    UNUSED(arg);
+    while (true){
+        vTaskDelay(pdMS_TO_TICKS(SCO_CAPTURE_FLUSH_PERIOD_MS));
+        if (atomic_load(&sco_capture_active)){
+            sco_capture_process();
+        }
+        if (atomic_exchange(&sco_capture_stop_requested, false)){
+            sco_capture_finish();
+            xSemaphoreGive(sco_capture_stopped);
+        }
+    }
+}
+
+static void sco_capture_create(void){
+    sco_capture_stopped = xSemaphoreCreateBinary();
+    xTaskCreate(&sco_capture_thread, "sco_capture", SCO_CAPTURE_TASK_STACK_SIZE, NULL,
+                SCO_CAPTURE_TASK_PRIORITY, NULL);
+}
+
+#else
+
+static pthread_t       sco_capture_pthread;
+static pthread_mutex_t sco_capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  sco_capture_cond  = PTHREAD_COND_INITIALIZER;
+static bool            sco_capture_stopped;
+
+static void sco_capture_wait_stopped(void){
+    pthread_mutex_lock(&sco_capture_mutex);
+    while (sco_capture_stopped == false){
+        pthread_cond_wait(&sco_capture_cond, &sco_capture_mutex);
+    }
+    sco_capture_stopped = false;
+    pthread_mutex_unlock(&sco_capture_mutex);
+}
+
+static void * sco_capture_thread(void * arg){
+    UNUSED(arg);
+    const struct timespec period = { 0, SCO_CAPTURE_FLUSH_PERIOD_MS * 1000000L };
+    while (true){
+        nanosleep(&period, NULL);
+        if (atomic_load(&sco_capture_active)){
+            sco_capture_process();
+        }
+        if (atomic_exchange(&sco_capture_stop_requested, false)){
+            sco_capture_finish();
+            pthread_mutex_lock(&sco_capture_mutex);
+            sco_capture_stopped = true;
+            pthread_cond_broadcast(&sco_capture_cond);
+            pthread_mutex_unlock(&sco_capture_mutex);
+        }
+    }
+    return NULL;
+}
+
+static void sco_capture_create(void){
+    pthread_create(&sco_capture_pthread, NULL, &sco_capture_thread, NULL);
+}
+
+#endif
+
+// audio path
+
+void sco_capture_start(const char * prefix, uint32_t sample_rate){
+    btstack_assert(atomic_load(&sco_capture_active) == false);
+    // writer still closes files of previous capture, at most one flush period
+    if (sco_capture_stopping){
+        sco_capture_stopping = false;
+        sco_capture_wait_stopped();
+    }
+    sco_capture_prefix      = prefix;
+    sco_capture_sample_rate = sample_rate;
+    uint8_t channel;
+    for (channel = 0; channel < SCO_CAPTURE_NUM_CHANNELS; channel++){
+        sco_capture_channel_state_t * state = &sco_capture_channels[channel];
+        sample_ring_buffer_init(&state->ring, sco_capture_storage[channel], SCO_CAPTURE_BUFFER_SAMPLES);
+        atomic_store(&state->samples_captured, 0);
+        atomic_store(&state->overrun_samples, 0);
+        atomic_store(&state->overruns, 0);
+        state->file             = NULL;
+        state->file_samples     = 0;
+        state->file_index       = 0;
+        atomic_store(&state->samples_written, 0);
+        atomic_store(&state->write_errors, 0);
+        atomic_store(&state->files, 0);
+    }
+    atomic_store(&sco_capture_stop_requested, false);
+    atomic_store(&sco_capture_active, true);
+    if (sco_capture_created == false){
+        sco_capture_created = true;
+        sco_capture_create();
+    }
+}
+
+void sco_capture_write(sco_capture_channel_t channel, const int16_t * samples, uint16_t num_samples){
+    if (atomic_load_explicit(&sco_capture_active, memory_order_relaxed) == false) return;
+    sco_capture_channel_state_t * state = &sco_capture_channels[channel];
+    // drop whole block if it doesn't fit to keep files free of partial blocks
+    if (sample_ring_buffer_samples_free(&state->ring) < num_samples){
+        sco_capture_counter_add(&state->overrun_samples, num_samples);
+        sco_capture_counter_add(&state->overruns, 1);
+        return;
+    }
+    sample_ring_buffer_write(&state->ring, samples, num_samples);
+    sco_capture_counter_add(&state->samples_captured, num_samples);
+}
+
+void sco_capture_stop(void){
+    if (atomic_load(&sco_capture_active) == false) return;
+    atomic_store(&sco_capture_active, false);
+    atomic_store(&sco_capture_stop_requested, true);
+    // writer flushes and closes files on its next period, confirmed on next start
+    sco_capture_stopping = true;
+}
+
+void sco_capture_get_statistics(sco_capture_channel_t channel, sco_capture_statistics_t * statistics){
+    sco_capture_channel_state_t * state = &sco_capture_channels[channel];
+    statistics->samples_captured = atomic_load_explicit(&state->samples_captured, memory_order_relaxed);
+    statistics->overrun_samples  = atomic_load_explicit(&state->overrun_samples,  memory_order_relaxed);
+    statistics->overruns         = atomic_load_explicit(&state->overruns,         memory_order_relaxed);
+    statistics->samples_written  = atomic_load(&state->samples_written);
+    statistics->write_errors     = atomic_load(&state->write_errors);
+    statistics->files            = (uint16_t) atomic_load(&state->files);
+}
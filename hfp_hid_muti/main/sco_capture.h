@@ -0,0 +1,78 @@
+/*
+ * sco_capture.h - capture received and sent SCO audio to rolling WAV files from a background writer
+ *
+ * The audio path appends samples to a lock-free ring buffer per direction and never blocks: if the
+ * writer falls behind, the samples are dropped and counted as overrun. The writer task flushes large
+ * blocks and starts a new file every SCO_CAPTURE_FILE_DURATION_SECONDS, reusing the names after
+ * SCO_CAPTURE_MAX_FILES files, so capture can run for the whole call without filling the disk.
+ */
+
+#ifndef SCO_CAPTURE_H
+#define SCO_CAPTURE_H
+
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// ring buffer per direction, about 250 ms at 32 kHz
+#define SCO_CAPTURE_BUFFER_SAMPLES          8192
+
+// samples per file write
+#define SCO_CAPTURE_BLOCK_SAMPLES           2048
+
+#define SCO_CAPTURE_FILE_DURATION_SECONDS   60
+#define SCO_CAPTURE_MAX_FILES               10
+
+typedef enum {
+    SCO_CAPTURE_RX = 0,
+    SCO_CAPTURE_TX,
+    SCO_CAPTURE_NUM_CHANNELS
+} sco_capture_channel_t;
+
+typedef struct {
+    uint32_t samples_captured;
+    // samples dropped as buffer was full and number of calls that dropped samples
+    uint32_t overrun_samples;
+    uint32_t overruns;
+    // updated by writer
+    uint32_t samples_written;
+    uint32_t write_errors;
+    uint16_t files;
+} sco_capture_statistics_t;
+
+/**
+ * @brief Start capture into <prefix>_rx_<n>.wav and <prefix>_tx_<n>.wav, files are opened by writer task
+ * @param prefix needs to stay valid
+ * @param sample_rate
+ */
+void sco_capture_start(const char * prefix, uint32_t sample_rate);
+
+/**
+ * @brief Append samples, never blocks. Single producer per channel
+ * @param channel
+ * @param samples
+ * @param num_samples
+ */
+void sco_capture_write(sco_capture_channel_t channel, const int16_t * samples, uint16_t num_samples);
+
+/**
+ * @brief Stop capture, never blocks. Writer flushes buffered samples and closes files on its next period, a
+ * following sco_capture_start waits for this if needed
+ */
+void sco_capture_stop(void);
+
+/**
+ * @brief Get statistics since start, can be called from any thread. Writer counters are final once the next
+ * start returns
+ * @param channel
+ * @param statistics
+ */
+void sco_capture_get_statistics(sco_capture_channel_t channel, sco_capture_statistics_t * statistics);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
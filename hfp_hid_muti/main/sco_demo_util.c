@@ -42,12 +42,20 @@
  */
 
 #include <stdio.h>
+#include <stdatomic.h>
 
 #include "sco_demo_util.h"
 
 #include "btstack_audio.h"
 #include "btstack_debug.h"
-#include "btstack_ring_buffer.h"
+#include "sco_dsp_task.h"
+#include "sco_capture.h"
+#include "deferred_log.h"
+#include "cycle_stats.h"
+#include "sample_ring_buffer.h"
+#include "asrc.h"
+#include "polyphase_resampler.h"
+#include "tone_generator.h"
 #include "classic/btstack_cvsd_plc.h"
 #include "classic/btstack_sbc.h"
 #include "classic/btstack_sbc_bluedroid.h"
@@ -65,28 +73,53 @@
 #pragma warning(disable : 4996)
 #endif
 
-#ifdef HAVE_POSIX_FILE_IO
-#include "wav_util.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
 #endif
 
 // test modes
-#define SCO_DEMO_MODE_SINE		 0
+#define SCO_DEMO_MODE_SINE       0
 #define SCO_DEMO_MODE_MICROPHONE 1
 #define SCO_DEMO_MODE_MODPLAYER  2
 
-// SCO demo configuration
+// SCO demo configuration, mode can be set by build, e.g. for host benchmarks
+#ifndef SCO_DEMO_MODE
 #define SCO_DEMO_MODE               SCO_DEMO_MODE_MICROPHONE
+#endif
+
+#if SCO_DEMO_MODE == SCO_DEMO_MODE_MICROPHONE
+#define USE_AUDIO_INPUT
+// cancel echo of played audio in microphone input, HF then reports EC/NR function
+// #define ENABLE_SCO_DEMO_AEC
+// condition microphone input before encoding: high-pass, noise suppression and gain control
+// #define ENABLE_SCO_DEMO_UPLINK
+#else
+#define USE_ADUIO_GENERATOR
+#endif
 
 // number of sco packets until 'report' on console
 #define SCO_REPORT_PERIOD           100
 
+// codec telemetry sampling period while receiving
+#define SCO_DEMO_CODEC_TELEMETRY_PERIOD_MS  1000
+
+// SCO payload rate on HCI: 16-bit linear CVSD samples or 64 kbit/s transparent data
+#define SCO_CVSD_BYTES_PER_SECOND           (SAMPLE_RATE_8KHZ * BYTES_PER_FRAME)
+#define SCO_TRANSPARENT_BYTES_PER_SECOND    8000
+
+// decode/encode in separate task (on second core if available) instead of on the run loop
+// #define ENABLE_SCO_DSP_TASK
+
 
 #ifdef HAVE_POSIX_FILE_IO
-// length and name of wav file on disk
-#define SCO_WAV_DURATION_IN_SECONDS 15
-#define SCO_WAV_FILENAME            "sco_input.wav"
+// capture received and sent audio into rolling wav files <prefix>_rx_<n>.wav and <prefix>_tx_<n>.wav
+#define SCO_CAPTURE_FILENAME_PREFIX "sco"
 #endif
 
+// audio device runs at fixed rate independent of codec, SCO audio is resampled
+#define SCO_DEMO_AUDIO_SAMPLE_RATE  48000
+
 // constants
 #define NUM_CHANNELS            1
 #define SAMPLE_RATE_8KHZ        8000
@@ -94,7 +127,7 @@
 #define SAMPLE_RATE_32KHZ       32000
 #define BYTES_PER_FRAME         2
 
-// audio pre-buffer - also defines latency
+// audio pre-buffer for sending, also sizes the ring buffers - playback depth is set by the jitter buffer
 #define SCO_PREBUFFER_MS      50
 #define PREBUFFER_BYTES_8KHZ  (SCO_PREBUFFER_MS *  SAMPLE_RATE_8KHZ/1000 * BYTES_PER_FRAME)
 #define PREBUFFER_BYTES_16KHZ (SCO_PREBUFFER_MS * SAMPLE_RATE_16KHZ/1000 * BYTES_PER_FRAME)
@@ -111,116 +144,276 @@
 #define SAMPLES_PER_FRAME_MAX 60
 #endif
 
-static uint16_t              audio_prebuffer_bytes;
+#if defined(ENABLE_HFP_WIDE_BAND_SPEECH) || defined(ENABLE_HFP_SUPER_WIDE_BAND_SPEECH)
+// H2 header + mSBC frame + padding byte or H2 header + LC3-SWB frame
+#define SCO_DEMO_H2_FRAME_SIZE          60
+#define SCO_DEMO_H2_HEADER_SIZE         2
+#define SCO_DEMO_COMFORT_NOISE_FRAMES   4
+
+// frames encoded ahead of SCO send cadence, adds up to this many frames of uplink latency, must be power of two
+#ifndef SCO_DEMO_ENCODE_AHEAD_FRAMES
+#define SCO_DEMO_ENCODE_AHEAD_FRAMES    2
+#endif
+#endif
 
-// output
-static int                   audio_output_paused  = 0;
-static uint8_t               audio_output_ring_buffer_storage[2 * PREBUFFER_BYTES_MAX];
-static btstack_ring_buffer_t audio_output_ring_buffer;
+// adaptive playback buffer depth
+#define JITTER_BUFFER_MIN_MS  15
+#define JITTER_BUFFER_MAX_MS  60
 
-// input
-#if SCO_DEMO_MODE == SCO_DEMO_MODE_MICROPHONE
-#define USE_AUDIO_INPUT
-#else
-#define USE_ADUIO_GENERATOR
-static void (*sco_demo_audio_generator)(uint16_t num_samples, int16_t * data);
+#ifdef ENABLE_SCO_DEMO_AEC
+// I2S DMA buffering of the audio driver, BTstack's ESP32 driver queues 2 buffers of 5 ms for playback and
+// delivers recorded audio one buffer at a time
+#ifndef SCO_DEMO_AUDIO_DMA_BUFFER_MS
+#define SCO_DEMO_AUDIO_DMA_BUFFER_MS        5
+#endif
+#ifndef SCO_DEMO_AUDIO_DMA_BUFFER_COUNT
+#define SCO_DEMO_AUDIO_DMA_BUFFER_COUNT     2
+#endif
+// echo tail modelled by the filter, and delay beyond audio buffering, e.g. for external amplifier with DSP
+#define SCO_DEMO_AEC_TAIL_MS        32
+#define SCO_DEMO_AEC_EXTRA_DELAY_MS 0
+// reference is delayed from being passed to the driver until its echo is recorded. A buffer is played after the
+// ones queued before it, its echo is recorded up to one buffer later depending on the phase of the recording
+// buffers. The reference must not arrive after its echo, so the shortest delay is used, the tail covers the rest
+#define SCO_DEMO_AEC_DELAY_MS       ((SCO_DEMO_AUDIO_DMA_BUFFER_COUNT - 1) * SCO_DEMO_AUDIO_DMA_BUFFER_MS + SCO_DEMO_AEC_EXTRA_DELAY_MS)
+// played samples at codec rate until recorded: audio callback sizes plus delay
+#define SCO_DEMO_AEC_REFERENCE_SAMPLES  (2048 + SCO_DEMO_AEC_DELAY_MS * SAMPLE_RATE_32KHZ / 1000)
 #endif
 
-static int                   audio_input_paused  = 0;
-static uint8_t               audio_input_ring_buffer_storage[2 * PREBUFFER_BYTES_MAX];
-static btstack_ring_buffer_t audio_input_ring_buffer;
+// uplink conditioning for CVSD, mSBC and LC3-SWB rate: stages, high-pass Hz, max noise attenuation dB,
+// target dBFS and max gain dB. Only the high-pass is enabled by default, add noise suppression and gain
+// control per rate after checking their cycles per frame in the close statistics
+#ifndef SCO_DEMO_UPLINK_STAGES
+#define SCO_DEMO_UPLINK_STAGES  SCO_UPLINK_STAGE_MASK(SCO_UPLINK_HIGH_PASS)
+#endif
+static sco_uplink_config_t sco_demo_uplink_configs[] = {
+    { SCO_DEMO_UPLINK_STAGES, 100, 12, -20, 12 },
+    { SCO_DEMO_UPLINK_STAGES, 100, 12, -20, 12 },
+    { SCO_DEMO_UPLINK_STAGES, 100, 12, -20, 12 },
+};
+
+static sco_uplink_config_t * sco_demo_uplink_config_for_rate(uint16_t sample_rate){
+    switch (sample_rate){
+        case SAMPLE_RATE_8KHZ:
+            return &sco_demo_uplink_configs[0];
+        case SAMPLE_RATE_16KHZ:
+            return &sco_demo_uplink_configs[1];
+        default:
+            btstack_assert(sample_rate == SAMPLE_RATE_32KHZ);
+            return &sco_demo_uplink_configs[2];
+    }
+}
 
 // mod player
 #if SCO_DEMO_MODE == SCO_DEMO_MODE_MODPLAYER
 #include "hxcmod.h"
 #include "mods/mod.h"
-static modcontext mod_context;
 #endif
 
-static int count_sent = 0;
-static int count_received = 0;
+// contexts in static pool
+#ifndef SCO_DEMO_MAX_CONTEXTS
+#define SCO_DEMO_MAX_CONTEXTS       2
+#endif
 
-static btstack_cvsd_plc_state_t cvsd_plc_state;
+// statistics of the codec thread, published as a whole for other threads
+typedef struct {
+    sco_demo_codec_telemetry_t telemetry;
+    // bytes are counted by the run loop
+    sco_demo_path_statistics_t decode;
+    sco_demo_path_statistics_t encode;
+    uint32_t receive_copied_bytes;
+    uint32_t cached_frames;
+    uint32_t encoder_starved_packets;
+} sco_demo_codec_snapshot_t;
+
+struct codec_support;
+
+// complete state of one SCO audio link
+struct sco_audio_ctx {
+    // current configuration
+    const struct codec_support * codec_current;
+    bool                         primary;
+    uint16_t                     audio_prebuffer_bytes;
+
+    // output
+    int16_t                      audio_output_ring_buffer_storage[2 * PREBUFFER_BYTES_MAX / BYTES_PER_FRAME];
+    sample_ring_buffer_t         audio_output_ring_buffer;
+    jitter_buffer_t              audio_output_jitter_buffer;
+    polyphase_resampler_t        audio_output_resampler;
+
+    // input
+    atomic_bool                  audio_input_paused;
+    atomic_bool                  microphone_muted;
+    int16_t                      audio_input_ring_buffer_storage[2 * PREBUFFER_BYTES_MAX / BYTES_PER_FRAME];
+    sample_ring_buffer_t         audio_input_ring_buffer;
+#ifdef USE_AUDIO_INPUT
+    asrc_t                       audio_input_asrc;
+    polyphase_resampler_t        audio_input_resampler;
+#endif
+#ifdef USE_ADUIO_GENERATOR
+    void (*audio_generator)(sco_audio_ctx_t * ctx, uint16_t num_samples, int16_t * data);
+#endif
+#if SCO_DEMO_MODE == SCO_DEMO_MODE_SINE
+    tone_generator_t             tone_generator;
+#endif
+#if SCO_DEMO_MODE == SCO_DEMO_MODE_MODPLAYER
+    modcontext                   mod_context;
+#endif
 
+    // codecs
+    btstack_cvsd_plc_state_t     cvsd_plc_state;
 #ifdef ENABLE_HFP_WIDE_BAND_SPEECH
-static const btstack_sbc_decoder_t *   sbc_decoder_instance;
-static btstack_sbc_decoder_bluedroid_t sbc_decoder_context;
-static const btstack_sbc_encoder_t *   sbc_encoder_instance;
-static btstack_sbc_encoder_bluedroid_t sbc_encoder_context;
+    const btstack_sbc_decoder_t *   sbc_decoder_instance;
+    btstack_sbc_decoder_bluedroid_t sbc_decoder_context;
+    const btstack_sbc_encoder_t *   sbc_encoder_instance;
+    btstack_sbc_encoder_bluedroid_t sbc_encoder_context;
 #endif
-
 #ifdef ENABLE_HFP_SUPER_WIDE_BAND_SPEECH
-static const btstack_lc3_decoder_t * lc3_decoder;
-static btstack_lc3_decoder_google_t lc3_decoder_context;
-static btstack_lc3_encoder_google_t lc3_encoder_context;
-static hfp_h2_sync_t    hfp_h2_sync;
+    const btstack_lc3_decoder_t * lc3_decoder;
+    btstack_lc3_decoder_google_t  lc3_decoder_context;
+    btstack_lc3_encoder_google_t  lc3_encoder_context;
+    hfp_h2_sync_t                 hfp_h2_sync;
 #endif
+#if defined(ENABLE_HFP_WIDE_BAND_SPEECH) || defined(ENABLE_HFP_SUPER_WIDE_BAND_SPEECH)
+    hfp_codec_t                  hfp_codec;
+
+    // pre-encoded frames sent while audio input is paused or muted
+    uint8_t                      silence_frame[SCO_DEMO_H2_FRAME_SIZE];
+    uint8_t                      comfort_noise_frames[SCO_DEMO_COMFORT_NOISE_FRAMES][SCO_DEMO_H2_FRAME_SIZE];
+    uint8_t                      comfort_noise_index;
+
+    // frames encoded from audio input, free-running indices
+    uint8_t                      encoded_frames[SCO_DEMO_ENCODE_AHEAD_FRAMES][SCO_DEMO_H2_FRAME_SIZE];
+    uint16_t                     encoded_frames_read_index;
+    uint16_t                     encoded_frames_write_index;
+
+    // frame currently sent, H2 sequence number is set on the fly for continuous numbering across encoded and cached frames
+    const uint8_t *              frame_current;
+    bool                         frame_current_encoded;
+    uint16_t                     frame_offset;
+    uint8_t                      frame_sequence_number;
+    // codec of cached silence / comfort noise frames, 0 if none
+    uint8_t                      frame_cache_codec;
+    // cached frames sent by run loop if DSP task has no payload ready
+    const uint8_t *              fallback_frame;
+    uint16_t                     fallback_frame_offset;
+    uint8_t                      fallback_sequence_number;
+    uint8_t                      fallback_comfort_noise_index;
+#endif
+    int                          num_audio_frames;
+    // encode ahead requested by audio input or mute, handled on codec thread
+    atomic_bool                  encode_ahead_pending;
+    btstack_context_callback_registration_t encode_ahead_callback;
+
+    // counters
+    int                          count_sent;
+    int                          count_received;
+    sco_link_stats_t             link_stats;
+
+    // codec telemetry and statistics, written on codec thread and published to double buffer for other threads.
+    // Reset is requested by the run loop and done by the codec thread
+    cycle_stats_t                codec_decode_cycles;
+    cycle_stats_t                codec_encode_cycles;
+    uint32_t                     codec_frames_encoded;
+    uint32_t                     codec_bytes_received;
+    uint32_t                     codec_bytes_sent;
+    uint32_t                     codec_telemetry_sampled_us;
+    cycle_stats_t                decode_cycles;
+    cycle_stats_t                encode_cycles;
+    uint32_t                     receive_copied_bytes;
+    uint32_t                     cached_frames;
+    uint32_t                     encoder_starved_packets;
+    bool                         encoder_starved;
+    atomic_bool                  codec_statistics_reset_requested;
+    sco_demo_codec_snapshot_t    codec_snapshot[2];
+    atomic_uint                  codec_snapshot_index;
+
+    // performance statistics
+    cycle_stats_t                receive_cycles;
+    cycle_stats_t                send_cycles;
+    uint32_t                     receive_bytes;
+    uint32_t                     send_bytes;
+    cycle_stats_t                playback_resampler_cycles;
+    cycle_stats_t                recording_resampler_cycles;
+    uint32_t                     playback_resampler_bytes;
+    uint32_t                     recording_resampler_bytes;
+    uint32_t                     recording_overruns;
+    uint32_t                     recording_overrun_samples;
+    cycle_stats_t                echo_cancel_cycles;
+    uint32_t                     echo_cancel_bytes;
+    uint32_t                     echo_cancel_reference_underruns;
+    uint32_t                     echo_cancel_reference_overruns;
+    cycle_stats_t                uplink_cycles[SCO_UPLINK_NUM_STAGES];
+    uint32_t                     uplink_bytes;
+    // time to first audio played: start time set before attach, latency written by audio callback
+    // and published by first_audio_played
+    uint32_t                     audio_start_us;
+    uint32_t                     first_audio_latency_us;
+    atomic_bool                  first_audio_played;
+    uint32_t                     statistics_start_ms;
+};
 
-int num_samples_to_write;
-int num_audio_frames;
+static sco_audio_ctx_t            sco_demo_contexts[SCO_DEMO_MAX_CONTEXTS];
+static uint8_t                    sco_demo_num_contexts;
+
+// context using audio device, capture and DSP task
+static _Atomic(sco_audio_ctx_t *) sco_demo_primary_ctx;
+
+// audio device is initialised once at fixed rate and keeps running, primary context is attached while connected
+static bool                       sco_demo_audio_running;
+static _Atomic(sco_audio_ctx_t *) sco_demo_audio_ctx;
+
+#ifdef ENABLE_SCO_DEMO_AEC
+// echo canceller used with audio device: reference written by playback, microphone blocks collected by recording
+static sco_aec_t                  sco_demo_aec;
+static int16_t                    sco_demo_aec_reference_storage[SCO_DEMO_AEC_REFERENCE_SAMPLES];
+static sample_ring_buffer_t       sco_demo_aec_reference;
+static int16_t                    sco_demo_aec_microphone[SCO_AEC_BLOCK_SAMPLES];
+static uint16_t                   sco_demo_aec_microphone_fill;
+#endif
+
+#ifdef ENABLE_SCO_DEMO_UPLINK
+// uplink conditioning used with audio device, microphone frames collected at codec rate after echo cancellation
+static sco_uplink_t               sco_demo_uplink;
+static int16_t                    sco_demo_uplink_frame[SCO_UPLINK_MAX_FRAME_SAMPLES];
+static uint16_t                   sco_demo_uplink_frame_fill;
+#endif
 
 // generic codec support
-typedef struct {
-    void (*init)(void);
-    void(*receive)(const uint8_t * packet, uint16_t size);
-    void (*fill_payload)(uint8_t * payload_buffer, uint16_t sco_payload_length);
-    void (*close)(void);
+typedef struct codec_support {
+    void (*init)(sco_audio_ctx_t * ctx);
+    void(*receive)(sco_audio_ctx_t * ctx, const uint8_t * packet, uint16_t size);
+    void (*fill_payload)(sco_audio_ctx_t * ctx, uint8_t * payload_buffer, uint16_t sco_payload_length);
+    // silence or cached frames without touching codec state, used on run loop if DSP task has no payload ready
+    void (*fill_cached_payload)(sco_audio_ctx_t * ctx, uint8_t * payload_buffer, uint16_t sco_payload_length);
+    // encode complete frames of audio input ahead of send, NULL if codec works per payload
+    void (*encode_ahead)(sco_audio_ctx_t * ctx);
     //
+    const char * name;
     uint16_t sample_rate;
 } codec_support_t;
 
-// current configuration
-static const codec_support_t * codec_current = NULL;
-
-// hfp_codec
-#if defined(ENABLE_HFP_WIDE_BAND_SPEECH) || defined(ENABLE_HFP_SUPER_WIDE_BAND_SPEECH)
-static hfp_codec_t hfp_codec;
-#endif
-
 // Sine Wave
 
 #if SCO_DEMO_MODE == SCO_DEMO_MODE_SINE
-static uint16_t sine_wave_phase;
-static uint16_t sine_wave_steps_per_sample;
-#define SINE_WAVE_SAMPLE_RATE SAMPLE_RATE_32KHZ
-
-// input signal: pre-computed int16 sine wave, 32000 Hz at 266 Hz
-static const int16_t sine_int16[] = {
-     0,   1715,   3425,   5126,   6813,   8481,  10126,  11743,  13328,  14876,
- 16383,  17846,  19260,  20621,  21925,  23170,  24351,  25465,  26509,  27481,
- 28377,  29196,  29934,  30591,  31163,  31650,  32051,  32364,  32587,  32722,
- 32767,  32722,  32587,  32364,  32051,  31650,  31163,  30591,  29934,  29196,
- 28377,  27481,  26509,  25465,  24351,  23170,  21925,  20621,  19260,  17846,
- 16383,  14876,  13328,  11743,  10126,   8481,   6813,   5126,   3425,   1715,
-     0,  -1715,  -3425,  -5126,  -6813,  -8481, -10126, -11743, -13328, -14876,
--16384, -17846, -19260, -20621, -21925, -23170, -24351, -25465, -26509, -27481,
--28377, -29196, -29934, -30591, -31163, -31650, -32051, -32364, -32587, -32722,
--32767, -32722, -32587, -32364, -32051, -31650, -31163, -30591, -29934, -29196,
--28377, -27481, -26509, -25465, -24351, -23170, -21925, -20621, -19260, -17846,
--16384, -14876, -13328, -11743, -10126,  -8481,  -6813,  -5126,  -3425,  -1715,
-};
+// test signal, add more tones or use tone_generator_add_sweep for frequency response measurements
+#define SCO_DEMO_TONE_FREQUENCY_HZ  266
+#define SCO_DEMO_TONE_AMPLITUDE     32767
 
-static void sco_demo_sine_wave_host_endian(uint16_t num_samples, int16_t * data){
-    unsigned int i;
-    for (i=0; i < num_samples; i++){
-        data[i] = sine_int16[sine_wave_phase];
-        sine_wave_phase += sine_wave_steps_per_sample;
-        if (sine_wave_phase >= (sizeof(sine_int16) / sizeof(int16_t))){
-            sine_wave_phase = 0;
-        }
-    }
+static void sco_demo_sine_wave_host_endian(sco_audio_ctx_t * ctx, uint16_t num_samples, int16_t * data){
+    tone_generator_fill(&ctx->tone_generator, data, num_samples);
 }
 #endif
 
 // Mod Player
 #if SCO_DEMO_MODE == SCO_DEMO_MODE_MODPLAYER
 #define NUM_SAMPLES_GENERATOR_BUFFER 30
-static void sco_demo_modplayer(uint16_t num_samples, int16_t * data){
+static void sco_demo_modplayer(sco_audio_ctx_t * ctx, uint16_t num_samples, int16_t * data){
     // mix down stereo
     signed short samples[NUM_SAMPLES_GENERATOR_BUFFER * 2];
     while (num_samples > 0){
         uint16_t next_samples = btstack_min(num_samples, NUM_SAMPLES_GENERATOR_BUFFER);
-    	hxcmod_fillbuffer(&mod_context, (unsigned short *) samples, next_samples, NULL);
+    	hxcmod_fillbuffer(&ctx->mod_context, (unsigned short *) samples, next_samples, NULL);
         num_samples -= next_samples;
         uint16_t i;
         for (i=0;i<next_samples;i++){
@@ -228,202 +421,648 @@ static void sco_demo_modplayer(uint16_t num_samples, int16_t * data){
             int32_t right = samples[2*i + 1];
             data[i] = (int16_t)((left + right) / 2);
         }
+        data += next_samples;
     }
 }
 #endif
 
+// Capture
+
+#ifdef SCO_CAPTURE_FILENAME_PREFIX
+static void sco_demo_capture_write(sco_audio_ctx_t * ctx, sco_capture_channel_t channel, const int16_t * samples, uint16_t num_samples){
+    if (ctx->primary == false) return;
+    sco_capture_write(channel, samples, num_samples);
+}
+#endif
+
+// microphone mute is set on run loop and read on codec thread
+static bool sco_demo_microphone_muted(sco_audio_ctx_t * ctx){
+    return atomic_load_explicit(&ctx->microphone_muted, memory_order_relaxed);
+}
+
+// audio input pause is set on codec thread and read by recording callback
+static bool sco_demo_audio_input_paused(sco_audio_ctx_t * ctx){
+    return atomic_load_explicit(&ctx->audio_input_paused, memory_order_relaxed);
+}
+
+static void sco_demo_set_audio_input_paused(sco_audio_ctx_t * ctx, bool paused){
+    atomic_store_explicit(&ctx->audio_input_paused, paused, memory_order_relaxed);
+}
+
+// Encode ahead: audio input or mute change triggers encoding on the codec thread, once until handled
+
+static void sco_demo_encode_ahead_handler(void * context){
+    sco_audio_ctx_t * ctx = (sco_audio_ctx_t *) context;
+    atomic_store_explicit(&ctx->encode_ahead_pending, false, memory_order_relaxed);
+    // connection might have been closed meanwhile
+    if (ctx->codec_current == NULL) return;
+    if (ctx->codec_current->encode_ahead == NULL) return;
+    (*ctx->codec_current->encode_ahead)(ctx);
+}
+
+// any thread
+static void sco_demo_encode_ahead_request(sco_audio_ctx_t * ctx){
+    if (atomic_exchange_explicit(&ctx->encode_ahead_pending, true, memory_order_relaxed)) return;
+#ifdef ENABLE_SCO_DSP_TASK
+    if (ctx->primary){
+        sco_dsp_task_wakeup();
+        return;
+    }
+#endif
+    ctx->encode_ahead_callback.callback = &sco_demo_encode_ahead_handler;
+    ctx->encode_ahead_callback.context  = ctx;
+    btstack_run_loop_execute_on_main_thread(&ctx->encode_ahead_callback);
+}
+
 // Audio Playback / Recording
 
+static uint32_t sco_demo_get_time_us(void){
+#ifdef ESP_PLATFORM
+    return (uint32_t) esp_timer_get_time();
+#else
+    return btstack_run_loop_get_time_ms() * 1000;
+#endif
+}
+
+// device side block size of audio callbacks, codec side of a block is never larger
+#define AUDIO_BLOCK_SAMPLES 64
+
+// first sample above this level counts as audio played, about -54 dBFS
+#define AUDIO_FIRST_AUDIO_THRESHOLD 64
+
+static void audio_first_audio_check(sco_audio_ctx_t * ctx, const int16_t * samples, uint16_t num_samples){
+    uint16_t i;
+    for (i = 0; i < num_samples; i++){
+        if ((samples[i] > AUDIO_FIRST_AUDIO_THRESHOLD) || (samples[i] < -AUDIO_FIRST_AUDIO_THRESHOLD)){
+            ctx->first_audio_latency_us = sco_demo_get_time_us() - ctx->audio_start_us;
+            atomic_store_explicit(&ctx->first_audio_played, true, memory_order_release);
+            return;
+        }
+    }
+}
+
 static void audio_playback_callback(int16_t * buffer, uint16_t num_samples){
+    sco_audio_ctx_t * ctx = atomic_load_explicit(&sco_demo_audio_ctx, memory_order_acquire);
+    if (ctx == NULL){
+        // no SCO connection, stream keeps running
+        memset(buffer, 0, num_samples * BYTES_PER_FRAME);
+        return;
+    }
+    while (num_samples > 0){
+        uint16_t num_output = btstack_min(num_samples, AUDIO_BLOCK_SAMPLES);
+        uint16_t num_input  = polyphase_resampler_get_input_needed(&ctx->audio_output_resampler, num_output);
+        btstack_assert(num_input <= AUDIO_BLOCK_SAMPLES);
+        // waits for target depth and conceals underruns
+        int16_t samples[AUDIO_BLOCK_SAMPLES];
+        jitter_buffer_read(&ctx->audio_output_jitter_buffer, samples, num_input);
+#ifdef ENABLE_SCO_DEMO_AEC
+        // far-end reference for echo cancellation
+        if (sample_ring_buffer_write(&sco_demo_aec_reference, samples, num_input) < num_input){
+            ctx->echo_cancel_reference_overruns++;
+        }
+#endif
+        uint32_t cycles_start = cycle_stats_get_cycles();
+        uint16_t num_input_used;
+        polyphase_resampler_process(&ctx->audio_output_resampler, samples, num_input, &num_input_used, buffer, num_output);
+        cycle_stats_add(&ctx->playback_resampler_cycles, cycle_stats_get_cycles() - cycles_start);
+        ctx->playback_resampler_bytes += num_output * BYTES_PER_FRAME;
+        if (atomic_load_explicit(&ctx->first_audio_played, memory_order_relaxed) == false){
+            audio_first_audio_check(ctx, buffer, num_output);
+        }
+        buffer      += num_output;
+        num_samples -= num_output;
+    }
+}
 
-    // fill with silence while paused
-    if (audio_output_paused){
-        if (btstack_ring_buffer_bytes_available(&audio_output_ring_buffer) < audio_prebuffer_bytes){
-            memset(buffer, 0, num_samples * BYTES_PER_FRAME);
-           return;
+#ifdef USE_AUDIO_INPUT
+static void audio_recording_write(sco_audio_ctx_t * ctx, const int16_t * buffer, uint16_t num_samples){
+    while (num_samples > 0){
+        // resample directly into ring buffer, drop input if full
+        int16_t * samples;
+        uint32_t region_size = sample_ring_buffer_get_write_region(&ctx->audio_input_ring_buffer, &samples);
+        int16_t overflow_samples[AUDIO_BLOCK_SAMPLES];
+        if (region_size == 0){
+            samples     = overflow_samples;
+            region_size = AUDIO_BLOCK_SAMPLES;
+            ctx->recording_overruns++;
+        }
+        uint16_t samples_used;
+        uint16_t samples_produced = asrc_process(&ctx->audio_input_asrc, buffer, num_samples, &samples_used,
+                                                 samples, (uint16_t) btstack_min(region_size, AUDIO_BLOCK_SAMPLES));
+        if (samples != overflow_samples){
+            sample_ring_buffer_commit_write(&ctx->audio_input_ring_buffer, samples_produced);
         } else {
-            // resume playback
-            audio_output_paused = 0;
+            ctx->recording_overrun_samples += samples_produced;
         }
+        buffer      += samples_used;
+        num_samples -= samples_used;
     }
+}
 
-    // get data from ringbuffer
-    uint32_t bytes_read = 0;
-    btstack_ring_buffer_read(&audio_output_ring_buffer, (uint8_t *) buffer, num_samples * BYTES_PER_FRAME, &bytes_read);
-    num_samples -= bytes_read / BYTES_PER_FRAME;
-    buffer      += bytes_read / BYTES_PER_FRAME;
+#ifdef ENABLE_SCO_DEMO_UPLINK
+static void audio_uplink_init(int sample_rate){
+    sco_uplink_init(&sco_demo_uplink, sample_rate, sco_demo_uplink_config_for_rate(sample_rate));
+    sco_demo_uplink_frame_fill = 0;
+}
 
-    // fill with 0 if not enough
-    if (num_samples){
-        memset(buffer, 0, num_samples * BYTES_PER_FRAME);
-        audio_output_paused = 1;
+// collect microphone frames at codec rate, condition and pass on
+static void audio_uplink_process(sco_audio_ctx_t * ctx, const int16_t * samples, uint16_t num_samples){
+    uint16_t frame_samples = sco_uplink_get_frame_samples(&sco_demo_uplink);
+    while (num_samples > 0){
+        uint16_t num_copy = btstack_min(num_samples, frame_samples - sco_demo_uplink_frame_fill);
+        memcpy(&sco_demo_uplink_frame[sco_demo_uplink_frame_fill], samples, num_copy * BYTES_PER_FRAME);
+        sco_demo_uplink_frame_fill += num_copy;
+        samples     += num_copy;
+        num_samples -= num_copy;
+        if (sco_demo_uplink_frame_fill < frame_samples) break;
+        sco_demo_uplink_frame_fill = 0;
+
+        uint32_t stage_cycles[SCO_UPLINK_NUM_STAGES];
+        sco_uplink_process(&sco_demo_uplink, sco_demo_uplink_frame, stage_cycles);
+        uint8_t stage;
+        for (stage = 0; stage < SCO_UPLINK_NUM_STAGES; stage++){
+            if (sco_demo_uplink.config.stages & SCO_UPLINK_STAGE_MASK(stage)){
+                cycle_stats_add(&ctx->uplink_cycles[stage], stage_cycles[stage]);
+            }
+        }
+        ctx->uplink_bytes += frame_samples * BYTES_PER_FRAME;
+        audio_recording_write(ctx, sco_demo_uplink_frame, frame_samples);
     }
 }
+#endif
+
+#ifdef ENABLE_SCO_DEMO_AEC
+static void audio_echo_cancel_init(int sample_rate){
+    sco_aec_init(&sco_demo_aec, sample_rate, SCO_DEMO_AEC_TAIL_MS);
+    sco_demo_aec_microphone_fill = 0;
+    sample_ring_buffer_init(&sco_demo_aec_reference, sco_demo_aec_reference_storage,
+                            sizeof(sco_demo_aec_reference_storage) / sizeof(int16_t));
+    // pre-fill reference with silence for the audio buffering between playback and recording
+    uint32_t delay_samples = SCO_DEMO_AEC_DELAY_MS * sample_rate / 1000;
+    while (delay_samples > 0){
+        int16_t * samples;
+        uint32_t region_size = btstack_min(sample_ring_buffer_get_write_region(&sco_demo_aec_reference, &samples), delay_samples);
+        memset(samples, 0, region_size * BYTES_PER_FRAME);
+        sample_ring_buffer_commit_write(&sco_demo_aec_reference, region_size);
+        delay_samples -= region_size;
+    }
+}
+
+// collect microphone blocks at codec rate, remove echo of reference played at the same time and pass on
+static void audio_echo_cancel_process(sco_audio_ctx_t * ctx, const int16_t * samples, uint16_t num_samples){
+    while (num_samples > 0){
+        uint16_t num_copy = btstack_min(num_samples, SCO_AEC_BLOCK_SAMPLES - sco_demo_aec_microphone_fill);
+        memcpy(&sco_demo_aec_microphone[sco_demo_aec_microphone_fill], samples, num_copy * BYTES_PER_FRAME);
+        sco_demo_aec_microphone_fill += num_copy;
+        samples     += num_copy;
+        num_samples -= num_copy;
+        if (sco_demo_aec_microphone_fill < SCO_AEC_BLOCK_SAMPLES) break;
+        sco_demo_aec_microphone_fill = 0;
+
+        // silence if playback fell behind
+        int16_t reference[SCO_AEC_BLOCK_SAMPLES];
+        uint32_t num_reference = sample_ring_buffer_read(&sco_demo_aec_reference, reference, SCO_AEC_BLOCK_SAMPLES);
+        if (num_reference < SCO_AEC_BLOCK_SAMPLES){
+            memset(&reference[num_reference], 0, (SCO_AEC_BLOCK_SAMPLES - num_reference) * BYTES_PER_FRAME);
+            ctx->echo_cancel_reference_underruns++;
+        }
+        uint32_t cycles_start = cycle_stats_get_cycles();
+        sco_aec_process(&sco_demo_aec, reference, sco_demo_aec_microphone);
+        cycle_stats_add(&ctx->echo_cancel_cycles, cycle_stats_get_cycles() - cycles_start);
+        ctx->echo_cancel_bytes += SCO_AEC_BLOCK_SAMPLES * BYTES_PER_FRAME;
+#ifdef ENABLE_SCO_DEMO_UPLINK
+        audio_uplink_process(ctx, sco_demo_aec_microphone, SCO_AEC_BLOCK_SAMPLES);
+#else
+        audio_recording_write(ctx, sco_demo_aec_microphone, SCO_AEC_BLOCK_SAMPLES);
+#endif
+    }
+}
+#endif
 
-#ifdef USE_AUDIO_INPUT
 static void audio_recording_callback(const int16_t * buffer, uint16_t num_samples){
-    btstack_ring_buffer_write(&audio_input_ring_buffer, (uint8_t *)buffer, num_samples * 2);
+    sco_audio_ctx_t * ctx = atomic_load_explicit(&sco_demo_audio_ctx, memory_order_acquire);
+    if (ctx == NULL) return;
+    // recording runs on the audio clock: follow the Bluetooth clock by keeping the input buffer at pre-buffer level
+    if (!sco_demo_audio_input_paused(ctx)){
+        int32_t fill_error = (int32_t) sample_ring_buffer_samples_available(&ctx->audio_input_ring_buffer)
+                           - (int32_t) (ctx->audio_prebuffer_bytes / BYTES_PER_FRAME);
+        asrc_update(&ctx->audio_input_asrc, fill_error);
+    }
+    while (num_samples > 0){
+        // convert to codec rate first
+        int16_t samples[AUDIO_BLOCK_SAMPLES];
+        uint32_t cycles_start = cycle_stats_get_cycles();
+        uint16_t num_input_used;
+        uint16_t num_output = polyphase_resampler_process(&ctx->audio_input_resampler, buffer, btstack_min(num_samples, AUDIO_BLOCK_SAMPLES),
+                                                          &num_input_used, samples, AUDIO_BLOCK_SAMPLES);
+        cycle_stats_add(&ctx->recording_resampler_cycles, cycle_stats_get_cycles() - cycles_start);
+        ctx->recording_resampler_bytes += num_input_used * BYTES_PER_FRAME;
+#if defined(ENABLE_SCO_DEMO_AEC)
+        audio_echo_cancel_process(ctx, samples, num_output);
+#elif defined(ENABLE_SCO_DEMO_UPLINK)
+        audio_uplink_process(ctx, samples, num_output);
+#else
+        audio_recording_write(ctx, samples, num_output);
+#endif
+        buffer      += num_input_used;
+        num_samples -= num_input_used;
+    }
+    // encode as soon as a frame is complete instead of waiting for the next send
+    // callback might still run while connection gets closed
+    const codec_support_t * codec = ctx->codec_current;
+    if (codec == NULL) return;
+    if (codec->encode_ahead == NULL) return;
+    uint32_t frame_samples = codec->sample_rate * 75 / 10000;
+    if (sample_ring_buffer_samples_available(&ctx->audio_input_ring_buffer) < frame_samples) return;
+    sco_demo_encode_ahead_request(ctx);
 }
 #endif
 
-// return 1 if ok
-static int audio_initialize(int sample_rate){
+// init driver and start streams at fixed rate, called on first connection only
+static void audio_start(void){
+    if (sco_demo_audio_running) return;
+    sco_demo_audio_running = true;
 
     // -- output -- //
 
-    // init buffers
-    memset(audio_output_ring_buffer_storage, 0, sizeof(audio_output_ring_buffer_storage));
-    btstack_ring_buffer_init(&audio_output_ring_buffer, audio_output_ring_buffer_storage, sizeof(audio_output_ring_buffer_storage));
-
     // config and setup audio playback
     const btstack_audio_sink_t * audio_sink = btstack_audio_sink_get_instance();
     if (audio_sink != NULL){
-        audio_sink->init(1, sample_rate, &audio_playback_callback);
+        audio_sink->init(1, SCO_DEMO_AUDIO_SAMPLE_RATE, &audio_playback_callback);
         audio_sink->start_stream();
-
-        audio_output_paused  = 1;
     }
 
     // -- input -- //
 
-    // init buffers
-    memset(audio_input_ring_buffer_storage, 0, sizeof(audio_input_ring_buffer_storage));
-    btstack_ring_buffer_init(&audio_input_ring_buffer, audio_input_ring_buffer_storage, sizeof(audio_input_ring_buffer_storage));
-    audio_input_paused  = 1;
-
 #ifdef USE_AUDIO_INPUT
     // config and setup audio recording
     const btstack_audio_source_t * audio_source = btstack_audio_source_get_instance();
     if (audio_source != NULL){
-        audio_source->init(1, sample_rate, &audio_recording_callback);
+        audio_source->init(1, SCO_DEMO_AUDIO_SAMPLE_RATE, &audio_recording_callback);
         audio_source->start_stream();
     }
 #endif
-
-    return 1;
 }
 
-static void audio_terminate(void){
-    const btstack_audio_sink_t * audio_sink = btstack_audio_sink_get_instance();
-    if (!audio_sink) return;
-    audio_sink->close();
+// return 1 if ok
+static int audio_initialize(sco_audio_ctx_t * ctx, int sample_rate){
 
+    // init buffers
+    memset(ctx->audio_output_ring_buffer_storage, 0, sizeof(ctx->audio_output_ring_buffer_storage));
+    sample_ring_buffer_init(&ctx->audio_output_ring_buffer, ctx->audio_output_ring_buffer_storage,
+                            sizeof(ctx->audio_output_ring_buffer_storage) / sizeof(int16_t));
+    jitter_buffer_init(&ctx->audio_output_jitter_buffer, &ctx->audio_output_ring_buffer, sample_rate,
+                       JITTER_BUFFER_MIN_MS, JITTER_BUFFER_MAX_MS);
+
+    memset(ctx->audio_input_ring_buffer_storage, 0, sizeof(ctx->audio_input_ring_buffer_storage));
+    sample_ring_buffer_init(&ctx->audio_input_ring_buffer, ctx->audio_input_ring_buffer_storage,
+                            sizeof(ctx->audio_input_ring_buffer_storage) / sizeof(int16_t));
+    sco_demo_set_audio_input_paused(ctx, true);
 #ifdef USE_AUDIO_INPUT
-    const btstack_audio_source_t * audio_source= btstack_audio_source_get_instance();
-    if (!audio_source) return;
-    audio_source->close();
+    asrc_init(&ctx->audio_input_asrc);
 #endif
+
+    // audio device is used by primary context only
+    if (ctx->primary == false) return 1;
+
+    // audio device stays at fixed rate, only resampler follows codec
+    bool resampler_ok = polyphase_resampler_init(&ctx->audio_output_resampler, sample_rate, SCO_DEMO_AUDIO_SAMPLE_RATE);
+#ifdef USE_AUDIO_INPUT
+    resampler_ok = polyphase_resampler_init(&ctx->audio_input_resampler, SCO_DEMO_AUDIO_SAMPLE_RATE, sample_rate) && resampler_ok;
+#endif
+    btstack_assert(resampler_ok);
+    UNUSED(resampler_ok);
+#ifdef ENABLE_SCO_DEMO_AEC
+    audio_echo_cancel_init(sample_rate);
+#endif
+#ifdef ENABLE_SCO_DEMO_UPLINK
+    audio_uplink_init(sample_rate);
+#endif
+
+    // time to first audio played, published to the audio callback by attaching the context below
+    ctx->audio_start_us = sco_demo_get_time_us();
+    ctx->first_audio_latency_us = 0;
+    atomic_store_explicit(&ctx->first_audio_played, false, memory_order_relaxed);
+
+    audio_start();
+
+    // attach after all buffers are set up
+    atomic_store_explicit(&sco_demo_audio_ctx, ctx, memory_order_release);
+    return 1;
+}
+
+static void audio_terminate(sco_audio_ctx_t * ctx){
+    if (ctx->primary == false) return;
+    // detach only, streams keep running with silence for next connection
+    atomic_store_explicit(&sco_demo_audio_ctx, NULL, memory_order_release);
 }
 
 
 // CVSD - 8 kHz
 
-static void sco_demo_cvsd_init(void){
+static void sco_demo_cvsd_init(sco_audio_ctx_t * ctx){
     printf("SCO Demo: Init CVSD\n");
-    btstack_cvsd_plc_init(&cvsd_plc_state);
+    btstack_cvsd_plc_init(&ctx->cvsd_plc_state);
 }
 
-static void sco_demo_cvsd_receive(const uint8_t * packet, uint16_t size){
+#define CVSD_MAX_SAMPLES_PER_PACKET 128
 
-    int16_t audio_frame_out[128];    //
+static void sco_demo_cvsd_receive(sco_audio_ctx_t * ctx, const uint8_t * packet, uint16_t size){
 
-    if (size > sizeof(audio_frame_out)){
+    const int audio_bytes_read = size - 3;
+    const int num_samples = audio_bytes_read / BYTES_PER_FRAME;
+
+    if (num_samples > CVSD_MAX_SAMPLES_PER_PACKET){
         printf("sco_demo_cvsd_receive: SCO packet larger than local output buffer - dropping data.\n");
         return;
     }
 
-    const int audio_bytes_read = size - 3;
-    const int num_samples = audio_bytes_read / BYTES_PER_FRAME;
-
-    // convert into host endian
-    int16_t audio_frame_in[128];
+    // samples are little endian at odd addresses: copy into aligned buffer, convert only on big endian hosts
+    int16_t audio_frame_in[CVSD_MAX_SAMPLES_PER_PACKET];
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    memcpy(audio_frame_in, &packet[3], num_samples * BYTES_PER_FRAME);
+#else
     int i;
     for (i=0;i<num_samples;i++){
         audio_frame_in[i] = little_endian_read_16(packet, 3 + i * 2);
     }
+#endif
+    ctx->receive_copied_bytes += num_samples * BYTES_PER_FRAME;
 
     // treat packet as bad frame if controller does not report 'all good'
     bool bad_frame = (packet[1] & 0x30) != 0;
 
-    btstack_cvsd_plc_process_data(&cvsd_plc_state, bad_frame, audio_frame_in, num_samples, audio_frame_out);
-
-#ifdef SCO_WAV_FILENAME
-    // Samples in CVSD SCO packet are in little endian, ready for wav files (take shortcut)
-    const int samples_to_write = btstack_min(num_samples, num_samples_to_write);
-    wav_writer_write_le_int16(samples_to_write, audio_frame_out);
-    num_samples_to_write -= samples_to_write;
-    if (num_samples_to_write == 0){
-        wav_writer_close();
+    // run PLC directly into playback buffer, use local buffer only if free space wraps around
+    int16_t   audio_frame_wrapped[CVSD_MAX_SAMPLES_PER_PACKET];
+    int16_t * audio_frame_out;
+    bool in_place = sample_ring_buffer_get_write_region(&ctx->audio_output_ring_buffer, &audio_frame_out) >= (uint32_t) num_samples;
+    if (in_place == false){
+        audio_frame_out = audio_frame_wrapped;
     }
+
+    int good_frames_nr = ctx->cvsd_plc_state.good_frames_nr;
+    uint32_t cycles_start = cycle_stats_get_cycles();
+    btstack_cvsd_plc_process_data(&ctx->cvsd_plc_state, bad_frame, audio_frame_in, num_samples, audio_frame_out);
+    cycle_stats_add(&ctx->codec_decode_cycles, cycle_stats_get_cycles() - cycles_start);
+    // PLC also conceals all-zero frames reported as good
+    sco_link_stats_frames_decoded(&ctx->link_stats, (ctx->cvsd_plc_state.good_frames_nr != good_frames_nr) ?
+                                  SCO_LINK_STATS_FRAME_GOOD : SCO_LINK_STATS_FRAME_CONCEALED, 1);
+
+#ifdef SCO_CAPTURE_FILENAME_PREFIX
+    sco_demo_capture_write(ctx, SCO_CAPTURE_RX, audio_frame_out, num_samples);
 #endif
 
-    btstack_ring_buffer_write(&audio_output_ring_buffer, (uint8_t *)audio_frame_out, audio_bytes_read);
+    if (in_place){
+        sample_ring_buffer_commit_write(&ctx->audio_output_ring_buffer, num_samples);
+    } else {
+        sample_ring_buffer_write(&ctx->audio_output_ring_buffer, audio_frame_out, num_samples);
+        ctx->receive_copied_bytes += num_samples * BYTES_PER_FRAME;
+    }
 }
 
-static void sco_demo_cvsd_fill_payload(uint8_t * payload_buffer, uint16_t sco_payload_length){
+static void sco_demo_cvsd_fill_payload(sco_audio_ctx_t * ctx, uint8_t * payload_buffer, uint16_t sco_payload_length){
     uint16_t bytes_to_copy = sco_payload_length;
 
     // get data from ringbuffer
     uint16_t pos = 0;
-    if (!audio_input_paused){
-        uint16_t samples_to_copy = sco_payload_length / 2;
-        uint32_t bytes_read = 0;
-        btstack_ring_buffer_read(&audio_input_ring_buffer, payload_buffer, bytes_to_copy, &bytes_read);
-        // flip 16 on big endian systems
+    bool muted = sco_demo_microphone_muted(ctx);
+    if (muted){
+        // drop input, send silence
+        const int16_t * samples;
+        uint32_t num_samples;
+        while ((num_samples = sample_ring_buffer_get_read_region(&ctx->audio_input_ring_buffer, &samples)) > 0){
+            sample_ring_buffer_commit_read(&ctx->audio_input_ring_buffer, num_samples);
+        }
+    } else if (!sco_demo_audio_input_paused(ctx)){
+        // copy little endian samples from ring buffer regions
         // @note We don't use (uint16_t *) casts since all sample addresses are odd which causes crahses on some systems
-        if (btstack_is_big_endian()){
+        uint16_t samples_to_copy = sco_payload_length / 2;
+        while (samples_to_copy > 0){
+            const int16_t * samples;
+            uint32_t region_size = sample_ring_buffer_get_read_region(&ctx->audio_input_ring_buffer, &samples);
+            if (region_size == 0) break;
+            uint16_t num_samples = (uint16_t) btstack_min(region_size, samples_to_copy);
+#ifdef SCO_CAPTURE_FILENAME_PREFIX
+            sco_demo_capture_write(ctx, SCO_CAPTURE_TX, samples, num_samples);
+#endif
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+            memcpy(&payload_buffer[pos], samples, num_samples * BYTES_PER_FRAME);
+#else
             uint16_t i;
-            for (i=0;i<samples_to_copy/2;i+=2){
-                uint8_t tmp           = payload_buffer[i*2];
-                payload_buffer[i*2]   = payload_buffer[i*2+1];
-                payload_buffer[i*2+1] = tmp;
+            for (i = 0; i < num_samples; i++){
+                little_endian_store_16(payload_buffer, pos + i * BYTES_PER_FRAME, (uint16_t) samples[i]);
             }
+#endif
+            sample_ring_buffer_commit_read(&ctx->audio_input_ring_buffer, num_samples);
+            samples_to_copy -= num_samples;
+            bytes_to_copy   -= num_samples * BYTES_PER_FRAME;
+            pos             += num_samples * BYTES_PER_FRAME;
         }
-        bytes_to_copy -= bytes_read;
-        pos           += bytes_read;
     }
 
     // fill with 0 if not enough
     if (bytes_to_copy){
         memset(payload_buffer + pos, 0, bytes_to_copy);
-        audio_input_paused = 1;
+        if (!muted){
+            sco_demo_set_audio_input_paused(ctx, true);
+        }
     }
 }
 
-static void sco_demo_cvsd_close(void){
-    printf("Used CVSD with PLC, number of proccesed frames: \n - %d good frames, \n - %d bad frames.\n", cvsd_plc_state.good_frames_nr, cvsd_plc_state.bad_frames_nr);
+static void sco_demo_cvsd_fill_silence(sco_audio_ctx_t * ctx, uint8_t * payload_buffer, uint16_t sco_payload_length){
+    UNUSED(ctx);
+    memset(payload_buffer, 0, sco_payload_length);
 }
 
 static const codec_support_t codec_cvsd = {
         .init         = &sco_demo_cvsd_init,
         .receive      = &sco_demo_cvsd_receive,
         .fill_payload = &sco_demo_cvsd_fill_payload,
-        .close        = &sco_demo_cvsd_close,
+        .fill_cached_payload = &sco_demo_cvsd_fill_silence,
+        .encode_ahead = NULL,
+        .name         = "CVSD",
         .sample_rate = SAMPLE_RATE_8KHZ
 };
 
 // encode using hfp_codec
 #if defined(ENABLE_HFP_WIDE_BAND_SPEECH) || defined(ENABLE_HFP_SUPER_WIDE_BAND_SPEECH)
-static void sco_demo_codec_fill_payload(uint8_t * payload_buffer, uint16_t sco_payload_length){
-    if (!audio_input_paused){
-        int num_samples = hfp_codec_num_audio_samples_per_frame(&hfp_codec);
-        btstack_assert(num_samples <= SAMPLES_PER_FRAME_MAX);
-        uint16_t samples_available = btstack_ring_buffer_bytes_available(&audio_input_ring_buffer) / BYTES_PER_FRAME;
-        if (hfp_codec_can_encode_audio_frame_now(&hfp_codec) && samples_available >= num_samples){
-            int16_t sample_buffer[SAMPLES_PER_FRAME_MAX];
-            uint32_t bytes_read;
-            btstack_ring_buffer_read(&audio_input_ring_buffer, (uint8_t*) sample_buffer, num_samples * BYTES_PER_FRAME, &bytes_read);
-            hfp_codec_encode_audio_frame(&hfp_codec, sample_buffer);
-            num_audio_frames++;
+
+// peak amplitude of comfort noise, about -60 dBFS
+#define SCO_DEMO_COMFORT_NOISE_LEVEL    32
+
+_Static_assert((SCO_DEMO_ENCODE_AHEAD_FRAMES & (SCO_DEMO_ENCODE_AHEAD_FRAMES - 1)) == 0, "SCO_DEMO_ENCODE_AHEAD_FRAMES must be power of two");
+
+static const uint8_t sco_demo_h2_header_byte_1[] = { 0x08, 0x38, 0xc8, 0xf8 };
+
+static void sco_demo_frame_cache_encode(sco_audio_ctx_t * ctx, uint8_t * frame, const int16_t * samples){
+    hfp_codec_encode_audio_frame(&ctx->hfp_codec, (int16_t *) samples);
+    btstack_assert(hfp_codec_num_bytes_available(&ctx->hfp_codec) == SCO_DEMO_H2_FRAME_SIZE);
+    hfp_codec_read_from_stream(&ctx->hfp_codec, frame, SCO_DEMO_H2_FRAME_SIZE);
+}
+
+// called after hfp_codec init, frames are only encoded on first use of the codec. H2 sequence number is set on send
+static void sco_demo_frame_cache_build(sco_audio_ctx_t * ctx, uint8_t codec){
+    ctx->comfort_noise_index        = 0;
+    ctx->encoded_frames_read_index  = 0;
+    ctx->encoded_frames_write_index = 0;
+    ctx->frame_current              = NULL;
+    ctx->frame_current_encoded      = false;
+    ctx->frame_offset               = 0;
+    ctx->frame_sequence_number      = 0;
+    ctx->fallback_frame             = NULL;
+    ctx->fallback_frame_offset      = 0;
+    ctx->fallback_sequence_number   = 0;
+    ctx->fallback_comfort_noise_index = 0;
+
+    if (ctx->frame_cache_codec == codec) return;
+    ctx->frame_cache_codec = codec;
+
+    int num_samples = hfp_codec_num_audio_samples_per_frame(&ctx->hfp_codec);
+    btstack_assert(num_samples <= SAMPLES_PER_FRAME_MAX);
+    int16_t samples[SAMPLES_PER_FRAME_MAX];
+
+    memset(samples, 0, sizeof(samples));
+    sco_demo_frame_cache_encode(ctx, ctx->silence_frame, samples);
+
+    // white noise from LCG
+    uint32_t seed = 0x12345678;
+    uint8_t frame;
+    for (frame = 0; frame < SCO_DEMO_COMFORT_NOISE_FRAMES; frame++){
+        int i;
+        for (i = 0; i < num_samples; i++){
+            seed = seed * 1664525u + 1013904223u;
+            int32_t value = (int32_t) ((seed >> 16) % (2 * SCO_DEMO_COMFORT_NOISE_LEVEL + 1)) - SCO_DEMO_COMFORT_NOISE_LEVEL;
+            samples[i] = (int16_t) value;
         }
+        sco_demo_frame_cache_encode(ctx, ctx->comfort_noise_frames[frame], samples);
+    }
+}
+
+// encode all complete frames from audio input until encode-ahead queue is full
+static void sco_demo_codec_encode_ahead(sco_audio_ctx_t * ctx){
+    if (sco_demo_microphone_muted(ctx)){
+        // drop input and queued frames, encoder stays idle. Frame currently sent keeps its slot until completed
+        const int16_t * samples;
+        uint32_t num_samples;
+        while ((num_samples = sample_ring_buffer_get_read_region(&ctx->audio_input_ring_buffer, &samples)) > 0){
+            sample_ring_buffer_commit_read(&ctx->audio_input_ring_buffer, num_samples);
+        }
+        ctx->encoded_frames_write_index = ctx->encoded_frames_read_index + (ctx->frame_current_encoded ? 1 : 0);
+        return;
     }
-    // get data from encoder, fill with 0 if not enough
-    if (audio_input_paused || hfp_codec_num_bytes_available(&hfp_codec) < sco_payload_length){
-        // just send '0's
-        memset(payload_buffer, 0, sco_payload_length);
-        audio_input_paused = 1;
+    if (sco_demo_audio_input_paused(ctx)) return;
+
+    int num_samples = hfp_codec_num_audio_samples_per_frame(&ctx->hfp_codec);
+    btstack_assert(num_samples <= SAMPLES_PER_FRAME_MAX);
+    while ((uint16_t) (ctx->encoded_frames_write_index - ctx->encoded_frames_read_index) < SCO_DEMO_ENCODE_AHEAD_FRAMES){
+        if (sample_ring_buffer_samples_available(&ctx->audio_input_ring_buffer) < (uint32_t) num_samples) break;
+        if (hfp_codec_can_encode_audio_frame_now(&ctx->hfp_codec) == false) break;
+        // encode in place unless frame wraps around
+        const int16_t * samples;
+        int16_t sample_buffer[SAMPLES_PER_FRAME_MAX];
+        bool in_place = sample_ring_buffer_get_read_region(&ctx->audio_input_ring_buffer, &samples) >= (uint32_t) num_samples;
+        if (in_place == false){
+            sample_ring_buffer_read(&ctx->audio_input_ring_buffer, sample_buffer, num_samples);
+            samples = sample_buffer;
+        }
+#ifdef SCO_CAPTURE_FILENAME_PREFIX
+        sco_demo_capture_write(ctx, SCO_CAPTURE_TX, samples, num_samples);
+#endif
+        uint32_t cycles_start = cycle_stats_get_cycles();
+        hfp_codec_encode_audio_frame(&ctx->hfp_codec, (int16_t *) samples);
+        cycle_stats_add(&ctx->codec_encode_cycles, cycle_stats_get_cycles() - cycles_start);
+        ctx->codec_frames_encoded++;
+        if (in_place){
+            sample_ring_buffer_commit_read(&ctx->audio_input_ring_buffer, num_samples);
+        }
+        uint8_t * frame = ctx->encoded_frames[ctx->encoded_frames_write_index & (SCO_DEMO_ENCODE_AHEAD_FRAMES - 1)];
+        hfp_codec_read_from_stream(&ctx->hfp_codec, frame, SCO_DEMO_H2_FRAME_SIZE);
+        ctx->encoded_frames_write_index++;
+        ctx->num_audio_frames++;
+    }
+}
+
+// select next frame: encoded audio if available, otherwise silence if muted or comfort noise
+static void sco_demo_frame_next(sco_audio_ctx_t * ctx){
+    bool muted = sco_demo_microphone_muted(ctx);
+    if (!sco_demo_audio_input_paused(ctx) && !muted && (ctx->encoded_frames_read_index != ctx->encoded_frames_write_index)){
+        ctx->frame_current = ctx->encoded_frames[ctx->encoded_frames_read_index & (SCO_DEMO_ENCODE_AHEAD_FRAMES - 1)];
+        ctx->frame_current_encoded = true;
+        return;
+    }
+    if (!sco_demo_audio_input_paused(ctx) && !muted){
+        // encoder starved, wait for pre-buffer
+        ctx->encoder_starved = true;
+        sco_demo_set_audio_input_paused(ctx, true);
+    }
+    if (muted){
+        ctx->frame_current = ctx->silence_frame;
     } else {
-        hfp_codec_read_from_stream(&hfp_codec, payload_buffer, sco_payload_length);
+        ctx->frame_current = ctx->comfort_noise_frames[ctx->comfort_noise_index];
+        ctx->comfort_noise_index = (ctx->comfort_noise_index + 1) % SCO_DEMO_COMFORT_NOISE_FRAMES;
+    }
+    ctx->frame_current_encoded = false;
+    ctx->cached_frames++;
+}
+
+// copy part of H2 frame starting at frame_offset, header is set with running sequence number
+static void sco_demo_h2_frame_write(uint8_t * buffer, const uint8_t * frame, uint16_t frame_offset, uint16_t bytes_to_copy,
+                                    uint8_t * sequence_number){
+    uint16_t i = 0;
+    while ((i < bytes_to_copy) && ((frame_offset + i) < SCO_DEMO_H2_HEADER_SIZE)){
+        if ((frame_offset + i) == 0){
+            buffer[i] = 0x01;
+        } else {
+            buffer[i] = sco_demo_h2_header_byte_1[*sequence_number];
+            *sequence_number = (*sequence_number + 1) & 3;
+        }
+        i++;
+    }
+    memcpy(&buffer[i], &frame[frame_offset + i], bytes_to_copy - i);
+}
+
+static void sco_demo_codec_fill_payload(sco_audio_ctx_t * ctx, uint8_t * payload_buffer, uint16_t sco_payload_length){
+    sco_demo_codec_encode_ahead(ctx);
+
+    // frames may span several payloads, switch source only at frame boundaries to keep H2 framing intact
+    ctx->encoder_starved = false;
+    uint16_t pos = 0;
+    while (pos < sco_payload_length){
+        if (ctx->frame_offset == 0){
+            sco_demo_frame_next(ctx);
+        }
+        uint16_t bytes_to_copy = btstack_min(sco_payload_length - pos, SCO_DEMO_H2_FRAME_SIZE - ctx->frame_offset);
+        sco_demo_h2_frame_write(&payload_buffer[pos], ctx->frame_current, ctx->frame_offset, bytes_to_copy, &ctx->frame_sequence_number);
+        pos += bytes_to_copy;
+        ctx->frame_offset = (ctx->frame_offset + bytes_to_copy) % SCO_DEMO_H2_FRAME_SIZE;
+        if ((ctx->frame_offset == 0) && ctx->frame_current_encoded){
+            ctx->encoded_frames_read_index++;
+            ctx->frame_current_encoded = false;
+        }
+    }
+    if (ctx->encoder_starved){
+        ctx->encoder_starved_packets++;
+    }
+}
+
+// run loop: DSP task had no payload ready, send silence if muted or comfort noise from cache with own framing state.
+// With the usual 60 byte payload each payload is a complete frame, so the H2 stream stays intact
+static void sco_demo_codec_fill_cached_payload(sco_audio_ctx_t * ctx, uint8_t * payload_buffer, uint16_t sco_payload_length){
+    uint16_t pos = 0;
+    while (pos < sco_payload_length){
+        if (ctx->fallback_frame_offset == 0){
+            if (sco_demo_microphone_muted(ctx)){
+                ctx->fallback_frame = ctx->silence_frame;
+            } else {
+                ctx->fallback_frame = ctx->comfort_noise_frames[ctx->fallback_comfort_noise_index];
+                ctx->fallback_comfort_noise_index = (ctx->fallback_comfort_noise_index + 1) % SCO_DEMO_COMFORT_NOISE_FRAMES;
+            }
+        }
+        uint16_t bytes_to_copy = btstack_min(sco_payload_length - pos, SCO_DEMO_H2_FRAME_SIZE - ctx->fallback_frame_offset);
+        sco_demo_h2_frame_write(&payload_buffer[pos], ctx->fallback_frame, ctx->fallback_frame_offset, bytes_to_copy,
+                                &ctx->fallback_sequence_number);
+        pos += bytes_to_copy;
+        ctx->fallback_frame_offset = (ctx->fallback_frame_offset + bytes_to_copy) % SCO_DEMO_H2_FRAME_SIZE;
     }
 }
 #endif
@@ -433,47 +1072,47 @@ static void sco_demo_codec_fill_payload(uint8_t * payload_buffer, uint16_t sco_p
 #ifdef ENABLE_HFP_WIDE_BAND_SPEECH
 
 static void handle_pcm_data(int16_t * data, int num_samples, int num_channels, int sample_rate, void * context){
-    UNUSED(context);
     UNUSED(sample_rate);
-    UNUSED(data);
-    UNUSED(num_samples);
-    UNUSED(num_channels);
+    sco_audio_ctx_t * ctx = (sco_audio_ctx_t *) context;
 
     // samples in callback in host endianess, ready for playback
-    btstack_ring_buffer_write(&audio_output_ring_buffer, (uint8_t *)data, num_samples*num_channels*2);
+    sample_ring_buffer_write(&ctx->audio_output_ring_buffer, data, num_samples*num_channels);
+    ctx->receive_copied_bytes += num_samples*num_channels*BYTES_PER_FRAME;
 
-#ifdef SCO_WAV_FILENAME
-    if (!num_samples_to_write) return;
-    num_samples = btstack_min(num_samples, num_samples_to_write);
-    num_samples_to_write -= num_samples;
-    wav_writer_write_int16(num_samples, data);
-    if (num_samples_to_write == 0){
-        wav_writer_close();
-    }
-#endif /* SCO_WAV_FILENAME */
+#ifdef SCO_CAPTURE_FILENAME_PREFIX
+    sco_demo_capture_write(ctx, SCO_CAPTURE_RX, data, num_samples*num_channels);
+#endif
 }
 
-static void sco_demo_msbc_init(void){
+static void sco_demo_msbc_init(sco_audio_ctx_t * ctx){
     printf("SCO Demo: Init mSBC\n");
-    sbc_decoder_instance = btstack_sbc_decoder_bluedroid_init_instance(&sbc_decoder_context);
-    sbc_decoder_instance->configure(&sbc_decoder_context, SBC_MODE_mSBC, &handle_pcm_data, NULL);
-    sbc_encoder_instance = btstack_sbc_encoder_bluedroid_init_instance(&sbc_encoder_context);
-    hfp_codec_init_msbc_with_codec(&hfp_codec, sbc_encoder_instance, &sbc_encoder_context);
+    ctx->sbc_decoder_instance = btstack_sbc_decoder_bluedroid_init_instance(&ctx->sbc_decoder_context);
+    ctx->sbc_decoder_instance->configure(&ctx->sbc_decoder_context, SBC_MODE_mSBC, &handle_pcm_data, ctx);
+    ctx->sbc_encoder_instance = btstack_sbc_encoder_bluedroid_init_instance(&ctx->sbc_encoder_context);
+    hfp_codec_init_msbc_with_codec(&ctx->hfp_codec, ctx->sbc_encoder_instance, &ctx->sbc_encoder_context);
+    sco_demo_frame_cache_build(ctx, HFP_CODEC_MSBC);
 }
 
-static void sco_demo_msbc_receive(const uint8_t * packet, uint16_t size){
-    sbc_decoder_instance->decode_signed_16(&sbc_decoder_context, (packet[1] >> 4) & 3, packet + 3, size - 3);
-}
-
-static void sco_demo_msbc_close(void){
-    printf("Used mSBC with PLC, number of processed frames: \n - %d good frames, \n - %d zero frames, \n - %d bad frames.\n", sbc_decoder_context.good_frames_nr, sbc_decoder_context.zero_frames_nr, sbc_decoder_context.bad_frames_nr);
+static void sco_demo_msbc_receive(sco_audio_ctx_t * ctx, const uint8_t * packet, uint16_t size){
+    int good_frames_nr      = ctx->sbc_decoder_context.good_frames_nr;
+    int concealed_frames_nr = ctx->sbc_decoder_context.bad_frames_nr + ctx->sbc_decoder_context.zero_frames_nr;
+    uint32_t cycles_start = cycle_stats_get_cycles();
+    ctx->sbc_decoder_instance->decode_signed_16(&ctx->sbc_decoder_context, (packet[1] >> 4) & 3, packet + 3, size - 3);
+    cycle_stats_add(&ctx->codec_decode_cycles, cycle_stats_get_cycles() - cycles_start);
+    // a packet completes at most one frame
+    sco_link_stats_frames_decoded(&ctx->link_stats, SCO_LINK_STATS_FRAME_GOOD,
+                                  (uint16_t) (ctx->sbc_decoder_context.good_frames_nr - good_frames_nr));
+    sco_link_stats_frames_decoded(&ctx->link_stats, SCO_LINK_STATS_FRAME_CONCEALED,
+                                  (uint16_t) (ctx->sbc_decoder_context.bad_frames_nr + ctx->sbc_decoder_context.zero_frames_nr - concealed_frames_nr));
 }
 
 static const codec_support_t codec_msbc = {
         .init         = &sco_demo_msbc_init,
         .receive      = &sco_demo_msbc_receive,
         .fill_payload = &sco_demo_codec_fill_payload,
-        .close        = &sco_demo_msbc_close,
+        .fill_cached_payload = &sco_demo_codec_fill_cached_payload,
+        .encode_ahead = &sco_demo_codec_encode_ahead,
+        .name         = "mSBC",
         .sample_rate = SAMPLE_RATE_16KHZ
 };
 
@@ -484,7 +1123,11 @@ static const codec_support_t codec_msbc = {
 #define LC3_SWB_SAMPLES_PER_FRAME 240
 #define LC3_SWB_OCTETS_PER_FRAME   58
 
+// H2 sync callback has no context, set while hfp_h2_sync_process runs on this thread
+static _Thread_local sco_audio_ctx_t * sco_demo_lc3swb_ctx;
+
 static bool sco_demo_lc3swb_frame_callback(bool bad_frame, const uint8_t * frame_data, uint16_t frame_len){
+    sco_audio_ctx_t * ctx = sco_demo_lc3swb_ctx;
 
     // skip H2 header for good frames
     if (bad_frame == false){
@@ -494,65 +1137,85 @@ static bool sco_demo_lc3swb_frame_callback(bool bad_frame, const uint8_t * frame
 
     uint8_t tmp_BEC_detect = 0;
     uint8_t BFI = bad_frame ? 1 : 0;
-    int16_t samples[LC3_SWB_SAMPLES_PER_FRAME];
-    (void) lc3_decoder->decode_signed_16(&lc3_decoder_context, frame_data, BFI,
-                                         samples, 1, &tmp_BEC_detect);
 
-    // samples in callback in host endianess, ready for playback
-    btstack_ring_buffer_write(&audio_output_ring_buffer, (uint8_t *)samples, LC3_SWB_SAMPLES_PER_FRAME*2);
-
-#ifdef SCO_WAV_FILENAME
-    if (num_samples_to_write > 0){
-        uint16_t num_samples = btstack_min(LC3_SWB_SAMPLES_PER_FRAME, num_samples_to_write);
-        num_samples_to_write -= num_samples;
-        wav_writer_write_int16(num_samples, samples);
-        if (num_samples_to_write == 0){
-            wav_writer_close();
-        }
+    // decode directly into playback buffer, use local buffer only if free space wraps around
+    int16_t   samples_wrapped[LC3_SWB_SAMPLES_PER_FRAME];
+    int16_t * samples;
+    bool in_place = sample_ring_buffer_get_write_region(&ctx->audio_output_ring_buffer, &samples) >= LC3_SWB_SAMPLES_PER_FRAME;
+    if (in_place == false){
+        samples = samples_wrapped;
     }
-#endif /* SCO_WAV_FILENAME */
+
+    uint32_t cycles_start = cycle_stats_get_cycles();
+    (void) ctx->lc3_decoder->decode_signed_16(&ctx->lc3_decoder_context, frame_data, BFI,
+                                              samples, 1, &tmp_BEC_detect);
+    cycle_stats_add(&ctx->codec_decode_cycles, cycle_stats_get_cycles() - cycles_start);
+
+    sco_link_stats_frame_t result = SCO_LINK_STATS_FRAME_GOOD;
+    if (bad_frame){
+        result = SCO_LINK_STATS_FRAME_CONCEALED;
+    } else if (tmp_BEC_detect != 0){
+        result = SCO_LINK_STATS_FRAME_BEC;
+    }
+    sco_link_stats_frames_decoded(&ctx->link_stats, result, 1);
+
+    // samples in host endianess, ready for playback
+    if (in_place){
+        sample_ring_buffer_commit_write(&ctx->audio_output_ring_buffer, LC3_SWB_SAMPLES_PER_FRAME);
+    } else {
+        sample_ring_buffer_write(&ctx->audio_output_ring_buffer, samples, LC3_SWB_SAMPLES_PER_FRAME);
+        ctx->receive_copied_bytes += LC3_SWB_SAMPLES_PER_FRAME * BYTES_PER_FRAME;
+    }
+
+#ifdef SCO_CAPTURE_FILENAME_PREFIX
+    sco_demo_capture_write(ctx, SCO_CAPTURE_RX, samples, LC3_SWB_SAMPLES_PER_FRAME);
+#endif
 
     // frame is good, if it isn't a bad frame and we didn't detect other errors
     return (bad_frame == false) && (tmp_BEC_detect == 0);
 }
 
-static void sco_demo_lc3swb_init(void){
+static void sco_demo_lc3swb_init(sco_audio_ctx_t * ctx){
 
     printf("SCO Demo: Init LC3-SWB\n");
 
-    hfp_codec.lc3_encoder_context = &lc3_encoder_context;
-    const btstack_lc3_encoder_t * lc3_encoder = btstack_lc3_encoder_google_init_instance( &lc3_encoder_context);
-    hfp_codec_init_lc3_swb(&hfp_codec, lc3_encoder, &lc3_encoder_context);
+    ctx->hfp_codec.lc3_encoder_context = &ctx->lc3_encoder_context;
+    const btstack_lc3_encoder_t * lc3_encoder = btstack_lc3_encoder_google_init_instance( &ctx->lc3_encoder_context);
+    hfp_codec_init_lc3_swb(&ctx->hfp_codec, lc3_encoder, &ctx->lc3_encoder_context);
+    sco_demo_frame_cache_build(ctx, HFP_CODEC_LC3_SWB);
 
     // init lc3 decoder
-    lc3_decoder = btstack_lc3_decoder_google_init_instance(&lc3_decoder_context);
-    lc3_decoder->configure(&lc3_decoder_context, SAMPLE_RATE_32KHZ, BTSTACK_LC3_FRAME_DURATION_7500US, LC3_SWB_OCTETS_PER_FRAME);
+    ctx->lc3_decoder = btstack_lc3_decoder_google_init_instance(&ctx->lc3_decoder_context);
+    ctx->lc3_decoder->configure(&ctx->lc3_decoder_context, SAMPLE_RATE_32KHZ, BTSTACK_LC3_FRAME_DURATION_7500US, LC3_SWB_OCTETS_PER_FRAME);
 
     // init HPF H2 framing
-    hfp_h2_sync_init(&hfp_h2_sync, &sco_demo_lc3swb_frame_callback);
+    hfp_h2_sync_init(&ctx->hfp_h2_sync, &sco_demo_lc3swb_frame_callback);
 }
 
-static void sco_demo_lc3swb_receive(const uint8_t * packet, uint16_t size){
+static void sco_demo_lc3swb_receive(sco_audio_ctx_t * ctx, const uint8_t * packet, uint16_t size){
     uint8_t packet_status = (packet[1] >> 4) & 3;
     bool bad_frame = packet_status != 0;
-    hfp_h2_sync_process(&hfp_h2_sync, bad_frame, &packet[3], size-3);
-}
-
-static void sco_demo_lc3swb_close(void){
-    // TODO: report
+    sco_demo_lc3swb_ctx = ctx;
+    hfp_h2_sync_process(&ctx->hfp_h2_sync, bad_frame, &packet[3], size-3);
+    sco_demo_lc3swb_ctx = NULL;
 }
 
 static const codec_support_t codec_lc3swb = {
         .init         = &sco_demo_lc3swb_init,
         .receive      = &sco_demo_lc3swb_receive,
         .fill_payload = &sco_demo_codec_fill_payload,
-        .close        = &sco_demo_lc3swb_close,
+        .fill_cached_payload = &sco_demo_codec_fill_cached_payload,
+        .encode_ahead = &sco_demo_codec_encode_ahead,
+        .name         = "LC3-SWB",
         .sample_rate = SAMPLE_RATE_32KHZ
 };
 #endif
 
 void sco_demo_init(void){
 
+    // hot paths log through deferred log
+    deferred_log_init();
+
 #ifdef ENABLE_CLASSIC_LEGACY_CONNECTIONS_FOR_SCO_DEMOS
     printf("Disable BR/EDR Secure Connctions due to incompatibilities with SCO connections\n");
     gap_secure_connections_enable(false);
@@ -570,25 +1233,389 @@ void sco_demo_init(void){
 #endif
 #if SCO_DEMO_MODE == SCO_DEMO_MODE_MODPLAYER
     printf("SCO Demo: Sending modplayer wave, audio output via btstack_audio.\n");
-    // init mod
-    int hxcmod_initialized = hxcmod_init(&mod_context);
-    btstack_assert(hxcmod_initialized != 0);
 #endif
 }
 
-void sco_demo_set_codec(uint8_t negotiated_codec){
+sco_audio_ctx_t * sco_demo_create_context(void){
+    if (sco_demo_num_contexts == SCO_DEMO_MAX_CONTEXTS) return NULL;
+    return &sco_demo_contexts[sco_demo_num_contexts++];
+}
+
+bool sco_demo_echo_cancel_supported(void){
+#ifdef ENABLE_SCO_DEMO_AEC
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void sco_demo_path_statistics_get(const cycle_stats_t * cycles, uint32_t bytes, sco_demo_path_statistics_t * path){
+    path->packets    = cycles->count;
+    path->bytes      = bytes;
+    path->cycles_min = (cycles->count == 0) ? 0 : cycles->min;
+    path->cycles_avg = cycle_stats_get_average(cycles);
+    path->cycles_max = cycles->max;
+    path->cycles_p50 = cycle_stats_get_percentile(cycles, 50);
+    path->cycles_p99 = cycle_stats_get_percentile(cycles, 99);
+}
+
+// in order of sco_uplink_stage_t
+static const char * const sco_demo_uplink_stage_names[SCO_UPLINK_NUM_STAGES] = {
+    "uplink high-pass",
+    "uplink noise suppression",
+    "uplink gain control",
+};
+
+static void sco_demo_path_statistics_dump(const char * name, const sco_demo_path_statistics_t * path, uint32_t duration_ms){
+    uint32_t bytes_per_second = (duration_ms == 0) ? 0 : (uint32_t) (((uint64_t) path->bytes * 1000) / duration_ms);
+    printf("- %s: %u packets, %u bytes/s, cycles min %u, avg %u, p50 %u, p99 %u, max %u\n", name,
+           (unsigned int) path->packets, (unsigned int) bytes_per_second,
+           (unsigned int) path->cycles_min, (unsigned int) path->cycles_avg,
+           (unsigned int) path->cycles_p50, (unsigned int) path->cycles_p99, (unsigned int) path->cycles_max);
+}
+
+void sco_demo_set_microphone_mute(sco_audio_ctx_t * ctx, bool muted){
+    atomic_store_explicit(&ctx->microphone_muted, muted, memory_order_relaxed);
+    // drop frames encoded before mute right away
+    if (muted && (ctx->codec_current != NULL) && (ctx->codec_current->encode_ahead != NULL)){
+        sco_demo_encode_ahead_request(ctx);
+    }
+}
+
+void sco_demo_set_uplink_config(uint16_t sample_rate, const sco_uplink_config_t * config){
+    *sco_demo_uplink_config_for_rate(sample_rate) = *config;
+}
+
+// codec work runs on the DSP task for the primary context, otherwise on the thread calling receive / send
+static bool sco_demo_codec_on_dsp_task(sco_audio_ctx_t * ctx){
+#ifdef ENABLE_SCO_DSP_TASK
+    return ctx->primary;
+#else
+    UNUSED(ctx);
+    return false;
+#endif
+}
+
+static void sco_demo_codec_snapshot_publish(sco_audio_ctx_t * ctx);
+
+void sco_demo_reset_statistics(sco_audio_ctx_t * ctx){
+    cycle_stats_reset(&ctx->receive_cycles);
+    cycle_stats_reset(&ctx->send_cycles);
+    ctx->receive_bytes = 0;
+    ctx->send_bytes = 0;
+    atomic_store_explicit(&ctx->codec_statistics_reset_requested, true, memory_order_relaxed);
+    cycle_stats_reset(&ctx->playback_resampler_cycles);
+    cycle_stats_reset(&ctx->recording_resampler_cycles);
+    ctx->playback_resampler_bytes = 0;
+    ctx->recording_resampler_bytes = 0;
+    ctx->recording_overruns = 0;
+    ctx->recording_overrun_samples = 0;
+    cycle_stats_reset(&ctx->echo_cancel_cycles);
+    ctx->echo_cancel_bytes = 0;
+    ctx->echo_cancel_reference_underruns = 0;
+    ctx->echo_cancel_reference_overruns = 0;
+    uint8_t stage;
+    for (stage = 0; stage < SCO_UPLINK_NUM_STAGES; stage++){
+        cycle_stats_reset(&ctx->uplink_cycles[stage]);
+    }
+    ctx->uplink_bytes = 0;
+    ctx->statistics_start_ms = btstack_run_loop_get_time_ms();
+}
+
+void sco_demo_get_statistics(sco_audio_ctx_t * ctx, sco_demo_statistics_t * statistics){
+    statistics->duration_ms = btstack_run_loop_get_time_ms() - ctx->statistics_start_ms;
+    sco_demo_path_statistics_get(&ctx->receive_cycles, ctx->receive_bytes, &statistics->receive);
+    sco_demo_path_statistics_get(&ctx->send_cycles, ctx->send_bytes, &statistics->send);
+    // codec thread publishes periodically, publish now if the codec runs on this thread
+    if (sco_demo_codec_on_dsp_task(ctx) == false){
+        sco_demo_codec_snapshot_publish(ctx);
+    }
+    unsigned int index = atomic_load_explicit(&ctx->codec_snapshot_index, memory_order_acquire);
+    const sco_demo_codec_snapshot_t * snapshot = &ctx->codec_snapshot[index];
+    statistics->decode = snapshot->decode;
+    statistics->decode.bytes = ctx->receive_bytes;
+    statistics->encode = snapshot->encode;
+    statistics->encode.bytes = ctx->send_bytes;
+    statistics->receive_copied_bytes = snapshot->receive_copied_bytes;
+    statistics->send_cached_frames = snapshot->cached_frames;
+    statistics->send_starved_packets = snapshot->encoder_starved_packets;
+    statistics->codec = snapshot->telemetry;
+    sco_link_stats_get(&ctx->link_stats, &statistics->link);
+    statistics->first_audio_played = atomic_load_explicit(&ctx->first_audio_played, memory_order_acquire);
+    statistics->first_audio_ms = statistics->first_audio_played ? (ctx->first_audio_latency_us / 1000) : 0;
+    jitter_buffer_get_metrics(&ctx->audio_output_jitter_buffer, &statistics->playback);
+    sco_demo_path_statistics_get(&ctx->playback_resampler_cycles, ctx->playback_resampler_bytes, &statistics->playback_resampler);
+    sco_demo_path_statistics_get(&ctx->recording_resampler_cycles, ctx->recording_resampler_bytes, &statistics->recording_resampler);
+    statistics->recording_overruns = ctx->recording_overruns;
+    statistics->recording_overrun_samples = ctx->recording_overrun_samples;
+    sco_demo_path_statistics_get(&ctx->echo_cancel_cycles, ctx->echo_cancel_bytes, &statistics->echo_cancel);
+    memset(&statistics->echo_cancel_metrics, 0, sizeof(statistics->echo_cancel_metrics));
+#ifdef ENABLE_SCO_DEMO_AEC
+    if (ctx->primary){
+        sco_aec_get_metrics(&sco_demo_aec, &statistics->echo_cancel_metrics);
+    }
+#endif
+    statistics->echo_cancel_reference_underruns = ctx->echo_cancel_reference_underruns;
+    statistics->echo_cancel_reference_overruns = ctx->echo_cancel_reference_overruns;
+    uint8_t stage;
+    for (stage = 0; stage < SCO_UPLINK_NUM_STAGES; stage++){
+        sco_demo_path_statistics_get(&ctx->uplink_cycles[stage], ctx->uplink_bytes, &statistics->uplink[stage]);
+    }
+    memset(&statistics->uplink_metrics, 0, sizeof(statistics->uplink_metrics));
+#ifdef ENABLE_SCO_DEMO_UPLINK
+    if (ctx->primary){
+        sco_uplink_get_metrics(&sco_demo_uplink, &statistics->uplink_metrics);
+    }
+#endif
+}
+
+static void sco_demo_dump_statistics(sco_audio_ctx_t * ctx){
+    sco_demo_statistics_t statistics;
+    sco_demo_get_statistics(ctx, &statistics);
+    printf("SCO demo performance over %u ms:\n", (unsigned int) statistics.duration_ms);
+    sco_demo_path_statistics_dump("receive", &statistics.receive, statistics.duration_ms);
+    sco_demo_path_statistics_dump("send",    &statistics.send,    statistics.duration_ms);
+#ifdef ENABLE_SCO_DSP_TASK
+    if (ctx->primary){
+        sco_demo_path_statistics_dump("decode",  &statistics.decode,  statistics.duration_ms);
+        sco_demo_path_statistics_dump("encode",  &statistics.encode,  statistics.duration_ms);
+        sco_dsp_task_statistics_t dsp_statistics;
+        sco_dsp_task_get_statistics(&dsp_statistics);
+        printf("- DSP task: %u received packets dropped, %u payloads not ready\n",
+               (unsigned int) dsp_statistics.packets_dropped, (unsigned int) dsp_statistics.payloads_missing);
+    }
+#endif
+    if (statistics.receive.packets > 0){
+        printf("- receive: %u bytes copied per packet\n",
+               (unsigned int) (statistics.receive_copied_bytes / statistics.receive.packets));
+    }
+    const sco_demo_codec_telemetry_t * codec = &statistics.codec;
+    printf("- codec %s: %u frames decoded, %u concealed, %u BEC, %u encoded, received %u bytes, sent %u bytes\n",
+           codec->codec, (unsigned int) codec->frames_decoded, (unsigned int) codec->frames_concealed,
+           (unsigned int) codec->bec_detections, (unsigned int) codec->frames_encoded,
+           (unsigned int) codec->bytes_received, (unsigned int) codec->bytes_sent);
+    printf("- codec %s: decode cycles min %u, avg %u, max %u, encode cycles min %u, avg %u, max %u\n",
+           codec->codec, (unsigned int) codec->decode_cycles_min, (unsigned int) codec->decode_cycles_avg,
+           (unsigned int) codec->decode_cycles_max, (unsigned int) codec->encode_cycles_min,
+           (unsigned int) codec->encode_cycles_avg, (unsigned int) codec->encode_cycles_max);
+    if (statistics.link.packets > 0){
+        const sco_link_stats_snapshot_t * link = &statistics.link;
+        printf("- link: %u packets, status good %u, invalid %u, no data %u, partially lost %u, loss %u permille now\n",
+               (unsigned int) link->packets, (unsigned int) link->status[SCO_LINK_STATS_STATUS_GOOD],
+               (unsigned int) link->status[SCO_LINK_STATS_STATUS_INVALID], (unsigned int) link->status[SCO_LINK_STATS_STATUS_NO_DATA],
+               (unsigned int) link->status[SCO_LINK_STATS_STATUS_PARTIALLY_LOST], (unsigned int) link->loss_permille);
+        printf("- link: %u erasures in %u bursts, max %u, bursts 1/2/3-4/5-8/9-16/17-32/33-64/more: %u/%u/%u/%u/%u/%u/%u/%u\n",
+               (unsigned int) link->erasures, (unsigned int) link->bursts, (unsigned int) link->burst_max,
+               (unsigned int) link->burst_histogram[0], (unsigned int) link->burst_histogram[1],
+               (unsigned int) link->burst_histogram[2], (unsigned int) link->burst_histogram[3],
+               (unsigned int) link->burst_histogram[4], (unsigned int) link->burst_histogram[5],
+               (unsigned int) link->burst_histogram[6], (unsigned int) link->burst_histogram[7]);
+        printf("- link: arrival jitter %u us, max %u us, deviation <0.5/1/2/4/8/16/32/more ms: %u/%u/%u/%u/%u/%u/%u/%u\n",
+               (unsigned int) link->jitter_us, (unsigned int) link->jitter_max_us,
+               (unsigned int) link->arrival_histogram[0], (unsigned int) link->arrival_histogram[1],
+               (unsigned int) link->arrival_histogram[2], (unsigned int) link->arrival_histogram[3],
+               (unsigned int) link->arrival_histogram[4], (unsigned int) link->arrival_histogram[5],
+               (unsigned int) link->arrival_histogram[6], (unsigned int) link->arrival_histogram[7]);
+    }
+    if (statistics.first_audio_played){
+        printf("- playback: first audio %u ms after audio connection\n", (unsigned int) statistics.first_audio_ms);
+    }
+    if (statistics.send_cached_frames > 0){
+        printf("- send: %u pre-encoded silence / comfort noise frames, %u packets with encoder starved\n",
+               (unsigned int) statistics.send_cached_frames, (unsigned int) statistics.send_starved_packets);
+    }
+    printf("- playback: depth %u ms, target %u ms, jitter %u ms, added latency %u ms, %u underruns, %u samples concealed, %u dropped, drift %d ppm\n",
+           statistics.playback.depth_ms, statistics.playback.target_ms, statistics.playback.jitter_ms,
+           statistics.playback.added_latency_ms, (unsigned int) statistics.playback.underruns,
+           (unsigned int) statistics.playback.concealed_samples, (unsigned int) statistics.playback.dropped_samples,
+           (int) statistics.playback.drift_ppm);
+#ifdef USE_AUDIO_INPUT
+    printf("- recording: drift %d ppm, %u overruns with %u samples dropped\n", (int) ctx->audio_input_asrc.ppm,
+           (unsigned int) statistics.recording_overruns, (unsigned int) statistics.recording_overrun_samples);
+#endif
+    if (statistics.playback_resampler.packets > 0){
+        sco_demo_path_statistics_dump("resample playback",  &statistics.playback_resampler,  statistics.duration_ms);
+    }
+    if (statistics.recording_resampler.packets > 0){
+        sco_demo_path_statistics_dump("resample recording", &statistics.recording_resampler, statistics.duration_ms);
+    }
+    if (statistics.echo_cancel.packets > 0){
+        const sco_aec_metrics_t * aec = &statistics.echo_cancel_metrics;
+        sco_demo_path_statistics_dump("echo cancel", &statistics.echo_cancel, statistics.duration_ms);
+        // budget: blocks per 7.5 ms codec frame
+        uint32_t frame_samples = (ctx->codec_current == NULL) ? 0 : (ctx->codec_current->sample_rate * 75 / 10000);
+        printf("- echo cancel: ERLE %d dB, tail %u ms, avg %u cycles per 7.5 ms frame, reference underruns %u, overruns %u\n",
+               aec->erle_db, aec->tail_ms, (unsigned int) (statistics.echo_cancel.cycles_avg * frame_samples / SCO_AEC_BLOCK_SAMPLES),
+               (unsigned int) statistics.echo_cancel_reference_underruns, (unsigned int) statistics.echo_cancel_reference_overruns);
+        printf("- echo cancel: %u blocks, far-end idle %u, double talk %u, bypassed %u, filter updates %u, restores %u\n",
+               (unsigned int) aec->blocks, (unsigned int) aec->blocks_far_end_idle, (unsigned int) aec->blocks_double_talk,
+               (unsigned int) aec->blocks_bypassed, (unsigned int) aec->filter_updates, (unsigned int) aec->filter_restores);
+    }
+    deferred_log_statistics_t log_statistics;
+    deferred_log_get_statistics(&log_statistics);
+    printf("- log: %u entries, %u dropped, write cycles avg %u, p99 %u, max %u\n",
+           (unsigned int) log_statistics.entries_logged, (unsigned int) log_statistics.entries_dropped,
+           (unsigned int) log_statistics.write_cycles_avg, (unsigned int) log_statistics.write_cycles_p99,
+           (unsigned int) log_statistics.write_cycles_max);
+    uint8_t stage;
+    for (stage = 0; stage < SCO_UPLINK_NUM_STAGES; stage++){
+        if (statistics.uplink[stage].packets > 0){
+            sco_demo_path_statistics_dump(sco_demo_uplink_stage_names[stage], &statistics.uplink[stage], statistics.duration_ms);
+        }
+    }
+    if (statistics.uplink_metrics.frames > 0){
+        const sco_uplink_metrics_t * uplink = &statistics.uplink_metrics;
+        printf("- uplink: %u frames, noise %d dBFS reduced by %d dB, speech %d dBFS, gain %d dB, %u speech frames, %u limited\n",
+               (unsigned int) uplink->frames, uplink->noise_level_dbfs, uplink->noise_reduction_db, uplink->speech_level_dbfs,
+               uplink->gain_db, (unsigned int) uplink->frames_speech, (unsigned int) uplink->frames_limited);
+    }
+#ifdef SCO_CAPTURE_FILENAME_PREFIX
+    if (ctx->primary == false) return;
+    uint8_t channel;
+    for (channel = 0; channel < SCO_CAPTURE_NUM_CHANNELS; channel++){
+        sco_capture_statistics_t capture;
+        sco_capture_get_statistics((sco_capture_channel_t) channel, &capture);
+        printf("- capture %s: %u samples, %u written to %u files, %u overruns with %u samples dropped, %u write errors\n",
+               (channel == SCO_CAPTURE_RX) ? "rx" : "tx", (unsigned int) capture.samples_captured,
+               (unsigned int) capture.samples_written, capture.files, (unsigned int) capture.overruns,
+               (unsigned int) capture.overrun_samples, (unsigned int) capture.write_errors);
+    }
+#endif
+}
+
+// on codec thread
+static void sco_demo_codec_statistics_reset_check(sco_audio_ctx_t * ctx){
+    if (atomic_exchange_explicit(&ctx->codec_statistics_reset_requested, false, memory_order_relaxed) == false) return;
+    cycle_stats_reset(&ctx->decode_cycles);
+    cycle_stats_reset(&ctx->encode_cycles);
+    ctx->receive_copied_bytes    = 0;
+    ctx->cached_frames           = 0;
+    ctx->encoder_starved_packets = 0;
+}
+
+// codec telemetry and statistics: sample on codec thread into inactive buffer, then switch buffers
+static void sco_demo_codec_snapshot_publish(sco_audio_ctx_t * ctx){
+    sco_demo_codec_statistics_reset_check(ctx);
+    unsigned int index = 1 - atomic_load_explicit(&ctx->codec_snapshot_index, memory_order_relaxed);
+    sco_demo_codec_snapshot_t * snapshot = &ctx->codec_snapshot[index];
+    sco_demo_codec_telemetry_t * telemetry = &snapshot->telemetry;
+    sco_link_stats_snapshot_t link;
+    sco_link_stats_get(&ctx->link_stats, &link);
+    telemetry->codec             = ctx->codec_current->name;
+    telemetry->frames_decoded    = link.frames[SCO_LINK_STATS_FRAME_GOOD] + link.frames[SCO_LINK_STATS_FRAME_BEC];
+    telemetry->frames_concealed  = link.frames[SCO_LINK_STATS_FRAME_CONCEALED];
+    telemetry->bec_detections    = link.frames[SCO_LINK_STATS_FRAME_BEC];
+    telemetry->frames_encoded    = ctx->codec_frames_encoded;
+    telemetry->decode_cycles_min = (ctx->codec_decode_cycles.count == 0) ? 0 : ctx->codec_decode_cycles.min;
+    telemetry->decode_cycles_avg = cycle_stats_get_average(&ctx->codec_decode_cycles);
+    telemetry->decode_cycles_max = ctx->codec_decode_cycles.max;
+    telemetry->encode_cycles_min = (ctx->codec_encode_cycles.count == 0) ? 0 : ctx->codec_encode_cycles.min;
+    telemetry->encode_cycles_avg = cycle_stats_get_average(&ctx->codec_encode_cycles);
+    telemetry->encode_cycles_max = ctx->codec_encode_cycles.max;
+    telemetry->bytes_received    = ctx->codec_bytes_received;
+    telemetry->bytes_sent        = ctx->codec_bytes_sent;
+    sco_demo_path_statistics_get(&ctx->decode_cycles, 0, &snapshot->decode);
+    sco_demo_path_statistics_get(&ctx->encode_cycles, 0, &snapshot->encode);
+    snapshot->receive_copied_bytes    = ctx->receive_copied_bytes;
+    snapshot->cached_frames           = ctx->cached_frames;
+    snapshot->encoder_starved_packets = ctx->encoder_starved_packets;
+    atomic_store_explicit(&ctx->codec_snapshot_index, index, memory_order_release);
+}
+
+// called before codec thread starts
+static void sco_demo_codec_telemetry_reset(sco_audio_ctx_t * ctx){
+    cycle_stats_reset(&ctx->codec_decode_cycles);
+    cycle_stats_reset(&ctx->codec_encode_cycles);
+    ctx->codec_frames_encoded = 0;
+    ctx->codec_bytes_received = 0;
+    ctx->codec_bytes_sent     = 0;
+    ctx->codec_telemetry_sampled_us = sco_demo_get_time_us();
+    atomic_store_explicit(&ctx->codec_statistics_reset_requested, true, memory_order_relaxed);
+    sco_demo_codec_snapshot_publish(ctx);
+}
+
+void sco_demo_get_codec_telemetry(sco_audio_ctx_t * ctx, sco_demo_codec_telemetry_t * telemetry){
+    // buffer is overwritten only after next sampling period
+    unsigned int index = atomic_load_explicit(&ctx->codec_snapshot_index, memory_order_acquire);
+    *telemetry = ctx->codec_snapshot[index].telemetry;
+}
+
+// decode packet and pass arrival time to jitter buffer, on run loop or DSP task
+static void sco_demo_process_packet(void * context, const uint8_t * packet, uint16_t size, uint32_t arrival_us){
+    sco_audio_ctx_t * ctx = (sco_audio_ctx_t *) context;
+    sco_demo_codec_statistics_reset_check(ctx);
+    uint32_t cycles_start = cycle_stats_get_cycles();
+    ctx->codec_current->receive(ctx, packet, size);
+    cycle_stats_add(&ctx->decode_cycles, cycle_stats_get_cycles() - cycles_start);
+    jitter_buffer_packet_received(&ctx->audio_output_jitter_buffer, arrival_us);
+
+    ctx->codec_bytes_received += size - 3;
+    if ((arrival_us - ctx->codec_telemetry_sampled_us) >= (SCO_DEMO_CODEC_TELEMETRY_PERIOD_MS * 1000)){
+        ctx->codec_telemetry_sampled_us = arrival_us;
+        sco_demo_codec_snapshot_publish(ctx);
+        const sco_demo_codec_telemetry_t * telemetry =
+            &ctx->codec_snapshot[atomic_load_explicit(&ctx->codec_snapshot_index, memory_order_relaxed)].telemetry;
+        deferred_log_debug("Codec %s: %u decoded, %u concealed, %u BEC, decode cycles avg %u, encode cycles avg %u\n",
+                           telemetry->codec, (unsigned int) telemetry->frames_decoded, (unsigned int) telemetry->frames_concealed,
+                           (unsigned int) telemetry->bec_detections, (unsigned int) telemetry->decode_cycles_avg,
+                           (unsigned int) telemetry->encode_cycles_avg);
+        UNUSED(telemetry);
+    }
+}
+
+// get audio and encode next SCO payload, on run loop or DSP task
+static void sco_demo_produce_payload(void * context, uint8_t * payload, uint16_t payload_size){
+    sco_audio_ctx_t * ctx = (sco_audio_ctx_t *) context;
+    sco_demo_codec_statistics_reset_check(ctx);
+    uint32_t cycles_start = cycle_stats_get_cycles();
+
+#ifdef USE_ADUIO_GENERATOR
+    // re-fill audio buffer, generate directly into free regions
+    while (true){
+        int16_t * samples;
+        uint32_t samples_to_add = sample_ring_buffer_get_write_region(&ctx->audio_input_ring_buffer, &samples);
+        if (samples_to_add == 0) break;
+        (*ctx->audio_generator)(ctx, (uint16_t) samples_to_add, samples);
+        sample_ring_buffer_commit_write(&ctx->audio_input_ring_buffer, samples_to_add);
+    }
+#endif
+
+    // resume if pre-buffer is filled
+    if (sco_demo_audio_input_paused(ctx)){
+        if ((sample_ring_buffer_samples_available(&ctx->audio_input_ring_buffer) * BYTES_PER_FRAME) >= ctx->audio_prebuffer_bytes){
+            // resume sending
+            sco_demo_set_audio_input_paused(ctx, false);
+        }
+    }
+
+    // fill payload by codec
+    ctx->codec_current->fill_payload(ctx, payload, payload_size);
+    ctx->codec_bytes_sent += payload_size;
+
+    cycle_stats_add(&ctx->encode_cycles, cycle_stats_get_cycles() - cycles_start);
+}
+
+#ifdef ENABLE_SCO_DSP_TASK
+static const sco_dsp_task_handler_t sco_demo_dsp_task_handler = {
+    .process_packet  = &sco_demo_process_packet,
+    .process_input   = &sco_demo_encode_ahead_handler,
+    .produce_payload = &sco_demo_produce_payload,
+};
+#endif
+
+void sco_demo_set_codec(sco_audio_ctx_t * ctx, uint8_t negotiated_codec){
     switch (negotiated_codec){
         case HFP_CODEC_CVSD:
-            codec_current = &codec_cvsd;
+            ctx->codec_current = &codec_cvsd;
             break;
 #ifdef ENABLE_HFP_WIDE_BAND_SPEECH
         case HFP_CODEC_MSBC:
-            codec_current = &codec_msbc;
+            ctx->codec_current = &codec_msbc;
             break;
 #endif
 #ifdef ENABLE_HFP_SUPER_WIDE_BAND_SPEECH
         case HFP_CODEC_LC3_SWB:
-            codec_current = &codec_lc3swb;
+            ctx->codec_current = &codec_lc3swb;
             break;
 #endif
         default:
@@ -596,52 +1623,70 @@ void sco_demo_set_codec(uint8_t negotiated_codec){
             break;
     }
 
-    codec_current->init();
+    // first context gets audio device, capture and DSP task
+    sco_audio_ctx_t * expected = NULL;
+    ctx->primary = atomic_compare_exchange_strong(&sco_demo_primary_ctx, &expected, ctx) || (expected == ctx);
+
+    ctx->codec_current->init(ctx);
+
+    ctx->audio_prebuffer_bytes = SCO_PREBUFFER_MS * (ctx->codec_current->sample_rate/1000) * BYTES_PER_FRAME;
+
+    sco_link_stats_init(&ctx->link_stats, (negotiated_codec == HFP_CODEC_CVSD) ? SCO_CVSD_BYTES_PER_SECOND : SCO_TRANSPARENT_BYTES_PER_SECOND);
+    sco_demo_codec_telemetry_reset(ctx);
+
+    audio_initialize(ctx, ctx->codec_current->sample_rate);
 
-    audio_initialize(codec_current->sample_rate);
+    sco_demo_reset_statistics(ctx);
 
-    audio_prebuffer_bytes = SCO_PREBUFFER_MS * (codec_current->sample_rate/1000) * BYTES_PER_FRAME;
+#ifdef ENABLE_SCO_DSP_TASK
+    if (ctx->primary){
+        sco_dsp_task_start(&sco_demo_dsp_task_handler, ctx);
+    }
+#endif
 
-#ifdef SCO_WAV_FILENAME
-    num_samples_to_write = codec_current->sample_rate * SCO_WAV_DURATION_IN_SECONDS;
-    wav_writer_open(SCO_WAV_FILENAME, 1, codec_current->sample_rate);
+#ifdef SCO_CAPTURE_FILENAME_PREFIX
+    if (ctx->primary){
+        sco_capture_start(SCO_CAPTURE_FILENAME_PREFIX, ctx->codec_current->sample_rate);
+    }
 #endif
 
 #if SCO_DEMO_MODE == SCO_DEMO_MODE_SINE
-    sine_wave_steps_per_sample = SINE_WAVE_SAMPLE_RATE / codec_current->sample_rate;
-    sco_demo_audio_generator = &sco_demo_sine_wave_host_endian;
+    tone_generator_init(&ctx->tone_generator, ctx->codec_current->sample_rate);
+    tone_generator_add_tone(&ctx->tone_generator, SCO_DEMO_TONE_FREQUENCY_HZ, SCO_DEMO_TONE_AMPLITUDE);
+    ctx->audio_generator = &sco_demo_sine_wave_host_endian;
 #endif
 
 #if SCO_DEMO_MODE == SCO_DEMO_MODE_MODPLAYER
-    // load mod
-    hxcmod_setcfg(&mod_context, codec_current->sample_rate, 16, 1, 1, 1);
-    hxcmod_load(&mod_context, (void *) &mod_data, mod_len);
-    sco_demo_audio_generator = &sco_demo_modplayer;
+    // init and load mod
+    int hxcmod_initialized = hxcmod_init(&ctx->mod_context);
+    btstack_assert(hxcmod_initialized != 0);
+    hxcmod_setcfg(&ctx->mod_context, ctx->codec_current->sample_rate, 16, 1, 1, 1);
+    hxcmod_load(&ctx->mod_context, (void *) &mod_data, mod_len);
+    ctx->audio_generator = &sco_demo_modplayer;
 #endif
 }
 
-void sco_demo_receive(uint8_t * packet, uint16_t size){
-    static uint32_t packets = 0;
-    static uint32_t crc_errors = 0;
-    static uint32_t data_received = 0;
-    static uint32_t byte_errors = 0;
+void sco_demo_receive(sco_audio_ctx_t * ctx, uint8_t * packet, uint16_t size){
+    ctx->count_received++;
 
-    count_received++;
+    uint32_t arrival_us = sco_demo_get_time_us();
+    sco_link_stats_packet_received(&ctx->link_stats, packet, size, arrival_us);
 
-    data_received += size - 3;
-    packets++;
-    if (data_received > 100000){
-        printf("Summary: data %07u, packets %04u, packet with crc errors %0u, byte errors %04u\n",  (unsigned int) data_received,  (unsigned int) packets, (unsigned int) crc_errors, (unsigned int) byte_errors);
-        crc_errors = 0;
-        byte_errors = 0;
-        data_received = 0;
-        packets = 0;
+    uint32_t cycles_start = cycle_stats_get_cycles();
+#ifdef ENABLE_SCO_DSP_TASK
+    if (ctx->primary){
+        sco_dsp_task_receive(packet, size, arrival_us);
+    } else {
+        sco_demo_process_packet(ctx, packet, size, arrival_us);
     }
-
-    codec_current->receive(packet, size);
+#else
+    sco_demo_process_packet(ctx, packet, size, arrival_us);
+#endif
+    cycle_stats_add(&ctx->receive_cycles, cycle_stats_get_cycles() - cycles_start);
+    ctx->receive_bytes += size - 3;
 }
 
-void sco_demo_send(hci_con_handle_t sco_handle){
+void sco_demo_send(sco_audio_ctx_t * ctx, hci_con_handle_t sco_handle){
 
     if (sco_handle == HCI_CON_HANDLE_INVALID) return;
 
@@ -651,29 +1696,20 @@ void sco_demo_send(hci_con_handle_t sco_handle){
     hci_reserve_packet_buffer();
     uint8_t * sco_packet = hci_get_outgoing_packet_buffer();
 
-#ifdef USE_ADUIO_GENERATOR
-    #define REFILL_SAMPLES 16
-    // re-fill audio buffer
-    uint16_t samples_free = btstack_ring_buffer_bytes_free(&audio_input_ring_buffer) / 2;
-    while (samples_free > 0){
-        int16_t samples_buffer[REFILL_SAMPLES];
-        uint16_t samples_to_add = btstack_min(samples_free, REFILL_SAMPLES);
-        (*sco_demo_audio_generator)(samples_to_add, samples_buffer);
-        btstack_ring_buffer_write(&audio_input_ring_buffer, (uint8_t *)samples_buffer, samples_to_add * 2);
-        samples_free -= samples_to_add;
-    }
-#endif
+    uint32_t cycles_start = cycle_stats_get_cycles();
 
-    // resume if pre-buffer is filled
-    if (audio_input_paused){
-        if (btstack_ring_buffer_bytes_available(&audio_input_ring_buffer) >= audio_prebuffer_bytes){
-            // resume sending
-            audio_input_paused = 0;
-        }
+#ifdef ENABLE_SCO_DSP_TASK
+    if (ctx->primary == false){
+        sco_demo_produce_payload(ctx, &sco_packet[3], sco_payload_length);
+    } else if (sco_dsp_task_get_payload(&sco_packet[3], sco_payload_length) == false){
+        ctx->codec_current->fill_cached_payload(ctx, &sco_packet[3], sco_payload_length);
     }
+#else
+    sco_demo_produce_payload(ctx, &sco_packet[3], sco_payload_length);
+#endif
 
-    // fill payload by codec
-    codec_current->fill_payload(&sco_packet[3], sco_payload_length);
+    cycle_stats_add(&ctx->send_cycles, cycle_stats_get_cycles() - cycles_start);
+    ctx->send_bytes += sco_payload_length;
 
     // set handle + flags
     little_endian_store_16(sco_packet, 0, sco_handle);
@@ -685,22 +1721,41 @@ void sco_demo_send(hci_con_handle_t sco_handle){
     // request another send event
     hci_request_sco_can_send_now_event();
 
-    count_sent++;
-    if ((count_sent % SCO_REPORT_PERIOD) == 0) {
-        printf("SCO: sent %u, received %u\n", count_sent, count_received);
+    ctx->count_sent++;
+    if ((ctx->count_sent % SCO_REPORT_PERIOD) == 0) {
+        deferred_log_info("SCO: sent %u, received %u\n", ctx->count_sent, ctx->count_received);
     }
 }
 
-void sco_demo_close(void){
+void sco_demo_close(sco_audio_ctx_t * ctx){
+    // print pending log entries, e.g. connection released, before the statistics
+    deferred_log_flush();
     printf("SCO demo close\n");
 
-    printf("SCO demo statistics: ");
-    codec_current->close();
-    codec_current = NULL;
+#ifdef ENABLE_SCO_DSP_TASK
+    if (ctx->primary){
+        sco_dsp_task_stop();
+    }
+#endif
+
+    // codec thread has stopped
+    sco_demo_codec_snapshot_publish(ctx);
 
-#if defined(SCO_WAV_FILENAME)
-    wav_writer_close();
+    sco_demo_dump_statistics(ctx);
+
+    // detach from audio callbacks before the codec goes away
+    audio_terminate(ctx);
+
+    ctx->codec_current = NULL;
+
+#ifdef SCO_CAPTURE_FILENAME_PREFIX
+    if (ctx->primary){
+        sco_capture_stop();
+    }
 #endif
 
-    audio_terminate();
+    if (ctx->primary){
+        ctx->primary = false;
+        atomic_store_explicit(&sco_demo_primary_ctx, NULL, memory_order_release);
+    }
 }
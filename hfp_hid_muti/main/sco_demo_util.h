@@ -43,38 +43,171 @@
 #ifndef SCO_DEMO_UTIL_H
 #define SCO_DEMO_UTIL_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #include "hci.h"
+#include "jitter_buffer.h"
+#include "sco_link_stats.h"
+#include "sco_aec.h"
+#include "sco_uplink.h"
 
 #if defined __cplusplus
 extern "C" {
 #endif
 
+typedef struct {
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t cycles_min;
+    uint32_t cycles_avg;
+    uint32_t cycles_max;
+    uint32_t cycles_p50;
+    uint32_t cycles_p99;
+} sco_demo_path_statistics_t;
+
+// per codec, sampled on the codec thread every SCO_DEMO_CODEC_TELEMETRY_PERIOD_MS and on close
+typedef struct {
+    const char * codec;
+    // frames from received data, incl. BEC, and frames replaced by PLC
+    uint32_t frames_decoded;
+    uint32_t frames_concealed;
+    uint32_t bec_detections;
+    uint32_t frames_encoded;
+    // codec call per frame only, encode is 0 for CVSD
+    uint32_t decode_cycles_min;
+    uint32_t decode_cycles_avg;
+    uint32_t decode_cycles_max;
+    uint32_t encode_cycles_min;
+    uint32_t encode_cycles_avg;
+    uint32_t encode_cycles_max;
+    // SCO payload on air
+    uint32_t bytes_received;
+    uint32_t bytes_sent;
+} sco_demo_codec_telemetry_t;
+
+typedef struct {
+    uint32_t duration_ms;
+    sco_demo_path_statistics_t receive;
+    sco_demo_path_statistics_t send;
+    // codec work only, equal to receive / send unless it runs in the DSP task
+    sco_demo_path_statistics_t decode;
+    sco_demo_path_statistics_t encode;
+    // bytes moved between buffers on receive, excluding decoder / PLC output into playback buffer
+    uint32_t receive_copied_bytes;
+    // mSBC / LC3-SWB frames sent from pre-encoded cache while audio input was paused or muted
+    uint32_t send_cached_frames;
+    // packets filled from cache because no encoded frame was ready while audio input was running
+    uint32_t send_starved_packets;
+    // time from codec set to first sample above silence played by audio device
+    bool     first_audio_played;
+    uint32_t first_audio_ms;
+    jitter_buffer_metrics_t playback;
+    // conversion between codec rate and audio device rate, per audio callback block, bytes at device rate
+    sco_demo_path_statistics_t playback_resampler;
+    sco_demo_path_statistics_t recording_resampler;
+    // recording blocks dropped because the input buffer was full, samples at codec rate
+    uint32_t recording_overruns;
+    uint32_t recording_overrun_samples;
+    // echo cancellation per block of SCO_AEC_BLOCK_SAMPLES at codec rate, bytes of microphone input
+    sco_demo_path_statistics_t echo_cancel;
+    sco_aec_metrics_t echo_cancel_metrics;
+    // blocks processed without reference because playback fell behind, reference samples dropped
+    uint32_t echo_cancel_reference_underruns;
+    uint32_t echo_cancel_reference_overruns;
+    // uplink conditioning per 7.5 ms frame at codec rate and stage, bytes of microphone input
+    sco_demo_path_statistics_t uplink[SCO_UPLINK_NUM_STAGES];
+    sco_uplink_metrics_t uplink_metrics;
+    // packet status, erasures and arrival jitter of received packets, frames by decoder result
+    sco_link_stats_snapshot_t link;
+    sco_demo_codec_telemetry_t codec;
+} sco_demo_statistics_t;
+
+/*
+ * State of one SCO audio link, opaque. Contexts are independent and can be processed on different threads.
+ * Audio input/output with echo cancellation and uplink conditioning, capture and the DSP task exist only once:
+ * they are attached to the first context that sets a codec until it is closed. Other contexts process audio
+ * without audio device, generated audio is sent in sine and mod player mode.
+ */
+typedef struct sco_audio_ctx sco_audio_ctx_t;
+
 /**
  * @brief Init demo SCO data production/consumtion
  */
 void sco_demo_init(void);
 
+/**
+ * @brief Get unused context from static pool of SCO_DEMO_MAX_CONTEXTS, contexts are not released
+ * @return ctx or NULL if all are in use
+ */
+sco_audio_ctx_t * sco_demo_create_context(void);
+
+/**
+ * @brief Echo cancellation of audio input is available, HF may report EC/NR function
+ * @return true if enabled in SCO demo configuration
+ */
+bool sco_demo_echo_cancel_supported(void);
+
 /**
  * @brief Set codec (cvsd:0x01, msbc:0x02) and initalize wav writter and portaudio .
+ * @param ctx
  * @param codec
  */
- void sco_demo_set_codec(uint8_t codec);
+ void sco_demo_set_codec(sco_audio_ctx_t * ctx, uint8_t codec);
 
 /**
  * @brief Send next data on con_handle
+ * @param ctx
  * @param con_handle
  */
-void sco_demo_send(hci_con_handle_t con_handle);
+void sco_demo_send(sco_audio_ctx_t * ctx, hci_con_handle_t con_handle);
 
 /**
  * @brief Process received data
+ * @param ctx
  */
-void sco_demo_receive(uint8_t * packet, uint16_t size);
+void sco_demo_receive(sco_audio_ctx_t * ctx, uint8_t * packet, uint16_t size);
 
 /**
  * @brief Close WAV writer, stop portaudio stream
+ * @param ctx
+ */
+void sco_demo_close(sco_audio_ctx_t * ctx);
+
+/**
+ * @brief Mute microphone: send silence instead of audio input. For mSBC / LC3-SWB pre-encoded frames are used
+ * @param ctx
+ * @param muted
+ */
+void sco_demo_set_microphone_mute(sco_audio_ctx_t * ctx, bool muted);
+
+/**
+ * @brief Set uplink conditioning for codec rate, e.g. to enable only the stages that fit the CPU budget. Used from
+ * next codec set on, microphone mode only
+ * @param sample_rate 8000 (CVSD), 16000 (mSBC) or 32000 (LC3-SWB)
+ * @param config copied
+ */
+void sco_demo_set_uplink_config(uint16_t sample_rate, const sco_uplink_config_t * config);
+
+/**
+ * @brief Get codec telemetry as last sampled by the codec thread, can be called from any thread while connected
+ * @param ctx
+ * @param telemetry
+ */
+void sco_demo_get_codec_telemetry(sco_audio_ctx_t * ctx, sco_demo_codec_telemetry_t * telemetry);
+
+/**
+ * @brief Get per-packet processing cost and throughput of receive and send path since codec was set
+ * @param ctx
+ * @param statistics
+ */
+void sco_demo_get_statistics(sco_audio_ctx_t * ctx, sco_demo_statistics_t * statistics);
+
+/**
+ * @brief Reset performance statistics
+ * @param ctx
  */
-void sco_demo_close(void);
+void sco_demo_reset_statistics(sco_audio_ctx_t * ctx);
 
 #if defined __cplusplus
 }
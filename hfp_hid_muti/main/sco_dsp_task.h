@@ -0,0 +1,102 @@
+/*
+ * sco_dsp_task.h - run SCO decode/encode in a separate task, exchanging packets with the run loop via lock-free queues
+ *
+ * The run loop queues received SCO packets and takes ready-made SCO payloads. The task decodes queued packets
+ * and keeps SCO_DSP_TASK_PAYLOADS_AHEAD payloads encoded in advance. On ESP32 the task is pinned to the second
+ * core unless FreeRTOS runs in single core mode. Other platforms use a pthread.
+ */
+
+#ifndef SCO_DSP_TASK_H
+#define SCO_DSP_TASK_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// HCI SCO packet: handle + flags (2), length (1), up to 255 bytes payload
+#define SCO_DSP_TASK_MAX_PACKET_SIZE    (3 + 255)
+
+// queue sizes, must be power of two
+#define SCO_DSP_TASK_QUEUE_SIZE         8
+
+// payloads encoded in advance, adds SCO_DSP_TASK_PAYLOADS_AHEAD packets of uplink latency
+#define SCO_DSP_TASK_PAYLOADS_AHEAD     2
+
+typedef struct {
+    /**
+     * @brief Decode received SCO packet, called on DSP task
+     * @param context
+     * @param packet including HCI SCO header
+     * @param size
+     * @param arrival_us time packet was received by run loop
+     */
+    void (*process_packet)(void * context, const uint8_t * packet, uint16_t size, uint32_t arrival_us);
+
+    /**
+     * @brief Process new audio input ahead of payload requests, optional. Called on DSP task after each wakeup
+     * @param context
+     */
+    void (*process_input)(void * context);
+
+    /**
+     * @brief Encode next SCO payload, called on DSP task
+     * @param context
+     * @param payload
+     * @param size
+     */
+    void (*produce_payload)(void * context, uint8_t * payload, uint16_t size);
+} sco_dsp_task_handler_t;
+
+typedef struct {
+    uint32_t packets_dropped;
+    uint32_t payloads_missing;
+} sco_dsp_task_statistics_t;
+
+/**
+ * @brief Start processing, creates task on first call. Called from run loop
+ * @param handler
+ * @param context passed to handler
+ */
+void sco_dsp_task_start(const sco_dsp_task_handler_t * handler, void * context);
+
+/**
+ * @brief Stop processing and drop queued packets and payloads. Blocks until task is idle. Called from run loop
+ */
+void sco_dsp_task_stop(void);
+
+/**
+ * @brief Queue received SCO packet for decoding. Called from run loop
+ * @param packet including HCI SCO header
+ * @param size
+ * @param arrival_us
+ */
+void sco_dsp_task_receive(const uint8_t * packet, uint16_t size, uint32_t arrival_us);
+
+/**
+ * @brief Get next encoded SCO payload. Called from run loop
+ * @param payload
+ * @param size of SCO payload, requested for following payloads as well
+ * @return false if no payload was ready
+ */
+bool sco_dsp_task_get_payload(uint8_t * payload, uint16_t size);
+
+/**
+ * @brief Wake task to process new audio input via process_input handler. Can be called from any thread
+ */
+void sco_dsp_task_wakeup(void);
+
+/**
+ * @brief Get queue statistics since start, can be called from any thread
+ * @param statistics
+ */
+void sco_dsp_task_get_statistics(sco_dsp_task_statistics_t * statistics);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * sco_link_stats.c - SCO link quality statistics from HCI packet status, arrival times and decoder concealment
+ */
+
+#include "sco_link_stats.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+// single writer per counter: plain load / store, no read-modify-write needed
+static inline void sco_link_stats_add(atomic_uint * counter, uint32_t value){
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static inline void sco_link_stats_set(atomic_uint * counter, uint32_t value){
+    atomic_store_explicit(counter, value, memory_order_relaxed);
+}
+
+static inline uint32_t sco_link_stats_read(atomic_uint * counter){
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+// bin 0 for values below first_limit, doubling limit per bin, last bin open
+static uint8_t sco_link_stats_log2_bin(uint32_t value, uint32_t first_limit, uint8_t num_bins){
+    uint8_t bin = 0;
+    uint32_t limit = first_limit;
+    while ((bin < (num_bins - 1)) && (value >= limit)){
+        bin++;
+        limit <<= 1;
+    }
+    return bin;
+}
+
+static void sco_link_stats_burst_ended(sco_link_stats_t * stats){
+    sco_link_stats_add(&stats->bursts, 1);
+    if (stats->burst_length > sco_link_stats_read(&stats->burst_max)){
+        sco_link_stats_set(&stats->burst_max, stats->burst_length);
+    }
+    // 1 -> 0, 2 -> 1, 3-4 -> 2, 5-8 -> 3, ...
+    uint8_t bin = sco_link_stats_log2_bin(stats->burst_length - 1, 1, SCO_LINK_STATS_BURST_BINS);
+    sco_link_stats_add(&stats->burst_histogram[bin], 1);
+    stats->burst_length = 0;
+}
+
+static void sco_link_stats_arrival(sco_link_stats_t * stats, uint16_t payload_size, uint32_t arrival_us){
+    uint32_t duration_us = (payload_size * stats->us_per_byte_q8) >> 8;
+    if (stats->arrival_started){
+        // deviation from air time of previous packet, RFC 3550 jitter with gain 1/16 in Q4
+        int32_t  deviation_us = (int32_t) (arrival_us - stats->last_arrival_us) - (int32_t) stats->last_duration_us;
+        uint32_t abs_deviation_us = (deviation_us < 0) ? (uint32_t) -deviation_us : (uint32_t) deviation_us;
+        stats->jitter_q4 += abs_deviation_us - ((stats->jitter_q4 + 8) >> 4);
+        sco_link_stats_set(&stats->jitter_us, stats->jitter_q4 >> 4);
+        if (abs_deviation_us > sco_link_stats_read(&stats->jitter_max_us)){
+            sco_link_stats_set(&stats->jitter_max_us, abs_deviation_us);
+        }
+        uint8_t bin = sco_link_stats_log2_bin(abs_deviation_us, 500, SCO_LINK_STATS_ARRIVAL_BINS);
+        sco_link_stats_add(&stats->arrival_histogram[bin], 1);
+    }
+    stats->arrival_started  = true;
+    stats->last_arrival_us  = arrival_us;
+    stats->last_duration_us = duration_us;
+}
+
+void sco_link_stats_init(sco_link_stats_t * stats, uint32_t bytes_per_second){
+    btstack_assert(bytes_per_second > 0);
+    stats->us_per_byte_q8   = (uint32_t) ((1000000ULL << 8) / bytes_per_second);
+    stats->arrival_started  = false;
+    stats->last_arrival_us  = 0;
+    stats->last_duration_us = 0;
+    stats->burst_length     = 0;
+    stats->jitter_q4        = 0;
+    stats->loss_q16         = 0;
+
+    uint8_t i;
+    atomic_init(&stats->packets, 0);
+    atomic_init(&stats->bytes, 0);
+    for (i = 0; i < SCO_LINK_STATS_NUM_STATUS; i++){
+        atomic_init(&stats->status[i], 0);
+    }
+    atomic_init(&stats->erasures, 0);
+    atomic_init(&stats->bursts, 0);
+    atomic_init(&stats->burst_max, 0);
+    for (i = 0; i < SCO_LINK_STATS_BURST_BINS; i++){
+        atomic_init(&stats->burst_histogram[i], 0);
+    }
+    atomic_init(&stats->loss_permille, 0);
+    atomic_init(&stats->jitter_us, 0);
+    atomic_init(&stats->jitter_max_us, 0);
+    for (i = 0; i < SCO_LINK_STATS_ARRIVAL_BINS; i++){
+        atomic_init(&stats->arrival_histogram[i], 0);
+    }
+    for (i = 0; i < SCO_LINK_STATS_NUM_FRAME_RESULTS; i++){
+        atomic_init(&stats->frames[i], 0);
+    }
+}
+
+void sco_link_stats_packet_received(sco_link_stats_t * stats, const uint8_t * packet, uint16_t size, uint32_t arrival_us){
+    if (size < 3) return;
+    uint16_t payload_size = size - 3;
+    sco_link_stats_status_t status = (sco_link_stats_status_t) ((packet[1] >> 4) & 3);
+
+    sco_link_stats_add(&stats->packets, 1);
+    sco_link_stats_add(&stats->bytes, payload_size);
+    sco_link_stats_add(&stats->status[status], 1);
+
+    bool erased = status != SCO_LINK_STATS_STATUS_GOOD;
+    if (erased){
+        sco_link_stats_add(&stats->erasures, 1);
+        stats->burst_length++;
+    } else if (stats->burst_length > 0){
+        sco_link_stats_burst_ended(stats);
+    }
+
+    // loss rate in Q16
+    uint32_t sample_q16 = erased ? 0x10000 : 0;
+    stats->loss_q16 = stats->loss_q16 - (stats->loss_q16 >> SCO_LINK_STATS_LOSS_EWMA_SHIFT) + (sample_q16 >> SCO_LINK_STATS_LOSS_EWMA_SHIFT);
+    sco_link_stats_set(&stats->loss_permille, (stats->loss_q16 * 1000 + 0x8000) >> 16);
+
+    sco_link_stats_arrival(stats, payload_size, arrival_us);
+}
+
+void sco_link_stats_frames_decoded(sco_link_stats_t * stats, sco_link_stats_frame_t result, uint16_t num_frames){
+    btstack_assert(result < SCO_LINK_STATS_NUM_FRAME_RESULTS);
+    if (num_frames == 0) return;
+    sco_link_stats_add(&stats->frames[result], num_frames);
+}
+
+void sco_link_stats_get(sco_link_stats_t * stats, sco_link_stats_snapshot_t * snapshot){
+    uint8_t i;
+    snapshot->packets = sco_link_stats_read(&stats->packets);
+    snapshot->bytes   = sco_link_stats_read(&stats->bytes);
+    for (i = 0; i < SCO_LINK_STATS_NUM_STATUS; i++){
+        snapshot->status[i] = sco_link_stats_read(&stats->status[i]);
+    }
+    snapshot->erasures  = sco_link_stats_read(&stats->erasures);
+    snapshot->bursts    = sco_link_stats_read(&stats->bursts);
+    snapshot->burst_max = sco_link_stats_read(&stats->burst_max);
+    for (i = 0; i < SCO_LINK_STATS_BURST_BINS; i++){
+        snapshot->burst_histogram[i] = sco_link_stats_read(&stats->burst_histogram[i]);
+    }
+    snapshot->loss_permille = sco_link_stats_read(&stats->loss_permille);
+    snapshot->jitter_us     = sco_link_stats_read(&stats->jitter_us);
+    snapshot->jitter_max_us = sco_link_stats_read(&stats->jitter_max_us);
+    for (i = 0; i < SCO_LINK_STATS_ARRIVAL_BINS; i++){
+        snapshot->arrival_histogram[i] = sco_link_stats_read(&stats->arrival_histogram[i]);
+    }
+    for (i = 0; i < SCO_LINK_STATS_NUM_FRAME_RESULTS; i++){
+        snapshot->frames[i] = sco_link_stats_read(&stats->frames[i]);
+    }
+}
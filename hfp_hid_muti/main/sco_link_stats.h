@@ -0,0 +1,132 @@
+/*
+ * sco_link_stats.h - SCO link quality statistics from HCI packet status, arrival times and decoder concealment
+ *
+ * Each received packet is classified by the packet status flags of the HCI SCO header. Packets not reported
+ * as correctly received are erasures: consecutive erasures form a burst, and an exponentially weighted
+ * moving average tracks the recent loss rate. Arrival times are compared against the air time of the
+ * previous packet, the deviation is smoothed as in RFC 3550 and collected in a histogram. Decoders report
+ * frames as good, concealed (PLC) or decoded with bit errors (BEC).
+ *
+ * All published values are plain 32-bit counters updated with relaxed atomics by a single writer each,
+ * packets on the receiving thread and frames on the decoding thread, so they can be read at any time.
+ */
+
+#ifndef SCO_LINK_STATS_H
+#define SCO_LINK_STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// erasure burst length histogram: 1, 2, 3-4, 5-8, 9-16, 17-32, 33-64, more packets
+#define SCO_LINK_STATS_BURST_BINS       8
+
+// arrival deviation histogram: below 0.5, 1, 2, 4, 8, 16, 32 ms, more
+#define SCO_LINK_STATS_ARRIVAL_BINS     8
+
+// loss rate average over about 2^SHIFT packets, 64 packets = 480 ms with 7.5 ms eSCO interval
+#define SCO_LINK_STATS_LOSS_EWMA_SHIFT  6
+
+// packet status flags in HCI SCO header
+typedef enum {
+    SCO_LINK_STATS_STATUS_GOOD = 0,
+    SCO_LINK_STATS_STATUS_INVALID,
+    SCO_LINK_STATS_STATUS_NO_DATA,
+    SCO_LINK_STATS_STATUS_PARTIALLY_LOST,
+    SCO_LINK_STATS_NUM_STATUS
+} sco_link_stats_status_t;
+
+typedef enum {
+    SCO_LINK_STATS_FRAME_GOOD = 0,
+    // lost frame replaced by packet loss concealment
+    SCO_LINK_STATS_FRAME_CONCEALED,
+    // frame decoded with detected bit errors, handled by bit error concealment
+    SCO_LINK_STATS_FRAME_BEC,
+    SCO_LINK_STATS_NUM_FRAME_RESULTS
+} sco_link_stats_frame_t;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t status[SCO_LINK_STATS_NUM_STATUS];
+    uint32_t erasures;
+    // bursts are counted when they end
+    uint32_t bursts;
+    uint32_t burst_max;
+    uint32_t burst_histogram[SCO_LINK_STATS_BURST_BINS];
+    // recent loss rate in 1/1000
+    uint32_t loss_permille;
+    // smoothed and max deviation of arrival time from expected interval
+    uint32_t jitter_us;
+    uint32_t jitter_max_us;
+    uint32_t arrival_histogram[SCO_LINK_STATS_ARRIVAL_BINS];
+    uint32_t frames[SCO_LINK_STATS_NUM_FRAME_RESULTS];
+} sco_link_stats_snapshot_t;
+
+typedef struct {
+    // receiving thread only
+    uint32_t    us_per_byte_q8;
+    bool        arrival_started;
+    uint32_t    last_arrival_us;
+    uint32_t    last_duration_us;
+    uint32_t    burst_length;
+    uint32_t    jitter_q4;
+    uint32_t    loss_q16;
+
+    // published
+    atomic_uint packets;
+    atomic_uint bytes;
+    atomic_uint status[SCO_LINK_STATS_NUM_STATUS];
+    atomic_uint erasures;
+    atomic_uint bursts;
+    atomic_uint burst_max;
+    atomic_uint burst_histogram[SCO_LINK_STATS_BURST_BINS];
+    atomic_uint loss_permille;
+    atomic_uint jitter_us;
+    atomic_uint jitter_max_us;
+    atomic_uint arrival_histogram[SCO_LINK_STATS_ARRIVAL_BINS];
+
+    // decoding thread
+    atomic_uint frames[SCO_LINK_STATS_NUM_FRAME_RESULTS];
+} sco_link_stats_t;
+
+/**
+ * @brief Reset statistics, called before packets are received
+ * @param stats
+ * @param bytes_per_second of SCO payload, 16000 for 16-bit CVSD, 8000 for transparent mode
+ */
+void sco_link_stats_init(sco_link_stats_t * stats, uint32_t bytes_per_second);
+
+/**
+ * @brief Account received packet. Called from receiving thread
+ * @param stats
+ * @param packet including HCI SCO header
+ * @param size
+ * @param arrival_us
+ */
+void sco_link_stats_packet_received(sco_link_stats_t * stats, const uint8_t * packet, uint16_t size, uint32_t arrival_us);
+
+/**
+ * @brief Account decoded frames. Called from decoding thread
+ * @param stats
+ * @param result
+ * @param num_frames
+ */
+void sco_link_stats_frames_decoded(sco_link_stats_t * stats, sco_link_stats_frame_t result, uint16_t num_frames);
+
+/**
+ * @brief Get current values, can be called from any thread
+ * @param stats
+ * @param snapshot
+ */
+void sco_link_stats_get(sco_link_stats_t * stats, sco_link_stats_snapshot_t * snapshot);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,281 @@
+/*
+ * sco_uplink.c - conditioning of microphone audio before encoding: high-pass, noise suppression and gain control
+ */
+
+#include <string.h>
+
+#include "sco_uplink.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+#include "cycle_stats.h"
+
+// samples are scaled up by 4 bits for precision, FFT growth of 9 bits still fits into int32_t
+#define SCO_UPLINK_SIGNAL_SHIFT             4
+
+// high-pass: corner limited to keep pole positive
+#define SCO_UPLINK_HIGH_PASS_MAX_HZ_DIVIDER 8
+
+// noise power: follows smoothed power down by 1/4 per frame, rises by 1/128 per frame, i.e. about 4.5 dB/s
+#define SCO_UPLINK_NOISE_FALL_SHIFT         2
+#define SCO_UPLINK_NOISE_RISE_SHIFT         7
+// reduction metric: smoothing 1/16 per frame, over frames with input energy below 4 times noise estimate
+#define SCO_UPLINK_NOISE_METRIC_SHIFT       4
+#define SCO_UPLINK_NOISE_FRAME_SHIFT        2
+
+// gain control: speech if frame level is above background level by margin and above minimum
+#define SCO_UPLINK_SPEECH_MARGIN_Q8         (9 * 256)
+#define SCO_UPLINK_SPEECH_MIN_DBFS_Q8       (-60 * 256)
+// speech level follows louder frames by 1/4 and quieter frames by 1/32 to track active speech rather than
+// the average over syllables, background level rises by 1/64 dB per frame
+#define SCO_UPLINK_SPEECH_RISE_SHIFT        2
+#define SCO_UPLINK_SPEECH_FALL_SHIFT        5
+#define SCO_UPLINK_BACKGROUND_RISE_Q8       4
+// gain change per speech frame: up 0.1 dB, down 1 dB, loud speech is attenuated by at most 12 dB
+#define SCO_UPLINK_GAIN_UP_Q8               26
+#define SCO_UPLINK_GAIN_DOWN_Q8             256
+#define SCO_UPLINK_GAIN_MIN_Q8              (-12 * 256)
+
+// level of silent frame
+#define SCO_UPLINK_LEVEL_MIN_DBFS_Q8        (-100 * 256)
+
+// 10 * log10(2) in Q8, 20 * log10(2) in Q8
+#define SCO_UPLINK_DB_PER_LOG2_POWER_Q8     771
+#define SCO_UPLINK_DB_PER_LOG2_GAIN_Q8      1541
+
+static inline int32_t sco_uplink_clamp(int32_t value, int32_t min, int32_t max){
+    if (value > max) return max;
+    if (value < min) return min;
+    return value;
+}
+
+static inline int16_t sco_uplink_saturate(int32_t value){
+    return (int16_t) sco_uplink_clamp(value, -32768, 32767);
+}
+
+// level of energy over num_samples in Q8 dBFS, full scale power is 2^30
+static int32_t sco_uplink_level_q8(uint64_t energy, uint16_t num_samples){
+    if (energy == 0) return SCO_UPLINK_LEVEL_MIN_DBFS_Q8;
+    int32_t log2_power = fixed_fft_log2_q8(energy) - fixed_fft_log2_q8(num_samples) - 30 * 256;
+    return sco_uplink_clamp((log2_power * SCO_UPLINK_DB_PER_LOG2_POWER_Q8) / 256, SCO_UPLINK_LEVEL_MIN_DBFS_Q8, 0);
+}
+
+// amplitude factor for gain in Q8 dB as Q16, 2^x approximated by 1 + 0.6565 x + 0.3435 x^2 between powers of two
+static int32_t sco_uplink_gain_q16(int32_t gain_q8){
+    int32_t log2_gain = (gain_q8 * 256) / SCO_UPLINK_DB_PER_LOG2_GAIN_Q8;
+    int32_t exponent  = log2_gain >> 8;
+    int32_t fraction  = log2_gain & 0xff;
+    int32_t mantissa  = 65536 + ((43025 * fraction) >> 8) + ((22512 * fraction * fraction) >> 16);
+    return (exponent >= 0) ? (mantissa << exponent) : (mantissa >> -exponent);
+}
+
+// sqrt-Hann window of 2 * frame_samples from rising half
+static inline int32_t sco_uplink_window(const sco_uplink_t * uplink, uint16_t n){
+    return (n <= uplink->frame_samples) ? uplink->window[n] : uplink->window[2 * uplink->frame_samples - n];
+}
+
+// y[n] = x[n] - x[n-1] + pole * y[n-1]
+static void sco_uplink_high_pass(sco_uplink_t * uplink, int16_t * samples){
+    int32_t state    = uplink->high_pass_state;
+    int32_t previous = uplink->high_pass_previous;
+    uint16_t i;
+    for (i = 0; i < uplink->frame_samples; i++){
+        int32_t input = samples[i];
+        state = (input - previous) * 256 + (int32_t) (((int64_t) uplink->high_pass_pole * state) >> 15);
+        previous = input;
+        samples[i] = sco_uplink_saturate((state + 128) >> 8);
+    }
+    uplink->high_pass_state    = state;
+    uplink->high_pass_previous = (int16_t) previous;
+}
+
+// gain 1 - 2 * noise / power in Q15, limited to floor. Both are normalized so the ratio is a 32-bit division
+static int32_t sco_uplink_noise_gain(const sco_uplink_t * uplink, uint64_t power, uint64_t noise_power){
+    uint64_t noise = noise_power << 1;
+    if (noise >= power) return uplink->gain_floor;
+    uint8_t shift = (uint8_t) __builtin_clzll(power);
+    uint32_t ratio_q15 = (uint32_t) ((noise << shift) >> 32) / (uint32_t) ((power << shift) >> 47);
+    return btstack_max(uplink->gain_floor, 32768 - (int32_t) ratio_q15);
+}
+
+static void sco_uplink_noise_suppression(sco_uplink_t * uplink, int16_t * samples){
+    fixed_fft_complex_t * work = uplink->work;
+    uint16_t frame_samples = uplink->frame_samples;
+    uint16_t size = 1 << uplink->fft_log2_size;
+    uint64_t input_energy = 0;
+    uint16_t i;
+
+    // previous and current frame windowed, zero padded
+    memset(work, 0, size * sizeof(fixed_fft_complex_t));
+    for (i = 0; i < frame_samples; i++){
+        work[i].re = (uplink->input_previous[i] * sco_uplink_window(uplink, i)) >> (15 - SCO_UPLINK_SIGNAL_SHIFT);
+        work[frame_samples + i].re = (samples[i] * sco_uplink_window(uplink, frame_samples + i)) >> (15 - SCO_UPLINK_SIGNAL_SHIFT);
+        // output is delayed by one frame
+        input_energy += (uint64_t) ((int32_t) uplink->input_previous[i] * uplink->input_previous[i]);
+    }
+    memcpy(uplink->input_previous, samples, frame_samples * sizeof(int16_t));
+    fixed_fft_forward(work, uplink->fft_log2_size);
+
+    // gain per bin, applied to mirrored bin as well so the output stays real
+    uint64_t noise_sum = 0;
+    uint16_t k;
+    for (k = 0; k <= (size / 2); k++){
+        uint64_t power = (uint64_t) ((int64_t) work[k].re * work[k].re) + (uint64_t) ((int64_t) work[k].im * work[k].im);
+        uplink->power[k] = (uplink->power[k] + power) >> 1;
+        uint64_t noise_power = uplink->noise_power[k];
+        if (uplink->noise_initialized == false){
+            noise_power = uplink->power[k];
+        } else if (uplink->power[k] < noise_power){
+            noise_power -= (noise_power - uplink->power[k]) >> SCO_UPLINK_NOISE_FALL_SHIFT;
+        } else {
+            noise_power += (noise_power >> SCO_UPLINK_NOISE_RISE_SHIFT) + 1;
+        }
+        uplink->noise_power[k] = noise_power;
+        noise_sum += (noise_power >> 8) << (((k == 0) || (k == (size / 2))) ? 0 : 1);
+
+        int32_t gain = (uplink->gain[k] + sco_uplink_noise_gain(uplink, uplink->power[k], noise_power)) >> 1;
+        uplink->gain[k] = (int16_t) btstack_min(gain, 32767);
+        work[k].re = (int32_t) (((int64_t) work[k].re * uplink->gain[k]) >> 15);
+        work[k].im = (int32_t) (((int64_t) work[k].im * uplink->gain[k]) >> 15);
+        if ((k > 0) && (k < (size / 2))){
+            work[size - k].re = (int32_t) (((int64_t) work[size - k].re * uplink->gain[k]) >> 15);
+            work[size - k].im = (int32_t) (((int64_t) work[size - k].im * uplink->gain[k]) >> 15);
+        }
+    }
+    uplink->noise_initialized = true;
+    fixed_fft_inverse(work, uplink->fft_log2_size);
+
+    // windowed overlap-add
+    uint64_t output_energy = 0;
+    uint8_t output_shift = 15 + uplink->fft_log2_size + SCO_UPLINK_SIGNAL_SHIFT;
+    for (i = 0; i < frame_samples; i++){
+        int32_t head = (int32_t) (((int64_t) work[i].re * sco_uplink_window(uplink, i)) >> output_shift);
+        int32_t tail = (int32_t) (((int64_t) work[frame_samples + i].re * sco_uplink_window(uplink, frame_samples + i)) >> output_shift);
+        samples[i] = sco_uplink_saturate(uplink->overlap[i] + head);
+        uplink->overlap[i] = tail;
+        output_energy += (uint64_t) ((int32_t) samples[i] * samples[i]);
+    }
+
+    // noise energy per frame from spectrum, sum over bins is size * 2^(2 * shift) times energy
+    uint64_t noise_energy = noise_sum >> (uplink->fft_log2_size + 2 * SCO_UPLINK_SIGNAL_SHIFT - 8);
+    uplink->metrics.noise_level_dbfs = (int16_t) (sco_uplink_level_q8(noise_energy, frame_samples) / 256);
+    if (input_energy > (noise_energy << SCO_UPLINK_NOISE_FRAME_SHIFT)) return;
+    uplink->noise_input_energy  += (input_energy  >> SCO_UPLINK_NOISE_METRIC_SHIFT) - (uplink->noise_input_energy  >> SCO_UPLINK_NOISE_METRIC_SHIFT);
+    uplink->noise_output_energy += (output_energy >> SCO_UPLINK_NOISE_METRIC_SHIFT) - (uplink->noise_output_energy >> SCO_UPLINK_NOISE_METRIC_SHIFT);
+    if (uplink->noise_output_energy > 0){
+        int32_t reduction = fixed_fft_log2_q8(uplink->noise_input_energy) - fixed_fft_log2_q8(uplink->noise_output_energy);
+        uplink->metrics.noise_reduction_db = (int16_t) (reduction * SCO_UPLINK_DB_PER_LOG2_POWER_Q8 / 65536);
+    }
+}
+
+static void sco_uplink_gain_control(sco_uplink_t * uplink, int16_t * samples){
+    uint16_t frame_samples = uplink->frame_samples;
+    uint64_t energy = 0;
+    int32_t  peak = 0;
+    uint16_t i;
+    for (i = 0; i < frame_samples; i++){
+        int32_t sample = samples[i];
+        energy += (uint64_t) (sample * sample);
+        peak = btstack_max(peak, (sample < 0) ? -sample : sample);
+    }
+
+    // background follows quiet frames down immediately and rises slowly
+    int32_t level = sco_uplink_level_q8(energy, frame_samples);
+    if (level < uplink->background_level){
+        uplink->background_level = level;
+    } else {
+        uplink->background_level += SCO_UPLINK_BACKGROUND_RISE_Q8;
+    }
+
+    // adapt on speech only, gain is kept in pauses
+    if ((level > (uplink->background_level + SCO_UPLINK_SPEECH_MARGIN_Q8)) && (level > SCO_UPLINK_SPEECH_MIN_DBFS_Q8)){
+        uplink->metrics.frames_speech++;
+        uint8_t shift = (level > uplink->speech_level) ? SCO_UPLINK_SPEECH_RISE_SHIFT : SCO_UPLINK_SPEECH_FALL_SHIFT;
+        uplink->speech_level += (level - uplink->speech_level) / (1 << shift);
+        int32_t target = uplink->config.gain_target_dbfs * 256 - uplink->speech_level;
+        target = sco_uplink_clamp(target, SCO_UPLINK_GAIN_MIN_Q8, uplink->config.gain_max_db * 256);
+        uplink->gain_level = sco_uplink_clamp(target, uplink->gain_level - SCO_UPLINK_GAIN_DOWN_Q8,
+                                              uplink->gain_level + SCO_UPLINK_GAIN_UP_Q8);
+    }
+
+    // limit to full scale for this frame only
+    int32_t gain = sco_uplink_gain_q16(uplink->gain_level);
+    if (((int64_t) peak * gain) > (32767 << 16)){
+        gain = (int32_t) ((32767 << 16) / peak);
+        uplink->metrics.frames_limited++;
+    }
+
+    // ramp from previous gain
+    int32_t applied = uplink->gain_applied;
+    int32_t step = (gain - applied) / frame_samples;
+    for (i = 0; i < frame_samples; i++){
+        applied += step;
+        samples[i] = sco_uplink_saturate((int32_t) (((int64_t) samples[i] * applied + 32768) >> 16));
+    }
+    uplink->gain_applied = gain;
+
+    uplink->metrics.speech_level_dbfs = (int16_t) (uplink->speech_level / 256);
+    uplink->metrics.gain_db = (int16_t) (uplink->gain_level / 256);
+}
+
+// in order of sco_uplink_stage_t
+static void (* const sco_uplink_stage_handlers[SCO_UPLINK_NUM_STAGES])(sco_uplink_t * uplink, int16_t * samples) = {
+    &sco_uplink_high_pass,
+    &sco_uplink_noise_suppression,
+    &sco_uplink_gain_control,
+};
+
+void sco_uplink_init(sco_uplink_t * uplink, uint16_t sample_rate, const sco_uplink_config_t * config){
+    btstack_assert(sample_rate > 0);
+    memset(uplink, 0, sizeof(sco_uplink_t));
+    uplink->config = *config;
+    uplink->frame_samples = (uint16_t) (sample_rate * 3 / 400);
+    btstack_assert((uplink->frame_samples > 0) && (uplink->frame_samples <= SCO_UPLINK_MAX_FRAME_SAMPLES));
+
+    uint16_t high_pass_hz = btstack_min(config->high_pass_hz, sample_rate / SCO_UPLINK_HIGH_PASS_MAX_HZ_DIVIDER);
+    // 1 - 2 pi fc / fs, with 2 pi in Q15
+    uplink->high_pass_pole = 32768 - (int32_t) ((205887 * (uint32_t) high_pass_hz) / sample_rate);
+
+    uplink->fft_log2_size = 1;
+    while ((1 << uplink->fft_log2_size) < (2 * uplink->frame_samples)){
+        uplink->fft_log2_size++;
+    }
+    btstack_assert(uplink->fft_log2_size <= FIXED_FFT_MAX_LOG2_SIZE);
+    uint16_t n;
+    for (n = 0; n <= uplink->frame_samples; n++){
+        // quarter period over frame_samples
+        uint32_t phase = (uint32_t) (((uint64_t) n << 30) / uplink->frame_samples);
+        uplink->window[n] = (int16_t) btstack_min((fixed_fft_sine_q30(phase) + (1 << 14)) >> 15, 32767);
+    }
+    uint16_t k;
+    for (k = 0; k < SCO_UPLINK_MAX_NUM_BINS; k++){
+        uplink->gain[k] = 32767;
+    }
+    uplink->gain_floor = (int16_t) btstack_min(sco_uplink_gain_q16(-(int32_t) config->noise_suppression_db * 256) >> 1, 32767);
+
+    uplink->background_level = SCO_UPLINK_LEVEL_MIN_DBFS_Q8;
+    uplink->speech_level = config->gain_target_dbfs * 256;
+    uplink->gain_applied = 1 << 16;
+    uplink->metrics.noise_level_dbfs  = SCO_UPLINK_LEVEL_MIN_DBFS_Q8 / 256;
+    uplink->metrics.speech_level_dbfs = config->gain_target_dbfs;
+}
+
+uint16_t sco_uplink_get_frame_samples(const sco_uplink_t * uplink){
+    return uplink->frame_samples;
+}
+
+void sco_uplink_process(sco_uplink_t * uplink, int16_t * samples, uint32_t * stage_cycles){
+    uint8_t stage;
+    for (stage = 0; stage < SCO_UPLINK_NUM_STAGES; stage++){
+        stage_cycles[stage] = 0;
+        if ((uplink->config.stages & SCO_UPLINK_STAGE_MASK(stage)) == 0) continue;
+        uint32_t cycles_start = cycle_stats_get_cycles();
+        (*sco_uplink_stage_handlers[stage])(uplink, samples);
+        stage_cycles[stage] = cycle_stats_get_cycles() - cycles_start;
+    }
+    uplink->metrics.frames++;
+}
+
+void sco_uplink_get_metrics(const sco_uplink_t * uplink, sco_uplink_metrics_t * metrics){
+    *metrics = uplink->metrics;
+}
@@ -0,0 +1,130 @@
+/*
+ * tone_generator.c - phase accumulator oscillator for test signals: multiple tones and linear sweeps
+ */
+
+#include <string.h>
+
+#include "tone_generator.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+// tones are mixed in blocks of this size
+#define TONE_GENERATOR_BLOCK_SAMPLES 64
+
+// one period, extra entry for interpolation
+static const int16_t tone_generator_sine[257] = {
+         0,    804,   1608,   2410,   3212,   4011,   4808,   5602,   6393,   7179,
+      7962,   8739,   9512,  10278,  11039,  11793,  12539,  13279,  14010,  14732,
+     15446,  16151,  16846,  17530,  18204,  18868,  19519,  20159,  20787,  21403,
+     22005,  22594,  23170,  23731,  24279,  24811,  25329,  25832,  26319,  26790,
+     27245,  27683,  28105,  28510,  28898,  29268,  29621,  29956,  30273,  30571,
+     30852,  31113,  31356,  31580,  31785,  31971,  32137,  32285,  32412,  32521,
+     32609,  32678,  32728,  32757,  32767,  32757,  32728,  32678,  32609,  32521,
+     32412,  32285,  32137,  31971,  31785,  31580,  31356,  31113,  30852,  30571,
+     30273,  29956,  29621,  29268,  28898,  28510,  28105,  27683,  27245,  26790,
+     26319,  25832,  25329,  24811,  24279,  23731,  23170,  22594,  22005,  21403,
+     20787,  20159,  19519,  18868,  18204,  17530,  16846,  16151,  15446,  14732,
+     14010,  13279,  12539,  11793,  11039,  10278,   9512,   8739,   7962,   7179,
+      6393,   5602,   4808,   4011,   3212,   2410,   1608,    804,      0,   -804,
+     -1608,  -2410,  -3212,  -4011,  -4808,  -5602,  -6393,  -7179,  -7962,  -8739,
+     -9512, -10278, -11039, -11793, -12539, -13279, -14010, -14732, -15446, -16151,
+    -16846, -17530, -18204, -18868, -19519, -20159, -20787, -21403, -22005, -22594,
+    -23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790, -27245, -27683,
+    -28105, -28510, -28898, -29268, -29621, -29956, -30273, -30571, -30852, -31113,
+    -31356, -31580, -31785, -31971, -32137, -32285, -32412, -32521, -32609, -32678,
+    -32728, -32757, -32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285,
+    -32137, -31971, -31785, -31580, -31356, -31113, -30852, -30571, -30273, -29956,
+    -29621, -29268, -28898, -28510, -28105, -27683, -27245, -26790, -26319, -25832,
+    -25329, -24811, -24279, -23731, -23170, -22594, -22005, -21403, -20787, -20159,
+    -19519, -18868, -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+    -12539, -11793, -11039, -10278,  -9512,  -8739,  -7962,  -7179,  -6393,  -5602,
+     -4808,  -4011,  -3212,  -2410,  -1608,   -804,      0,
+};
+
+static uint32_t tone_generator_step_for_frequency(const tone_generator_t * generator, uint32_t frequency_hz){
+    btstack_assert(frequency_hz < (generator->sample_rate / 2));
+    return (uint32_t) ((((uint64_t) frequency_hz) << 32) / generator->sample_rate);
+}
+
+// table index from top 8 bits, linear interpolation with next 16 bits
+static inline int32_t tone_generator_sine_at(uint32_t phase){
+    uint32_t index    = phase >> 24;
+    int32_t  fraction = (int32_t) ((phase >> 8) & 0xffff);
+    int32_t  s0 = tone_generator_sine[index];
+    int32_t  s1 = tone_generator_sine[index + 1];
+    return s0 + (((s1 - s0) * fraction) >> 16);
+}
+
+static void tone_generator_render(tone_generator_tone_t * tone, int32_t * mix, uint32_t num_samples){
+    uint32_t phase     = tone->phase;
+    uint32_t step      = tone->step;
+    int32_t  amplitude = tone->amplitude;
+    uint32_t i;
+    if (tone->sweep_samples == 0){
+        for (i = 0; i < num_samples; i++){
+            mix[i] += (tone_generator_sine_at(phase) * amplitude) >> 15;
+            phase  += step;
+        }
+    } else {
+        uint32_t position = tone->sweep_position;
+        for (i = 0; i < num_samples; i++){
+            mix[i] += (tone_generator_sine_at(phase) * amplitude) >> 15;
+            phase  += step;
+            step   += (uint32_t) tone->step_delta;
+            if (++position == tone->sweep_samples){
+                position = 0;
+                step     = tone->step_start;
+            }
+        }
+        tone->sweep_position = position;
+    }
+    tone->phase = phase;
+    tone->step  = step;
+}
+
+void tone_generator_init(tone_generator_t * generator, uint32_t sample_rate){
+    memset(generator, 0, sizeof(tone_generator_t));
+    generator->sample_rate = sample_rate;
+}
+
+bool tone_generator_add_tone(tone_generator_t * generator, uint32_t frequency_hz, int16_t amplitude){
+    return tone_generator_add_sweep(generator, frequency_hz, frequency_hz, 0, amplitude);
+}
+
+bool tone_generator_add_sweep(tone_generator_t * generator, uint32_t start_hz, uint32_t end_hz, uint32_t duration_ms, int16_t amplitude){
+    if (generator->num_tones >= TONE_GENERATOR_MAX_TONES) return false;
+    tone_generator_tone_t * tone = &generator->tones[generator->num_tones++];
+    memset(tone, 0, sizeof(tone_generator_tone_t));
+    tone->amplitude  = amplitude;
+    tone->step_start = tone_generator_step_for_frequency(generator, start_hz);
+    tone->step       = tone->step_start;
+    uint32_t sweep_samples = (uint32_t) (((uint64_t) duration_ms * generator->sample_rate) / 1000);
+    if ((start_hz != end_hz) && (sweep_samples > 0)){
+        int64_t step_range = (int64_t) tone_generator_step_for_frequency(generator, end_hz) - (int64_t) tone->step_start;
+        tone->step_delta    = (int32_t) (step_range / (int64_t) sweep_samples);
+        tone->sweep_samples = sweep_samples;
+    }
+    return true;
+}
+
+void tone_generator_fill(tone_generator_t * generator, int16_t * samples, uint32_t num_samples){
+    int32_t mix[TONE_GENERATOR_BLOCK_SAMPLES];
+    while (num_samples > 0){
+        uint32_t block_size = btstack_min(num_samples, TONE_GENERATOR_BLOCK_SAMPLES);
+        memset(mix, 0, block_size * sizeof(int32_t));
+        uint8_t i;
+        for (i = 0; i < generator->num_tones; i++){
+            tone_generator_render(&generator->tones[i], mix, block_size);
+        }
+        uint32_t j;
+        for (j = 0; j < block_size; j++){
+            int32_t value = mix[j];
+            if (value > 32767)  value = 32767;
+            if (value < -32768) value = -32768;
+            samples[j] = (int16_t) value;
+        }
+        samples     += block_size;
+        num_samples -= block_size;
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ * button_input.c - edge triggered, debounced button input delivered on the BTstack run loop
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "button_input.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+#include "btstack_run_loop.h"
+
+typedef struct {
+    btstack_timer_source_t debounce_timer;
+    bool                   debounce_active;
+    bool                   pressed;
+} button_input_state_t;
+
+static const button_input_hal_t *    button_input_hal;
+static button_input_handler_t        button_input_handler;
+static uint16_t                      button_input_debounce_ms;
+static button_input_state_t          button_input_states[BUTTON_INPUT_MAX_BUTTONS];
+
+// edges reported from other threads, handled on run loop
+static atomic_uint                             button_input_edges_pending;
+static atomic_bool                             button_input_callback_pending;
+static btstack_context_callback_registration_t button_input_callback_registration;
+
+static void button_input_debounce_timer_handler(btstack_timer_source_t * ts);
+
+// report change and ignore further edges until debounce window is over
+static void button_input_check(uint8_t button){
+    button_input_state_t * state = &button_input_states[button];
+    bool pressed = (*button_input_hal->is_pressed)(button);
+    if (pressed == state->pressed) return;
+
+    state->pressed = pressed;
+    (*button_input_handler)(button, pressed);
+
+    state->debounce_active = true;
+    btstack_run_loop_set_timer_handler(&state->debounce_timer, &button_input_debounce_timer_handler);
+    btstack_run_loop_set_timer_context(&state->debounce_timer, (void *)(uintptr_t) button);
+    btstack_run_loop_set_timer(&state->debounce_timer, button_input_debounce_ms);
+    btstack_run_loop_add_timer(&state->debounce_timer);
+}
+
+static void button_input_debounce_timer_handler(btstack_timer_source_t * ts){
+    uint8_t button = (uint8_t)(uintptr_t) btstack_run_loop_get_timer_context(ts);
+    button_input_states[button].debounce_active = false;
+    // pick up edges that got ignored during debounce window
+    button_input_check(button);
+}
+
+static void button_input_process_edges(void * context){
+    UNUSED(context);
+    // allow next edge to schedule callback before collecting edges, so none gets lost
+    atomic_store(&button_input_callback_pending, false);
+    unsigned int edges = atomic_exchange(&button_input_edges_pending, 0);
+    uint8_t button;
+    for (button = 0; button < button_input_hal->num_buttons; button++){
+        if ((edges & (1u << button)) == 0) continue;
+        if (button_input_states[button].debounce_active) continue;
+        button_input_check(button);
+    }
+}
+
+void button_input_init(const button_input_hal_t * hal, uint16_t debounce_ms, button_input_handler_t handler){
+    btstack_assert(hal->num_buttons <= BUTTON_INPUT_MAX_BUTTONS);
+
+    button_input_hal         = hal;
+    button_input_debounce_ms = debounce_ms;
+    button_input_handler     = handler;
+
+    button_input_callback_registration.callback = &button_input_process_edges;
+    button_input_callback_registration.context  = NULL;
+    atomic_store(&button_input_edges_pending, 0);
+    atomic_store(&button_input_callback_pending, false);
+
+    (*button_input_hal->init)();
+
+    // initial state is not reported
+    uint8_t button;
+    for (button = 0; button < button_input_hal->num_buttons; button++){
+        button_input_states[button].debounce_active = false;
+        button_input_states[button].pressed = (*button_input_hal->is_pressed)(button);
+    }
+}
+
+bool button_input_is_pressed(uint8_t button){
+    return button_input_states[button].pressed;
+}
+
+void button_input_edge_detected(uint8_t button){
+    atomic_fetch_or(&button_input_edges_pending, 1u << button);
+    if (atomic_exchange(&button_input_callback_pending, true) == false){
+        btstack_run_loop_execute_on_main_thread(&button_input_callback_registration);
+    }
+}
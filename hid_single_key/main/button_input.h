@@ -0,0 +1,70 @@
+/*
+ * button_input.h - edge triggered, debounced button input delivered on the BTstack run loop
+ *
+ * The hardware abstraction reports edges via button_input_edge_detected() from thread context.
+ * On ESP32, button_input_esp32.c does this from a GPIO interrupt via a deferred task;
+ * a host build can provide its own HAL and replay scripted edge timelines instead.
+ */
+
+#ifndef BUTTON_INPUT_H
+#define BUTTON_INPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#define BUTTON_INPUT_MAX_BUTTONS 8
+
+typedef struct {
+    // number of buttons provided, max BUTTON_INPUT_MAX_BUTTONS
+    uint8_t num_buttons;
+
+    /**
+     * @brief Setup hardware and start reporting edges via button_input_edge_detected()
+     */
+    void (*init)(void);
+
+    /**
+     * @brief Read current button state
+     * @param button index
+     * @return true if pressed
+     */
+    bool (*is_pressed)(uint8_t button);
+} button_input_hal_t;
+
+/**
+ * @brief Called on run loop for every debounced state change
+ * @param button index
+ * @param pressed
+ */
+typedef void (*button_input_handler_t)(uint8_t button, bool pressed);
+
+/**
+ * @brief Init button input, needs to be called from run loop
+ * @param hal
+ * @param debounce_ms edges within this window after a reported change are ignored, final state is re-checked afterwards
+ * @param handler
+ */
+void button_input_init(const button_input_hal_t * hal, uint16_t debounce_ms, button_input_handler_t handler);
+
+/**
+ * @brief Get debounced state
+ * @param button index
+ * @return true if pressed
+ */
+bool button_input_is_pressed(uint8_t button);
+
+/**
+ * @brief Report edge on button. Thread-safe, but must not be called from interrupt context
+ * @param button index
+ */
+void button_input_edge_detected(uint8_t button);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * button_input_esp32.h - button input HAL for active-low GPIO buttons with edge interrupts
+ */
+
+#ifndef BUTTON_INPUT_ESP32_H
+#define BUTTON_INPUT_ESP32_H
+
+#include <stdint.h>
+
+#include "button_input.h"
+#include "driver/gpio.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Get HAL for buttons connected between GPIO and GND, internal pull-ups get enabled
+ * @param gpios array needs to stay valid
+ * @param num_gpios max BUTTON_INPUT_MAX_BUTTONS
+ * @return hal
+ */
+const button_input_hal_t * button_input_esp32_get_instance(const gpio_num_t * gpios, uint8_t num_gpios);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -4,8 +4,10 @@
 #include <string.h>
 #include "btstack.h"
 #include "driver/gpio.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
+#include "btstack_run_loop.h"
+#include "hid_device.h"
+#include "button_input.h"
+#include "button_input_esp32.h"
 
 // 常量和定義
 #define BTSTACK_FILE__ "hid_single_key.c"
@@ -85,11 +87,6 @@ static enum {
 // 函數原型
 static void send_report(int modifier, int keycode);
 static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t packet_size);
-void button_init();
-bool button_is_pressed();
-void send_key_q();
-void release_key();
-void task_button_monitor(void *arg);
 int btstack_main(int argc, const char * argv[]);
 
 // 發送 HID 報告
@@ -143,82 +140,29 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
     }
 }
 
-// 初始化按鈕 GPIO
-void button_init() {
-    gpio_reset_pin(BUTTON_GPIO);
-    gpio_set_direction(BUTTON_GPIO, GPIO_MODE_INPUT);
-    gpio_set_pull_mode(BUTTON_GPIO, GPIO_PULLUP_ONLY);
-}
-
-// 檢查按鈕是否被按下
-bool button_is_pressed() {
-    return gpio_get_level(BUTTON_GPIO) == 0;
-}
-
-// 發送 'Q' 鍵按下
-void send_key_q() {
-    uint8_t keycode = HID_KEY_Q;
-    uint8_t modifier = 0;
-    send_report(modifier, keycode);
-}
-
-// 釋放所有按鍵
-void release_key() {
-    uint8_t key_report[] = { 0xa1, 0x01, 0, 0, 0, 0, 0, 0, 0 };
-    hid_device_send_interrupt_message(0, key_report, sizeof(key_report));
-}
-
-// 監控按鈕狀態的任務
-void task_button_monitor(void *arg) {
-    while (1) {
-        if (button_is_pressed()) {
-            send_key_q();
-        } else {
-            send_report(0, 0);
-        }
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-    }
-}
-#include "btstack_run_loop.h"
-#include "hid_device.h"
+// 去抖動窗口
+#define BUTTON_DEBOUNCE_MS 20
 
-// 定义全局定时器结构体
-static btstack_timer_source_t button_monitor_timer;
-
-// 按钮监控任务处理器
-static void button_monitor_handler(btstack_timer_source_t *ts) {
-    if (button_is_pressed()) {
-        uint8_t keycode = HID_KEY_Q;
-        uint8_t modifier = 0;
-        send_report(modifier, keycode);
-    } else {
-        send_report(0, 0);
-    }
+// 按鍵 GPIO，由 GPIO 中斷觸發，去抖動後在 run loop 中處理
+static const gpio_num_t button_gpios[] = { BUTTON_GPIO };
 
-    // 重新设置定时器间隔时间，10ms 后再次调用
-    btstack_run_loop_set_timer(ts, 10);  // 设置 10ms 的间隔
-    btstack_run_loop_add_timer(ts);      // 重新添加定时器
+// 按鍵事件處理器：僅在按下/釋放時發送報告
+static void button_handler(uint8_t button, bool pressed) {
+    UNUSED(button);
+    if (app_state != APP_CONNECTED) return;
+    send_report(0, pressed ? HID_KEY_Q : 0);
 }
 
-// 初始化并启动定时器
+// 啟動按鍵輸入
 static void start_button_monitor(void) {
-    // 初始化定时器
-    btstack_run_loop_set_timer_handler(&button_monitor_timer, button_monitor_handler);
-
-    // 设置初始超时时间为 10ms
-    btstack_run_loop_set_timer(&button_monitor_timer, 10);
-
-    // 添加定时器到 BTstack run loop
-    btstack_run_loop_add_timer(&button_monitor_timer);
+    const button_input_hal_t * hal = button_input_esp32_get_instance(button_gpios, sizeof(button_gpios) / sizeof(button_gpios[0]));
+    button_input_init(hal, BUTTON_DEBOUNCE_MS, &button_handler);
 }
 
 int btstack_main(int argc, const char * argv[]) {
     (void)argc;
     (void)argv;
 
-    // 初始化按鈕並創建監控任務
-    button_init();
-
     // 配置藍牙設置
     gap_discoverable_control(1);
     gap_set_local_name("HID Keyboard Button");
@@ -2,13 +2,31 @@
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "hid_key_tracker.h"
+#include "key_event_queue.h"
 
 #define BUTTON_GPIO 18
 #define HID_KEY_Q 0x14
 
+// 去抖動時間；連發 (typematic) 延遲/週期，週期為 0 時停用
+#define BUTTON_DEBOUNCE_MS      20
+#define TYPEMATIC_DELAY_MS      500
+#define TYPEMATIC_PERIOD_MS     0
+
 static uint16_t hid_cid;
 static uint8_t hid_service_buffer[300];
 
+// 按鍵狀態追蹤：僅在按下/釋放時發送報告 (僅在 run loop 中使用)
+static hid_key_tracker_t key_tracker;
+static btstack_timer_source_t typematic_timer;
+
+// 按鈕任務 -> run loop 的按鍵事件佇列
+// BTstack 不是執行緒安全的，按鈕任務只寫入佇列，由 run loop 在 HID_SUBEVENT_CAN_SEND_NOW 時發送
+static key_event_queue_t key_event_queue;
+static atomic_bool key_event_callback_pending;
+static btstack_context_callback_registration_t key_event_callback_registration;
+static TaskHandle_t button_task_handle;
+
 // HID 描述符（必須與 HID 規範匹配）
 const uint8_t hid_descriptor_keyboard[] = {
     0x05, 0x01,                    // Usage Page (Generic Desktop)
@@ -37,11 +55,22 @@ const uint8_t hid_descriptor_keyboard[] = {
     0xc0                           // End Collection
 };
 
-// 初始化按鈕
+// GPIO 中斷：喚醒按鈕任務
+static void IRAM_ATTR button_isr_handler(void *arg) {
+    (void) arg;
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(button_task_handle, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+// 初始化按鈕 (雙緣觸發中斷)
 void button_init() {
     gpio_reset_pin(BUTTON_GPIO);
     gpio_set_direction(BUTTON_GPIO, GPIO_MODE_INPUT);
     gpio_set_pull_mode(BUTTON_GPIO, GPIO_PULLUP_ONLY);
+    gpio_set_intr_type(BUTTON_GPIO, GPIO_INTR_ANYEDGE);
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(BUTTON_GPIO, &button_isr_handler, NULL);
 }
 
 // 檢查按鈕是否按下
@@ -49,27 +78,81 @@ bool button_is_pressed() {
     return gpio_get_level(BUTTON_GPIO) == 0;
 }
 
-// 發送 'q' 鍵的 HID 報告
-void send_key_q() {
-    uint8_t report[] = {0xa1, 0x01, 0, 0, HID_KEY_Q, 0, 0, 0, 0, 0};
+// 發送 HID 報告，只能在 run loop 中呼叫
+static void send_report(uint8_t modifier, const uint8_t * keycodes) {
+    uint8_t report[] = {0xa1, 0x01, modifier, 0,
+                        keycodes[0], keycodes[1], keycodes[2], keycodes[3], keycodes[4], keycodes[5]};
     hid_device_send_interrupt_message(hid_cid, report, sizeof(report));
 }
 
-// 釋放按鍵
-void release_key() {
-    uint8_t report[] = {0xa1, 0x01, 0, 0, 0, 0, 0, 0, 0, 0};
-    hid_device_send_interrupt_message(hid_cid, report, sizeof(report));
+// 在 run loop 中：有待發送的事件時請求 CAN_SEND_NOW
+static void key_events_process(void *context) {
+    UNUSED(context);
+    atomic_store(&key_event_callback_pending, false);
+    if (hid_cid == 0) return;
+    if (key_event_queue_empty(&key_event_queue)) return;
+    hid_device_request_can_send_now_event(hid_cid);
+}
+
+// 在 run loop 中：丟棄佇列中所有事件
+static void key_events_drain(void) {
+    key_event_t event;
+    while (key_event_queue_get(&key_event_queue, &event)) {
+    }
+}
+
+static void typematic_timer_handler(btstack_timer_source_t *ts) {
+    UNUSED(ts);
+    if (hid_cid == 0) return;
+    hid_device_request_can_send_now_event(hid_cid);
 }
 
-// 按鈕監控任務
+// 在 run loop 中：HID_SUBEVENT_CAN_SEND_NOW 時取出一個事件並發送報告
+static void key_events_can_send_now(void) {
+    key_event_t event;
+    if (key_event_queue_get(&key_event_queue, &event)) {
+        uint8_t keycode = event.pressed ? event.keycode : 0;
+        hid_key_tracker_set_keys(&key_tracker, event.modifier, &keycode, 1);
+    }
+
+    // 僅在狀態變化（或連發到期）時發送
+    uint32_t now_ms = btstack_run_loop_get_time_ms();
+    if (hid_key_tracker_poll(&key_tracker, now_ms)) {
+        send_report(key_tracker.report_modifier, key_tracker.report_keycodes);
+    }
+
+    btstack_run_loop_remove_timer(&typematic_timer);
+    uint32_t due_ms;
+    if (!key_event_queue_empty(&key_event_queue)) {
+        hid_device_request_can_send_now_event(hid_cid);
+    } else if (hid_key_tracker_get_next_poll_ms(&key_tracker, &due_ms)) {
+        int32_t delay_ms = (int32_t)(due_ms - now_ms);
+        btstack_run_loop_set_timer_handler(&typematic_timer, &typematic_timer_handler);
+        btstack_run_loop_set_timer(&typematic_timer, (delay_ms > 0) ? (uint32_t) delay_ms : 0);
+        btstack_run_loop_add_timer(&typematic_timer);
+    }
+}
+
+// 按鈕監控任務：等待 GPIO 中斷，去抖動後將按鍵事件寫入佇列
 void task_button_monitor(void *arg) {
+    bool pressed = false;
     while (1) {
-        if (button_is_pressed()) {
-            send_key_q();  // 發送 'q' 鍵
-        } else {
-            release_key();  // 釋放按鍵
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        vTaskDelay(BUTTON_DEBOUNCE_MS / portTICK_PERIOD_MS);
+        // 去抖動期間的邊緣已包含在本次讀取中
+        ulTaskNotifyTake(pdTRUE, 0);
+
+        bool now_pressed = button_is_pressed();
+        if (now_pressed == pressed) continue;
+        pressed = now_pressed;
+
+        key_event_t event = { .modifier = 0, .keycode = HID_KEY_Q, .pressed = pressed };
+        key_event_queue_put(&key_event_queue, &event);
+
+        // 通知 run loop (執行緒安全)
+        if (atomic_exchange(&key_event_callback_pending, true) == false) {
+            btstack_run_loop_execute_on_main_thread(&key_event_callback_registration);
         }
-        vTaskDelay(10 / portTICK_PERIOD_MS);  // 10 毫秒延遲
     }
 }
 
@@ -90,11 +173,23 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
                     switch (hci_event_hid_meta_get_subevent_code(packet)) {
                         case HID_SUBEVENT_CONNECTION_OPENED:
                             hid_cid = hid_subevent_connection_opened_get_hid_cid(packet);
+                            // 新連線的主機認為所有按鍵均已釋放
+                            hid_key_tracker_reset(&key_tracker);
+                            // 丟棄斷線期間佇列中的事件，不重放給新主機
+                            key_events_drain();
                             printf("HID connection opened\n");
+                            hid_device_request_can_send_now_event(hid_cid);
                             break;
                         case HID_SUBEVENT_CONNECTION_CLOSED:
                             hid_cid = 0;
+                            btstack_run_loop_remove_timer(&typematic_timer);
                             printf("HID connection closed\n");
+                            printf("HID reports: %u sent, %u suppressed, %u key events dropped\n",
+                                   (unsigned int) key_tracker.reports_sent, (unsigned int) key_tracker.reports_suppressed,
+                                   (unsigned int) key_event_queue.dropped);
+                            break;
+                        case HID_SUBEVENT_CAN_SEND_NOW:
+                            key_events_can_send_now();
                             break;
                         default:
                             break;
@@ -111,8 +206,13 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
 
 // 主程序入口
 int btstack_main(int argc, const char *argv[]) {
+    hid_key_tracker_init(&key_tracker);
+    hid_key_tracker_set_typematic(&key_tracker, TYPEMATIC_DELAY_MS, TYPEMATIC_PERIOD_MS);
+    key_event_queue_init(&key_event_queue);
+    key_event_callback_registration.callback = &key_events_process;
+    key_event_callback_registration.context = NULL;
+    xTaskCreate(task_button_monitor, "button_monitor_task", 2048, NULL, 10, &button_task_handle);
     button_init();
-    xTaskCreate(task_button_monitor, "button_monitor_task", 2048, NULL, 10, NULL);
 
     // 初始化 HID 服務
     l2cap_init();
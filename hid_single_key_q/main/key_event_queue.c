@@ -0,0 +1,44 @@
+/*
+ * key_event_queue.c - lock-free single-producer/single-consumer queue for key events
+ */
+
+#include "key_event_queue.h"
+
+#define KEY_EVENT_QUEUE_MASK (KEY_EVENT_QUEUE_SIZE - 1)
+
+_Static_assert((KEY_EVENT_QUEUE_SIZE & KEY_EVENT_QUEUE_MASK) == 0, "KEY_EVENT_QUEUE_SIZE must be power of two");
+
+void key_event_queue_init(key_event_queue_t * queue){
+    atomic_init(&queue->write_index, 0);
+    atomic_init(&queue->read_index, 0);
+    queue->dropped = 0;
+}
+
+bool key_event_queue_put(key_event_queue_t * queue, const key_event_t * event){
+    unsigned int write_index = atomic_load_explicit(&queue->write_index, memory_order_relaxed);
+    unsigned int read_index  = atomic_load_explicit(&queue->read_index,  memory_order_acquire);
+    if ((write_index - read_index) >= KEY_EVENT_QUEUE_SIZE){
+        queue->dropped++;
+        return false;
+    }
+    queue->events[write_index & KEY_EVENT_QUEUE_MASK] = *event;
+    // publish event after it has been stored
+    atomic_store_explicit(&queue->write_index, write_index + 1, memory_order_release);
+    return true;
+}
+
+bool key_event_queue_get(key_event_queue_t * queue, key_event_t * event){
+    unsigned int read_index  = atomic_load_explicit(&queue->read_index,  memory_order_relaxed);
+    unsigned int write_index = atomic_load_explicit(&queue->write_index, memory_order_acquire);
+    if (read_index == write_index) return false;
+    *event = queue->events[read_index & KEY_EVENT_QUEUE_MASK];
+    // release slot after event has been copied
+    atomic_store_explicit(&queue->read_index, read_index + 1, memory_order_release);
+    return true;
+}
+
+bool key_event_queue_empty(key_event_queue_t * queue){
+    unsigned int read_index  = atomic_load_explicit(&queue->read_index,  memory_order_relaxed);
+    unsigned int write_index = atomic_load_explicit(&queue->write_index, memory_order_acquire);
+    return read_index == write_index;
+}
@@ -0,0 +1,69 @@
+/*
+ * key_event_queue.h - lock-free single-producer/single-consumer queue for key events
+ *
+ * One task may call key_event_queue_put(), one other (e.g. the BTstack run loop) key_event_queue_get().
+ */
+
+#ifndef KEY_EVENT_QUEUE_H
+#define KEY_EVENT_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// must be power of two
+#define KEY_EVENT_QUEUE_SIZE 32
+
+typedef struct {
+    uint8_t modifier;
+    uint8_t keycode;
+    bool    pressed;
+} key_event_t;
+
+typedef struct {
+    // free running indices, only written by producer / consumer respectively
+    atomic_uint write_index;
+    atomic_uint read_index;
+    // events lost because queue was full, producer only
+    uint32_t    dropped;
+    key_event_t events[KEY_EVENT_QUEUE_SIZE];
+} key_event_queue_t;
+
+/**
+ * @brief Init empty queue
+ * @param queue
+ */
+void key_event_queue_init(key_event_queue_t * queue);
+
+/**
+ * @brief Add event, producer side
+ * @param queue
+ * @param event
+ * @return false if queue is full and event was dropped
+ */
+bool key_event_queue_put(key_event_queue_t * queue, const key_event_t * event);
+
+/**
+ * @brief Get oldest event, consumer side
+ * @param queue
+ * @param event
+ * @return false if queue is empty
+ */
+bool key_event_queue_get(key_event_queue_t * queue, key_event_t * event);
+
+/**
+ * @brief Check for pending events, consumer side
+ * @param queue
+ * @return true if empty
+ */
+bool key_event_queue_empty(key_event_queue_t * queue);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
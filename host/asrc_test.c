@@ -0,0 +1,204 @@
+/*
+ * asrc_test.c - asrc tracking between two simulated clocks at up to +/- 200 ppm
+ *
+ * Mirrors the recording path of sco_demo_util: the audio device clock delivers blocks of 5 ms at the codec
+ * rate, asrc_update steers by the fill level error of the ring buffer and asrc_process pushes into it. The
+ * Bluetooth clock takes one 7.5 ms frame at a time, starting once the ring holds the target level. Both
+ * clocks are offset by a given ppm from nominal and events run in order of their simulated time. The whole
+ * run has to pass without underrun or overflow. The controller settles within minutes, so averages are taken
+ * over the second half of a call length run: the ratio has to match the clock offset and the fill level
+ * seen by the controller the target.
+ *
+ * Usage: asrc_test [seconds of simulated time per scenario, default 600]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+#include "asrc.h"
+#include "sample_ring_buffer.h"
+#include "tone_generator.h"
+
+#define TEST_SAMPLE_RATE            16000
+#define TEST_PRODUCER_BLOCK_SAMPLES 80
+#define TEST_CONSUMER_BLOCK_SAMPLES 120
+#define TEST_TARGET_SAMPLES         240
+#define TEST_RING_SAMPLES           961
+#define TEST_TONE_HZ                1000
+#define TEST_TONE_AMPLITUDE         8192
+// allowed deviation of average ratio from clock offset and of average fill level from target
+#define TEST_MAX_PPM_ERROR          10
+#define TEST_MAX_FILL_ERROR         16
+
+typedef struct {
+    const char * name;
+    // offset from nominal rate
+    int32_t      producer_ppm;
+    int32_t      consumer_ppm;
+} test_scenario_t;
+
+static const test_scenario_t test_scenarios[] = {
+    { "equal clocks",           0,    0 },
+    { "audio fast",           200,    0 },
+    { "audio slow",          -200,    0 },
+    { "bluetooth fast",         0,  200 },
+    { "bluetooth slow",         0, -200 },
+    { "audio fast, bt slow",  200, -200 },
+    { "audio slow, bt fast", -200,  200 },
+};
+
+#define TEST_NUM_SCENARIOS (sizeof(test_scenarios) / sizeof(test_scenarios[0]))
+
+typedef struct {
+    // settled half of the run
+    uint32_t num_updates;
+    int64_t  ppm_sum;
+    int64_t  fill_sum;
+    int32_t  fill_min;
+    int32_t  fill_max;
+    uint32_t underruns;
+    uint32_t overflows;
+    int32_t  ppm_average;
+    int32_t  fill_error_average;
+} test_result_t;
+
+static asrc_t               test_asrc;
+static sample_ring_buffer_t test_ring;
+static int16_t              test_ring_storage[TEST_RING_SAMPLES];
+static tone_generator_t     test_tone;
+static test_result_t        test_results[TEST_NUM_SCENARIOS];
+
+// period of a block in ps on a clock that is off by ppm
+static uint64_t test_period_ps(uint32_t num_samples, int32_t ppm){
+    uint64_t nominal_ps = (uint64_t) num_samples * 1000000000000ULL / TEST_SAMPLE_RATE;
+    return nominal_ps * 1000000 / (uint64_t) (1000000 + ppm);
+}
+
+static void test_track_fill(test_result_t * result, int32_t fill){
+    if (fill < result->fill_min) result->fill_min = fill;
+    if (fill > result->fill_max) result->fill_max = fill;
+}
+
+static void test_producer_block(test_result_t * result, bool settled){
+    int32_t fill = (int32_t) sample_ring_buffer_samples_available(&test_ring);
+    asrc_update(&test_asrc, fill - TEST_TARGET_SAMPLES);
+    // average of fill level seen by controller
+    if (settled){
+        result->ppm_sum  += test_asrc.ppm;
+        result->fill_sum += fill;
+        result->num_updates++;
+        test_track_fill(result, fill);
+    }
+
+    int16_t input[TEST_PRODUCER_BLOCK_SAMPLES];
+    tone_generator_fill(&test_tone, input, TEST_PRODUCER_BLOCK_SAMPLES);
+    const int16_t * buffer = input;
+    uint16_t num_samples = TEST_PRODUCER_BLOCK_SAMPLES;
+    while (num_samples > 0){
+        int16_t * samples;
+        uint32_t region_size = sample_ring_buffer_get_write_region(&test_ring, &samples);
+        int16_t overflow_samples[TEST_PRODUCER_BLOCK_SAMPLES];
+        if (region_size == 0){
+            samples     = overflow_samples;
+            region_size = TEST_PRODUCER_BLOCK_SAMPLES;
+            result->overflows++;
+        }
+        uint16_t samples_used;
+        uint16_t samples_produced = asrc_process(&test_asrc, buffer, num_samples, &samples_used, samples,
+                                                 (uint16_t) btstack_min(region_size, TEST_PRODUCER_BLOCK_SAMPLES));
+        if (samples != overflow_samples){
+            sample_ring_buffer_commit_write(&test_ring, samples_produced);
+        }
+        buffer      += samples_used;
+        num_samples -= samples_used;
+    }
+}
+
+static void test_consumer_block(test_result_t * result, bool settled){
+    int16_t frame[TEST_CONSUMER_BLOCK_SAMPLES];
+    uint32_t num_read = sample_ring_buffer_read(&test_ring, frame, TEST_CONSUMER_BLOCK_SAMPLES);
+    if (num_read < TEST_CONSUMER_BLOCK_SAMPLES){
+        result->underruns++;
+    }
+    if (settled){
+        test_track_fill(result, (int32_t) sample_ring_buffer_samples_available(&test_ring));
+    }
+}
+
+static void test_run_scenario(test_result_t * result, const test_scenario_t * scenario, uint32_t seconds){
+    asrc_init(&test_asrc);
+    sample_ring_buffer_init(&test_ring, test_ring_storage, TEST_RING_SAMPLES);
+    tone_generator_init(&test_tone, TEST_SAMPLE_RATE);
+    tone_generator_add_tone(&test_tone, TEST_TONE_HZ, TEST_TONE_AMPLITUDE);
+    result->fill_min = TEST_RING_SAMPLES;
+    result->fill_max = 0;
+
+    // simulated time in ps to keep ppm offsets exact over long runs
+    uint64_t producer_period_ps = test_period_ps(TEST_PRODUCER_BLOCK_SAMPLES, scenario->producer_ppm);
+    uint64_t consumer_period_ps = test_period_ps(TEST_CONSUMER_BLOCK_SAMPLES, scenario->consumer_ppm);
+    uint64_t end_ps     = (uint64_t) seconds * 1000000000000ULL;
+    uint64_t settled_ps = end_ps / 2;
+    uint64_t next_producer_ps = 0;
+    uint64_t next_consumer_ps = 0;
+    bool consumer_started = false;
+    while ((next_producer_ps < end_ps) || (next_consumer_ps < end_ps)){
+        if (next_producer_ps <= next_consumer_ps){
+            test_producer_block(result, next_producer_ps >= settled_ps);
+            next_producer_ps += producer_period_ps;
+            continue;
+        }
+        // Bluetooth side starts with pre-buffered samples
+        if (consumer_started == false){
+            consumer_started = sample_ring_buffer_samples_available(&test_ring) >= TEST_TARGET_SAMPLES;
+        }
+        if (consumer_started){
+            test_consumer_block(result, next_consumer_ps >= settled_ps);
+        }
+        next_consumer_ps += consumer_period_ps;
+    }
+
+    int64_t num_updates = (int64_t) btstack_max(1, result->num_updates);
+    result->ppm_average        = (int32_t) (result->ppm_sum / num_updates);
+    result->fill_error_average = (int32_t) (result->fill_sum / num_updates) - TEST_TARGET_SAMPLES;
+}
+
+static bool test_report(const test_result_t * result, const test_scenario_t * scenario){
+    // converter consumes more input per output if producer runs faster
+    int32_t expected_ppm = scenario->producer_ppm - scenario->consumer_ppm;
+    int32_t ppm_error = result->ppm_average - expected_ppm;
+    bool ok = (result->underruns == 0) && (result->overflows == 0)
+           && (ppm_error <= TEST_MAX_PPM_ERROR) && (ppm_error >= -TEST_MAX_PPM_ERROR)
+           && (result->fill_error_average <= TEST_MAX_FILL_ERROR) && (result->fill_error_average >= -TEST_MAX_FILL_ERROR);
+    printf("%-20s %5d %5d  %5d %5d  %5d  %4d %4d  %5u %5u%s\n", scenario->name,
+           (int) scenario->producer_ppm, (int) scenario->consumer_ppm, (int) expected_ppm, (int) result->ppm_average,
+           (int) result->fill_error_average, (int) result->fill_min, (int) result->fill_max,
+           (unsigned int) result->underruns, (unsigned int) result->overflows, ok ? "" : "  FAILED");
+    return ok;
+}
+
+int main(int argc, const char * argv[]){
+    uint32_t seconds = 600;
+    if (argc > 1){
+        seconds = (uint32_t) atoi(argv[1]);
+    }
+    btstack_assert(seconds > 0);
+
+    unsigned int i;
+    for (i = 0; i < TEST_NUM_SCENARIOS; i++){
+        test_run_scenario(&test_results[i], &test_scenarios[i], seconds);
+    }
+
+    printf("\nASRC drift test: %u s per scenario, fill level target %u samples, second half evaluated\n",
+           (unsigned int) seconds, TEST_TARGET_SAMPLES);
+    printf("%-20s %5s %5s  %5s %5s  %5s  %4s %4s  %5s %5s\n", "scenario", "audio", "bt", "ppm", "asrc",
+           "fill", "min", "max", "under", "over");
+    bool ok = true;
+    for (i = 0; i < TEST_NUM_SCENARIOS; i++){
+        ok = test_report(&test_results[i], &test_scenarios[i]) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,23 @@
+//
+// btstack_config.h for host benchmarks and tests of the ESP32 projects, see CMakeLists.txt
+//
+
+#ifndef BTSTACK_CONFIG_H
+#define BTSTACK_CONFIG_H
+
+// Port related features
+#define HAVE_ASSERT
+#define HAVE_MALLOC
+#define HAVE_POSIX_TIME
+
+// BTstack features that can be enabled
+#define ENABLE_CLASSIC
+#define ENABLE_HFP_WIDE_BAND_SPEECH
+#define ENABLE_HFP_SUPER_WIDE_BAND_SPEECH
+#define ENABLE_SCO_OVER_HCI
+
+// BTstack configuration. buffers, sizes, ...
+#define HCI_ACL_PAYLOAD_SIZE (1691 + 4)
+#define HCI_INCOMING_PRE_BUFFER_SIZE 14 // sizeof BNEP header, avoid memcpy
+
+#endif
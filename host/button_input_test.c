@@ -0,0 +1,157 @@
+/*
+ * button_input_test.c - button_input with scripted edge timelines on a simulated run loop
+ *
+ * A simulated HAL holds the raw level of each button. Each scenario is a timeline of raw level changes,
+ * every change is reported via button_input_edge_detected() like the ESP32 GPIO interrupt does. The
+ * debounced changes passed to the handler are compared with the expected ones including their time, i.e.
+ * presses and releases are reported at the first edge, bounces within the debounce window are ignored and
+ * a state that differs at the end of the window is reported then.
+ *
+ * Usage: button_input_test
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "btstack_debug.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+
+#include "button_input.h"
+#include "hid_host_run_loop.h"
+
+#define TEST_NUM_BUTTONS    2
+#define TEST_DEBOUNCE_MS    20
+#define TEST_MAX_EVENTS     16
+// time after last edge to let debounce timers run
+#define TEST_SETTLE_MS      100
+
+typedef struct {
+    uint32_t time_ms;
+    uint8_t  button;
+    bool     pressed;
+} test_event_t;
+
+typedef struct {
+    const char * name;
+    // raw levels before init, not reported
+    bool         initial[TEST_NUM_BUTTONS];
+    uint8_t      num_edges;
+    test_event_t edges[TEST_MAX_EVENTS];
+    uint8_t      num_expected;
+    test_event_t expected[TEST_MAX_EVENTS];
+} test_scenario_t;
+
+static const test_scenario_t test_scenarios[] = {
+    { "clean press and release", { false, false },
+        2, { { 100, 0, true }, { 300, 0, false } },
+        2, { { 100, 0, true }, { 300, 0, false } } },
+    { "press bounce", { false, false },
+        6, { { 100, 0, true }, { 101, 0, false }, { 102, 0, true }, { 104, 0, false }, { 105, 0, true }, { 300, 0, false } },
+        2, { { 100, 0, true }, { 300, 0, false } } },
+    { "release bounce", { false, false },
+        5, { { 100, 0, true }, { 300, 0, false }, { 301, 0, true }, { 303, 0, false }, { 304, 0, true } },
+        3, { { 100, 0, true }, { 300, 0, false }, { 320, 0, true } } },
+    { "glitch shorter than window", { false, false },
+        2, { { 100, 0, true }, { 105, 0, false } },
+        2, { { 100, 0, true }, { 120, 0, false } } },
+    { "edges within window, same end state", { false, false },
+        3, { { 100, 0, true }, { 110, 0, false }, { 115, 0, true } },
+        1, { { 100, 0, true } } },
+    { "taps slower than window", { false, false },
+        4, { { 100, 0, true }, { 130, 0, false }, { 160, 0, true }, { 190, 0, false } },
+        4, { { 100, 0, true }, { 130, 0, false }, { 160, 0, true }, { 190, 0, false } } },
+    { "two buttons at once", { false, false },
+        5, { { 100, 0, true }, { 100, 1, true }, { 101, 1, false }, { 102, 1, true }, { 200, 0, false } },
+        3, { { 100, 0, true }, { 100, 1, true }, { 200, 0, false } } },
+    { "edge without level change", { false, false },
+        1, { { 100, 0, false } },
+        0, { { 0 } } },
+    { "held at init", { true, false },
+        1, { { 100, 0, false } },
+        1, { { 100, 0, false } } },
+};
+
+#define TEST_NUM_SCENARIOS (sizeof(test_scenarios) / sizeof(test_scenarios[0]))
+
+static bool         test_levels[TEST_NUM_BUTTONS];
+static test_event_t test_events[TEST_MAX_EVENTS];
+static uint8_t      test_num_events;
+
+static void test_hal_init(void){
+}
+
+static bool test_hal_is_pressed(uint8_t button){
+    return test_levels[button];
+}
+
+static const button_input_hal_t test_hal = {
+    .num_buttons = TEST_NUM_BUTTONS,
+    .init        = &test_hal_init,
+    .is_pressed  = &test_hal_is_pressed,
+};
+
+static void test_handler(uint8_t button, bool pressed){
+    btstack_assert(test_num_events < TEST_MAX_EVENTS);
+    test_event_t * event = &test_events[test_num_events++];
+    event->time_ms = btstack_run_loop_get_time_ms();
+    event->button  = button;
+    event->pressed = pressed;
+}
+
+static bool test_run_scenario(const test_scenario_t * scenario){
+    hid_host_run_loop_init();
+    uint8_t i;
+    for (i = 0; i < TEST_NUM_BUTTONS; i++){
+        test_levels[i] = scenario->initial[i];
+    }
+    test_num_events = 0;
+    button_input_init(&test_hal, TEST_DEBOUNCE_MS, &test_handler);
+    bool ok = button_input_is_pressed(0) == scenario->initial[0];
+
+    uint32_t end_ms = 0;
+    for (i = 0; i < scenario->num_edges; i++){
+        const test_event_t * edge = &scenario->edges[i];
+        hid_host_run_loop_run_until_ms(edge->time_ms);
+        test_levels[edge->button] = edge->pressed;
+        button_input_edge_detected(edge->button);
+        end_ms = edge->time_ms + TEST_SETTLE_MS;
+    }
+    hid_host_run_loop_run_until_ms(end_ms);
+
+    ok = ok && (test_num_events == scenario->num_expected);
+    for (i = 0; ok && (i < test_num_events); i++){
+        const test_event_t * event    = &test_events[i];
+        const test_event_t * expected = &scenario->expected[i];
+        ok = (event->time_ms == expected->time_ms) && (event->button == expected->button) && (event->pressed == expected->pressed);
+    }
+    // debounced state follows raw level once settled
+    for (i = 0; i < TEST_NUM_BUTTONS; i++){
+        ok = ok && (button_input_is_pressed(i) == test_levels[i]);
+    }
+
+    printf("%-36s %5u %6u %8u  %s\n", scenario->name, (unsigned int) scenario->num_edges, (unsigned int) test_num_events,
+           (unsigned int) scenario->num_expected, ok ? "ok" : "FAILED");
+    if (ok == false){
+        for (i = 0; i < test_num_events; i++){
+            printf("  %5u ms: button %u %s\n", (unsigned int) test_events[i].time_ms, (unsigned int) test_events[i].button,
+                   test_events[i].pressed ? "pressed" : "released");
+        }
+    }
+    return ok;
+}
+
+int main(int argc, const char * argv[]){
+    UNUSED(argc);
+    UNUSED(argv);
+
+    printf("Button input test: debounce %u ms\n", TEST_DEBOUNCE_MS);
+    printf("%-36s %5s %6s %8s  %s\n", "scenario", "edges", "events", "expected", "result");
+    bool ok = true;
+    unsigned int i;
+    for (i = 0; i < TEST_NUM_SCENARIOS; i++){
+        ok = test_run_scenario(&test_scenarios[i]) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,85 @@
+/*
+ * hid_host_run_loop.c - BTstack run loop with simulated time for host tests of the HID modules
+ */
+
+#include <stddef.h>
+
+#include "hid_host_run_loop.h"
+
+#include "btstack_debug.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+
+static uint32_t hid_host_time_ms;
+static uint32_t hid_host_timers_fired;
+
+static void hid_host_init(void){
+    btstack_run_loop_base_init();
+    hid_host_time_ms      = 0;
+    hid_host_timers_fired = 0;
+}
+
+static uint32_t hid_host_get_time_ms(void){
+    return hid_host_time_ms;
+}
+
+static void hid_host_set_timer(btstack_timer_source_t * timer, uint32_t timeout_in_ms){
+    timer->timeout = hid_host_time_ms + timeout_in_ms;
+}
+
+static void hid_host_add_timer(btstack_timer_source_t * timer){
+    btstack_run_loop_base_add_timer(timer);
+}
+
+static bool hid_host_remove_timer(btstack_timer_source_t * timer){
+    return btstack_run_loop_base_remove_timer(timer);
+}
+
+static void hid_host_execute_on_main_thread(btstack_context_callback_registration_t * callback_registration){
+    btstack_run_loop_base_add_callback(callback_registration);
+}
+
+static void hid_host_execute(void){
+    // time only advances via hid_host_run_loop_run_until_ms
+    btstack_assert(false);
+}
+
+static void hid_host_trigger_exit(void){
+}
+
+static const btstack_run_loop_t hid_host_run_loop = {
+    .init                   = &hid_host_init,
+    .set_timer              = &hid_host_set_timer,
+    .add_timer              = &hid_host_add_timer,
+    .remove_timer           = &hid_host_remove_timer,
+    .execute                = &hid_host_execute,
+    .get_time_ms            = &hid_host_get_time_ms,
+    .execute_on_main_thread = &hid_host_execute_on_main_thread,
+    .trigger_exit           = &hid_host_trigger_exit,
+};
+
+void hid_host_run_loop_init(void){
+    btstack_run_loop_init(&hid_host_run_loop);
+}
+
+void hid_host_run_loop_run_until_ms(uint32_t time_ms){
+    btstack_assert((int32_t) (time_ms - hid_host_time_ms) >= 0);
+    while (true){
+        btstack_run_loop_base_execute_callbacks();
+        int32_t time_until_timeout = btstack_run_loop_base_get_time_until_timeout(hid_host_time_ms);
+        if (time_until_timeout < 0) break;
+        uint32_t timeout_ms = hid_host_time_ms + (uint32_t) time_until_timeout;
+        if ((int32_t) (timeout_ms - time_ms) > 0) break;
+        // fire each timer at its own timeout, timer handlers may add new timers
+        hid_host_time_ms = timeout_ms;
+        btstack_timer_source_t * timer = (btstack_timer_source_t *) btstack_run_loop_base_timers;
+        btstack_run_loop_base_remove_timer(timer);
+        hid_host_timers_fired++;
+        (*timer->process)(timer);
+    }
+    hid_host_time_ms = time_ms;
+}
+
+uint32_t hid_host_run_loop_get_timers_fired(void){
+    return hid_host_timers_fired;
+}
@@ -0,0 +1,40 @@
+/*
+ * hid_host_run_loop.h - BTstack run loop with simulated time for host tests of the HID modules
+ *
+ * Timers and callbacks registered via btstack_run_loop_execute_on_main_thread are kept by the BTstack run
+ * loop base. Nothing runs on its own: the test advances simulated time, which executes pending callbacks and
+ * all timers due until then in order of their timeout, each at its own timeout. Single threaded, i.e. edges
+ * or wakeups that come from other threads on the target are injected from the test thread.
+ */
+
+#ifndef HID_HOST_RUN_LOOP_H
+#define HID_HOST_RUN_LOOP_H
+
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Install run loop, drop all timers and callbacks and set time to 0 ms
+ */
+void hid_host_run_loop_init(void);
+
+/**
+ * @brief Execute callbacks and timers due until given time, then set time
+ * @param time_ms >= current time
+ */
+void hid_host_run_loop_run_until_ms(uint32_t time_ms);
+
+/**
+ * @brief Get number of timer handlers called since init, e.g. to count wakeups
+ * @return num timers fired
+ */
+uint32_t hid_host_run_loop_get_timers_fired(void);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
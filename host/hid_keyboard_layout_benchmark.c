@@ -0,0 +1,262 @@
+/*
+ * hid_keyboard_layout_benchmark.c - character to keycode lookup cost for bulk text injection
+ *
+ * Compares the 256-entry reverse map of hid_keyboard_layout with the linear search through
+ * keytable_us_none / keytable_us_shift that hid_single_key.c and old/hfp_hid_muti.c use. Both are run over
+ * the same texts: the text of keyboard_layout_benchmark in hfp_hid_muti, lowercase prose, where the linear
+ * search hits early, and shifted symbols, which are found only after both tables were walked. Reports
+ * cycles per character of each lookup and the speedup. Fails if the map returns a different keycode or
+ * modifier than the linear search for any character the keytables contain.
+ *
+ * Usage: hid_keyboard_layout_benchmark [passes over each text, default 10000]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+#include "cycle_stats.h"
+#include "hid_keyboard_layout.h"
+
+#define BENCHMARK_TEXT_CHARS    4096
+
+#define CHAR_ILLEGAL     0xff
+#define CHAR_RETURN     '\n'
+#define CHAR_ESCAPE      27
+#define CHAR_TAB         '\t'
+#define CHAR_BACKSPACE   0x7f
+
+// keytables and lookup as in old/hid_single_key.c
+static const uint8_t keytable_us_none [] = {
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /*   0-3 */
+    'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j',                   /*  4-13 */
+    'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't',                   /* 14-23 */
+    'u', 'v', 'w', 'x', 'y', 'z',                                       /* 24-29 */
+    '1', '2', '3', '4', '5', '6', '7', '8', '9', '0',                   /* 30-39 */
+    CHAR_RETURN, CHAR_ESCAPE, CHAR_BACKSPACE, CHAR_TAB, ' ',            /* 40-44 */
+    '-', '=', '[', ']', '\\', CHAR_ILLEGAL, ';', '\'', 0x60, ',',       /* 45-54 */
+    '.', '/', CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,   /* 55-60 */
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /* 61-64 */
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /* 65-68 */
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /* 69-72 */
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /* 73-76 */
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /* 77-80 */
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /* 81-84 */
+    '*', '-', '+', '\n', '1', '2', '3', '4', '5',                       /* 85-97 */
+    '6', '7', '8', '9', '0', '.', 0xa7,                                 /* 97-100 */
+};
+
+static const uint8_t keytable_us_shift[] = {
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /*  0-3  */
+    'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J',                   /*  4-13 */
+    'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T',                   /* 14-23 */
+    'U', 'V', 'W', 'X', 'Y', 'Z',                                       /* 24-29 */
+    '!', '@', '#', '$', '%', '^', '&', '*', '(', ')',                   /* 30-39 */
+    CHAR_RETURN, CHAR_ESCAPE, CHAR_BACKSPACE, CHAR_TAB, ' ',            /* 40-44 */
+    '_', '+', '{', '}', '|', CHAR_ILLEGAL, ':', '"', 0x7E, '<',         /* 45-54 */
+    '>', '?', CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,   /* 55-60 */
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /* 61-64 */
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /* 65-68 */
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /* 69-72 */
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /* 73-76 */
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /* 77-80 */
+    CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL, CHAR_ILLEGAL,             /* 81-84 */
+    '*', '-', '+', '\n', '1', '2', '3', '4', '5',                       /* 85-97 */
+    '6', '7', '8', '9', '0', '.', 0xb1,                                 /* 97-100 */
+};
+
+static bool lookup_keycode(uint8_t character, const uint8_t * table, int size, uint8_t * keycode){
+    int i;
+    for (i=0;i<size;i++){
+        if (table[i] != character) continue;
+        *keycode = i;
+        return true;
+    }
+    return false;
+}
+
+static bool keycode_and_modifer_us_for_character(uint8_t character, uint8_t * keycode, uint8_t * modifier){
+    bool found;
+    found = lookup_keycode(character, keytable_us_none, sizeof(keytable_us_none), keycode);
+    if (found) {
+        *modifier = 0;  // none
+        return true;
+    }
+    found = lookup_keycode(character, keytable_us_shift, sizeof(keytable_us_shift), keycode);
+    if (found) {
+        *modifier = 2;  // shift
+        return true;
+    }
+    return false;
+}
+
+typedef struct {
+    const char * name;
+    // text is built from these characters if no fixed text given
+    const char * fixed_text;
+    const char * alphabet;
+} benchmark_text_t;
+
+static const benchmark_text_t benchmark_texts[] = {
+    { "firmware text",   "The quick brown fox jumps over the lazy dog. 0123456789 !@#$%^&*()_+-=[]{};':\",./<>?\n", NULL },
+    { "lowercase prose", NULL, "etaoinshrdlcumwfgypbvkjxqz      ,." },
+    { "shifted symbols", NULL, "!@#$%^&*()_+{}|:\"~<>?" },
+};
+
+#define BENCHMARK_NUM_TEXTS (sizeof(benchmark_texts) / sizeof(benchmark_texts[0]))
+
+typedef struct {
+    uint32_t      num_chars;
+    uint32_t      num_found;
+    cycle_stats_t map_cycles;
+    cycle_stats_t linear_cycles;
+} benchmark_result_t;
+
+static benchmark_result_t benchmark_results[BENCHMARK_NUM_TEXTS];
+static uint8_t            benchmark_text[BENCHMARK_TEXT_CHARS];
+static uint32_t           benchmark_random_state = 0x12345678;
+// keeps lookups from being optimized away
+static volatile uint32_t  benchmark_sink;
+
+static uint32_t benchmark_random(void){
+    uint32_t x = benchmark_random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    benchmark_random_state = x;
+    return x;
+}
+
+static uint64_t benchmark_get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// cycle counter rate, to convert lookup cycles into wall time
+static uint32_t benchmark_cycles_per_us(void){
+    uint64_t ns_start = benchmark_get_time_ns();
+    uint32_t cycles_start = cycle_stats_get_cycles();
+    const struct timespec period = { 0, 20000000L };
+    nanosleep(&period, NULL);
+    uint32_t cycles = cycle_stats_get_cycles() - cycles_start;
+    uint64_t us = (benchmark_get_time_ns() - ns_start) / 1000;
+    return (uint32_t) btstack_max(1, (uint32_t) (cycles / us));
+}
+
+// map has to agree with the linear search wherever the keytables have an entry
+static bool benchmark_verify_layout(void){
+    bool ok = true;
+    unsigned int character;
+    for (character = 0; character < HID_KEYBOARD_LAYOUT_NUM_CHARACTERS; character++){
+        // unused table entries match CHAR_ILLEGAL
+        if (character == CHAR_ILLEGAL) continue;
+        uint8_t keycode = 0;
+        uint8_t modifier = 0;
+        if (keycode_and_modifer_us_for_character((uint8_t) character, &keycode, &modifier) == false) continue;
+        uint8_t map_keycode = 0;
+        uint8_t map_modifier = 0;
+        bool found = hid_keyboard_layout_lookup(&hid_keyboard_layout_us, (uint8_t) character, &map_keycode, &map_modifier);
+        if (found && (map_keycode == keycode) && (map_modifier == modifier)) continue;
+        printf("character 0x%02x: keytables 0x%02x/0x%02x, layout '%s' %s 0x%02x/0x%02x\n", character, keycode, modifier,
+               hid_keyboard_layout_us.name, found ? "has" : "misses", map_keycode, map_modifier);
+        ok = false;
+    }
+    return ok;
+}
+
+static uint32_t benchmark_build_text(const benchmark_text_t * text){
+    if (text->fixed_text != NULL){
+        uint32_t num_chars = (uint32_t) strlen(text->fixed_text);
+        memcpy(benchmark_text, text->fixed_text, num_chars);
+        return num_chars;
+    }
+    uint32_t alphabet_size = (uint32_t) strlen(text->alphabet);
+    uint32_t i;
+    for (i = 0; i < BENCHMARK_TEXT_CHARS; i++){
+        benchmark_text[i] = (uint8_t) text->alphabet[benchmark_random() % alphabet_size];
+    }
+    return BENCHMARK_TEXT_CHARS;
+}
+
+static void benchmark_run_text(benchmark_result_t * result, const benchmark_text_t * text, uint32_t passes){
+    result->num_chars = benchmark_build_text(text);
+    cycle_stats_reset(&result->map_cycles);
+    cycle_stats_reset(&result->linear_cycles);
+
+    uint32_t pass;
+    for (pass = 0; pass < passes; pass++){
+        uint32_t sum = 0;
+        uint32_t found = 0;
+        uint32_t i;
+        uint32_t cycles_start = cycle_stats_get_cycles();
+        for (i = 0; i < result->num_chars; i++){
+            uint8_t keycode;
+            uint8_t modifier;
+            if (hid_keyboard_layout_lookup(&hid_keyboard_layout_us, benchmark_text[i], &keycode, &modifier)){
+                sum += keycode + modifier;
+                found++;
+            }
+        }
+        cycle_stats_add(&result->map_cycles, cycle_stats_get_cycles() - cycles_start);
+        result->num_found = found;
+
+        cycles_start = cycle_stats_get_cycles();
+        for (i = 0; i < result->num_chars; i++){
+            uint8_t keycode;
+            uint8_t modifier;
+            if (keycode_and_modifer_us_for_character(benchmark_text[i], &keycode, &modifier)){
+                sum -= keycode + modifier;
+            }
+        }
+        cycle_stats_add(&result->linear_cycles, cycle_stats_get_cycles() - cycles_start);
+        benchmark_sink += sum;
+    }
+}
+
+static void benchmark_report_text(const benchmark_result_t * result, const benchmark_text_t * text, uint32_t cycles_per_us){
+    uint32_t map_cycles    = cycle_stats_get_percentile(&result->map_cycles, 50);
+    uint32_t linear_cycles = cycle_stats_get_percentile(&result->linear_cycles, 50);
+    // per char in 0.01 cycles
+    uint32_t map_per_char    = (uint32_t) ((uint64_t) map_cycles * 100 / result->num_chars);
+    uint32_t linear_per_char = (uint32_t) ((uint64_t) linear_cycles * 100 / result->num_chars);
+    uint32_t speedup = linear_per_char * 10 / btstack_max(1, map_per_char);
+    printf("%-16s %5u %5u  %5u.%02u %8u.%02u  %5u.%u  %11u\n", text->name,
+           (unsigned int) result->num_chars, (unsigned int) result->num_found,
+           (unsigned int) (map_per_char / 100), (unsigned int) (map_per_char % 100),
+           (unsigned int) (linear_per_char / 100), (unsigned int) (linear_per_char % 100),
+           (unsigned int) (speedup / 10), (unsigned int) (speedup % 10),
+           (unsigned int) ((uint64_t) map_cycles * 1000 / cycles_per_us));
+}
+
+int main(int argc, const char * argv[]){
+    uint32_t passes = 10000;
+    if (argc > 1){
+        passes = (uint32_t) atoi(argv[1]);
+    }
+    btstack_assert(passes > 0);
+
+    bool ok = benchmark_verify_layout();
+    unsigned int i;
+    for (i = 0; i < BENCHMARK_NUM_TEXTS; i++){
+        benchmark_run_text(&benchmark_results[i], &benchmark_texts[i], passes);
+    }
+
+    uint32_t cycles_per_us = benchmark_cycles_per_us();
+    printf("\nKeyboard layout benchmark: layout '%s', %u passes per text, median pass, %u cycles per us\n",
+           hid_keyboard_layout_us.name, (unsigned int) passes, (unsigned int) cycles_per_us);
+    printf("%-16s %5s %5s  %8s %11s  %7s  %11s\n", "text", "chars", "found", "map c/ch", "linear c/ch", "speedup",
+           "map ns/pass");
+    for (i = 0; i < BENCHMARK_NUM_TEXTS; i++){
+        benchmark_report_text(&benchmark_results[i], &benchmark_texts[i], cycles_per_us);
+    }
+    if (ok == false){
+        printf("layout '%s' differs from keytables\n", hid_keyboard_layout_us.name);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,367 @@
+/*
+ * hid_text_typer_benchmark.c - hid_text_typer over a simulated HID interrupt channel: chars/s and correctness
+ *
+ * The simulated link holds up to BENCHMARK_LINK_BUFFERS reports in the controller and sends one per link
+ * interval, e.g. every slot pair of an active link or every sniff interval. A HID_SUBEVENT_CAN_SEND_NOW
+ * is emitted on request as soon as a buffer is free. The handler mirrors typing_can_send_now in
+ * hfp_hid_muti: get the next report, request the next event while reports are pending. Text is streamed
+ * into the typer buffer of TYPING_BUFFER_SIZE as space gets free. Texts are prose, mostly lowercase with
+ * sentence case, and a mix of letters, digits and symbols where about every third character changes the
+ * modifier. The host side decodes every received report like a HID host does: keys not pressed in the
+ * previous report are typed in array order with the report modifier.
+ *
+ * Reports characters per second from hid_text_typer_get_chars_per_second, characters per report and the
+ * cost of hid_text_typer_get_next_report, next to the 25 chars/s of the old path with a fixed 40 ms per
+ * character. Fails if the decoded text differs from the typable characters of the input or keys are left
+ * pressed at the end.
+ *
+ * Usage: hid_text_typer_benchmark [characters of text per configuration, default 20000]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btstack_debug.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+
+#include "cycle_stats.h"
+#include "hid_host_run_loop.h"
+#include "hid_keyboard_layout.h"
+#include "hid_text_typer.h"
+
+// as in hfp_hid_muti
+#define TYPING_BUFFER_SIZE          1024
+// old path: TYPING_KEYDOWN_MS + TYPING_DELAY_MS per character
+#define BENCHMARK_OLD_MS_PER_CHAR   40
+
+#define BENCHMARK_LINK_BUFFERS      2
+#define BENCHMARK_MAX_TEXT_CHARS    1000000
+
+typedef enum {
+    BENCHMARK_TEXT_PROSE,
+    BENCHMARK_TEXT_MIXED,
+} benchmark_text_type_t;
+
+typedef struct {
+    const char *          name;
+    benchmark_text_type_t text_type;
+    uint8_t               max_keys_per_report;
+    uint16_t              link_interval_ms;
+} benchmark_config_t;
+
+static const benchmark_config_t benchmark_configs[] = {
+    { "prose, 1 key",         BENCHMARK_TEXT_PROSE, 1,  1 },
+    { "prose, 6 keys",        BENCHMARK_TEXT_PROSE, 6,  1 },
+    { "prose, sniff, 6 keys", BENCHMARK_TEXT_PROSE, 6, 10 },
+    { "mixed, 1 key",         BENCHMARK_TEXT_MIXED, 1,  1 },
+    { "mixed, 6 keys",        BENCHMARK_TEXT_MIXED, 6,  1 },
+    { "mixed, sniff, 6 keys", BENCHMARK_TEXT_MIXED, 6, 10 },
+};
+
+#define BENCHMARK_NUM_CONFIGS (sizeof(benchmark_configs) / sizeof(benchmark_configs[0]))
+
+static const char * const benchmark_words[] = {
+    "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "hello", "world", "keyboard", "report",
+    "little", "address", "bluetooth", "a", "of", "to", "and", "is", "in", "that", "it", "with", "for", "see",
+};
+
+#define BENCHMARK_NUM_WORDS (sizeof(benchmark_words) / sizeof(benchmark_words[0]))
+
+// letters by frequency, duplicates make repeated keys likely, 0x01 is not in the layout
+static const char benchmark_alphabet[] =
+    "eeeeetttaaooiinnsshhrrdlcumwfgypbvkjxqz          "
+    "EATOINSHRDLCUMWFGYPBVKJXQZ0123456789.,;:'\"!?-_()[]{}@#$%^&*+=/\\|<>~`\n\t\x01";
+
+typedef struct {
+    uint8_t modifier;
+    uint8_t keycodes[HID_TEXT_TYPER_NUM_KEYS];
+} benchmark_report_t;
+
+typedef struct {
+    uint32_t      chars_typed;
+    uint32_t      chars_skipped;
+    uint32_t      reports;
+    uint32_t      reports_release;
+    uint32_t      reports_modifier;
+    uint32_t      chars_per_second;
+    uint32_t      duration_ms;
+    uint32_t      errors;
+    cycle_stats_t report_cycles;
+} benchmark_result_t;
+
+static hid_text_typer_t         benchmark_typer;
+static uint8_t                  benchmark_typer_storage[TYPING_BUFFER_SIZE];
+static const benchmark_config_t * benchmark_config;
+static benchmark_result_t *     benchmark_result;
+static benchmark_result_t       benchmark_results[BENCHMARK_NUM_CONFIGS];
+static uint32_t                 benchmark_random_state;
+
+// input text and position of next character to write into the typer
+static char                     benchmark_text[BENCHMARK_MAX_TEXT_CHARS];
+static uint32_t                 benchmark_text_len;
+static uint32_t                 benchmark_text_pos;
+static bool                     benchmark_typing_active;
+
+// controller buffers of the HID interrupt channel
+static benchmark_report_t       benchmark_link_queue[BENCHMARK_LINK_BUFFERS];
+static uint8_t                  benchmark_link_read_pos;
+static uint8_t                  benchmark_link_queued;
+static bool                     benchmark_link_can_send_now_requested;
+static btstack_timer_source_t   benchmark_link_timer;
+static btstack_context_callback_registration_t benchmark_link_can_send_now_registration;
+
+// host side: reverse of layout, last report and decoded text
+static uint8_t                  benchmark_host_characters[2][256];
+static benchmark_report_t       benchmark_host_report;
+static char                     benchmark_host_text[BENCHMARK_MAX_TEXT_CHARS];
+static uint32_t                 benchmark_host_text_len;
+
+static void benchmark_link_request_can_send_now(void);
+
+static uint32_t benchmark_random(void){
+    // xorshift32
+    uint32_t x = benchmark_random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    benchmark_random_state = x;
+    return x;
+}
+
+static void benchmark_host_init(const hid_keyboard_layout_t * layout){
+    memset(benchmark_host_characters, 0, sizeof(benchmark_host_characters));
+    memset(&benchmark_host_report, 0, sizeof(benchmark_host_report));
+    benchmark_host_text_len = 0;
+    unsigned int character;
+    for (character = 1; character < HID_KEYBOARD_LAYOUT_NUM_CHARACTERS; character++){
+        uint8_t keycode;
+        uint8_t modifier;
+        if (hid_keyboard_layout_lookup(layout, (uint8_t) character, &keycode, &modifier) == false) continue;
+        uint8_t shift = (modifier == HID_KEYBOARD_MODIFIER_LEFT_SHIFT) ? 1 : 0;
+        btstack_assert(benchmark_host_characters[shift][keycode] == 0);
+        benchmark_host_characters[shift][keycode] = (uint8_t) character;
+    }
+}
+
+// newly pressed keys are typed in array order with the modifier of the report
+static void benchmark_host_receive(const benchmark_report_t * report){
+    uint8_t shift = (report->modifier == HID_KEYBOARD_MODIFIER_LEFT_SHIFT) ? 1 : 0;
+    if ((report->modifier != 0) && (shift == 0)){
+        benchmark_result->errors++;
+    }
+    uint8_t i;
+    for (i = 0; i < HID_TEXT_TYPER_NUM_KEYS; i++){
+        uint8_t keycode = report->keycodes[i];
+        if (keycode == 0) continue;
+        if (memchr(benchmark_host_report.keycodes, keycode, HID_TEXT_TYPER_NUM_KEYS) != NULL) continue;
+        uint8_t character = benchmark_host_characters[shift][keycode];
+        if ((character == 0) || (benchmark_host_text_len == BENCHMARK_MAX_TEXT_CHARS)){
+            benchmark_result->errors++;
+            continue;
+        }
+        benchmark_host_text[benchmark_host_text_len++] = (char) character;
+    }
+    benchmark_host_report = *report;
+}
+
+// streaming source: refill typer as space gets free
+static void benchmark_write_text(void){
+    uint32_t num_chars = benchmark_text_len - benchmark_text_pos;
+    benchmark_text_pos += hid_text_typer_write(&benchmark_typer, &benchmark_text[benchmark_text_pos], num_chars);
+}
+
+// as typing_can_send_now in hfp_hid_muti
+static void benchmark_typing_can_send_now(void){
+    if (benchmark_typing_active == false) return;
+    benchmark_write_text();
+
+    benchmark_report_t report;
+    uint32_t cycles_start = cycle_stats_get_cycles();
+    bool have_report = hid_text_typer_get_next_report(&benchmark_typer, btstack_run_loop_get_time_ms(), &report.modifier,
+                                                      report.keycodes);
+    cycle_stats_add(&benchmark_result->report_cycles, cycle_stats_get_cycles() - cycles_start);
+    if (have_report){
+        btstack_assert(benchmark_link_queued < BENCHMARK_LINK_BUFFERS);
+        uint8_t write_pos = (benchmark_link_read_pos + benchmark_link_queued) % BENCHMARK_LINK_BUFFERS;
+        benchmark_link_queue[write_pos] = report;
+        benchmark_link_queued++;
+        if (benchmark_link_queued == 1){
+            btstack_run_loop_set_timer(&benchmark_link_timer, benchmark_config->link_interval_ms);
+            btstack_run_loop_add_timer(&benchmark_link_timer);
+        }
+    }
+    if (hid_text_typer_has_report(&benchmark_typer) || (benchmark_text_pos < benchmark_text_len)){
+        benchmark_link_request_can_send_now();
+        return;
+    }
+    benchmark_typing_active = false;
+}
+
+static void benchmark_link_emit_can_send_now(void * context){
+    UNUSED(context);
+    benchmark_typing_can_send_now();
+}
+
+static void benchmark_link_request_can_send_now(void){
+    if (benchmark_link_queued < BENCHMARK_LINK_BUFFERS){
+        // buffer free: event is emitted from the run loop
+        benchmark_link_can_send_now_registration.callback = &benchmark_link_emit_can_send_now;
+        btstack_run_loop_execute_on_main_thread(&benchmark_link_can_send_now_registration);
+        return;
+    }
+    benchmark_link_can_send_now_requested = true;
+}
+
+// one report leaves the controller per link interval
+static void benchmark_link_timer_handler(btstack_timer_source_t * ts){
+    benchmark_host_receive(&benchmark_link_queue[benchmark_link_read_pos]);
+    benchmark_link_read_pos = (benchmark_link_read_pos + 1) % BENCHMARK_LINK_BUFFERS;
+    benchmark_link_queued--;
+    if (benchmark_link_can_send_now_requested){
+        benchmark_link_can_send_now_requested = false;
+        benchmark_typing_can_send_now();
+    }
+    if (benchmark_link_queued > 0){
+        btstack_run_loop_set_timer(ts, benchmark_config->link_interval_ms);
+        btstack_run_loop_add_timer(ts);
+    }
+}
+
+// sentences of 4..11 words, paragraph after 5 sentences on average
+static void benchmark_build_prose(uint32_t num_chars){
+    uint32_t pos = 0;
+    uint32_t words_left = 0;
+    while (pos < num_chars){
+        if (words_left == 0){
+            words_left = 4 + (benchmark_random() % 8);
+        }
+        const char * word = benchmark_words[benchmark_random() % BENCHMARK_NUM_WORDS];
+        bool sentence_start = (pos == 0) || (benchmark_text[pos - 1] != ' ');
+        while ((*word != 0) && (pos < num_chars)){
+            char character = *word++;
+            if (sentence_start){
+                character = (char) (character - 'a' + 'A');
+                sentence_start = false;
+            }
+            benchmark_text[pos++] = character;
+        }
+        words_left--;
+        if (words_left == 0){
+            if (pos < num_chars) benchmark_text[pos++] = '.';
+            if (pos < num_chars) benchmark_text[pos++] = ((benchmark_random() % 5) == 0) ? '\n' : ' ';
+        } else if (pos < num_chars){
+            benchmark_text[pos++] = ' ';
+        }
+    }
+}
+
+static void benchmark_build_text(benchmark_text_type_t text_type, uint32_t num_chars){
+    benchmark_random_state = 0x2545f491;
+    benchmark_text_len = num_chars;
+    if (text_type == BENCHMARK_TEXT_PROSE){
+        benchmark_build_prose(num_chars);
+        return;
+    }
+    uint32_t alphabet_size = sizeof(benchmark_alphabet) - 1;
+    uint32_t i;
+    for (i = 0; i < num_chars; i++){
+        benchmark_text[i] = benchmark_alphabet[benchmark_random() % alphabet_size];
+    }
+}
+
+static void benchmark_run_config(benchmark_result_t * result, const benchmark_config_t * config, uint32_t num_chars){
+    memset(result, 0, sizeof(benchmark_result_t));
+    benchmark_build_text(config->text_type, num_chars);
+    cycle_stats_reset(&result->report_cycles);
+    benchmark_config = config;
+    benchmark_result = result;
+
+    hid_host_run_loop_init();
+    hid_text_typer_init(&benchmark_typer, &hid_keyboard_layout_us, benchmark_typer_storage, sizeof(benchmark_typer_storage));
+    hid_text_typer_set_max_keys_per_report(&benchmark_typer, config->max_keys_per_report);
+    benchmark_host_init(&hid_keyboard_layout_us);
+    benchmark_link_read_pos = 0;
+    benchmark_link_queued   = 0;
+    benchmark_link_can_send_now_requested = false;
+    btstack_run_loop_set_timer_handler(&benchmark_link_timer, &benchmark_link_timer_handler);
+
+    // as keyboard_type_text in hfp_hid_muti
+    benchmark_text_pos = 0;
+    benchmark_write_text();
+    benchmark_typing_active = true;
+    benchmark_link_request_can_send_now();
+    while (benchmark_typing_active || (benchmark_link_queued > 0)){
+        hid_host_run_loop_run_until_ms(btstack_run_loop_get_time_ms() + 1);
+    }
+
+    result->chars_typed      = benchmark_typer.chars_typed;
+    result->chars_skipped    = benchmark_typer.chars_skipped;
+    result->reports          = benchmark_typer.reports_sent;
+    result->reports_release  = benchmark_typer.reports_release;
+    result->reports_modifier = benchmark_typer.reports_modifier;
+    result->chars_per_second = hid_text_typer_get_chars_per_second(&benchmark_typer);
+    result->duration_ms      = benchmark_typer.last_report_ms - benchmark_typer.first_report_ms;
+
+    // host has to see the typable characters in order and all keys released
+    uint32_t host_pos = 0;
+    uint32_t i;
+    for (i = 0; i < benchmark_text_len; i++){
+        uint8_t keycode;
+        uint8_t modifier;
+        if (hid_keyboard_layout_lookup(&hid_keyboard_layout_us, (uint8_t) benchmark_text[i], &keycode, &modifier) == false) continue;
+        if ((host_pos == benchmark_host_text_len) || (benchmark_host_text[host_pos] != benchmark_text[i])){
+            result->errors++;
+            break;
+        }
+        host_pos++;
+    }
+    if (host_pos != benchmark_host_text_len){
+        result->errors++;
+    }
+    const benchmark_report_t released = { 0 };
+    if (memcmp(&benchmark_host_report, &released, sizeof(released)) != 0){
+        result->errors++;
+    }
+}
+
+static bool benchmark_report_config(const benchmark_result_t * result, const benchmark_config_t * config){
+    const cycle_stats_t * cycles = &result->report_cycles;
+    // per report in 0.01 chars
+    uint32_t chars_per_report = (uint32_t) ((uint64_t) result->chars_typed * 100 / btstack_max(1, result->reports));
+    bool ok = result->errors == 0;
+    printf("%-20s %7u %7u %7u %7u %8u  %4u.%02u %8u %8u  %6u %6u%s\n", config->name,
+           (unsigned int) result->chars_typed, (unsigned int) result->chars_skipped, (unsigned int) result->reports,
+           (unsigned int) result->reports_release, (unsigned int) result->reports_modifier,
+           (unsigned int) (chars_per_report / 100), (unsigned int) (chars_per_report % 100),
+           (unsigned int) result->duration_ms, (unsigned int) result->chars_per_second,
+           (unsigned int) cycle_stats_get_percentile(cycles, 50), (unsigned int) cycle_stats_get_percentile(cycles, 99),
+           ok ? "" : "  FAILED");
+    if (ok == false){
+        printf("  %u errors, host decoded %u characters\n", (unsigned int) result->errors,
+               (unsigned int) benchmark_host_text_len);
+    }
+    return ok;
+}
+
+int main(int argc, const char * argv[]){
+    uint32_t num_chars = 20000;
+    if (argc > 1){
+        num_chars = (uint32_t) atoi(argv[1]);
+    }
+    btstack_assert((num_chars > 0) && (num_chars <= BENCHMARK_MAX_TEXT_CHARS));
+
+    printf("Text typer benchmark: %u characters, typer buffer %u, %u link buffers, old path %u chars/s\n",
+           (unsigned int) num_chars, TYPING_BUFFER_SIZE, BENCHMARK_LINK_BUFFERS, 1000 / BENCHMARK_OLD_MS_PER_CHAR);
+    printf("%-20s %7s %7s %7s %7s %8s  %7s %8s %8s  %-13s\n", "configuration", "typed", "skipped", "reports",
+           "release", "modifier", "ch/rep", "ms", "chars/s", "report cycles");
+    bool ok = true;
+    unsigned int i;
+    for (i = 0; i < BENCHMARK_NUM_CONFIGS; i++){
+        benchmark_run_config(&benchmark_results[i], &benchmark_configs[i], num_chars);
+        ok = benchmark_report_config(&benchmark_results[i], &benchmark_configs[i]) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
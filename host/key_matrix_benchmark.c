@@ -0,0 +1,345 @@
+/*
+ * key_matrix_benchmark.c - key_matrix on a simulated matrix: scan rate, scan cost and report latency
+ *
+ * A simulated matrix HAL is typed on by a pseudo-random script: keys are pressed every 40..160 ms and held
+ * for 40..200 ms, so several keys overlap, and each contact bounces for up to BENCHMARK_BOUNCE_MS after
+ * every press and release. Time advances in 1 ms steps while a contact bounces. With idle wakeup, any
+ * closed contact in idle mode calls key_matrix_wakeup() like the column edge interrupt and the level check
+ * on enabling wakeup of key_matrix_esp32. Debounced changes update a 6KRO report as in hfp_hid_muti.
+ *
+ * Reports scans per second of simulated time, the share of scan periods that were scanned, the cost of a
+ * full matrix scan without the row settle time of the hardware, and the latency from the first contact or
+ * release to the debounced change as p50 / p99 / max. Fails if a press or release gets lost, reported
+ * twice or later than the debounce bound after the contact settled.
+ *
+ * Usage: key_matrix_benchmark [seconds of simulated typing per configuration, default 600]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "btstack_debug.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+
+#include "cycle_stats.h"
+#include "hid_host_run_loop.h"
+#include "hid_keyboard_report.h"
+#include "key_matrix.h"
+
+#define BENCHMARK_BOUNCE_MS         5
+#define BENCHMARK_MAX_HELD_KEYS     8
+#define BENCHMARK_PRESS_INTERVAL_MS 40
+#define BENCHMARK_PRESS_JITTER_MS   120
+#define BENCHMARK_HOLD_MS           40
+#define BENCHMARK_HOLD_JITTER_MS    160
+
+typedef struct {
+    const char * name;
+    uint8_t      num_rows;
+    uint8_t      num_cols;
+    uint16_t     scan_period_ms;
+    uint8_t      debounce_scans;
+    bool         idle_wakeup;
+} benchmark_config_t;
+
+static const benchmark_config_t benchmark_configs[] = {
+    { "4x4 keypad",         4,  4, 1, 5, true  },
+    { "6x16 full size",     6, 16, 1, 5, true  },
+    { "6x16 without idle",  6, 16, 1, 5, false },
+    { "8x16 slow scan",     8, 16, 2, 3, true  },
+};
+
+#define BENCHMARK_NUM_CONFIGS (sizeof(benchmark_configs) / sizeof(benchmark_configs[0]))
+
+typedef struct {
+    // physical state
+    bool     pressed;
+    uint32_t changed_ms;
+    uint32_t release_ms;
+    // debounced state reported by key_matrix
+    bool     reported;
+} benchmark_key_t;
+
+typedef struct {
+    uint32_t      presses;
+    uint32_t      releases;
+    uint32_t      reported_changes;
+    uint32_t      errors;
+    uint32_t      late;
+    uint32_t      reports;
+    uint32_t      scans;
+    uint32_t      wakeups;
+    cycle_stats_t latency_ms;
+    cycle_stats_t scan_cycles;
+} benchmark_result_t;
+
+static const benchmark_config_t * benchmark_config;
+static benchmark_key_t            benchmark_keys[KEY_MATRIX_MAX_ROWS][KEY_MATRIX_MAX_COLS];
+// rows are debounced as a whole, a change restarts debouncing of the other keys in the row
+static uint32_t                   benchmark_row_changed_ms[KEY_MATRIX_MAX_ROWS];
+static bool                       benchmark_idle;
+static uint32_t                   benchmark_random_state;
+static hid_keyboard_keys_t        benchmark_keyboard_keys;
+static uint8_t                    benchmark_report[1 + HID_KEYBOARD_6KRO_NUM_KEYS];
+static benchmark_result_t *       benchmark_result;
+static benchmark_result_t         benchmark_results[BENCHMARK_NUM_CONFIGS];
+
+static uint32_t benchmark_random(void){
+    // xorshift32
+    uint32_t x = benchmark_random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    benchmark_random_state = x;
+    return x;
+}
+
+static uint64_t benchmark_get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// cycle counter rate, to convert scan cycles into wall time
+static uint32_t benchmark_cycles_per_us(void){
+    uint64_t ns_start = benchmark_get_time_ns();
+    uint32_t cycles_start = cycle_stats_get_cycles();
+    const struct timespec period = { 0, 20000000L };
+    nanosleep(&period, NULL);
+    uint32_t cycles = cycle_stats_get_cycles() - cycles_start;
+    uint64_t us = (benchmark_get_time_ns() - ns_start) / 1000;
+    return (uint32_t) btstack_max(1, (uint32_t) (cycles / us));
+}
+
+// contact bounces pseudo-randomly per ms after each change
+static bool benchmark_contact(const benchmark_key_t * key, uint8_t row, uint8_t col, uint32_t now_ms){
+    uint32_t since_change_ms = now_ms - key->changed_ms;
+    if ((key->changed_ms == 0) || (since_change_ms >= BENCHMARK_BOUNCE_MS)) return key->pressed;
+    // first contact on press and release
+    if (since_change_ms == 0) return key->pressed;
+    uint32_t hash = (now_ms * 2654435761u) ^ ((uint32_t) row << 8) ^ col;
+    return ((hash >> 16) & 1) != 0;
+}
+
+static void benchmark_hal_init(void){
+}
+
+static uint32_t benchmark_hal_scan_row(uint8_t row){
+    uint32_t now_ms = btstack_run_loop_get_time_ms();
+    uint32_t columns = 0;
+    uint8_t col;
+    for (col = 0; col < benchmark_config->num_cols; col++){
+        if (benchmark_contact(&benchmark_keys[row][col], row, col, now_ms)){
+            columns |= 1u << col;
+        }
+    }
+    return columns;
+}
+
+// column interrupt in idle mode: all rows active, any closed contact pulls its column low
+static void benchmark_check_wakeup(void){
+    if (benchmark_idle == false) return;
+    uint32_t columns = 0;
+    uint8_t row;
+    for (row = 0; row < benchmark_config->num_rows; row++){
+        columns |= benchmark_hal_scan_row(row);
+    }
+    if (columns == 0) return;
+    benchmark_idle = false;
+    benchmark_result->wakeups++;
+    key_matrix_wakeup();
+}
+
+static void benchmark_hal_set_idle_wakeup(bool enabled){
+    benchmark_idle = enabled;
+    // key pressed while enabling wakeup
+    benchmark_check_wakeup();
+}
+
+static key_matrix_hal_t benchmark_hal = {
+    .init            = &benchmark_hal_init,
+    .scan_row        = &benchmark_hal_scan_row,
+    .set_idle_wakeup = &benchmark_hal_set_idle_wakeup,
+};
+
+static uint8_t benchmark_keymap(uint8_t row, uint8_t col){
+    // usages from 'a' on, without modifiers
+    return (uint8_t) (0x04 + ((row * KEY_MATRIX_MAX_COLS + col) % 0xa0));
+}
+
+static void benchmark_handler(uint8_t row, uint8_t col, bool pressed){
+    benchmark_key_t * key = &benchmark_keys[row][col];
+    uint32_t now_ms = btstack_run_loop_get_time_ms();
+    benchmark_result->reported_changes++;
+    if ((key->reported == pressed) || (key->pressed != pressed)){
+        benchmark_result->errors++;
+    }
+    key->reported = pressed;
+
+    // row settles after bounce, then debounce_scans identical scans follow within one period each
+    uint32_t latency_ms = now_ms - key->changed_ms;
+    cycle_stats_add(&benchmark_result->latency_ms, latency_ms);
+    uint32_t max_latency_ms = BENCHMARK_BOUNCE_MS + (benchmark_config->debounce_scans + 1) * benchmark_config->scan_period_ms;
+    if ((now_ms - benchmark_row_changed_ms[row]) > max_latency_ms){
+        benchmark_result->late++;
+    }
+
+    // 6KRO report as sent by hfp_hid_muti
+    hid_keyboard_keys_set(&benchmark_keyboard_keys, benchmark_keymap(row, col), pressed);
+    benchmark_report[0] = hid_keyboard_keys_get_6kro(&benchmark_keyboard_keys, &benchmark_report[1]);
+    benchmark_result->reports++;
+}
+
+static void benchmark_change_key(uint8_t row, uint8_t col, bool pressed, uint32_t now_ms){
+    benchmark_key_t * key = &benchmark_keys[row][col];
+    key->pressed    = pressed;
+    key->changed_ms = now_ms;
+    benchmark_row_changed_ms[row] = now_ms;
+    if (pressed){
+        benchmark_result->presses++;
+    } else {
+        benchmark_result->releases++;
+    }
+}
+
+static uint32_t benchmark_next_press_ms;
+
+// schedule next press, returns true if a key got pressed now
+static bool benchmark_press_random_key(uint32_t now_ms, uint8_t num_held){
+    benchmark_next_press_ms += BENCHMARK_PRESS_INTERVAL_MS + benchmark_random() % BENCHMARK_PRESS_JITTER_MS;
+    if (num_held == BENCHMARK_MAX_HELD_KEYS) return false;
+    uint8_t row = (uint8_t) (benchmark_random() % benchmark_config->num_rows);
+    uint8_t col = (uint8_t) (benchmark_random() % benchmark_config->num_cols);
+    benchmark_key_t * key = &benchmark_keys[row][col];
+    // skip keys that are held or just released
+    if (key->pressed || ((now_ms - key->changed_ms) < BENCHMARK_HOLD_MS)) return false;
+    key->release_ms = now_ms + BENCHMARK_HOLD_MS + benchmark_random() % BENCHMARK_HOLD_JITTER_MS;
+    benchmark_change_key(row, col, true, now_ms);
+    return true;
+}
+
+static void benchmark_run_config(benchmark_result_t * result, const benchmark_config_t * config, uint32_t seconds){
+    memset(result, 0, sizeof(benchmark_result_t));
+    memset(benchmark_keys, 0, sizeof(benchmark_keys));
+    memset(benchmark_row_changed_ms, 0, sizeof(benchmark_row_changed_ms));
+    cycle_stats_reset(&result->latency_ms);
+    benchmark_config       = config;
+    benchmark_result       = result;
+    benchmark_random_state = 0x2545f491;
+    benchmark_idle         = false;
+    hid_keyboard_keys_init(&benchmark_keyboard_keys);
+
+    benchmark_hal.num_rows        = config->num_rows;
+    benchmark_hal.num_cols        = config->num_cols;
+    benchmark_hal.set_idle_wakeup = config->idle_wakeup ? &benchmark_hal_set_idle_wakeup : NULL;
+    hid_host_run_loop_init();
+    // keep time 0 free, it marks keys that never changed
+    hid_host_run_loop_run_until_ms(1);
+    key_matrix_init(&benchmark_hal, config->scan_period_ms, config->debounce_scans, &benchmark_handler);
+
+    uint32_t end_ms = seconds * 1000;
+    benchmark_next_press_ms = 100;
+    uint8_t  num_held = 0;
+    while (true){
+        // next physical change: release of a held key or next press
+        uint32_t now_ms  = btstack_run_loop_get_time_ms();
+        uint32_t next_ms = benchmark_next_press_ms;
+        uint8_t row;
+        uint8_t col;
+        for (row = 0; row < config->num_rows; row++){
+            for (col = 0; col < config->num_cols; col++){
+                const benchmark_key_t * key = &benchmark_keys[row][col];
+                if (key->pressed && ((int32_t) (key->release_ms - next_ms) < 0)){
+                    next_ms = key->release_ms;
+                }
+                // step through bounce
+                if ((key->changed_ms != 0) && ((now_ms - key->changed_ms) < BENCHMARK_BOUNCE_MS)){
+                    next_ms = btstack_min(next_ms, now_ms + 1);
+                }
+            }
+        }
+        if (next_ms >= end_ms) break;
+        hid_host_run_loop_run_until_ms(next_ms);
+
+        for (row = 0; row < config->num_rows; row++){
+            for (col = 0; col < config->num_cols; col++){
+                benchmark_key_t * key = &benchmark_keys[row][col];
+                if (key->pressed && (key->release_ms == next_ms)){
+                    benchmark_change_key(row, col, false, next_ms);
+                    num_held--;
+                }
+            }
+        }
+        if ((next_ms == benchmark_next_press_ms) && benchmark_press_random_key(next_ms, num_held)){
+            num_held++;
+        }
+        // wakeup is handled at time of contact
+        benchmark_check_wakeup();
+        hid_host_run_loop_run_until_ms(next_ms);
+    }
+    // let last changes settle
+    hid_host_run_loop_run_until_ms(end_ms + 100);
+
+    result->scan_cycles = *key_matrix_get_scan_cycles();
+    result->scans       = result->scan_cycles.count;
+    uint8_t row;
+    uint8_t col;
+    for (row = 0; row < config->num_rows; row++){
+        for (col = 0; col < config->num_cols; col++){
+            if (benchmark_keys[row][col].reported != benchmark_keys[row][col].pressed){
+                result->errors++;
+            }
+        }
+    }
+}
+
+static bool benchmark_report_config(const benchmark_result_t * result, const benchmark_config_t * config, uint32_t seconds,
+                                    uint32_t cycles_per_us){
+    const cycle_stats_t * scan = &result->scan_cycles;
+    const cycle_stats_t * latency = &result->latency_ms;
+    uint32_t duration_ms = seconds * 1000 + 100;
+    // share of scan periods actually scanned, in 0.1 %
+    uint32_t scanned = (uint32_t) ((uint64_t) result->scans * config->scan_period_ms * 1000 / duration_ms);
+    bool ok = (result->errors == 0) && (result->late == 0) && (result->reported_changes == result->presses + result->releases);
+    printf("%-18s %7u %7u  %7u %4u.%u%%  %6u %6u %6u %6u  %4u %4u %4u  %7u%s\n", config->name,
+           (unsigned int) result->presses, (unsigned int) result->wakeups,
+           (unsigned int) (result->scans * 1000ULL / duration_ms), (unsigned int) (scanned / 10), (unsigned int) (scanned % 10),
+           (unsigned int) cycle_stats_get_percentile(scan, 50), (unsigned int) cycle_stats_get_percentile(scan, 99),
+           (unsigned int) scan->max, (unsigned int) (cycle_stats_get_percentile(scan, 99) * 1000ULL / cycles_per_us),
+           (unsigned int) cycle_stats_get_percentile(latency, 50), (unsigned int) cycle_stats_get_percentile(latency, 99),
+           (unsigned int) latency->max, (unsigned int) result->reports, ok ? "" : "  FAILED");
+    if (ok == false){
+        printf("  %u changes reported for %u presses and %u releases, %u errors, %u late\n",
+               (unsigned int) result->reported_changes, (unsigned int) result->presses, (unsigned int) result->releases,
+               (unsigned int) result->errors, (unsigned int) result->late);
+    }
+    return ok;
+}
+
+int main(int argc, const char * argv[]){
+    uint32_t seconds = 600;
+    if (argc > 1){
+        seconds = (uint32_t) atoi(argv[1]);
+    }
+    btstack_assert((seconds > 0) && (seconds < 3600000));
+
+    unsigned int i;
+    for (i = 0; i < BENCHMARK_NUM_CONFIGS; i++){
+        benchmark_run_config(&benchmark_results[i], &benchmark_configs[i], seconds);
+    }
+
+    uint32_t cycles_per_us = benchmark_cycles_per_us();
+    printf("\nKey matrix benchmark: %u s typing per configuration, bounce %u ms, %u cycles per us\n",
+           (unsigned int) seconds, BENCHMARK_BOUNCE_MS, (unsigned int) cycles_per_us);
+    printf("%-18s %7s %7s  %7s %6s  %-20s %6s  %-14s  %7s\n", "configuration", "presses", "wakeups", "scans/s",
+           "active", "scan cycles p50/p99/max", "p99 ns", "latency ms", "reports");
+    bool ok = true;
+    for (i = 0; i < BENCHMARK_NUM_CONFIGS; i++){
+        ok = benchmark_report_config(&benchmark_results[i], &benchmark_configs[i], seconds, cycles_per_us) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,179 @@
+/*
+ * polyphase_resampler_benchmark.c - cycles per block of polyphase_resampler for all codec rates
+ *
+ * Resamples a tone between 8, 16 or 32 kHz and the fixed 48 kHz audio device rate in blocks of one DMA
+ * buffer at 48 kHz, as sco_demo_util does for playback and recording. Reports cycles per block as
+ * avg / p50 / p99 / max, cycles per 48 kHz sample and the share of the block period at the p99 cost. The tone level after resampling is checked against the input level to catch a broken
+ * filter.
+ *
+ * Usage: polyphase_resampler_benchmark [seconds of audio per conversion, default 60]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sco_host_harness.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+#include "cycle_stats.h"
+#include "polyphase_resampler.h"
+#include "tone_generator.h"
+
+#define BENCHMARK_BLOCK_SAMPLES     SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES
+#define BENCHMARK_BLOCK_US          SCO_HOST_AUDIO_PERIOD_US
+#define BENCHMARK_TONE_HZ           1000
+#define BENCHMARK_TONE_AMPLITUDE    8192
+// skip filter startup in level check
+#define BENCHMARK_WARMUP_BLOCKS     10
+// passband gain of the prototype filter at the tone frequency
+#define BENCHMARK_MAX_LEVEL_ERROR_DB 1.0
+
+typedef struct {
+    uint32_t input_rate;
+    uint32_t output_rate;
+} benchmark_conversion_t;
+
+// playback: codec rate to audio device, recording: audio device to codec rate
+static const benchmark_conversion_t benchmark_conversions[] = {
+    {  8000, 48000 },
+    { 16000, 48000 },
+    { 32000, 48000 },
+    { 48000,  8000 },
+    { 48000, 16000 },
+    { 48000, 32000 },
+};
+
+#define BENCHMARK_NUM_CONVERSIONS (sizeof(benchmark_conversions) / sizeof(benchmark_conversions[0]))
+
+typedef struct {
+    uint32_t      blocks;
+    uint32_t      blocks_failed;
+    cycle_stats_t block_cycles;
+    double        input_energy;
+    double        output_energy;
+    uint32_t      input_samples;
+    uint32_t      output_samples;
+} benchmark_t;
+
+static polyphase_resampler_t benchmark_resampler;
+static tone_generator_t      benchmark_tone;
+static benchmark_t           benchmark_results[BENCHMARK_NUM_CONVERSIONS];
+
+static uint64_t benchmark_get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// cycle counter rate, to convert per-block cycles into wall time
+static uint32_t benchmark_cycles_per_us(void){
+    uint64_t ns_start = benchmark_get_time_ns();
+    uint32_t cycles_start = cycle_stats_get_cycles();
+    const struct timespec period = { 0, 20000000L };
+    nanosleep(&period, NULL);
+    uint32_t cycles = cycle_stats_get_cycles() - cycles_start;
+    uint64_t us = (benchmark_get_time_ns() - ns_start) / 1000;
+    return (uint32_t) btstack_max(1, (uint32_t) (cycles / us));
+}
+
+static double benchmark_energy(const int16_t * samples, uint16_t num_samples){
+    double energy = 0.0;
+    uint16_t i;
+    for (i = 0; i < num_samples; i++){
+        energy += (double) samples[i] * (double) samples[i];
+    }
+    return energy;
+}
+
+static void benchmark_run_conversion(benchmark_t * benchmark, const benchmark_conversion_t * conversion, uint32_t seconds){
+    bool ok = polyphase_resampler_init(&benchmark_resampler, conversion->input_rate, conversion->output_rate);
+    btstack_assert(ok);
+    tone_generator_init(&benchmark_tone, conversion->input_rate);
+    tone_generator_add_tone(&benchmark_tone, BENCHMARK_TONE_HZ, BENCHMARK_TONE_AMPLITUDE);
+    cycle_stats_reset(&benchmark->block_cycles);
+
+    // one side of each conversion runs at 48 kHz with one DMA buffer per block
+    bool upsampling = conversion->output_rate > conversion->input_rate;
+    int16_t input[BENCHMARK_BLOCK_SAMPLES];
+    int16_t output[BENCHMARK_BLOCK_SAMPLES];
+    uint32_t num_blocks = seconds * 1000000 / BENCHMARK_BLOCK_US;
+    uint32_t i;
+    for (i = 0; i < num_blocks; i++){
+        uint16_t num_output = BENCHMARK_BLOCK_SAMPLES;
+        uint16_t num_input  = BENCHMARK_BLOCK_SAMPLES;
+        if (upsampling){
+            num_input = polyphase_resampler_get_input_needed(&benchmark_resampler, num_output);
+            btstack_assert(num_input <= BENCHMARK_BLOCK_SAMPLES);
+        }
+        tone_generator_fill(&benchmark_tone, input, num_input);
+
+        uint16_t num_input_used;
+        uint32_t cycles_start = cycle_stats_get_cycles();
+        uint16_t num_produced = polyphase_resampler_process(&benchmark_resampler, input, num_input, &num_input_used,
+                                                            output, num_output);
+        cycle_stats_add(&benchmark->block_cycles, cycle_stats_get_cycles() - cycles_start);
+
+        // all input consumed, upsampling fills the block
+        if ((num_input_used != num_input) || (upsampling && (num_produced != num_output))){
+            benchmark->blocks_failed++;
+        }
+        if (i >= BENCHMARK_WARMUP_BLOCKS){
+            benchmark->input_energy   += benchmark_energy(input, num_input);
+            benchmark->output_energy  += benchmark_energy(output, num_produced);
+            benchmark->input_samples  += num_input;
+            benchmark->output_samples += num_produced;
+        }
+        benchmark->blocks++;
+    }
+}
+
+static bool benchmark_report(const benchmark_t * benchmark, const benchmark_conversion_t * conversion, uint32_t cycles_per_us){
+    const cycle_stats_t * stats = &benchmark->block_cycles;
+    uint32_t p99 = cycle_stats_get_percentile(stats, 99);
+    // block period share in 0.01 %
+    uint32_t load = (uint32_t) (p99 * 10000ULL / ((uint64_t) cycles_per_us * BENCHMARK_BLOCK_US));
+    double input_level  = benchmark->input_energy  / (double) btstack_max(1, benchmark->input_samples);
+    double output_level = benchmark->output_energy / (double) btstack_max(1, benchmark->output_samples);
+    double level_db = 10.0 * log10((output_level + 1.0) / (input_level + 1.0));
+
+    char name[24];
+    snprintf(name, sizeof(name), "%2u -> %2u kHz", (unsigned int) (conversion->input_rate / 1000),
+             (unsigned int) (conversion->output_rate / 1000));
+    printf("%-13s %7u  %7u %7u %7u %7u  %7u  %3u.%02u%%  %+5.2f\n", name, (unsigned int) benchmark->blocks,
+           (unsigned int) cycle_stats_get_average(stats), (unsigned int) cycle_stats_get_percentile(stats, 50),
+           (unsigned int) p99, (unsigned int) stats->max,
+           (unsigned int) (cycle_stats_get_average(stats) / BENCHMARK_BLOCK_SAMPLES),
+           (unsigned int) (load / 100), (unsigned int) (load % 100), level_db);
+
+    if (benchmark->blocks_failed > 0) return false;
+    if (fabs(level_db) > BENCHMARK_MAX_LEVEL_ERROR_DB) return false;
+    return true;
+}
+
+int main(int argc, const char * argv[]){
+    uint32_t seconds = 60;
+    if (argc > 1){
+        seconds = (uint32_t) atoi(argv[1]);
+    }
+    btstack_assert(seconds > 0);
+
+    unsigned int i;
+    for (i = 0; i < BENCHMARK_NUM_CONVERSIONS; i++){
+        benchmark_run_conversion(&benchmark_results[i], &benchmark_conversions[i], seconds);
+    }
+
+    uint32_t cycles_per_us = benchmark_cycles_per_us();
+    printf("\nPolyphase resampler benchmark: %u s audio per conversion, blocks of %u samples at 48 kHz, %u cycles per us\n",
+           (unsigned int) seconds, BENCHMARK_BLOCK_SAMPLES, (unsigned int) cycles_per_us);
+    printf("%-13s %7s  %-31s  %7s  %7s  %5s\n", "conversion", "blocks", "block cycles avg/p50/p99/max",
+           "cyc/smp", "p99 load", "dB");
+    bool ok = true;
+    for (i = 0; i < BENCHMARK_NUM_CONVERSIONS; i++){
+        ok = benchmark_report(&benchmark_results[i], &benchmark_conversions[i], cycles_per_us) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,270 @@
+/*
+ * sample_ring_buffer_benchmark.c - sample_ring_buffer vs. btstack_ring_buffer
+ *
+ * Streams a running sample counter through a ring of BENCHMARK_RING_SAMPLES in blocks of
+ * BENCHMARK_BLOCK_SAMPLES. The producer renders each block, the consumer sums it up, the sum is checked.
+ * Single thread: write and read alternate, for btstack_ring_buffer with 16-bit samples as bytes, for
+ * sample_ring_buffer with write/read copies and with rendering into and summing from regions in place.
+ * Two threads: producer and consumer run on separate threads, btstack_ring_buffer guarded by a mutex as it
+ * has no thread safety, sample_ring_buffer without locking. A side yields when the ring is full or empty.
+ * Reports ns per sample and million samples per second.
+ *
+ * Usage: sample_ring_buffer_benchmark [million samples per variant, default 100]
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "btstack_debug.h"
+#include "btstack_defines.h"
+#include "btstack_ring_buffer.h"
+#include "btstack_util.h"
+
+#include "sample_ring_buffer.h"
+
+// 2.5 ms at 48 kHz, i.e. DMA buffer size
+#define BENCHMARK_BLOCK_SAMPLES  120
+#define BENCHMARK_RING_SAMPLES   481
+
+typedef enum {
+    BENCHMARK_BTSTACK_RING_BUFFER = 0,
+    BENCHMARK_SAMPLE_RING_BUFFER_COPY,
+    BENCHMARK_SAMPLE_RING_BUFFER_REGIONS,
+    BENCHMARK_NUM_VARIANTS
+} benchmark_variant_t;
+
+static const char * benchmark_variant_names[BENCHMARK_NUM_VARIANTS] = {
+    "btstack_ring_buffer",
+    "sample_ring_buffer copy",
+    "sample_ring_buffer regions",
+};
+
+typedef struct {
+    benchmark_variant_t   variant;
+    uint32_t              num_blocks;
+    btstack_ring_buffer_t btstack_ring;
+    pthread_mutex_t       btstack_ring_mutex;
+    sample_ring_buffer_t  sample_ring;
+    // sum of all samples, checked against the expected one
+    uint64_t              sum;
+} benchmark_t;
+
+typedef struct {
+    uint64_t single_thread_ns;
+    uint64_t two_threads_ns;
+    bool     ok;
+} benchmark_result_t;
+
+static uint8_t            benchmark_btstack_storage[BENCHMARK_RING_SAMPLES * 2];
+static int16_t            benchmark_sample_storage[BENCHMARK_RING_SAMPLES];
+static benchmark_result_t benchmark_results[BENCHMARK_NUM_VARIANTS];
+
+static uint64_t benchmark_get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void benchmark_render(int16_t * samples, uint32_t num_samples, uint32_t first){
+    uint32_t i;
+    for (i = 0; i < num_samples; i++){
+        samples[i] = (int16_t) ((first + i) & 0x7fff);
+    }
+}
+
+static uint64_t benchmark_sum(const int16_t * samples, uint32_t num_samples){
+    uint64_t sum = 0;
+    uint32_t i;
+    for (i = 0; i < num_samples; i++){
+        sum += (uint16_t) samples[i];
+    }
+    return sum;
+}
+
+static uint64_t benchmark_expected_sum(uint32_t num_samples){
+    uint64_t sum = 0;
+    uint32_t i;
+    for (i = 0; i < num_samples; i++){
+        sum += i & 0x7fff;
+    }
+    return sum;
+}
+
+// producer side, returns num samples written: whole block or nothing
+static uint32_t benchmark_write(benchmark_t * benchmark, uint32_t first, bool locked){
+    int16_t block[BENCHMARK_BLOCK_SAMPLES];
+    switch (benchmark->variant){
+        case BENCHMARK_BTSTACK_RING_BUFFER: {
+            benchmark_render(block, BENCHMARK_BLOCK_SAMPLES, first);
+            if (locked) pthread_mutex_lock(&benchmark->btstack_ring_mutex);
+            int status = btstack_ring_buffer_write(&benchmark->btstack_ring, (uint8_t *) block, sizeof(block));
+            if (locked) pthread_mutex_unlock(&benchmark->btstack_ring_mutex);
+            return (status == ERROR_CODE_SUCCESS) ? BENCHMARK_BLOCK_SAMPLES : 0;
+        }
+        case BENCHMARK_SAMPLE_RING_BUFFER_COPY:
+            if (sample_ring_buffer_samples_free(&benchmark->sample_ring) < BENCHMARK_BLOCK_SAMPLES) return 0;
+            benchmark_render(block, BENCHMARK_BLOCK_SAMPLES, first);
+            return sample_ring_buffer_write(&benchmark->sample_ring, block, BENCHMARK_BLOCK_SAMPLES);
+        default: {
+            if (sample_ring_buffer_samples_free(&benchmark->sample_ring) < BENCHMARK_BLOCK_SAMPLES) return 0;
+            // block may wrap around
+            uint32_t written = 0;
+            while (written < BENCHMARK_BLOCK_SAMPLES){
+                int16_t * region;
+                uint32_t region_size = btstack_min(sample_ring_buffer_get_write_region(&benchmark->sample_ring, &region),
+                                                   BENCHMARK_BLOCK_SAMPLES - written);
+                benchmark_render(region, region_size, first + written);
+                sample_ring_buffer_commit_write(&benchmark->sample_ring, region_size);
+                written += region_size;
+            }
+            return written;
+        }
+    }
+}
+
+// consumer side, returns num samples read: whole block or nothing
+static uint32_t benchmark_read(benchmark_t * benchmark, bool locked){
+    int16_t block[BENCHMARK_BLOCK_SAMPLES];
+    switch (benchmark->variant){
+        case BENCHMARK_BTSTACK_RING_BUFFER: {
+            uint32_t bytes_read = 0;
+            if (locked) pthread_mutex_lock(&benchmark->btstack_ring_mutex);
+            if (btstack_ring_buffer_bytes_available(&benchmark->btstack_ring) >= sizeof(block)){
+                btstack_ring_buffer_read(&benchmark->btstack_ring, (uint8_t *) block, sizeof(block), &bytes_read);
+            }
+            if (locked) pthread_mutex_unlock(&benchmark->btstack_ring_mutex);
+            if (bytes_read == 0) return 0;
+            benchmark->sum += benchmark_sum(block, BENCHMARK_BLOCK_SAMPLES);
+            return BENCHMARK_BLOCK_SAMPLES;
+        }
+        case BENCHMARK_SAMPLE_RING_BUFFER_COPY:
+            if (sample_ring_buffer_samples_available(&benchmark->sample_ring) < BENCHMARK_BLOCK_SAMPLES) return 0;
+            sample_ring_buffer_read(&benchmark->sample_ring, block, BENCHMARK_BLOCK_SAMPLES);
+            benchmark->sum += benchmark_sum(block, BENCHMARK_BLOCK_SAMPLES);
+            return BENCHMARK_BLOCK_SAMPLES;
+        default: {
+            if (sample_ring_buffer_samples_available(&benchmark->sample_ring) < BENCHMARK_BLOCK_SAMPLES) return 0;
+            uint32_t num_read = 0;
+            while (num_read < BENCHMARK_BLOCK_SAMPLES){
+                const int16_t * region;
+                uint32_t region_size = btstack_min(sample_ring_buffer_get_read_region(&benchmark->sample_ring, &region),
+                                                   BENCHMARK_BLOCK_SAMPLES - num_read);
+                benchmark->sum += benchmark_sum(region, region_size);
+                sample_ring_buffer_commit_read(&benchmark->sample_ring, region_size);
+                num_read += region_size;
+            }
+            return num_read;
+        }
+    }
+}
+
+static void benchmark_init(benchmark_t * benchmark, benchmark_variant_t variant, uint32_t num_blocks){
+    benchmark->variant    = variant;
+    benchmark->num_blocks = num_blocks;
+    benchmark->sum        = 0;
+    btstack_ring_buffer_init(&benchmark->btstack_ring, benchmark_btstack_storage, sizeof(benchmark_btstack_storage));
+    sample_ring_buffer_init(&benchmark->sample_ring, benchmark_sample_storage, BENCHMARK_RING_SAMPLES);
+}
+
+static uint64_t benchmark_single_thread(benchmark_t * benchmark){
+    uint64_t start_ns = benchmark_get_time_ns();
+    uint32_t i;
+    for (i = 0; i < benchmark->num_blocks; i++){
+        uint32_t written = benchmark_write(benchmark, i * BENCHMARK_BLOCK_SAMPLES, false);
+        uint32_t num_read = benchmark_read(benchmark, false);
+        btstack_assert((written == BENCHMARK_BLOCK_SAMPLES) && (num_read == BENCHMARK_BLOCK_SAMPLES));
+    }
+    return benchmark_get_time_ns() - start_ns;
+}
+
+static void * benchmark_producer(void * context){
+    benchmark_t * benchmark = (benchmark_t *) context;
+    uint32_t i = 0;
+    while (i < benchmark->num_blocks){
+        if (benchmark_write(benchmark, i * BENCHMARK_BLOCK_SAMPLES, true) == 0){
+            sched_yield();
+            continue;
+        }
+        i++;
+    }
+    return NULL;
+}
+
+static void * benchmark_consumer(void * context){
+    benchmark_t * benchmark = (benchmark_t *) context;
+    uint32_t i = 0;
+    while (i < benchmark->num_blocks){
+        if (benchmark_read(benchmark, true) == 0){
+            sched_yield();
+            continue;
+        }
+        i++;
+    }
+    return NULL;
+}
+
+static uint64_t benchmark_two_threads(benchmark_t * benchmark){
+    pthread_mutex_init(&benchmark->btstack_ring_mutex, NULL);
+    pthread_t producer;
+    pthread_t consumer;
+    uint64_t start_ns = benchmark_get_time_ns();
+    pthread_create(&producer, NULL, &benchmark_producer, benchmark);
+    pthread_create(&consumer, NULL, &benchmark_consumer, benchmark);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    uint64_t duration_ns = benchmark_get_time_ns() - start_ns;
+    pthread_mutex_destroy(&benchmark->btstack_ring_mutex);
+    return duration_ns;
+}
+
+static void benchmark_print(const char * name, uint64_t duration_ns, uint32_t num_samples, bool ok){
+    uint64_t ps_per_sample = duration_ns * 1000 / num_samples;
+    uint64_t samples_per_second = (uint64_t) num_samples * 1000000000ULL / ((duration_ns > 0) ? duration_ns : 1);
+    printf("%-28s %4u.%03u %9u.%u%s\n", name,
+           (unsigned int) (ps_per_sample / 1000), (unsigned int) (ps_per_sample % 1000),
+           (unsigned int) (samples_per_second / 1000000), (unsigned int) (samples_per_second % 1000000 / 100000),
+           ok ? "" : "  FAILED");
+}
+
+int main(int argc, const char * argv[]){
+    uint32_t million_samples = 100;
+    if (argc > 1){
+        million_samples = (uint32_t) atoi(argv[1]);
+    }
+    btstack_assert((million_samples > 0) && (million_samples <= 4000));
+
+    uint32_t num_blocks  = million_samples * 1000000 / BENCHMARK_BLOCK_SAMPLES;
+    uint32_t num_samples = num_blocks * BENCHMARK_BLOCK_SAMPLES;
+    uint64_t expected_sum = benchmark_expected_sum(num_samples);
+
+    static benchmark_t benchmark;
+    unsigned int i;
+    for (i = 0; i < BENCHMARK_NUM_VARIANTS; i++){
+        benchmark_result_t * result = &benchmark_results[i];
+        benchmark_init(&benchmark, (benchmark_variant_t) i, num_blocks);
+        result->single_thread_ns = benchmark_single_thread(&benchmark);
+        result->ok = benchmark.sum == expected_sum;
+        benchmark_init(&benchmark, (benchmark_variant_t) i, num_blocks);
+        result->two_threads_ns = benchmark_two_threads(&benchmark);
+        result->ok = result->ok && (benchmark.sum == expected_sum);
+    }
+
+    printf("\nSample ring buffer benchmark: %u samples in blocks of %u, ring of %u samples\n",
+           (unsigned int) num_samples, BENCHMARK_BLOCK_SAMPLES, BENCHMARK_RING_SAMPLES);
+    bool ok = true;
+    printf("%-28s %8s %11s\n", "single thread", "ns/sample", "Msamples/s");
+    for (i = 0; i < BENCHMARK_NUM_VARIANTS; i++){
+        benchmark_print(benchmark_variant_names[i], benchmark_results[i].single_thread_ns, num_samples, benchmark_results[i].ok);
+        ok = ok && benchmark_results[i].ok;
+    }
+    printf("%-28s %8s %11s\n", "producer and consumer thread", "ns/sample", "Msamples/s");
+    for (i = 0; i < BENCHMARK_NUM_VARIANTS; i++){
+        const char * name = (i == BENCHMARK_BTSTACK_RING_BUFFER) ? "btstack_ring_buffer + mutex" : benchmark_variant_names[i];
+        benchmark_print(name, benchmark_results[i].two_threads_ns, num_samples, benchmark_results[i].ok);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,211 @@
+/*
+ * sample_ring_buffer_test.c - single producer / single consumer stress test for sample_ring_buffer
+ *
+ * A producer thread writes a running sample counter in random block sizes, alternating between copying with
+ * sample_ring_buffer_write and rendering into write regions. A consumer thread reads random block sizes with
+ * sample_ring_buffer_read and from read regions and checks that every sample arrives once and in order. Odd
+ * ring sizes make blocks wrap at all positions. Both sides check that available and free space never exceed
+ * the capacity. A side yields when it made no progress and fails the test when it made none for
+ * TEST_STALL_TIMEOUT_MS, e.g. after corrupted positions. Run under ThreadSanitizer to check the memory
+ * ordering as well.
+ *
+ * Usage: sample_ring_buffer_test [million samples for rings of TEST_FULL_RUN_RING_SIZE and above, default 20]
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+#include "sample_ring_buffer.h"
+
+#define TEST_MAX_BLOCK_SAMPLES  300
+// smaller rings get proportionally fewer samples, each block needs a thread switch on a single core
+#define TEST_FULL_RUN_RING_SIZE 480
+#define TEST_STALL_TIMEOUT_MS   1000
+
+static const uint32_t test_ring_sizes[] = { 2, 3, 97, 480, 1027 };
+
+typedef struct {
+    sample_ring_buffer_t ring;
+    uint32_t             num_samples;
+    // set by producer, lets consumer stop after lost samples
+    atomic_bool          producer_done;
+    // set by the side that stalls, stops the other one
+    atomic_bool          stalled;
+    // counted by consumer and producer, checked by main thread after join
+    uint32_t             errors;
+    uint32_t             producer_errors;
+} test_t;
+
+static int16_t test_storage[1027];
+
+static uint32_t test_random(uint32_t * state){
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static uint64_t test_get_time_ms(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+// called when a side made no progress, returns true once it or the other side stalled for too long
+static bool test_stalled(test_t * test, uint64_t * stall_start_ms){
+    if (atomic_load_explicit(&test->stalled, memory_order_relaxed)) return true;
+    uint64_t now_ms = test_get_time_ms();
+    if (*stall_start_ms == 0){
+        *stall_start_ms = now_ms;
+    } else if ((now_ms - *stall_start_ms) > TEST_STALL_TIMEOUT_MS){
+        atomic_store_explicit(&test->stalled, true, memory_order_relaxed);
+        return true;
+    }
+    sched_yield();
+    return false;
+}
+
+static void * test_producer(void * context){
+    test_t * test = (test_t *) context;
+    sample_ring_buffer_t * ring = &test->ring;
+    uint32_t random_state = 0x1234567;
+    uint64_t stall_start_ms = 0;
+    uint32_t next = 0;
+    while (next < test->num_samples){
+        uint32_t previous = next;
+        uint32_t capacity = ring->size - 1;
+        if (sample_ring_buffer_samples_free(ring) > capacity){
+            test->producer_errors++;
+        }
+        uint32_t block = 1 + test_random(&random_state) % TEST_MAX_BLOCK_SAMPLES;
+        block = btstack_min(block, test->num_samples - next);
+        if (test_random(&random_state) & 1){
+            int16_t samples[TEST_MAX_BLOCK_SAMPLES];
+            uint32_t i;
+            for (i = 0; i < block; i++){
+                samples[i] = (int16_t) (next + i);
+            }
+            next += sample_ring_buffer_write(ring, samples, block);
+        } else {
+            int16_t * region;
+            uint32_t region_size = btstack_min(sample_ring_buffer_get_write_region(ring, &region), block);
+            uint32_t i;
+            for (i = 0; i < region_size; i++){
+                region[i] = (int16_t) (next + i);
+            }
+            sample_ring_buffer_commit_write(ring, region_size);
+            next += region_size;
+        }
+        if (next != previous){
+            stall_start_ms = 0;
+        } else if (test_stalled(test, &stall_start_ms)){
+            break;
+        }
+    }
+    atomic_store_explicit(&test->producer_done, true, memory_order_release);
+    return NULL;
+}
+
+static void * test_consumer(void * context){
+    test_t * test = (test_t *) context;
+    sample_ring_buffer_t * ring = &test->ring;
+    uint32_t random_state = 0x7654321;
+    uint64_t stall_start_ms = 0;
+    uint32_t expected = 0;
+    while (expected < test->num_samples){
+        uint32_t previous = expected;
+        uint32_t capacity = ring->size - 1;
+        if (sample_ring_buffer_samples_available(ring) > capacity){
+            test->errors++;
+        }
+        uint32_t block = 1 + test_random(&random_state) % TEST_MAX_BLOCK_SAMPLES;
+        uint32_t i;
+        if (test_random(&random_state) & 1){
+            int16_t samples[TEST_MAX_BLOCK_SAMPLES];
+            uint32_t num_read = sample_ring_buffer_read(ring, samples, block);
+            for (i = 0; i < num_read; i++){
+                if (samples[i] != (int16_t) (expected + i)){
+                    test->errors++;
+                }
+            }
+            expected += num_read;
+        } else {
+            const int16_t * region;
+            uint32_t region_size = btstack_min(sample_ring_buffer_get_read_region(ring, &region), block);
+            for (i = 0; i < region_size; i++){
+                if (region[i] != (int16_t) (expected + i)){
+                    test->errors++;
+                }
+            }
+            sample_ring_buffer_commit_read(ring, region_size);
+            expected += region_size;
+        }
+        if (expected != previous){
+            stall_start_ms = 0;
+            continue;
+        }
+        // lost samples: stop once producer is done and ring is drained
+        if (atomic_load_explicit(&test->producer_done, memory_order_acquire)
+         && (sample_ring_buffer_samples_available(ring) == 0)) break;
+        if (test_stalled(test, &stall_start_ms)) break;
+    }
+    // every sample arrived, nothing left over
+    if (expected < test->num_samples){
+        test->errors += test->num_samples - expected;
+    }
+    if (sample_ring_buffer_samples_available(ring) != 0){
+        test->errors++;
+    }
+    return NULL;
+}
+
+static bool test_run(uint32_t ring_size, uint32_t num_samples){
+    test_t test;
+    test.num_samples     = num_samples;
+    test.errors          = 0;
+    test.producer_errors = 0;
+    atomic_init(&test.producer_done, false);
+    atomic_init(&test.stalled, false);
+    sample_ring_buffer_init(&test.ring, test_storage, ring_size);
+
+    pthread_t producer;
+    pthread_t consumer;
+    pthread_create(&producer, NULL, &test_producer, &test);
+    pthread_create(&consumer, NULL, &test_consumer, &test);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    uint32_t errors = test.errors + test.producer_errors;
+    bool stalled = atomic_load_explicit(&test.stalled, memory_order_relaxed);
+    printf("ring size %4u: %u samples, %u errors%s\n", (unsigned int) ring_size, (unsigned int) num_samples,
+           (unsigned int) errors, stalled ? ", stalled" : "");
+    return (errors == 0) && (stalled == false);
+}
+
+int main(int argc, const char * argv[]){
+    uint32_t million_samples = 20;
+    if (argc > 1){
+        million_samples = (uint32_t) atoi(argv[1]);
+    }
+
+    bool ok = true;
+    unsigned int i;
+    for (i = 0; i < sizeof(test_ring_sizes) / sizeof(test_ring_sizes[0]); i++){
+        btstack_assert(test_ring_sizes[i] <= sizeof(test_storage) / sizeof(test_storage[0]));
+        uint32_t num_samples = (uint32_t) ((uint64_t) million_samples * 1000000
+                                         * btstack_min(test_ring_sizes[i], TEST_FULL_RUN_RING_SIZE) / TEST_FULL_RUN_RING_SIZE);
+        ok = test_run(test_ring_sizes[i], num_samples) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,184 @@
+/*
+ * sco_demo_benchmark.c - per-packet cost, latency and throughput of sco_demo_util for CVSD, mSBC and LC3-SWB
+ *
+ * Each codec runs for a number of seconds of simulated audio time as fast as possible: SCO packets are sent,
+ * looped back and received at the codec packet interval, and the fake audio device plays and records
+ * 5 ms periods with a tone on the microphone. Reports cycles per packet for send and receive, wall time per
+ * packet (send + receive) as p50 / p99 and throughput as packets per second and real-time factor. The
+ * statistics dump of sco_demo_close for each codec is printed before the summary.
+ *
+ * Usage: sco_demo_benchmark [seconds of audio per codec, default 10]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sco_host_harness.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+#include "classic/hfp.h"
+
+#include "cycle_stats.h"
+#include "sco_demo_util.h"
+#include "tone_generator.h"
+
+#define BENCHMARK_SCO_HANDLE        0x0001
+#define BENCHMARK_TONE_HZ           440
+#define BENCHMARK_TONE_AMPLITUDE    3276
+
+typedef struct {
+    uint8_t          codec;
+    const char *     name;
+    // SCO packets per 7.5 ms with 60 byte payload
+    uint8_t          packets_per_frame;
+} benchmark_codec_t;
+
+static const benchmark_codec_t benchmark_codecs[] = {
+    { HFP_CODEC_CVSD,    "CVSD",    2 },
+    { HFP_CODEC_MSBC,    "mSBC",    1 },
+    { HFP_CODEC_LC3_SWB, "LC3-SWB", 1 },
+};
+
+typedef struct {
+    sco_audio_ctx_t * ctx;
+    uint32_t          sco_interval_us;
+    uint32_t          start_us;
+    uint32_t          end_us;
+    uint32_t          next_sco_us;
+    uint32_t          next_audio_us;
+    uint32_t          packets;
+    uint32_t          packets_failed;
+    cycle_stats_t     packet_cycles;
+    uint64_t          wall_ns;
+    sco_demo_statistics_t statistics;
+} benchmark_t;
+
+static tone_generator_t benchmark_tone;
+static benchmark_t      benchmark_results[sizeof(benchmark_codecs) / sizeof(benchmark_codecs[0])];
+static uint32_t         benchmark_time_us;
+
+static uint64_t benchmark_get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// cycle counter rate, to convert per-packet cycles into wall time
+static uint32_t benchmark_cycles_per_us(void){
+    uint64_t ns_start = benchmark_get_time_ns();
+    uint32_t cycles_start = cycle_stats_get_cycles();
+    const struct timespec period = { 0, 20000000L };
+    nanosleep(&period, NULL);
+    uint32_t cycles = cycle_stats_get_cycles() - cycles_start;
+    uint64_t us = (benchmark_get_time_ns() - ns_start) / 1000;
+    return (uint32_t) btstack_max(1, (uint32_t) (cycles / us));
+}
+
+static void benchmark_microphone(void * context, const int16_t * played, int16_t * recorded, uint16_t num_samples){
+    UNUSED(context);
+    UNUSED(played);
+    tone_generator_fill(&benchmark_tone, recorded, num_samples);
+}
+
+// one event per call, callbacks requested by sco_demo_util run in between
+static bool benchmark_step(void * context){
+    benchmark_t * benchmark = (benchmark_t *) context;
+    if (benchmark->next_sco_us >= benchmark->end_us) return false;
+    if (benchmark->next_audio_us < benchmark->next_sco_us){
+        sco_host_harness_set_time_us(benchmark->next_audio_us);
+        sco_host_audio_period();
+        benchmark->next_audio_us += SCO_HOST_AUDIO_PERIOD_US;
+        return true;
+    }
+    sco_host_harness_set_time_us(benchmark->next_sco_us);
+    uint32_t cycles_start = cycle_stats_get_cycles();
+    sco_demo_send(benchmark->ctx, BENCHMARK_SCO_HANDLE);
+    uint16_t size;
+    uint8_t * packet = sco_host_hci_get_sent_packet(&size);
+    if (packet == NULL){
+        benchmark->packets_failed++;
+    } else {
+        sco_demo_receive(benchmark->ctx, packet, size);
+    }
+    cycle_stats_add(&benchmark->packet_cycles, cycle_stats_get_cycles() - cycles_start);
+    benchmark->packets++;
+    benchmark->next_sco_us += benchmark->sco_interval_us;
+    return true;
+}
+
+static void benchmark_run_codec(benchmark_t * benchmark, sco_audio_ctx_t * ctx, const benchmark_codec_t * codec, uint32_t seconds){
+    memset(benchmark, 0, sizeof(benchmark_t));
+    benchmark->ctx             = ctx;
+    benchmark->sco_interval_us = 7500 / codec->packets_per_frame;
+    benchmark->start_us        = benchmark_time_us;
+    benchmark->end_us          = benchmark_time_us + seconds * 1000000;
+    benchmark->next_sco_us     = benchmark->start_us;
+    benchmark->next_audio_us   = benchmark->start_us;
+    cycle_stats_reset(&benchmark->packet_cycles);
+
+    sco_host_harness_set_time_us(benchmark->start_us);
+    sco_demo_set_codec(ctx, codec->codec);
+    uint64_t ns_start = benchmark_get_time_ns();
+    sco_host_harness_run(&benchmark_step, benchmark);
+    benchmark->wall_ns = benchmark_get_time_ns() - ns_start;
+
+    sco_demo_get_statistics(ctx, &benchmark->statistics);
+    sco_demo_close(ctx);
+    benchmark_time_us = benchmark->end_us;
+}
+
+static bool benchmark_report(const benchmark_t * benchmark, const benchmark_codec_t * codec, uint32_t cycles_per_us){
+    const sco_demo_statistics_t * statistics = &benchmark->statistics;
+    uint64_t audio_us = (uint64_t) benchmark->packets * benchmark->sco_interval_us;
+    uint64_t wall_ns  = benchmark->wall_ns > 0 ? benchmark->wall_ns : 1;
+    printf("%-8s %8u  %7u %7u %7u  %7u %7u %7u  %8u %8u  %9u  %7.1f\n",
+           codec->name, (unsigned int) benchmark->packets,
+           (unsigned int) statistics->send.cycles_avg, (unsigned int) statistics->send.cycles_p50,
+           (unsigned int) statistics->send.cycles_p99,
+           (unsigned int) statistics->receive.cycles_avg, (unsigned int) statistics->receive.cycles_p50,
+           (unsigned int) statistics->receive.cycles_p99,
+           (unsigned int) (cycle_stats_get_percentile(&benchmark->packet_cycles, 50) * 1000ULL / cycles_per_us),
+           (unsigned int) (cycle_stats_get_percentile(&benchmark->packet_cycles, 99) * 1000ULL / cycles_per_us),
+           (unsigned int) (benchmark->packets * 1000000000ULL / wall_ns),
+           (double) audio_us * 1000.0 / (double) wall_ns);
+
+    // loopback: every packet is sent, received and decoded without concealment
+    if (benchmark->packets_failed > 0) return false;
+    if (statistics->codec.frames_decoded == 0) return false;
+    if (statistics->codec.frames_concealed > 0) return false;
+    return true;
+}
+
+int main(int argc, const char * argv[]){
+    uint32_t seconds = 10;
+    if (argc > 1){
+        seconds = (uint32_t) atoi(argv[1]);
+    }
+    btstack_assert(seconds > 0);
+
+    sco_host_harness_init();
+    sco_demo_init();
+    sco_audio_ctx_t * ctx = sco_demo_create_context();
+
+    tone_generator_init(&benchmark_tone, SCO_HOST_AUDIO_SAMPLE_RATE);
+    tone_generator_add_tone(&benchmark_tone, BENCHMARK_TONE_HZ, BENCHMARK_TONE_AMPLITUDE);
+    sco_host_audio_set_microphone(&benchmark_microphone, NULL);
+
+    unsigned int i;
+    for (i = 0; i < sizeof(benchmark_codecs) / sizeof(benchmark_codecs[0]); i++){
+        benchmark_run_codec(&benchmark_results[i], ctx, &benchmark_codecs[i], seconds);
+    }
+
+    uint32_t cycles_per_us = benchmark_cycles_per_us();
+    printf("\nSCO demo benchmark: %u s audio per codec, %u cycles per us\n", (unsigned int) seconds, (unsigned int) cycles_per_us);
+    printf("%-8s %8s  %-23s  %-23s  %-17s  %9s  %7s\n", "codec", "packets", "send cycles avg/p50/p99",
+           "recv cycles avg/p50/p99", "packet ns p50/p99", "packets/s", "x real");
+    bool ok = true;
+    for (i = 0; i < sizeof(benchmark_codecs) / sizeof(benchmark_codecs[0]); i++){
+        ok = benchmark_report(&benchmark_results[i], &benchmark_codecs[i], cycles_per_us) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,250 @@
+/*
+ * sco_echo_test.c - echo cancellation of sco_demo_util in far-end, near-end and double talk scenarios
+ *
+ * Built with ENABLE_SCO_DEMO_AEC. A CVSD link receives far-end noise from the test instead of loopback. The
+ * microphone records the echo of the samples played by the fake audio device, with two taps at 2 and 6 ms,
+ * plus a near-end sweep. Uplink SCO payloads are the echo-cancelled microphone signal at 8 kHz.
+ *
+ * The scenario runs in phases. For the second half of each phase, the power of the uplink signal is compared
+ * with the power of the echo and the near-end signal in the microphone:
+ * - near-end only: near-end passes unchanged, before and after the filter has converged
+ * - far-end only: echo is reduced by at least ECHO_TEST_MIN_REDUCTION_DB once converged
+ * - double talk: near-end passes, echo stays reduced
+ * - far-end only after double talk: filter was not disturbed by near-end speech
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sco_host_harness.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+#include "classic/hfp.h"
+
+#include "sco_demo_util.h"
+#include "tone_generator.h"
+
+#define ECHO_TEST_SCO_HANDLE            0x0001
+#define ECHO_TEST_CVSD_SAMPLES          ((SCO_HOST_HCI_PACKET_LENGTH - 3) / 2)
+#define ECHO_TEST_SCO_INTERVAL_US       3750
+
+// far-end noise amplitude and echo taps at 48 kHz: gain Q15, delay in samples
+#define ECHO_TEST_FAR_END_AMPLITUDE     8000
+#define ECHO_TEST_ECHO_TAP_1_GAIN       16384
+#define ECHO_TEST_ECHO_TAP_1_DELAY      96
+#define ECHO_TEST_ECHO_TAP_2_GAIN       8192
+#define ECHO_TEST_ECHO_TAP_2_DELAY      288
+
+// near-end speech stand-in, about 6 dB below the echo
+#define ECHO_TEST_NEAR_END_START_HZ     300
+#define ECHO_TEST_NEAR_END_END_HZ       3000
+#define ECHO_TEST_NEAR_END_SWEEP_MS     500
+#define ECHO_TEST_NEAR_END_AMPLITUDE    1800
+
+#define ECHO_TEST_MIN_REDUCTION_DB      20.0
+#define ECHO_TEST_NEAR_END_TOLERANCE_DB 3.0
+
+typedef enum {
+    ECHO_TEST_CHECK_NEAR_END_PASSED = 0,
+    ECHO_TEST_CHECK_ECHO_REDUCED,
+    ECHO_TEST_CHECK_DOUBLE_TALK,
+} echo_test_check_t;
+
+typedef struct {
+    const char *      name;
+    uint32_t          duration_ms;
+    bool              far_end;
+    bool              near_end;
+    echo_test_check_t check;
+} echo_test_phase_t;
+
+static const echo_test_phase_t echo_test_phases[] = {
+    { "near-end only, filter not adapted", 2000, false, true,  ECHO_TEST_CHECK_NEAR_END_PASSED },
+    { "far-end only, converging",          4000, true,  false, ECHO_TEST_CHECK_ECHO_REDUCED },
+    { "double talk",                       2000, true,  true,  ECHO_TEST_CHECK_DOUBLE_TALK },
+    { "far-end only after double talk",    1000, true,  false, ECHO_TEST_CHECK_ECHO_REDUCED },
+    { "near-end only, filter converged",   1000, false, true,  ECHO_TEST_CHECK_NEAR_END_PASSED },
+};
+
+#define ECHO_TEST_NUM_PHASES (sizeof(echo_test_phases) / sizeof(echo_test_phases[0]))
+
+// mean square per sample over second half of phase
+typedef struct {
+    double   echo_energy;
+    uint32_t echo_samples;
+    double   near_end_energy;
+    uint32_t near_end_samples;
+    double   uplink_energy;
+    uint32_t uplink_samples;
+} echo_test_measurement_t;
+
+static sco_audio_ctx_t *       echo_test_ctx;
+static uint8_t                 echo_test_phase;
+static uint32_t                echo_test_phase_start_us;
+static uint32_t                echo_test_next_sco_us;
+static uint32_t                echo_test_next_audio_us;
+static uint32_t                echo_test_noise_state = 0x12345678;
+static tone_generator_t        echo_test_near_end;
+// played samples of previous periods followed by current period
+static int16_t                 echo_test_played[ECHO_TEST_ECHO_TAP_2_DELAY + SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES];
+static echo_test_measurement_t echo_test_measurements[ECHO_TEST_NUM_PHASES];
+
+static bool echo_test_measuring(uint32_t now_us){
+    return (now_us - echo_test_phase_start_us) >= (echo_test_phases[echo_test_phase].duration_ms * 500);
+}
+
+static int16_t echo_test_noise(void){
+    echo_test_noise_state = echo_test_noise_state * 1664525 + 1013904223;
+    return (int16_t) ((int32_t) ((echo_test_noise_state >> 16) & 0xffff) * (2 * ECHO_TEST_FAR_END_AMPLITUDE) / 0x10000 - ECHO_TEST_FAR_END_AMPLITUDE);
+}
+
+static void echo_test_microphone(void * context, const int16_t * played, int16_t * recorded, uint16_t num_samples){
+    UNUSED(context);
+    btstack_assert(num_samples == SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES);
+    const echo_test_phase_t * phase = &echo_test_phases[echo_test_phase];
+    echo_test_measurement_t * measurement = &echo_test_measurements[echo_test_phase];
+    bool measuring = echo_test_measuring(echo_test_next_audio_us);
+
+    int16_t near_end[SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES];
+    tone_generator_fill(&echo_test_near_end, near_end, num_samples);
+    memcpy(&echo_test_played[ECHO_TEST_ECHO_TAP_2_DELAY], played, num_samples * sizeof(int16_t));
+    uint16_t i;
+    for (i = 0; i < num_samples; i++){
+        const int16_t * now = &echo_test_played[ECHO_TEST_ECHO_TAP_2_DELAY + i];
+        int32_t echo = (now[-ECHO_TEST_ECHO_TAP_1_DELAY] * ECHO_TEST_ECHO_TAP_1_GAIN
+                     +  now[-ECHO_TEST_ECHO_TAP_2_DELAY] * ECHO_TEST_ECHO_TAP_2_GAIN) >> 15;
+        int32_t speech = phase->near_end ? near_end[i] : 0;
+        int32_t sample = echo + speech;
+        if (sample > INT16_MAX){
+            sample = INT16_MAX;
+        } else if (sample < INT16_MIN){
+            sample = INT16_MIN;
+        }
+        recorded[i] = (int16_t) sample;
+        if (measuring){
+            measurement->echo_energy     += (double) echo * echo;
+            measurement->near_end_energy += (double) speech * speech;
+        }
+    }
+    if (measuring){
+        measurement->echo_samples     += num_samples;
+        measurement->near_end_samples += num_samples;
+    }
+    memmove(echo_test_played, &echo_test_played[num_samples], ECHO_TEST_ECHO_TAP_2_DELAY * sizeof(int16_t));
+}
+
+// uplink payload is echo-cancelled microphone signal, far-end packet replaces loopback
+static void echo_test_sco_exchange(void){
+    echo_test_measurement_t * measurement = &echo_test_measurements[echo_test_phase];
+    sco_demo_send(echo_test_ctx, ECHO_TEST_SCO_HANDLE);
+    uint16_t size;
+    uint8_t * packet = sco_host_hci_get_sent_packet(&size);
+    btstack_assert(packet != NULL);
+    if (echo_test_measuring(echo_test_next_sco_us)){
+        uint16_t i;
+        for (i = 3; (i + 1) < size; i += 2){
+            int16_t sample = (int16_t) little_endian_read_16(packet, i);
+            measurement->uplink_energy += (double) sample * sample;
+            measurement->uplink_samples++;
+        }
+    }
+
+    uint8_t far_end_packet[3 + 2 * ECHO_TEST_CVSD_SAMPLES];
+    little_endian_store_16(far_end_packet, 0, ECHO_TEST_SCO_HANDLE);
+    far_end_packet[2] = 2 * ECHO_TEST_CVSD_SAMPLES;
+    uint16_t i;
+    for (i = 0; i < ECHO_TEST_CVSD_SAMPLES; i++){
+        int16_t sample = echo_test_phases[echo_test_phase].far_end ? echo_test_noise() : 0;
+        little_endian_store_16(far_end_packet, 3 + 2 * i, (uint16_t) sample);
+    }
+    sco_demo_receive(echo_test_ctx, far_end_packet, sizeof(far_end_packet));
+}
+
+static bool echo_test_step(void * context){
+    UNUSED(context);
+    uint32_t now_us = btstack_min(echo_test_next_sco_us, echo_test_next_audio_us);
+    if ((now_us - echo_test_phase_start_us) >= (echo_test_phases[echo_test_phase].duration_ms * 1000)){
+        echo_test_phase++;
+        if (echo_test_phase == ECHO_TEST_NUM_PHASES) return false;
+        echo_test_phase_start_us = now_us;
+    }
+    sco_host_harness_set_time_us(now_us);
+    if (echo_test_next_audio_us < echo_test_next_sco_us){
+        sco_host_audio_period();
+        echo_test_next_audio_us += SCO_HOST_AUDIO_PERIOD_US;
+    } else {
+        echo_test_sco_exchange();
+        echo_test_next_sco_us += ECHO_TEST_SCO_INTERVAL_US;
+    }
+    return true;
+}
+
+static double echo_test_level_db(double energy, uint32_t num_samples){
+    if (num_samples == 0) return -INFINITY;
+    return 10.0 * log10((energy / num_samples) + 1e-3);
+}
+
+static bool echo_test_report(const echo_test_phase_t * phase, const echo_test_measurement_t * measurement){
+    double echo_db     = echo_test_level_db(measurement->echo_energy, measurement->echo_samples);
+    double near_end_db = echo_test_level_db(measurement->near_end_energy, measurement->near_end_samples);
+    double uplink_db   = echo_test_level_db(measurement->uplink_energy, measurement->uplink_samples);
+    bool ok;
+    switch (phase->check){
+        case ECHO_TEST_CHECK_NEAR_END_PASSED:
+            ok = fabs(uplink_db - near_end_db) <= ECHO_TEST_NEAR_END_TOLERANCE_DB;
+            break;
+        case ECHO_TEST_CHECK_ECHO_REDUCED:
+            ok = (echo_db - uplink_db) >= ECHO_TEST_MIN_REDUCTION_DB;
+            break;
+        case ECHO_TEST_CHECK_DOUBLE_TALK:
+            // near-end is the loudest remaining component
+            ok = (fabs(uplink_db - near_end_db) <= ECHO_TEST_NEAR_END_TOLERANCE_DB) && ((echo_db - near_end_db) > ECHO_TEST_NEAR_END_TOLERANCE_DB);
+            break;
+        default:
+            ok = false;
+            break;
+    }
+    printf("%-34s %9.1f %9.1f %9.1f  %s\n", phase->name, echo_db, near_end_db, uplink_db, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, const char * argv[]){
+    UNUSED(argc);
+    UNUSED(argv);
+
+    sco_host_harness_init();
+    sco_demo_init();
+    btstack_assert(sco_demo_echo_cancel_supported());
+    echo_test_ctx = sco_demo_create_context();
+
+    tone_generator_init(&echo_test_near_end, SCO_HOST_AUDIO_SAMPLE_RATE);
+    tone_generator_add_sweep(&echo_test_near_end, ECHO_TEST_NEAR_END_START_HZ, ECHO_TEST_NEAR_END_END_HZ,
+                             ECHO_TEST_NEAR_END_SWEEP_MS, ECHO_TEST_NEAR_END_AMPLITUDE);
+    sco_host_audio_set_microphone(&echo_test_microphone, NULL);
+
+    sco_host_harness_set_time_us(0);
+    sco_demo_set_codec(echo_test_ctx, HFP_CODEC_CVSD);
+    sco_host_harness_run(&echo_test_step, NULL);
+
+    sco_demo_statistics_t statistics;
+    sco_demo_get_statistics(echo_test_ctx, &statistics);
+    sco_demo_close(echo_test_ctx);
+
+    printf("\nSCO echo test, CVSD, levels in dB over second half of each phase\n");
+    printf("%-34s %9s %9s %9s\n", "phase", "echo", "near-end", "uplink");
+    bool ok = true;
+    unsigned int i;
+    for (i = 0; i < ECHO_TEST_NUM_PHASES; i++){
+        ok = echo_test_report(&echo_test_phases[i], &echo_test_measurements[i]) && ok;
+    }
+    printf("ERLE %d dB, %u double talk blocks, %u reference underruns, %u overruns\n",
+           statistics.echo_cancel_metrics.erle_db, (unsigned int) statistics.echo_cancel_metrics.blocks_double_talk,
+           (unsigned int) statistics.echo_cancel_reference_underruns, (unsigned int) statistics.echo_cancel_reference_overruns);
+    // reference stays aligned with the microphone
+    if (statistics.echo_cancel_reference_underruns > 0) ok = false;
+    if (statistics.echo_cancel_reference_overruns > 0) ok = false;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,234 @@
+/*
+ * sco_host_harness.c - fake HCI SCO transport and audio device to run sco_demo_util on a host
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include "sco_host_harness.h"
+
+#include "btstack_audio.h"
+#include "btstack_debug.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_util.h"
+
+// HCI
+
+static uint16_t sco_host_hci_packet_length = SCO_HOST_HCI_PACKET_LENGTH;
+static atomic_uint sco_host_hci_packets_sent;
+
+// sco_demo_send can run on several threads, e.g. in scaling benchmarks
+static _Thread_local uint8_t  sco_host_hci_outgoing_buffer[HCI_OUTGOING_PRE_BUFFER_SIZE + 3 + 255];
+static _Thread_local uint16_t sco_host_hci_outgoing_size;
+
+void hci_set_sco_voice_setting(uint16_t voice_setting){
+    UNUSED(voice_setting);
+}
+
+uint16_t hci_get_sco_packet_length_for_connection(hci_con_handle_t sco_con_handle){
+    UNUSED(sco_con_handle);
+    return sco_host_hci_packet_length;
+}
+
+bool hci_reserve_packet_buffer(void){
+    return true;
+}
+
+uint8_t * hci_get_outgoing_packet_buffer(void){
+    return &sco_host_hci_outgoing_buffer[HCI_OUTGOING_PRE_BUFFER_SIZE];
+}
+
+uint8_t hci_send_sco_packet_buffer(int size){
+    btstack_assert(size <= (3 + 255));
+    sco_host_hci_outgoing_size = (uint16_t) size;
+    atomic_fetch_add_explicit(&sco_host_hci_packets_sent, 1, memory_order_relaxed);
+    return ERROR_CODE_SUCCESS;
+}
+
+uint8_t hci_request_sco_can_send_now_event(void){
+    // test decides when to send
+    return ERROR_CODE_SUCCESS;
+}
+
+void sco_host_hci_set_packet_length(uint16_t packet_length){
+    btstack_assert(packet_length <= (3 + 255));
+    sco_host_hci_packet_length = packet_length;
+}
+
+uint8_t * sco_host_hci_get_sent_packet(uint16_t * size){
+    *size = sco_host_hci_outgoing_size;
+    if (sco_host_hci_outgoing_size == 0) return NULL;
+    return &sco_host_hci_outgoing_buffer[HCI_OUTGOING_PRE_BUFFER_SIZE];
+}
+
+uint32_t sco_host_hci_get_packets_sent(void){
+    return atomic_load_explicit(&sco_host_hci_packets_sent, memory_order_relaxed);
+}
+
+// audio device
+
+static void (*sco_host_playback_callback)(int16_t * buffer, uint16_t num_samples);
+static void (*sco_host_recording_callback)(const int16_t * buffer, uint16_t num_samples);
+static bool sco_host_playback_running;
+static bool sco_host_recording_running;
+
+static int16_t  sco_host_dma_buffers[SCO_HOST_AUDIO_DMA_BUFFER_COUNT][SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES];
+static uint8_t  sco_host_dma_playing;
+static int16_t  sco_host_played[SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES];
+static int16_t  sco_host_recorded[SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES];
+
+static sco_host_microphone_handler_t sco_host_microphone_handler;
+static void *                        sco_host_microphone_context;
+
+static int sco_host_sink_init(uint8_t channels, uint32_t samplerate, void (*playback)(int16_t * buffer, uint16_t num_samples)){
+    btstack_assert(channels == 1);
+    btstack_assert(samplerate == SCO_HOST_AUDIO_SAMPLE_RATE);
+    UNUSED(channels);
+    UNUSED(samplerate);
+    sco_host_playback_callback = playback;
+    return 0;
+}
+
+static uint32_t sco_host_get_samplerate(void){
+    return SCO_HOST_AUDIO_SAMPLE_RATE;
+}
+
+static void sco_host_sink_set_volume(uint8_t volume){
+    UNUSED(volume);
+}
+
+static void sco_host_sink_start_stream(void){
+    // DMA buffers start with silence, like the I2S driver
+    memset(sco_host_dma_buffers, 0, sizeof(sco_host_dma_buffers));
+    sco_host_dma_playing = 0;
+    sco_host_playback_running = true;
+}
+
+static void sco_host_sink_stop_stream(void){
+    sco_host_playback_running = false;
+}
+
+static void sco_host_sink_close(void){
+    sco_host_playback_running = false;
+    sco_host_playback_callback = NULL;
+}
+
+static int sco_host_source_init(uint8_t channels, uint32_t samplerate, void (*recording)(const int16_t * buffer, uint16_t num_samples)){
+    btstack_assert(channels == 1);
+    btstack_assert(samplerate == SCO_HOST_AUDIO_SAMPLE_RATE);
+    UNUSED(channels);
+    UNUSED(samplerate);
+    sco_host_recording_callback = recording;
+    return 0;
+}
+
+static void sco_host_source_set_gain(uint8_t gain){
+    UNUSED(gain);
+}
+
+static void sco_host_source_start_stream(void){
+    sco_host_recording_running = true;
+}
+
+static void sco_host_source_stop_stream(void){
+    sco_host_recording_running = false;
+}
+
+static void sco_host_source_close(void){
+    sco_host_recording_running = false;
+    sco_host_recording_callback = NULL;
+}
+
+static const btstack_audio_sink_t sco_host_audio_sink = {
+    .init           = &sco_host_sink_init,
+    .get_samplerate = &sco_host_get_samplerate,
+    .set_volume     = &sco_host_sink_set_volume,
+    .start_stream   = &sco_host_sink_start_stream,
+    .stop_stream    = &sco_host_sink_stop_stream,
+    .close          = &sco_host_sink_close,
+};
+
+static const btstack_audio_source_t sco_host_audio_source = {
+    .init           = &sco_host_source_init,
+    .get_samplerate = &sco_host_get_samplerate,
+    .set_gain       = &sco_host_source_set_gain,
+    .start_stream   = &sco_host_source_start_stream,
+    .stop_stream    = &sco_host_source_stop_stream,
+    .close          = &sco_host_source_close,
+};
+
+void sco_host_audio_set_microphone(sco_host_microphone_handler_t handler, void * context){
+    sco_host_microphone_handler = handler;
+    sco_host_microphone_context = context;
+}
+
+void sco_host_audio_period(void){
+    if (sco_host_playback_running){
+        // current buffer is played, then refilled and queued behind the other buffers
+        int16_t * buffer = sco_host_dma_buffers[sco_host_dma_playing];
+        memcpy(sco_host_played, buffer, sizeof(sco_host_played));
+        sco_host_playback_callback(buffer, SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES);
+        sco_host_dma_playing = (sco_host_dma_playing + 1) % SCO_HOST_AUDIO_DMA_BUFFER_COUNT;
+    } else {
+        memset(sco_host_played, 0, sizeof(sco_host_played));
+    }
+    if (sco_host_recording_running == false) return;
+    if (sco_host_microphone_handler != NULL){
+        (*sco_host_microphone_handler)(sco_host_microphone_context, sco_host_played, sco_host_recorded, SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES);
+    } else {
+        memset(sco_host_recorded, 0, sizeof(sco_host_recorded));
+    }
+    sco_host_recording_callback(sco_host_recorded, SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES);
+}
+
+const int16_t * sco_host_audio_get_played(void){
+    return sco_host_played;
+}
+
+// run loop
+
+static bool sco_host_run_loop_initialized;
+static btstack_run_loop_t sco_host_run_loop;
+static uint32_t sco_host_time_us;
+static bool (*sco_host_run_step)(void * context);
+static btstack_context_callback_registration_t sco_host_run_callback;
+
+static void sco_host_run_handler(void * context){
+    if ((*sco_host_run_step)(context)){
+        // queue behind callbacks requested by the step
+        btstack_run_loop_execute_on_main_thread(&sco_host_run_callback);
+    } else {
+        btstack_run_loop_trigger_exit();
+    }
+}
+
+static uint32_t sco_host_get_time_ms(void){
+    return sco_host_time_us / 1000;
+}
+
+void sco_host_harness_set_time_us(uint32_t time_us){
+    sco_host_time_us = time_us;
+}
+
+void sco_host_harness_run(bool (*step)(void * context), void * context){
+    sco_host_run_step = step;
+    sco_host_run_callback.callback = &sco_host_run_handler;
+    sco_host_run_callback.context  = context;
+    btstack_run_loop_execute_on_main_thread(&sco_host_run_callback);
+    btstack_run_loop_execute();
+}
+
+void sco_host_harness_init(void){
+    if (sco_host_run_loop_initialized == false){
+        sco_host_run_loop_initialized = true;
+        // POSIX run loop with simulated time
+        sco_host_run_loop = *btstack_run_loop_posix_get_instance();
+        sco_host_run_loop.get_time_ms = &sco_host_get_time_ms;
+        btstack_run_loop_init(&sco_host_run_loop);
+    }
+    btstack_audio_sink_set_instance(&sco_host_audio_sink);
+    btstack_audio_source_set_instance(&sco_host_audio_source);
+    sco_host_hci_packet_length = SCO_HOST_HCI_PACKET_LENGTH;
+    sco_host_microphone_handler = NULL;
+}
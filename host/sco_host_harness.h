@@ -0,0 +1,108 @@
+/*
+ * sco_host_harness.h - fake HCI SCO transport and audio device to run sco_demo_util on a host
+ *
+ * The SCO transport implements the HCI functions used by sco_demo_util: a sent packet is kept per thread and
+ * can be looped back into sco_demo_receive, or replaced by packets generated by a test.
+ *
+ * The audio device is registered as btstack_audio sink and source at SCO_HOST_AUDIO_SAMPLE_RATE and models
+ * I2S DMA buffering like the ESP32 driver: SCO_HOST_AUDIO_DMA_BUFFER_COUNT buffers of
+ * SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES, a buffer is filled by the playback callback when it has been played and
+ * plays after the other buffers. Recorded audio is passed to the recording callback one buffer at a time. A
+ * microphone handler produces the recorded samples from the samples played in the same period, e.g. to
+ * model an echo path.
+ *
+ * Time is simulated: the test decides when SCO packets are exchanged and when audio periods pass and sets
+ * the time returned by btstack_run_loop_get_time_ms accordingly. The POSIX run loop is used for callbacks
+ * from sco_demo_util.
+ */
+
+#ifndef SCO_HOST_HARNESS_H
+#define SCO_HOST_HARNESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hci.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// audio device rate of sco_demo_util
+#define SCO_HOST_AUDIO_SAMPLE_RATE          48000
+#define SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES   240
+#define SCO_HOST_AUDIO_DMA_BUFFER_COUNT     2
+#define SCO_HOST_AUDIO_PERIOD_US            (SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES * 1000000 / SCO_HOST_AUDIO_SAMPLE_RATE)
+
+// HCI SCO packet with 60 bytes payload, i.e. one mSBC / LC3-SWB frame per 7.5 ms or CVSD every 3.75 ms
+#define SCO_HOST_HCI_PACKET_LENGTH          (3 + 60)
+
+/**
+ * @brief Produce recorded samples for one audio period
+ * @param context
+ * @param played samples played during the period
+ * @param recorded samples to record
+ * @param num_samples SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES
+ */
+typedef void (*sco_host_microphone_handler_t)(void * context, const int16_t * played, int16_t * recorded, uint16_t num_samples);
+
+/**
+ * @brief Init POSIX run loop, register audio device and reset transport
+ */
+void sco_host_harness_init(void);
+
+/**
+ * @brief Run function on run loop until it returns false, processes callbacks queued in between, e.g. encode ahead
+ * @param step called repeatedly
+ * @param context
+ */
+void sco_host_harness_run(bool (*step)(void * context), void * context);
+
+/**
+ * @brief Set simulated time
+ * @param time_us
+ */
+void sco_host_harness_set_time_us(uint32_t time_us);
+
+/**
+ * @brief Set SCO packet length for all connections
+ * @param packet_length including 3 bytes HCI header
+ */
+void sco_host_hci_set_packet_length(uint16_t packet_length);
+
+/**
+ * @brief Get packet sent by sco_demo_send on this thread
+ * @param size of packet including HCI header
+ * @return packet or NULL if none has been sent
+ */
+uint8_t * sco_host_hci_get_sent_packet(uint16_t * size);
+
+/**
+ * @brief Get number of SCO packets sent on all threads
+ */
+uint32_t sco_host_hci_get_packets_sent(void);
+
+/**
+ * @brief Set microphone handler, recorded audio is silence without handler
+ * @param handler
+ * @param context
+ */
+void sco_host_audio_set_microphone(sco_host_microphone_handler_t handler, void * context);
+
+/**
+ * @brief Pass one audio period: play the current DMA buffer, refill it via playback callback and deliver
+ *        recorded buffer via recording callback. Does nothing until streams have been started
+ */
+void sco_host_audio_period(void);
+
+/**
+ * @brief Get samples played in last audio period
+ * @return SCO_HOST_AUDIO_DMA_BUFFER_SAMPLES samples
+ */
+const int16_t * sco_host_audio_get_played(void);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
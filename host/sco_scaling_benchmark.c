@@ -0,0 +1,179 @@
+/*
+ * sco_scaling_benchmark.c - throughput of independent SCO links processed on separate threads
+ *
+ * Built with SCO_DEMO_MODE_SINE so contexts other than the primary one encode a generated tone without audio
+ * device. The main thread holds the primary context, each worker thread owns one further context and
+ * exchanges SCO packets in loopback as fast as possible. Reports aggregate packets per second for 1, 2, 4, ...
+ * threads and the speedup over one thread for CVSD, mSBC and LC3-SWB.
+ *
+ * Usage: sco_scaling_benchmark [seconds of audio per thread and run, default 60]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sco_host_harness.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+#include "classic/hfp.h"
+
+#include "sco_demo_util.h"
+
+// one context is the primary one
+#define SCALING_MAX_THREADS         (SCO_DEMO_MAX_CONTEXTS - 1)
+#define SCALING_SCO_HANDLE          0x0001
+
+typedef struct {
+    uint8_t          codec;
+    const char *     name;
+    // SCO packets per 7.5 ms with 60 byte payload
+    uint8_t          packets_per_frame;
+} scaling_codec_t;
+
+static const scaling_codec_t scaling_codecs[] = {
+    { HFP_CODEC_CVSD,    "CVSD",    2 },
+    { HFP_CODEC_MSBC,    "mSBC",    1 },
+    { HFP_CODEC_LC3_SWB, "LC3-SWB", 1 },
+};
+
+typedef struct {
+    pthread_t         thread;
+    sco_audio_ctx_t * ctx;
+    uint8_t           codec;
+    uint32_t          packets;
+    uint32_t          packets_failed;
+    uint64_t          start_ns;
+    uint64_t          end_ns;
+    sco_demo_statistics_t statistics;
+} scaling_worker_t;
+
+typedef struct {
+    uint8_t  num_threads;
+    uint32_t packets;
+    uint32_t packets_per_second;
+    bool     ok;
+} scaling_result_t;
+
+static scaling_worker_t  scaling_workers[SCALING_MAX_THREADS];
+static pthread_barrier_t scaling_barrier;
+static scaling_result_t  scaling_results[sizeof(scaling_codecs) / sizeof(scaling_codecs[0])][SCALING_MAX_THREADS];
+
+static uint64_t scaling_get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void * scaling_worker_thread(void * arg){
+    scaling_worker_t * worker = (scaling_worker_t *) arg;
+    sco_demo_set_codec(worker->ctx, worker->codec);
+
+    // all threads start together
+    pthread_barrier_wait(&scaling_barrier);
+    worker->start_ns = scaling_get_time_ns();
+    uint32_t i;
+    for (i = 0; i < worker->packets; i++){
+        sco_demo_send(worker->ctx, SCALING_SCO_HANDLE);
+        uint16_t size;
+        uint8_t * packet = sco_host_hci_get_sent_packet(&size);
+        if (packet == NULL){
+            worker->packets_failed++;
+            continue;
+        }
+        sco_demo_receive(worker->ctx, packet, size);
+    }
+    worker->end_ns = scaling_get_time_ns();
+
+    sco_demo_get_statistics(worker->ctx, &worker->statistics);
+    sco_demo_close(worker->ctx);
+    return NULL;
+}
+
+static void scaling_run(scaling_result_t * result, const scaling_codec_t * codec, uint8_t num_threads, uint32_t seconds){
+    pthread_barrier_init(&scaling_barrier, NULL, num_threads);
+    uint8_t i;
+    for (i = 0; i < num_threads; i++){
+        scaling_worker_t * worker = &scaling_workers[i];
+        worker->codec          = codec->codec;
+        worker->packets        = seconds * 1000 * codec->packets_per_frame * 10 / 75;
+        worker->packets_failed = 0;
+        pthread_create(&worker->thread, NULL, &scaling_worker_thread, worker);
+    }
+    uint64_t start_ns = UINT64_MAX;
+    uint64_t end_ns   = 0;
+    result->num_threads = num_threads;
+    result->packets     = 0;
+    result->ok          = true;
+    for (i = 0; i < num_threads; i++){
+        scaling_worker_t * worker = &scaling_workers[i];
+        pthread_join(worker->thread, NULL);
+        if (worker->start_ns < start_ns){
+            start_ns = worker->start_ns;
+        }
+        if (worker->end_ns > end_ns){
+            end_ns = worker->end_ns;
+        }
+        result->packets += worker->packets;
+        // loopback: every packet is sent, received and decoded without concealment
+        const sco_demo_statistics_t * statistics = &worker->statistics;
+        if (worker->packets_failed > 0) result->ok = false;
+        if (statistics->link.frames[SCO_LINK_STATS_FRAME_GOOD] == 0) result->ok = false;
+        if (statistics->link.frames[SCO_LINK_STATS_FRAME_CONCEALED] > 0) result->ok = false;
+    }
+    pthread_barrier_destroy(&scaling_barrier);
+    uint64_t wall_ns = (end_ns > start_ns) ? (end_ns - start_ns) : 1;
+    result->packets_per_second = (uint32_t) (result->packets * 1000000000ULL / wall_ns);
+}
+
+int main(int argc, const char * argv[]){
+    uint32_t seconds = 60;
+    if (argc > 1){
+        seconds = (uint32_t) atoi(argv[1]);
+    }
+    btstack_assert(seconds > 0);
+
+    sco_host_harness_init();
+    sco_demo_init();
+
+    // hold primary context, its audio device stays idle
+    sco_audio_ctx_t * primary = sco_demo_create_context();
+    sco_demo_set_codec(primary, HFP_CODEC_CVSD);
+    uint8_t i;
+    for (i = 0; i < SCALING_MAX_THREADS; i++){
+        scaling_workers[i].ctx = sco_demo_create_context();
+        btstack_assert(scaling_workers[i].ctx != NULL);
+    }
+
+    unsigned int c;
+    for (c = 0; c < sizeof(scaling_codecs) / sizeof(scaling_codecs[0]); c++){
+        uint8_t num_threads;
+        for (num_threads = 1; num_threads <= SCALING_MAX_THREADS; num_threads *= 2){
+            scaling_run(&scaling_results[c][num_threads - 1], &scaling_codecs[c], num_threads, seconds);
+        }
+    }
+    sco_demo_close(primary);
+
+    printf("\nSCO scaling benchmark: %u s audio per thread, %u CPUs online\n", (unsigned int) seconds,
+           (unsigned int) sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-8s %7s %10s %9s %7s %10s\n", "codec", "threads", "packets", "packets/s", "speedup", "efficiency");
+    bool ok = true;
+    for (c = 0; c < sizeof(scaling_codecs) / sizeof(scaling_codecs[0]); c++){
+        const scaling_result_t * single = &scaling_results[c][0];
+        uint8_t num_threads;
+        for (num_threads = 1; num_threads <= SCALING_MAX_THREADS; num_threads *= 2){
+            const scaling_result_t * result = &scaling_results[c][num_threads - 1];
+            uint32_t speedup_percent = (uint32_t) (result->packets_per_second * 100ULL / btstack_max(1, single->packets_per_second));
+            printf("%-8s %7u %10u %9u %4u.%02u %9u%%%s\n", scaling_codecs[c].name, (unsigned int) num_threads,
+                   (unsigned int) result->packets, (unsigned int) result->packets_per_second,
+                   (unsigned int) (speedup_percent / 100), (unsigned int) (speedup_percent % 100),
+                   (unsigned int) (speedup_percent / num_threads), result->ok ? "" : "  FAILED");
+            ok = ok && result->ok;
+        }
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,222 @@
+/*
+ * sco_stall_benchmark.c - run loop stall per SCO packet and audio period, built with and without ENABLE_SCO_DSP_TASK
+ *
+ * Runs CVSD, mSBC and LC3-SWB in loopback, paced in real time so the DSP task gets the same time budget as on
+ * the target. The run loop is busy for an event from the start of the SCO packet exchange or audio period
+ * until the next event starts, including callbacks queued by sco_demo_util, e.g. encode ahead. Reports the
+ * busy time per event as p50 / p99 / max and, with the DSP task, the payloads that were not encoded in time.
+ *
+ * Usage: sco_stall_benchmark[_dsp_task] [seconds of audio per codec, default 5]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sco_host_harness.h"
+
+#include "btstack_debug.h"
+#include "btstack_util.h"
+#include "classic/hfp.h"
+
+#include "cycle_stats.h"
+#include "sco_demo_util.h"
+#include "tone_generator.h"
+
+#ifdef ENABLE_SCO_DSP_TASK
+#include "sco_dsp_task.h"
+#endif
+
+#ifdef ENABLE_SCO_DSP_TASK
+#define STALL_CONFIGURATION         "DSP task"
+#else
+#define STALL_CONFIGURATION         "run loop"
+#endif
+
+#define STALL_SCO_HANDLE            0x0001
+#define STALL_TONE_HZ               440
+#define STALL_TONE_AMPLITUDE        3276
+
+typedef struct {
+    uint8_t          codec;
+    const char *     name;
+    // SCO packets per 7.5 ms with 60 byte payload
+    uint8_t          packets_per_frame;
+} stall_codec_t;
+
+static const stall_codec_t stall_codecs[] = {
+    { HFP_CODEC_CVSD,    "CVSD",    2 },
+    { HFP_CODEC_MSBC,    "mSBC",    1 },
+    { HFP_CODEC_LC3_SWB, "LC3-SWB", 1 },
+};
+
+typedef enum {
+    STALL_EVENT_NONE = 0,
+    STALL_EVENT_SCO,
+    STALL_EVENT_AUDIO,
+} stall_event_t;
+
+typedef struct {
+    sco_audio_ctx_t * ctx;
+    uint32_t          sco_interval_us;
+    uint32_t          end_us;
+    uint32_t          next_sco_us;
+    uint32_t          next_audio_us;
+    uint32_t          packets_failed;
+    // wall time of simulated time 0
+    uint64_t          wall_start_ns;
+    uint32_t          sim_start_us;
+    stall_event_t     last_event;
+    uint64_t          last_event_ns;
+    // busy time in ns
+    cycle_stats_t     sco_busy;
+    cycle_stats_t     audio_busy;
+    sco_demo_statistics_t statistics;
+    uint32_t          payloads_late;
+} stall_t;
+
+static tone_generator_t stall_tone;
+static stall_t          stall_results[sizeof(stall_codecs) / sizeof(stall_codecs[0])];
+static uint32_t         stall_time_us;
+
+static uint64_t stall_get_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void stall_sleep_until_ns(uint64_t time_ns){
+    uint64_t now_ns = stall_get_time_ns();
+    if (now_ns >= time_ns) return;
+    uint64_t delay_ns = time_ns - now_ns;
+    struct timespec delay = { (time_t) (delay_ns / 1000000000ULL), (long) (delay_ns % 1000000000ULL) };
+    nanosleep(&delay, NULL);
+}
+
+static void stall_microphone(void * context, const int16_t * played, int16_t * recorded, uint16_t num_samples){
+    UNUSED(context);
+    UNUSED(played);
+    tone_generator_fill(&stall_tone, recorded, num_samples);
+}
+
+// busy time of last event ends when the run loop calls the step for the next event
+static void stall_event_start(stall_t * stall, stall_event_t event, uint32_t time_us){
+    uint64_t busy_ns = stall_get_time_ns() - stall->last_event_ns;
+    if (busy_ns > UINT32_MAX){
+        busy_ns = UINT32_MAX;
+    }
+    switch (stall->last_event){
+        case STALL_EVENT_SCO:
+            cycle_stats_add(&stall->sco_busy, (uint32_t) busy_ns);
+            break;
+        case STALL_EVENT_AUDIO:
+            cycle_stats_add(&stall->audio_busy, (uint32_t) busy_ns);
+            break;
+        default:
+            break;
+    }
+    stall_sleep_until_ns(stall->wall_start_ns + (uint64_t) (time_us - stall->sim_start_us) * 1000);
+    stall->last_event = event;
+    stall->last_event_ns = stall_get_time_ns();
+    sco_host_harness_set_time_us(time_us);
+}
+
+static bool stall_step(void * context){
+    stall_t * stall = (stall_t *) context;
+    if (stall->next_sco_us >= stall->end_us){
+        stall_event_start(stall, STALL_EVENT_NONE, stall->end_us);
+        return false;
+    }
+    if (stall->next_audio_us < stall->next_sco_us){
+        stall_event_start(stall, STALL_EVENT_AUDIO, stall->next_audio_us);
+        sco_host_audio_period();
+        stall->next_audio_us += SCO_HOST_AUDIO_PERIOD_US;
+        return true;
+    }
+    stall_event_start(stall, STALL_EVENT_SCO, stall->next_sco_us);
+    sco_demo_send(stall->ctx, STALL_SCO_HANDLE);
+    uint16_t size;
+    uint8_t * packet = sco_host_hci_get_sent_packet(&size);
+    if (packet == NULL){
+        stall->packets_failed++;
+    } else {
+        sco_demo_receive(stall->ctx, packet, size);
+    }
+    stall->next_sco_us += stall->sco_interval_us;
+    return true;
+}
+
+static void stall_run_codec(stall_t * stall, sco_audio_ctx_t * ctx, const stall_codec_t * codec, uint32_t seconds){
+    memset(stall, 0, sizeof(stall_t));
+    stall->ctx             = ctx;
+    stall->sco_interval_us = 7500 / codec->packets_per_frame;
+    stall->sim_start_us    = stall_time_us;
+    stall->end_us          = stall_time_us + seconds * 1000000;
+    stall->next_sco_us     = stall_time_us;
+    stall->next_audio_us   = stall_time_us;
+    cycle_stats_reset(&stall->sco_busy);
+    cycle_stats_reset(&stall->audio_busy);
+
+    sco_host_harness_set_time_us(stall_time_us);
+    sco_demo_set_codec(ctx, codec->codec);
+    stall->wall_start_ns = stall_get_time_ns();
+    sco_host_harness_run(&stall_step, stall);
+
+    sco_demo_get_statistics(ctx, &stall->statistics);
+#ifdef ENABLE_SCO_DSP_TASK
+    // codec telemetry of the DSP task is published once per second, queue statistics are current
+    sco_dsp_task_statistics_t dsp_statistics;
+    sco_dsp_task_get_statistics(&dsp_statistics);
+    stall->payloads_late = dsp_statistics.payloads_missing;
+#endif
+    sco_demo_close(ctx);
+    stall_time_us = stall->end_us;
+}
+
+static bool stall_report(const stall_t * stall, const stall_codec_t * codec){
+    const sco_demo_statistics_t * statistics = &stall->statistics;
+    printf("%-8s %7u %7u %7u  %7u %7u %7u  %8u %8u\n", codec->name,
+           (unsigned int) (cycle_stats_get_percentile(&stall->sco_busy, 50) / 1000),
+           (unsigned int) (cycle_stats_get_percentile(&stall->sco_busy, 99) / 1000),
+           (unsigned int) (stall->sco_busy.max / 1000),
+           (unsigned int) (cycle_stats_get_percentile(&stall->audio_busy, 50) / 1000),
+           (unsigned int) (cycle_stats_get_percentile(&stall->audio_busy, 99) / 1000),
+           (unsigned int) (stall->audio_busy.max / 1000),
+           (unsigned int) statistics->send.packets,
+           (unsigned int) stall->payloads_late);
+
+    // loopback: every packet is sent and decoded
+    if (stall->packets_failed > 0) return false;
+    if (statistics->link.frames[SCO_LINK_STATS_FRAME_GOOD] == 0) return false;
+    return true;
+}
+
+int main(int argc, const char * argv[]){
+    uint32_t seconds = 5;
+    if (argc > 1){
+        seconds = (uint32_t) atoi(argv[1]);
+    }
+    btstack_assert(seconds > 0);
+
+    sco_host_harness_init();
+    sco_demo_init();
+    sco_audio_ctx_t * ctx = sco_demo_create_context();
+
+    tone_generator_init(&stall_tone, SCO_HOST_AUDIO_SAMPLE_RATE);
+    tone_generator_add_tone(&stall_tone, STALL_TONE_HZ, STALL_TONE_AMPLITUDE);
+    sco_host_audio_set_microphone(&stall_microphone, NULL);
+
+    unsigned int i;
+    for (i = 0; i < sizeof(stall_codecs) / sizeof(stall_codecs[0]); i++){
+        stall_run_codec(&stall_results[i], ctx, &stall_codecs[i], seconds);
+    }
+
+    printf("\nSCO run loop stall, codec work on %s: %u s audio per codec\n", STALL_CONFIGURATION, (unsigned int) seconds);
+    printf("%-8s %-23s  %-23s  %8s %8s\n", "codec", "SCO us p50/p99/max", "audio us p50/p99/max", "packets", "late");
+    bool ok = true;
+    for (i = 0; i < sizeof(stall_codecs) / sizeof(stall_codecs[0]); i++){
+        ok = stall_report(&stall_results[i], &stall_codecs[i]) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}